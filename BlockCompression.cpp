@@ -0,0 +1,427 @@
+#include "BlockCompression.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+size_t blockBytes(BlockFormat format) {
+    return (format == BlockFormat::BC1) ? 8 : 16;
+}
+
+size_t compressedSize(BlockFormat format, int width, int height) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+// Endpoint fitting ------------------------------------------------------------
+
+// Picks two endpoints spanning the block's colours over the first `channels`
+// channels of each pixel.
+static void fitEndpoints(const float pixels[16][4], int channels, CompressionQuality quality,
+    float e0[4], float e1[4]) {
+    float mean[4] = { 0, 0, 0, 0 };
+    float lo[4], hi[4];
+    for (int c = 0; c < 4; c++) {
+        lo[c] = 255.0f;
+        hi[c] = 0.0f;
+    }
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < channels; c++) {
+            mean[c] += pixels[i][c] / 16.0f;
+            lo[c] = std::min(lo[c], pixels[i][c]);
+            hi[c] = std::max(hi[c], pixels[i][c]);
+        }
+    }
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++)
+                covariance[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+        }
+    }
+
+    if (quality == CompressionQuality::Fast) {
+        // Bounding box diagonal, flipped on channels that run against green
+        for (int c = 0; c < channels; c++) {
+            bool flip = c != 1 && covariance[c][1] < 0.0f;
+            e0[c] = flip ? lo[c] : hi[c];
+            e1[c] = flip ? hi[c] : lo[c];
+        }
+        return;
+    }
+
+    // Principal axis by power iteration, seeded with the box diagonal
+    float axis[4] = { 0, 0, 0, 0 };
+    for (int c = 0; c < channels; c++)
+        axis[c] = hi[c] - lo[c];
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = { 0, 0, 0, 0 };
+        float length = 0.0f;
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++)
+                next[a] += covariance[a][b] * axis[b];
+            length = std::max(length, std::fabs(next[a]));
+        }
+        if (length <= 0.0f)
+            break;
+        for (int c = 0; c < channels; c++)
+            axis[c] = next[c] / length;
+    }
+
+    float length = 0.0f;
+    for (int c = 0; c < channels; c++)
+        length += axis[c] * axis[c];
+    if (length <= 0.0f) {
+        // Flat block
+        for (int c = 0; c < channels; c++)
+            e0[c] = e1[c] = mean[c];
+        return;
+    }
+    length = std::sqrt(length);
+    for (int c = 0; c < channels; c++)
+        axis[c] /= length;
+
+    float tMin = 0.0f, tMax = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++)
+            t += (pixels[i][c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    for (int c = 0; c < channels; c++) {
+        e0[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * tMax));
+        e1[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * tMin));
+    }
+}
+
+// Least-squares endpoints for fixed interpolation weights (0 = e0, 1 = e1).
+// Returns false when every weight is the same and the system is singular.
+static bool refineEndpoints(const float pixels[16][4], int channels, const float weights[16],
+    float e0[4], float e1[4]) {
+    float aa = 0, ab = 0, bb = 0;
+    float ax[4] = { 0, 0, 0, 0 }, bx[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 16; i++) {
+        float b = weights[i];
+        float a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < channels; c++) {
+            ax[c] += a * pixels[i][c];
+            bx[c] += b * pixels[i][c];
+        }
+    }
+    float determinant = aa * bb - ab * ab;
+    if (std::fabs(determinant) < 1e-6f)
+        return false;
+    for (int c = 0; c < channels; c++) {
+        e0[c] = std::min(255.0f, std::max(0.0f, (bb * ax[c] - ab * bx[c]) / determinant));
+        e1[c] = std::min(255.0f, std::max(0.0f, (aa * bx[c] - ab * ax[c]) / determinant));
+    }
+    return true;
+}
+
+// Chooses the nearest palette entry for every pixel; returns the total error.
+static float selectIndices(const float pixels[16][4], int channels, const float palette[][4],
+    int paletteSize, int indices[16]) {
+    float total = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        float best = 1e30f;
+        for (int p = 0; p < paletteSize; p++) {
+            float error = 0.0f;
+            for (int c = 0; c < channels; c++) {
+                float d = pixels[i][c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < best) {
+                best = error;
+                indices[i] = p;
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+// BC1 -------------------------------------------------------------------------
+
+static uint16_t packRGB565(const float color[4]) {
+    int r = (int)std::lround(color[0] * 31.0f / 255.0f);
+    int g = (int)std::lround(color[1] * 63.0f / 255.0f);
+    int b = (int)std::lround(color[2] * 31.0f / 255.0f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(uint16_t packed, int color[3]) {
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// Encodes with the four-colour palette; returns the squared error.
+static float encodeColorBlock(const float pixels[16][4], const float e0[4], const float e1[4], unsigned char* out) {
+    uint16_t c0 = packRGB565(e0);
+    uint16_t c1 = packRGB565(e1);
+    if (c0 < c1)
+        std::swap(c0, c1); // c0 > c1 selects four-colour mode
+
+    int a[3], b[3];
+    unpackRGB565(c0, a);
+    unpackRGB565(c1, b);
+    float palette[4][4] = {};
+    for (int c = 0; c < 3; c++) {
+        palette[0][c] = (float)a[c];
+        palette[1][c] = (float)b[c];
+        palette[2][c] = (float)((2 * a[c] + b[c]) / 3);
+        palette[3][c] = (float)((a[c] + 2 * b[c]) / 3);
+    }
+
+    int indices[16] = {};
+    float error = selectIndices(pixels, 3, palette, (c0 == c1) ? 1 : 4, indices);
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; i++)
+        bits |= (uint32_t)indices[i] << (2 * i);
+    out[0] = (unsigned char)(c0 & 0xFF);
+    out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)(c1 & 0xFF);
+    out[3] = (unsigned char)(c1 >> 8);
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (unsigned char)(bits >> (8 * i));
+    return error;
+}
+
+static void compressColorBlock(const float pixels[16][4], CompressionQuality quality, unsigned char* out) {
+    float e0[4], e1[4];
+    fitEndpoints(pixels, 3, quality, e0, e1);
+    float error = encodeColorBlock(pixels, e0, e1, out);
+    if (quality != CompressionQuality::Best)
+        return;
+
+    static const float indexWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+    for (int iteration = 0; iteration < 2 && error > 0.0f; iteration++) {
+        uint32_t bits = out[4] | (out[5] << 8) | (out[6] << 16) | ((uint32_t)out[7] << 24);
+        float weights[16];
+        for (int i = 0; i < 16; i++)
+            weights[i] = indexWeights[(bits >> (2 * i)) & 3];
+        if (!refineEndpoints(pixels, 3, weights, e0, e1))
+            break;
+
+        unsigned char candidate[8];
+        float candidateError = encodeColorBlock(pixels, e0, e1, candidate);
+        if (candidateError >= error)
+            break;
+        memcpy(out, candidate, 8);
+        error = candidateError;
+    }
+}
+
+// BC3 alpha -------------------------------------------------------------------
+
+static void compressAlphaBlock(const float pixels[16][4], unsigned char* out) {
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; i++) {
+        a0 = std::max(a0, (int)pixels[i][3]);
+        a1 = std::min(a1, (int)pixels[i][3]);
+    }
+
+    // a0 > a1 selects the eight-value palette
+    int palette[8] = { a0, a1 };
+    for (int i = 2; i < 8; i++)
+        palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 16 && a0 != a1; i++) {
+        int best = 0, bestError = 256;
+        for (int p = 0; p < 8; p++) {
+            int error = std::abs((int)pixels[i][3] - palette[p]);
+            if (error < bestError) {
+                bestError = error;
+                best = p;
+            }
+        }
+        bits |= (uint64_t)best << (3 * i);
+    }
+
+    out[0] = (unsigned char)a0;
+    out[1] = (unsigned char)a1;
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+// BC7 mode 6 ------------------------------------------------------------------
+
+static const int bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct Bc7Endpoints {
+    int quantized[2][4]; // 7 bits per channel
+    int pbit[2];
+};
+
+// Rounds an endpoint to 7 bits plus a shared p-bit, picking the better p-bit.
+static void quantizeBc7Endpoint(const float color[4], int quantized[4], int& pbit) {
+    float bestError = 1e30f;
+    for (int p = 0; p < 2; p++) {
+        int candidate[4];
+        float error = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            candidate[c] = std::min(127, std::max(0, (int)std::lround((color[c] - p) / 2.0f)));
+            float d = color[c] - (float)((candidate[c] << 1) | p);
+            error += d * d;
+        }
+        if (error < bestError) {
+            bestError = error;
+            pbit = p;
+            memcpy(quantized, candidate, sizeof(candidate));
+        }
+    }
+}
+
+struct BitWriter {
+    unsigned char* out;
+    int position;
+
+    void put(uint32_t value, int count) {
+        for (int i = 0; i < count; i++, position++) {
+            if ((value >> i) & 1)
+                out[position >> 3] |= (unsigned char)(1 << (position & 7));
+        }
+    }
+};
+
+static float encodeBc7Block(const float pixels[16][4], const float e0[4], const float e1[4], unsigned char* out) {
+    Bc7Endpoints endpoints;
+    quantizeBc7Endpoint(e0, endpoints.quantized[0], endpoints.pbit[0]);
+    quantizeBc7Endpoint(e1, endpoints.quantized[1], endpoints.pbit[1]);
+
+    float palette[16][4];
+    for (int c = 0; c < 4; c++) {
+        int v0 = (endpoints.quantized[0][c] << 1) | endpoints.pbit[0];
+        int v1 = (endpoints.quantized[1][c] << 1) | endpoints.pbit[1];
+        for (int i = 0; i < 16; i++)
+            palette[i][c] = (float)(((64 - bc7Weights[i]) * v0 + bc7Weights[i] * v1 + 32) >> 6);
+    }
+
+    int indices[16];
+    float error = selectIndices(pixels, 4, palette, 16, indices);
+
+    // The first index is stored with its top bit implied zero
+    if (indices[0] >= 8) {
+        std::swap(endpoints.quantized[0], endpoints.quantized[1]);
+        std::swap(endpoints.pbit[0], endpoints.pbit[1]);
+        for (int i = 0; i < 16; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    memset(out, 0, 16);
+    BitWriter writer = { out, 0 };
+    writer.put(1 << 6, 7); // Mode 6
+    for (int c = 0; c < 4; c++) {
+        writer.put(endpoints.quantized[0][c], 7);
+        writer.put(endpoints.quantized[1][c], 7);
+    }
+    writer.put(endpoints.pbit[0], 1);
+    writer.put(endpoints.pbit[1], 1);
+    writer.put(indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        writer.put(indices[i], 4);
+    return error;
+}
+
+// Reads back the 4-bit weights of an encoded mode 6 block.
+static void bc7BlockWeights(const unsigned char* block, float weights[16]) {
+    int position = 65;
+    for (int i = 0; i < 16; i++) {
+        int count = (i == 0) ? 3 : 4;
+        int index = 0;
+        for (int b = 0; b < count; b++, position++)
+            index |= ((block[position >> 3] >> (position & 7)) & 1) << b;
+        weights[i] = bc7Weights[index] / 64.0f;
+    }
+}
+
+static void compressBc7Block(const float pixels[16][4], CompressionQuality quality, unsigned char* out) {
+    float e0[4], e1[4];
+    fitEndpoints(pixels, 4, quality, e0, e1);
+    float error = encodeBc7Block(pixels, e0, e1, out);
+    if (quality != CompressionQuality::Best)
+        return;
+
+    for (int iteration = 0; iteration < 2 && error > 0.0f; iteration++) {
+        float weights[16];
+        bc7BlockWeights(out, weights);
+        // Weights are relative to the stored (possibly swapped) endpoint order
+        if (!refineEndpoints(pixels, 4, weights, e0, e1))
+            break;
+
+        unsigned char candidate[16];
+        float candidateError = encodeBc7Block(pixels, e0, e1, candidate);
+        if (candidateError >= error)
+            break;
+        memcpy(out, candidate, 16);
+        error = candidateError;
+    }
+}
+
+// Entry points ----------------------------------------------------------------
+
+void compressBlock(BlockFormat format, CompressionQuality quality, const unsigned char* rgba, unsigned char* out) {
+    float pixels[16][4];
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 4; c++)
+            pixels[i][c] = rgba[i * 4 + c];
+    }
+
+    switch (format) {
+    case BlockFormat::BC1:
+        compressColorBlock(pixels, quality, out);
+        break;
+    case BlockFormat::BC3:
+        compressAlphaBlock(pixels, out);
+        compressColorBlock(pixels, quality, out + 8);
+        break;
+    case BlockFormat::BC7:
+        compressBc7Block(pixels, quality, out);
+        break;
+    }
+}
+
+void compressImage(BlockFormat format, CompressionQuality quality, const unsigned char* rgba,
+    int width, int height, unsigned char* out, int threadCount) {
+    int blocksWide = (width + 3) / 4;
+    int blocksHigh = (height + 3) / 4;
+    size_t bytesPerBlock = blockBytes(format);
+
+    if (threadCount <= 0)
+        threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+    threadCount = std::min(threadCount, blocksHigh);
+
+    std::atomic<int> nextRow(0);
+    auto worker = [&]() {
+        unsigned char block[64];
+        for (int by = nextRow++; by < blocksHigh; by = nextRow++) {
+            for (int bx = 0; bx < blocksWide; bx++) {
+                for (int y = 0; y < 4; y++) {
+                    int sy = std::min(by * 4 + y, height - 1);
+                    for (int x = 0; x < 4; x++) {
+                        int sx = std::min(bx * 4 + x, width - 1);
+                        memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+                    }
+                }
+                compressBlock(format, quality, block, out + ((size_t)by * blocksWide + bx) * bytesPerBlock);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+}
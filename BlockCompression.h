@@ -0,0 +1,32 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <cstddef>
+
+// CPU encoders for the GPU block-compressed formats the texture cache can hold.
+enum class BlockFormat {
+    BC1,    // 8 bytes per 4x4 block, opaque RGB
+    BC3,    // 16 bytes per block, BC1 colour plus an interpolated alpha block
+    BC7     // 16 bytes per block, encoded as mode 6 (single subset RGBA)
+};
+
+// Trades encode time for quality: Fast fits endpoints to the bounding box,
+// Normal to the principal axis, Best additionally refines them by least squares.
+enum class CompressionQuality {
+    Fast,
+    Normal,
+    Best
+};
+
+size_t blockBytes(BlockFormat format);
+size_t compressedSize(BlockFormat format, int width, int height);
+
+// rgba is 64 bytes: 16 pixels in row order.
+void compressBlock(BlockFormat format, CompressionQuality quality, const unsigned char* rgba, unsigned char* out);
+
+// Compresses a whole RGBA8 image, splitting rows of blocks over threadCount
+// threads (0 uses every core). Edge blocks repeat the last row/column.
+void compressImage(BlockFormat format, CompressionQuality quality, const unsigned char* rgba,
+    int width, int height, unsigned char* out, int threadCount = 0);
+
+#endif
@@ -0,0 +1,182 @@
+#include "Bvh.h"
+
+// Centroid bins per axis when looking for a split
+static const int BIN_COUNT = 16;
+
+// Leaves stop shrinking here, and the tree stops deepening here so the
+// queries' fixed stacks always suffice
+static const uint32_t MAX_LEAF_SIZE = 4;
+static const int MAX_DEPTH = 48;
+
+// Cost of visiting a node relative to testing one object
+static const float TRAVERSAL_COST = 1.0f;
+
+void frustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6]) {
+    // Rows of the matrix, added to and subtracted from the w row
+    glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+    for (int i = 0; i < 3; i++) {
+        glm::vec4 row(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        planes[i * 2] = w + row;
+        planes[i * 2 + 1] = w - row;
+    }
+    for (int i = 0; i < 6; i++)
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+void Bvh::build(const std::vector<Aabb>& objectBoxes) {
+    boxes = objectBoxes;
+    uint32_t count = (uint32_t)boxes.size();
+    tree.clear();
+    parents.clear();
+    order.resize(count);
+    leaves.assign(count, 0);
+    if (count == 0)
+        return;
+    tree.reserve(2 * count);
+    parents.reserve(2 * count);
+
+    std::vector<glm::vec3> centers(count);
+    for (uint32_t i = 0; i < count; i++) {
+        order[i] = i;
+        centers[i] = boxes[i].center();
+    }
+
+    struct Task {
+        uint32_t node;
+        uint32_t begin, end;
+        int depth;
+    };
+    std::vector<Task> tasks;
+    tree.push_back(Node());
+    parents.push_back(NO_OBJECT);
+    tasks.push_back({ 0, 0, count, 0 });
+
+    while (!tasks.empty()) {
+        Task task = tasks.back();
+        tasks.pop_back();
+        uint32_t objectCount = task.end - task.begin;
+
+        Aabb bounds = Aabb::empty(), centroids = Aabb::empty();
+        for (uint32_t i = task.begin; i < task.end; i++) {
+            bounds.grow(boxes[order[i]]);
+            centroids.grow(centers[order[i]]);
+        }
+        tree[task.node].min = bounds.min;
+        tree[task.node].max = bounds.max;
+
+        // Cheapest binned split over all three axes
+        int bestAxis = -1, bestBin = 0;
+        float bestCost = objectCount * bounds.surfaceArea();   // As a leaf
+        glm::vec3 extent = centroids.max - centroids.min;
+        if (objectCount > MAX_LEAF_SIZE && task.depth < MAX_DEPTH) {
+            float forcedCost = 1e30f;   // Best split even if dearer than a leaf
+            int forcedAxis = -1, forcedBin = 0;
+            for (int axis = 0; axis < 3; axis++) {
+                if (extent[axis] <= 0.0f)
+                    continue;
+                Aabb binBounds[BIN_COUNT];
+                uint32_t binCounts[BIN_COUNT] = {};
+                for (Aabb& box : binBounds)
+                    box = Aabb::empty();
+                float scale = BIN_COUNT / extent[axis];
+                for (uint32_t i = task.begin; i < task.end; i++) {
+                    int bin = std::min(BIN_COUNT - 1, (int)((centers[order[i]][axis] - centroids.min[axis]) * scale));
+                    binBounds[bin].grow(boxes[order[i]]);
+                    binCounts[bin]++;
+                }
+                // Areas and counts left of each boundary, then right of it
+                float leftArea[BIN_COUNT - 1];
+                uint32_t leftCount[BIN_COUNT - 1];
+                Aabb sweep = Aabb::empty();
+                uint32_t sum = 0;
+                for (int b = 0; b < BIN_COUNT - 1; b++) {
+                    sweep.grow(binBounds[b]);
+                    sum += binCounts[b];
+                    leftArea[b] = sweep.surfaceArea();
+                    leftCount[b] = sum;
+                }
+                sweep = Aabb::empty();
+                sum = 0;
+                for (int b = BIN_COUNT - 1; b > 0; b--) {
+                    sweep.grow(binBounds[b]);
+                    sum += binCounts[b];
+                    if (leftCount[b - 1] == 0 || sum == 0)
+                        continue;
+                    float cost = TRAVERSAL_COST * bounds.surfaceArea() + leftCount[b - 1] * leftArea[b - 1] +
+                        sum * sweep.surfaceArea();
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestBin = b;
+                    }
+                    if (cost < forcedCost) {
+                        forcedCost = cost;
+                        forcedAxis = axis;
+                        forcedBin = b;
+                    }
+                }
+            }
+            // Big leaves are never worth their cost in tests
+            if (bestAxis < 0 && objectCount > 4 * MAX_LEAF_SIZE) {
+                bestAxis = forcedAxis;
+                bestBin = forcedBin;
+            }
+        }
+
+        if (bestAxis < 0) {
+            tree[task.node].first = task.begin;
+            tree[task.node].count = objectCount;
+            for (uint32_t i = task.begin; i < task.end; i++)
+                leaves[order[i]] = task.node;
+            continue;
+        }
+
+        float scale = BIN_COUNT / extent[bestAxis];
+        uint32_t* middle = std::partition(order.data() + task.begin, order.data() + task.end, [&](uint32_t object) {
+            return std::min(BIN_COUNT - 1, (int)((centers[object][bestAxis] - centroids.min[bestAxis]) * scale)) < bestBin;
+        });
+        uint32_t split = (uint32_t)(middle - order.data());
+
+        uint32_t left = (uint32_t)tree.size();
+        tree[task.node].first = left;
+        tree[task.node].count = 0;
+        tree.push_back(Node());
+        tree.push_back(Node());
+        parents.push_back(task.node);
+        parents.push_back(task.node);
+        tasks.push_back({ left, task.begin, split, task.depth + 1 });
+        tasks.push_back({ left + 1, split, task.end, task.depth + 1 });
+    }
+}
+
+void Bvh::fit(uint32_t index) {
+    Node& node = tree[index];
+    Aabb box = Aabb::empty();
+    if (node.count > 0) {
+        for (uint32_t i = node.first; i < node.first + node.count; i++)
+            box.grow(boxes[order[i]]);
+    }
+    else {
+        box.grow(Aabb{ tree[node.first].min, tree[node.first].max });
+        box.grow(Aabb{ tree[node.first + 1].min, tree[node.first + 1].max });
+    }
+    node.min = box.min;
+    node.max = box.max;
+}
+
+void Bvh::update(uint32_t object, const Aabb& box) {
+    boxes[object] = box;
+    for (uint32_t node = leaves[object]; node != NO_OBJECT; node = parents[node]) {
+        glm::vec3 oldMin = tree[node].min, oldMax = tree[node].max;
+        fit(node);
+        if (tree[node].min == oldMin && tree[node].max == oldMax)
+            break;
+    }
+}
+
+void Bvh::refit(const std::vector<Aabb>& objectBoxes) {
+    boxes = objectBoxes;
+    // Children always come after their parent
+    for (size_t i = tree.size(); i-- > 0;)
+        fit((uint32_t)i);
+}
@@ -0,0 +1,244 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+struct Aabb {
+    glm::vec3 min, max;
+
+    static Aabb empty() { return { glm::vec3(1e30f), glm::vec3(-1e30f) }; }
+    void grow(const glm::vec3& point) { min = glm::min(min, point); max = glm::max(max, point); }
+    void grow(const Aabb& box) { min = glm::min(min, box.min); max = glm::max(max, box.max); }
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    float surfaceArea() const {
+        glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+    bool overlaps(const Aabb& box) const {
+        return min.x <= box.max.x && max.x >= box.min.x && min.y <= box.max.y && max.y >= box.min.y &&
+            min.z <= box.max.z && max.z >= box.min.z;
+    }
+};
+
+// The six planes (left, right, bottom, top, near, far) of a view-projection
+// matrix, normalized and facing inwards.
+void frustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6]);
+
+// Bounding volume hierarchy over a set of boxes, identified by their index in
+// the list given to build(). Built top-down with the surface area heuristic
+// over binned centroids and stored as one flat array of 32-byte nodes, the two
+// children of a node side by side. Objects that move are refitted in place
+// (update() for a few, refit() for many) without rebuilding; the tree only
+// loosens as they drift far from where they were built.
+//
+// The same tree answers frustum culling, ray picking and overlap (collision)
+// queries; each takes a callback so callers can test the objects themselves.
+class Bvh {
+public:
+    static constexpr uint32_t NO_OBJECT = 0xFFFFFFFF;
+
+    struct Node {
+        glm::vec3 min;
+        uint32_t first;     // First child, or first entry of objects() in a leaf
+        glm::vec3 max;
+        uint32_t count;     // Objects in a leaf, 0 for an inner node
+    };
+
+    void build(const std::vector<Aabb>& boxes);
+
+    // Moves one object and widens or tightens its ancestors to match.
+    void update(uint32_t object, const Aabb& box);
+
+    // Takes new boxes for every object (same count as built) and recomputes
+    // every node bottom up.
+    void refit(const std::vector<Aabb>& boxes);
+
+    // Calls visit(object) for every object whose box is not wholly outside
+    // one of the planes.
+    template <typename Visit>
+    void frustum(const glm::vec4 planes[6], Visit visit) const;
+
+    // The nearest object along the ray within maxDistance, or NO_OBJECT.
+    // hit(object, distance to its box) returns the distance to the object
+    // itself, or a negative value to ignore it; distance is set to the result.
+    template <typename Hit>
+    uint32_t raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Hit hit,
+        float& distance) const;
+
+    // Calls visit(object) for every object whose box overlaps box.
+    template <typename Visit>
+    void overlap(const Aabb& box, Visit visit) const;
+
+    const std::vector<Node>& nodes() const { return tree; }
+    const std::vector<uint32_t>& objects() const { return order; }
+    const Aabb& bounds(uint32_t object) const { return boxes[object]; }
+    size_t objectCount() const { return boxes.size(); }
+
+private:
+    void fit(uint32_t node);
+
+    std::vector<Node> tree;
+    std::vector<uint32_t> order;        // Objects in leaf order
+    std::vector<Aabb> boxes;            // By object
+    std::vector<uint32_t> parents;      // By node
+    std::vector<uint32_t> leaves;       // By object
+};
+
+template <typename Visit>
+void Bvh::frustum(const glm::vec4 planes[6], Visit visit) const {
+    if (tree.empty())
+        return;
+    // -1 wholly outside some plane, 1 wholly inside all of them, 0 across
+    auto classify = [planes](const glm::vec3& min, const glm::vec3& max) {
+        int result = 1;
+        for (int i = 0; i < 6; i++) {
+            const glm::vec4& plane = planes[i];
+            glm::vec3 positive(plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y,
+                plane.z >= 0.0f ? max.z : min.z);
+            if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+                return -1;
+            glm::vec3 negative(plane.x >= 0.0f ? min.x : max.x, plane.y >= 0.0f ? min.y : max.y,
+                plane.z >= 0.0f ? min.z : max.z);
+            if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.0f)
+                result = 0;
+        }
+        return result;
+    };
+
+    // Nodes wholly inside pass their objects without more tests
+    uint32_t stack[64];
+    bool inside[64];
+    int top = 0;
+    stack[top] = 0;
+    inside[top++] = false;
+    while (top > 0) {
+        top--;
+        const Node& node = tree[stack[top]];
+        bool contained = inside[top];
+        if (!contained) {
+            int side = classify(node.min, node.max);
+            if (side < 0)
+                continue;
+            contained = side > 0;
+        }
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                if (contained || classify(boxes[order[i]].min, boxes[order[i]].max) >= 0)
+                    visit(order[i]);
+            }
+            continue;
+        }
+        stack[top] = node.first;
+        inside[top++] = contained;
+        stack[top] = node.first + 1;
+        inside[top++] = contained;
+    }
+}
+
+// Distance along the ray to where it enters box, or -1 if it misses it
+// within maxDistance.
+inline float rayEntersBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& min,
+    const glm::vec3& max, float maxDistance) {
+    glm::vec3 t0 = (min - origin) * inverseDirection;
+    glm::vec3 t1 = (max - origin) * inverseDirection;
+    glm::vec3 nearT = glm::min(t0, t1), farT = glm::max(t0, t1);
+    float enter = std::max(std::max(nearT.x, nearT.y), std::max(nearT.z, 0.0f));
+    float exit = std::min(std::min(farT.x, farT.y), std::min(farT.z, maxDistance));
+    return enter <= exit ? enter : -1.0f;
+}
+
+template <typename Hit>
+uint32_t Bvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Hit hit,
+    float& distance) const {
+    uint32_t nearest = NO_OBJECT;
+    distance = maxDistance;
+    if (tree.empty())
+        return nearest;
+    // Axis-parallel rays get a tiny slope rather than an infinite inverse
+    glm::vec3 inverse;
+    for (int i = 0; i < 3; i++)
+        inverse[i] = 1.0f / (std::fabs(direction[i]) > 1e-20f ? direction[i] : 1e-20f);
+    if (rayEntersBox(origin, inverse, tree[0].min, tree[0].max, distance) < 0.0f)
+        return nearest;
+
+    // Nearer child first, so most far subtrees are skipped by the hit so far
+    uint32_t stack[64];
+    float entry[64];
+    int top = 0;
+    stack[top] = 0;
+    entry[top++] = 0.0f;
+    while (top > 0) {
+        top--;
+        if (entry[top] > distance)
+            continue;
+        const Node& node = tree[stack[top]];
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                const Aabb& box = boxes[order[i]];
+                float enter = rayEntersBox(origin, inverse, box.min, box.max, distance);
+                if (enter < 0.0f)
+                    continue;
+                float t = hit(order[i], enter);
+                if (t >= 0.0f && t < distance) {
+                    distance = t;
+                    nearest = order[i];
+                }
+            }
+            continue;
+        }
+        const Node& left = tree[node.first];
+        const Node& right = tree[node.first + 1];
+        float leftT = rayEntersBox(origin, inverse, left.min, left.max, distance);
+        float rightT = rayEntersBox(origin, inverse, right.min, right.max, distance);
+        bool leftFirst = leftT >= 0.0f && (rightT < 0.0f || leftT <= rightT);
+        // Push the farther one first so the nearer one is popped next
+        if (leftFirst) {
+            if (rightT >= 0.0f) {
+                stack[top] = node.first + 1;
+                entry[top++] = rightT;
+            }
+            stack[top] = node.first;
+            entry[top++] = leftT;
+        }
+        else {
+            if (leftT >= 0.0f) {
+                stack[top] = node.first;
+                entry[top++] = leftT;
+            }
+            if (rightT >= 0.0f) {
+                stack[top] = node.first + 1;
+                entry[top++] = rightT;
+            }
+        }
+    }
+    return nearest;
+}
+
+template <typename Visit>
+void Bvh::overlap(const Aabb& box, Visit visit) const {
+    if (tree.empty())
+        return;
+    uint32_t stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = tree[stack[--top]];
+        if (!box.overlaps({ node.min, node.max }))
+            continue;
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                if (box.overlaps(boxes[order[i]]))
+                    visit(order[i]);
+            }
+            continue;
+        }
+        stack[top++] = node.first;
+        stack[top++] = node.first + 1;
+    }
+}
+
+#endif
@@ -0,0 +1,263 @@
+#include "CookedMesh.h"
+#include "MeshImport.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+static const uint32_t MESH_FILE_VERSION = 3;
+
+// The simplified level aims at this fraction of the triangles, but no fewer
+// than the minimum, and is only kept when it halves them at least
+static const size_t SIMPLIFIED_RATIO = 16;
+static const size_t MIN_SIMPLIFIED_TRIANGLES = 2000;
+
+static bool sourceStamp(const std::string& path, uint64_t& size, int64_t& time) {
+    std::error_code error;
+    size = (uint64_t)fs::file_size(path, error);
+    if (error)
+        return false;
+    time = (int64_t)fs::last_write_time(path, error).time_since_epoch().count();
+    return !error;
+}
+
+std::string meshCachePath(const std::string& sourcePath) {
+    fs::path path = fs::path("cache") / fs::path(sourcePath).relative_path();
+    path += ".gmesh";
+    return path.string();
+}
+
+// Bitwise keys for welding: packed vertices, and float positions
+struct VertexKey {
+    uint64_t bits[2];
+    bool operator==(const VertexKey& other) const { return bits[0] == other.bits[0] && bits[1] == other.bits[1]; }
+};
+
+struct VertexKeyHash {
+    size_t operator()(const VertexKey& key) const {
+        uint64_t h = key.bits[0] * 0x9E3779B97F4A7C15ull ^ key.bits[1] * 0xC2B2AE3D27D4EB4Full;
+        return (size_t)(h ^ (h >> 31));
+    }
+};
+
+static VertexKey keyOf(const void* data, size_t size) {
+    VertexKey key = { { 0, 0 } };
+    memcpy(key.bits, data, size);
+    return key;
+}
+
+// Area-weighted face normals summed at each position, so the mesh is smooth
+// across its uv seams
+static void computeNormals(ImportedMesh& mesh) {
+    std::unordered_map<VertexKey, uint32_t, VertexKeyHash> positions;
+    std::vector<uint32_t> group(mesh.positions.size());
+    for (size_t i = 0; i < mesh.positions.size(); i++)
+        group[i] = positions.emplace(keyOf(&mesh.positions[i], sizeof(glm::vec3)), (uint32_t)positions.size()).first->second;
+
+    std::vector<glm::vec3> sums(positions.size(), glm::vec3(0.0f));
+    for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+        const glm::vec3& a = mesh.positions[mesh.indices[t]];
+        const glm::vec3& b = mesh.positions[mesh.indices[t + 1]];
+        const glm::vec3& c = mesh.positions[mesh.indices[t + 2]];
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        for (int corner = 0; corner < 3; corner++)
+            sums[group[mesh.indices[t + corner]]] += normal;
+    }
+    mesh.normals.resize(mesh.positions.size());
+    for (size_t i = 0; i < mesh.positions.size(); i++)
+        mesh.normals[i] = sums[group[i]];
+}
+
+bool cookMesh(const std::string& sourcePath, std::vector<unsigned char>& cooked, MeshCookStats* stats) {
+    ImportedMesh mesh;
+    if (!importMesh(sourcePath, mesh))
+        return false;
+    if (mesh.positions.size() > 0xFFFFFFFFull || mesh.indices.size() > 0xFFFFFFFFull) {
+        std::cerr << sourcePath << ": too large for 32-bit indices" << std::endl;
+        return false;
+    }
+    if (mesh.normals.empty())
+        computeNormals(mesh);
+
+    glm::vec3 low = mesh.positions[0], high = low;
+    for (const glm::vec3& p : mesh.positions) {
+        low = glm::min(low, p);
+        high = glm::max(high, p);
+    }
+    glm::vec3 size = glm::max(high - low, glm::vec3(1e-6f));
+
+    // Vertices that pack to the same record are one vertex; triangles that
+    // collapse on the way are dropped
+    std::unordered_map<VertexKey, uint32_t, VertexKeyHash> welded;
+    std::vector<SceneVertex> vertices;
+    std::vector<glm::vec3> positions;   // Of each welded vertex, for the overdraw order and clusters
+    std::vector<uint32_t> remap(mesh.positions.size());
+    for (size_t i = 0; i < mesh.positions.size(); i++) {
+        glm::vec3 normal = mesh.normals[i];
+        if (!(glm::dot(normal, normal) > 0.0f))
+            normal = glm::vec3(0.0f, 1.0f, 0.0f);
+        SceneVertex packed = packSceneVertex(mesh.positions[i], mesh.uvs.empty() ? glm::vec2(0.0f) : mesh.uvs[i], normal,
+            0, low, size);
+        std::pair<std::unordered_map<VertexKey, uint32_t, VertexKeyHash>::iterator, bool> added =
+            welded.emplace(keyOf(&packed, sizeof(packed)), (uint32_t)vertices.size());
+        if (added.second) {
+            vertices.push_back(packed);
+            positions.push_back(mesh.positions[i]);
+        }
+        remap[i] = added.first->second;
+    }
+    std::vector<uint32_t> indices;
+    indices.reserve(mesh.indices.size());
+    size_t degenerate = 0;
+    for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+        uint32_t a = remap[mesh.indices[t]], b = remap[mesh.indices[t + 1]], c = remap[mesh.indices[t + 2]];
+        if (a == b || b == c || a == c) {
+            degenerate++;
+            continue;
+        }
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+    if (indices.empty()) {
+        std::cerr << sourcePath << ": every triangle collapsed" << std::endl;
+        return false;
+    }
+
+    float missRatioBefore = averageCacheMissRatio(indices, vertices.size());
+    optimizeVertexCache(indices, vertices.size());
+    // Spheres cover the positions as quantized too
+    std::vector<MeshCluster> clusters = buildClusters(indices, positions, glm::length(size) / 65535.0f);
+    optimizeOverdraw(indices, positions, clusters);
+    size_t fullCount = indices.size();
+    float missRatioAfter = averageCacheMissRatio(indices, vertices.size());
+
+    // The simplified level follows the full one
+    std::vector<uint32_t> simplified =
+        simplifyMesh(indices, positions, std::max(fullCount / 3 / SIMPLIFIED_RATIO, MIN_SIMPLIFIED_TRIANGLES));
+    if (simplified.size() * 2 > fullCount)
+        simplified.clear();
+    optimizeVertexCache(simplified, vertices.size());
+    indices.insert(indices.end(), simplified.begin(), simplified.end());
+    std::vector<uint32_t> order = optimizeVertexFetch(indices, vertices.size());
+    uint32_t used = 0;
+    for (uint32_t index : indices)
+        used = std::max(used, index + 1);
+    std::vector<SceneVertex> ordered(used);
+    for (size_t i = 0; i < vertices.size(); i++) {
+        if (order[i] < used)
+            ordered[order[i]] = vertices[i];
+    }
+
+    if (stats) {
+        stats->importedVertices = mesh.positions.size();
+        stats->vertices = ordered.size();
+        stats->triangles = fullCount / 3;
+        stats->simplifiedTriangles = simplified.size() / 3;
+        stats->clusters = clusters.size();
+        stats->degenerate = degenerate;
+        stats->missRatioBefore = missRatioBefore;
+        stats->missRatioAfter = missRatioAfter;
+    }
+
+    MeshFileHeader header = {};
+    memcpy(header.magic, "GMSH", 4);
+    header.version = MESH_FILE_VERSION;
+    header.vertexCount = (uint32_t)ordered.size();
+    header.indexCount = (uint32_t)indices.size();
+    header.simplifiedIndexCount = (uint32_t)simplified.size();
+    header.clusterCount = (uint32_t)clusters.size();
+    for (int c = 0; c < 3; c++) {
+        header.boundsMin[c] = low[c];
+        header.boundsSize[c] = size[c];
+    }
+    sourceStamp(sourcePath, header.sourceSize, header.sourceTime);
+
+    // Every array starts on an 8-byte boundary
+    header.verticesOffset = (sizeof(MeshFileHeader) + 7) & ~(uint64_t)7;
+    header.indicesOffset = header.verticesOffset + ordered.size() * sizeof(SceneVertex);
+    header.clustersOffset = (header.indicesOffset + indices.size() * sizeof(uint32_t) + 7) & ~(uint64_t)7;
+    cooked.assign(header.clustersOffset + clusters.size() * sizeof(MeshCluster), 0);
+    memcpy(cooked.data(), &header, sizeof(header));
+    memcpy(cooked.data() + header.verticesOffset, ordered.data(), ordered.size() * sizeof(SceneVertex));
+    memcpy(cooked.data() + header.indicesOffset, indices.data(), indices.size() * sizeof(uint32_t));
+    memcpy(cooked.data() + header.clustersOffset, clusters.data(), clusters.size() * sizeof(MeshCluster));
+    return true;
+}
+
+bool saveCookedMesh(const std::string& path, const std::vector<unsigned char>& cooked) {
+    std::error_code error;
+    fs::create_directories(fs::path(path).parent_path(), error);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write((const char*)cooked.data(), cooked.size());
+    return (bool)out;
+}
+
+// Checks that the arrays lie inside the data, every index inside the
+// vertices and every cluster inside the full level's indices, before any of
+// it is used.
+bool CookedMesh::use(const unsigned char* data, size_t size) {
+    bytes = nullptr;
+    if (size < sizeof(MeshFileHeader))
+        return false;
+    const MeshFileHeader& h = *(const MeshFileHeader*)data;
+    if (memcmp(h.magic, "GMSH", 4) != 0 || h.version != MESH_FILE_VERSION)
+        return false;
+    auto fits = [size](uint64_t offset, uint64_t count, size_t recordSize) {
+        return offset % 8 == 0 && offset <= size && count <= (size - offset) / recordSize;
+    };
+    if (!fits(h.verticesOffset, h.vertexCount, sizeof(SceneVertex)) || !fits(h.indicesOffset, h.indexCount, sizeof(uint32_t)) ||
+        !fits(h.clustersOffset, h.clusterCount, sizeof(MeshCluster)))
+        return false;
+    if (h.simplifiedIndexCount > h.indexCount || h.simplifiedIndexCount % 3 != 0)
+        return false;
+    uint32_t fullCount = h.indexCount - h.simplifiedIndexCount;
+    const uint32_t* indexData = (const uint32_t*)(data + h.indicesOffset);
+    for (uint32_t i = 0; i < h.indexCount; i++) {
+        if (indexData[i] >= h.vertexCount)
+            return false;
+    }
+    const MeshCluster* clusterData = (const MeshCluster*)(data + h.clustersOffset);
+    for (uint32_t i = 0; i < h.clusterCount; i++) {
+        if (clusterData[i].firstIndex > fullCount || clusterData[i].indexCount > fullCount - clusterData[i].firstIndex)
+            return false;
+    }
+    bytes = data;
+    return true;
+}
+
+bool CookedMesh::load(const std::string& path) {
+    if (fs::path(path).extension() == ".gmesh") {
+        if (file.open(path) && use(file.data(), file.size()))
+            return true;
+        std::cerr << "Failed to load mesh: " << path << std::endl;
+        return false;
+    }
+
+    // The cooked copy, unless the source has changed since
+    std::string cachePath = meshCachePath(path);
+    uint64_t size;
+    int64_t time;
+    bool haveSource = sourceStamp(path, size, time);
+    if (file.open(cachePath) && use(file.data(), file.size()) &&
+        (!haveSource || (header().sourceSize == size && header().sourceTime == time)))
+        return true;
+    file.close();
+    bytes = nullptr;
+
+    std::vector<unsigned char> fresh;
+    if (!cookMesh(path, fresh))
+        return false;
+    saveCookedMesh(cachePath, fresh);
+    if (file.open(cachePath) && file.size() == fresh.size() && use(file.data(), file.size()))
+        return true;
+    file.close();
+
+    cooked = std::move(fresh);
+    return use(cooked.data(), cooked.size());
+}
@@ -0,0 +1,80 @@
+#ifndef COOKED_MESH_H
+#define COOKED_MESH_H
+
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+#include "SceneGeometry.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk layout of a cooked mesh (.gmesh): this header, then the vertices as
+// SceneVertex records, the triangles as 32-bit indices and the clusters
+// partitioning them as MeshCluster records, each at its offset. The last
+// simplifiedIndexCount indices are a simplified level of the mesh over the
+// same vertices, which the clusters leave out. Vertices and indices are copied
+// into GL buffers as they are, straight from the mapped file.
+struct MeshFileHeader {
+    char magic[4];          // "GMSH"
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    float boundsMin[3];     // Vertex positions are fractions of these bounds
+    float boundsSize[3];
+    uint32_t clusterCount;
+    uint32_t simplifiedIndexCount;  // 0 for none
+    uint64_t verticesOffset;
+    uint64_t indicesOffset;
+    uint64_t clustersOffset;
+    uint64_t sourceSize;    // Size and timestamp of the file it was cooked
+    int64_t sourceTime;     // from, used to spot stale copies
+};
+
+// A mesh for the scene's sculptures, imported from OBJ or glTF (see
+// MeshImport.h) and cooked once: vertices welded, packed and stored in the
+// order they are first used, triangles ordered for the post-transform cache,
+// then grouped into clusters sorted for overdraw (see MeshOptimizer.h), plus a
+// simplified level for when the mesh is small on screen. The cooked copy is
+// cached in cache/ like compiled scenes.
+class CookedMesh {
+public:
+    // Loads a mesh through its cooked copy, cooking it again (and rewriting
+    // the copy) when the source is newer. A .gmesh path is mapped directly.
+    bool load(const std::string& path);
+
+    const MeshFileHeader& header() const { return *(const MeshFileHeader*)bytes; }
+    const SceneVertex* vertices() const { return (const SceneVertex*)(bytes + header().verticesOffset); }
+    const uint32_t* indices() const { return (const uint32_t*)(bytes + header().indicesOffset); }
+    const MeshCluster* clusters() const { return (const MeshCluster*)(bytes + header().clustersOffset); }
+
+private:
+    bool use(const unsigned char* data, size_t size);
+
+    MappedFile file;
+    std::vector<unsigned char> cooked;  // When the cache could not be written
+    const unsigned char* bytes = nullptr;
+};
+
+// What cookMesh() did, for the offline cooker to report
+struct MeshCookStats {
+    size_t importedVertices;
+    size_t vertices;        // After welding
+    size_t triangles;
+    size_t simplifiedTriangles;     // 0 when there is no simplified level
+    size_t clusters;
+    size_t degenerate;      // Triangles dropped for having collapsed
+    float missRatioBefore;  // averageCacheMissRatio() as imported ...
+    float missRatioAfter;   // ... and once cooked
+};
+
+// Where the cooked copy of a mesh lives, e.g. sculptures/head.obj ->
+// cache/sculptures/head.obj.gmesh
+std::string meshCachePath(const std::string& sourcePath);
+
+// Imports and cooks a mesh; errors go to std::cerr.
+bool cookMesh(const std::string& sourcePath, std::vector<unsigned char>& cooked, MeshCookStats* stats = nullptr);
+
+// Writes a cooked mesh to path, making its folder if need be.
+bool saveCookedMesh(const std::string& path, const std::vector<unsigned char>& cooked);
+
+#endif
@@ -0,0 +1,189 @@
+#include "FrustumCuller.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(FRUSTUM_CULLER_SCALAR)
+#define CULL_SCALAR 1
+#elif defined(__AVX2__)
+#define CULL_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULL_SSE2 1
+#include <emmintrin.h>
+#else
+#define CULL_SCALAR 1
+#endif
+
+// Objects are stored in batches of this many, whatever the path
+static const size_t BATCH = 8;
+
+// Objects tested per job, a whole number of batches
+static const size_t OBJECTS_PER_JOB = 4096;
+
+// Radius of the padding after the last object: far enough behind every plane
+// that it is always culled
+static const float PADDING_RADIUS = -1e30f;
+
+void FrustumCuller::clear() {
+    count = 0;
+    for (std::vector<float>* array : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ, &radius })
+        array->clear();
+}
+
+uint32_t FrustumCuller::add(const glm::vec3& center, const glm::vec3& extent, float objectRadius) {
+    if (count % BATCH == 0) {
+        for (std::vector<float>* array : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ })
+            array->resize(count + BATCH, 0.0f);
+        radius.resize(count + BATCH, PADDING_RADIUS);
+    }
+    centerX[count] = center.x;
+    centerY[count] = center.y;
+    centerZ[count] = center.z;
+    extentX[count] = extent.x;
+    extentY[count] = extent.y;
+    extentZ[count] = extent.z;
+    radius[count] = objectRadius;
+    return (uint32_t)count++;
+}
+
+uint32_t FrustumCuller::addBox(const Aabb& box) {
+    return add(box.center(), (box.max - box.min) * 0.5f, 0.0f);
+}
+
+uint32_t FrustumCuller::addSphere(const glm::vec3& center, float sphereRadius) {
+    return add(center, glm::vec3(0.0f), sphereRadius);
+}
+
+void FrustumCuller::setBox(uint32_t object, const Aabb& box) {
+    glm::vec3 center = box.center(), extent = (box.max - box.min) * 0.5f;
+    centerX[object] = center.x;
+    centerY[object] = center.y;
+    centerZ[object] = center.z;
+    extentX[object] = extent.x;
+    extentY[object] = extent.y;
+    extentZ[object] = extent.z;
+}
+
+// An object is outside a plane when its centre is further behind it than the
+// box reaches towards it (the half sizes projected on the normal) plus the
+// radius.
+void FrustumCuller::cullRange(const glm::vec4* planes, size_t begin, size_t end, std::vector<uint32_t>& out) const {
+#if CULL_AVX2
+    __m256 nx[6], ny[6], nz[6], nd[6], ax[6], ay[6], az[6];
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+    for (int p = 0; p < 6; p++) {
+        nx[p] = _mm256_set1_ps(planes[p].x);
+        ny[p] = _mm256_set1_ps(planes[p].y);
+        nz[p] = _mm256_set1_ps(planes[p].z);
+        nd[p] = _mm256_set1_ps(planes[p].w);
+        ax[p] = _mm256_andnot_ps(signBit, nx[p]);
+        ay[p] = _mm256_andnot_ps(signBit, ny[p]);
+        az[p] = _mm256_andnot_ps(signBit, nz[p]);
+    }
+    for (size_t first = begin; first < end; first += 8) {
+        __m256 cx = _mm256_loadu_ps(&centerX[first]), cy = _mm256_loadu_ps(&centerY[first]);
+        __m256 cz = _mm256_loadu_ps(&centerZ[first]), r = _mm256_loadu_ps(&radius[first]);
+        __m256 ex = _mm256_loadu_ps(&extentX[first]), ey = _mm256_loadu_ps(&extentY[first]);
+        __m256 ez = _mm256_loadu_ps(&extentZ[first]);
+        __m256 outside = _mm256_setzero_ps();
+        for (int p = 0; p < 6; p++) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy)),
+                _mm256_add_ps(_mm256_mul_ps(nz[p], cz), nd[p]));
+            __m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey)),
+                _mm256_add_ps(_mm256_mul_ps(az[p], ez), r));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+        int mask = ~_mm256_movemask_ps(outside) & 0xFF;
+        for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1) {
+            if (mask & 1)
+                out.push_back((uint32_t)first + lane);
+        }
+    }
+#elif CULL_SSE2
+    __m128 nx[6], ny[6], nz[6], nd[6], ax[6], ay[6], az[6];
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    for (int p = 0; p < 6; p++) {
+        nx[p] = _mm_set1_ps(planes[p].x);
+        ny[p] = _mm_set1_ps(planes[p].y);
+        nz[p] = _mm_set1_ps(planes[p].z);
+        nd[p] = _mm_set1_ps(planes[p].w);
+        ax[p] = _mm_andnot_ps(signBit, nx[p]);
+        ay[p] = _mm_andnot_ps(signBit, ny[p]);
+        az[p] = _mm_andnot_ps(signBit, nz[p]);
+    }
+    for (size_t first = begin; first < end; first += 4) {
+        __m128 cx = _mm_loadu_ps(&centerX[first]), cy = _mm_loadu_ps(&centerY[first]);
+        __m128 cz = _mm_loadu_ps(&centerZ[first]), r = _mm_loadu_ps(&radius[first]);
+        __m128 ex = _mm_loadu_ps(&extentX[first]), ey = _mm_loadu_ps(&extentY[first]);
+        __m128 ez = _mm_loadu_ps(&extentZ[first]);
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; p++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)),
+                _mm_add_ps(_mm_mul_ps(nz[p], cz), nd[p]));
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)),
+                _mm_add_ps(_mm_mul_ps(az[p], ez), r));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+        }
+        int mask = ~_mm_movemask_ps(outside) & 0xF;
+        for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1) {
+            if (mask & 1)
+                out.push_back((uint32_t)first + lane);
+        }
+    }
+#else
+    for (size_t i = begin; i < end; i++) {
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; p++) {
+            const glm::vec4& plane = planes[p];
+            // Summed in the same order as the batches, so every path agrees
+            float distance = (plane.x * centerX[i] + plane.y * centerY[i]) + (plane.z * centerZ[i] + plane.w);
+            float reach = (std::fabs(plane.x) * extentX[i] + std::fabs(plane.y) * extentY[i]) +
+                (std::fabs(plane.z) * extentZ[i] + radius[i]);
+            outside = distance + reach < 0.0f;
+        }
+        if (!outside)
+            out.push_back((uint32_t)i);
+    }
+#endif
+}
+
+const std::vector<uint32_t>& FrustumCuller::cull(const glm::mat4& viewProjection, JobSystem* jobs) {
+    glm::vec4 planes[6];
+    frustumPlanes(viewProjection, planes);
+    visible.clear();
+    size_t padded = centerX.size();
+    if (jobs && padded > OBJECTS_PER_JOB) {
+        // Each job lists its own part, and the parts are joined in order
+        size_t parts = (padded + OBJECTS_PER_JOB - 1) / OBJECTS_PER_JOB;
+        if (partVisible.size() < parts)
+            partVisible.resize(parts);
+        jobs->parallelFor(parts, 1, [&](size_t first, size_t end) {
+            for (size_t part = first; part < end; part++) {
+                partVisible[part].clear();
+                cullRange(planes, part * OBJECTS_PER_JOB, std::min(padded, (part + 1) * OBJECTS_PER_JOB),
+                    partVisible[part]);
+            }
+        });
+        for (size_t part = 0; part < parts; part++)
+            visible.insert(visible.end(), partVisible[part].begin(), partVisible[part].end());
+    }
+    else {
+        cullRange(planes, 0, padded, visible);
+    }
+
+    stats.tested = (int)count;
+    stats.visible = (int)visible.size();
+    stats.culled = stats.tested - stats.visible;
+    return visible;
+}
+
+const char* frustumCullerPath() {
+#if CULL_AVX2
+    return "AVX2";
+#elif CULL_SSE2
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,62 @@
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include "Bvh.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// Tests a flat list of boxes and spheres against a view frustum and lists the
+// ones in view. Bounds are kept as separate arrays of centres, half sizes and
+// radii (a box has radius 0, a sphere half size 0), so 8 (AVX2) or 4 (SSE2)
+// objects are tested against a plane per instruction. For the few hundred
+// objects of the rooms around the camera this beats walking a tree; for much
+// larger sets use Bvh::frustum().
+class FrustumCuller {
+public:
+    struct Counters {
+        int tested;
+        int visible;
+        int culled;
+    };
+
+    void clear();
+
+    // Adds an object and returns its index, which cull() reports.
+    uint32_t addBox(const Aabb& box);
+    uint32_t addSphere(const glm::vec3& center, float radius);
+
+    // Moves an object added with addBox().
+    void setBox(uint32_t object, const Aabb& box);
+
+    // The objects not wholly outside one of the planes of viewProjection, in
+    // increasing index order. Valid until the next call. Given jobs, large
+    // sets are tested a few thousand objects per job.
+    const std::vector<uint32_t>& cull(const glm::mat4& viewProjection, JobSystem* jobs = nullptr);
+
+    size_t objectCount() const { return count; }
+
+    // Of the last cull()
+    const Counters& counters() const { return stats; }
+
+private:
+    uint32_t add(const glm::vec3& center, const glm::vec3& extent, float objectRadius);
+    void cullRange(const glm::vec4* planes, size_t begin, size_t end, std::vector<uint32_t>& out) const;
+
+    size_t count = 0;
+    // Padded to a whole number of batches; padding is never visible
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+    std::vector<float> radius;
+    std::vector<uint32_t> visible;
+    std::vector<std::vector<uint32_t>> partVisible;    // Of each job, when there are jobs
+    Counters stats = {};
+};
+
+// The instruction set the culler was compiled for: "AVX2", "SSE2" or
+// "scalar". Define FRUSTUM_CULLER_SCALAR to force the portable path.
+const char* frustumCullerPath();
+
+#endif
@@ -0,0 +1,177 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+// The system and queue of the thread running, for workers
+static thread_local const JobSystem* currentSystem = nullptr;
+static thread_local int currentIndex = 0;
+
+JobSystem::JobSystem(int workerCount) {
+    if (workerCount < 0) {
+        int cores = (int)std::thread::hardware_concurrency();
+        workerCount = std::max(0, cores - 1); // Leave a core for the GL thread
+    }
+    for (int i = 0; i <= workerCount; i++)
+        queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    for (int i = 1; i <= workerCount; i++)
+        workers.emplace_back(&JobSystem::workerMain, this, i);
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+int JobSystem::currentThread() const {
+    return currentSystem == this ? currentIndex : 0;
+}
+
+void JobSystem::run(std::function<void()> work, Counter* counter) {
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    push({ std::move(work), nullptr, 0, 0, counter });
+}
+
+void JobSystem::run(std::function<void()> work, Counter* counter, Counter& after) {
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    {
+        // finished() empties held under the same lock once pending is 0
+        std::lock_guard<std::mutex> lock(after.mutex);
+        if (after.pending.load(std::memory_order_acquire) > 0) {
+            after.held.push_back({ std::move(work), counter });
+            return;
+        }
+    }
+    push({ std::move(work), nullptr, 0, 0, counter });
+}
+
+void JobSystem::push(Job job) {
+    Queue& queue = *queues[currentThread()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    wake(1);
+}
+
+// Counts jobs just queued, waking sleeping workers for them
+void JobSystem::wake(int jobs) {
+    bool anyAsleep;
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued.fetch_add(jobs, std::memory_order_release);
+        anyAsleep = sleeping > 0;
+    }
+    if (anyAsleep) {
+        if (jobs == 1)
+            jobReady.notify_one();
+        else
+            jobReady.notify_all();
+    }
+}
+
+// The newest job of the thread's own queue, or else the oldest of another's
+bool JobSystem::take(int thread, Job& job) {
+    if (queued.load(std::memory_order_acquire) <= 0)
+        return false;
+    int count = (int)queues.size();
+    for (int i = 0; i < count; i++) {
+        Queue& queue = *queues[(thread + i) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty())
+            continue;
+        if (i == 0) {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        }
+        else {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+        }
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::execute(Job& job) {
+    if (job.body)
+        (*job.body)(job.first, job.end);
+    else
+        job.work();
+    if (job.counter)
+        finished(*job.counter);
+}
+
+// The lock is held across the decrement so that wait(), which takes it once
+// pending is 0, cannot return (and the counter go) while this still uses it
+void JobSystem::finished(Counter& counter) {
+    std::vector<Counter::Held> released;
+    {
+        std::lock_guard<std::mutex> lock(counter.mutex);
+        if (counter.pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            released.swap(counter.held);
+    }
+    for (Counter::Held& held : released)
+        push({ std::move(held.work), nullptr, 0, 0, held.counter });
+}
+
+void JobSystem::wait(Counter& counter) {
+    int thread = currentThread();
+    while (counter.pending.load(std::memory_order_acquire) > 0) {
+        Job job;
+        if (take(thread, job))
+            execute(job);
+        else
+            std::this_thread::yield();
+    }
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+    grain = std::max<size_t>(grain, 1);
+    if (count == 0)
+        return;
+    if (count <= grain || workers.empty()) {
+        body(0, count);
+        return;
+    }
+
+    // The first range runs here; the others are queued for the workers to
+    // steal, and whatever they leave is run here too
+    Counter counter;
+    size_t ranges = (count + grain - 1) / grain;
+    counter.pending.store((int)(ranges - 1), std::memory_order_relaxed);
+    Queue& queue = *queues[currentThread()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        for (size_t first = grain; first < count; first += grain)
+            queue.jobs.push_back({ std::function<void()>(), &body, first, std::min(first + grain, count), &counter });
+    }
+    wake((int)(ranges - 1));
+    body(0, grain);
+    wait(counter);
+}
+
+void JobSystem::workerMain(int thread) {
+    currentSystem = this;
+    currentIndex = thread;
+    for (;;) {
+        Job job;
+        if (take(thread, job)) {
+            execute(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleeping++;
+        jobReady.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+        sleeping--;
+        if (stopping)
+            return;
+    }
+}
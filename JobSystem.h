@@ -0,0 +1,93 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Spreads a frame's CPU work (culling, levels of detail, animation) over a
+// few threads. Every thread has its own deque of jobs: it pushes and pops
+// jobs at the back of its own and, when that runs dry, steals from the front
+// of another's, so threads seldom contend for the same lock. The thread that
+// made the system (the GL thread) owns deque 0 but only runs jobs while it
+// waits for some in wait() or parallelFor(); the workers sleep when there is
+// nothing to steal.
+//
+// Jobs are grouped by counters, which count the jobs still to finish. A job
+// can be held back until another counter's jobs are done, so the next stage
+// of the work is queued before the first has finished.
+class JobSystem {
+public:
+    // Must outlive its jobs: wait() on it before it goes
+    class Counter {
+    private:
+        friend class JobSystem;
+        struct Held {
+            std::function<void()> work;
+            Counter* counter;
+        };
+        std::atomic<int> pending{ 0 };
+        std::mutex mutex;
+        std::vector<Held> held;     // Jobs waiting for pending to reach 0
+    };
+
+    // workerCount threads besides the caller; with a negative count, one per
+    // core but the caller's. With 0 every job runs on the waiting thread.
+    explicit JobSystem(int workerCount = -1);
+    ~JobSystem();
+
+    // Queues work; counter, if any, counts it until it has run.
+    void run(std::function<void()> work, Counter* counter = nullptr);
+
+    // Queues work to run once after's jobs are done.
+    void run(std::function<void()> work, Counter* counter, Counter& after);
+
+    // Runs queued jobs on the calling thread until counter's are done.
+    void wait(Counter& counter);
+
+    // Calls body(first, end) over [0, count) in ranges of grain items (the
+    // last may be shorter), spread over the threads, and returns once all are
+    // done. A single range runs straight away on the calling thread.
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+    // Threads running jobs, counting the caller
+    int threadCount() const { return (int)queues.size(); }
+
+private:
+    // Either work, or a range of a parallelFor() body
+    struct Job {
+        std::function<void()> work;
+        const std::function<void(size_t, size_t)>* body;
+        size_t first, end;
+        Counter* counter;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    void push(Job job);
+    void wake(int jobs);
+    bool take(int thread, Job& job);
+    void execute(Job& job);
+    void finished(Counter& counter);
+    void workerMain(int thread);
+    int currentThread() const;
+
+    std::vector<std::unique_ptr<Queue>> queues;    // By thread, the caller's first
+    std::vector<std::thread> workers;
+    std::atomic<int> queued{ 0 };      // Jobs in the queues; changed under sleepMutex when it grows
+    std::mutex sleepMutex;
+    std::condition_variable jobReady;
+    int sleeping = 0;
+    bool stopping = false;
+};
+
+#endif
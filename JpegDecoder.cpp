@@ -0,0 +1,737 @@
+#include "JpegDecoder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Position in the block, in natural (row-major) order, of each coefficient in
+// the zigzag order the file stores them in
+static const unsigned char ZIGZAG[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+static const int FAST_BITS = 9;
+
+namespace {
+
+struct Huffman {
+    unsigned short fast[1 << FAST_BITS];   // length << 8 | symbol, 0 for longer codes
+    // For AC tables: value << 8 | run << 4 | length of code and magnitude bits
+    // together, when both fit in FAST_BITS and the value in a byte; else 0
+    short fastAc[1 << FAST_BITS];
+    int maxCode[18];                        // Largest code of each length, -1 if none
+    int valueOffset[17];
+    unsigned char values[256];
+    bool defined;
+};
+
+struct Component {
+    int id, h, v, quantTable;
+    int dcTable, acTable;
+    int blocksPerLine, blocksPerColumn;
+    int dcPredictor;
+    std::vector<short> coefficients;       // stride coefficients per block, zigzag order
+    std::vector<unsigned char> plane;       // After the IDCT, blocksPerLine * scale wide
+};
+
+// Entropy-coded data with byte stuffing removed. A marker ends the data: the
+// reader stops before it and feeds zero bits from then on.
+struct BitReader {
+    const unsigned char* data;
+    size_t pos, end;
+    uint64_t bits;      // Next bits to read, from the top
+    int count;
+    bool atMarker;
+    bool corrupt;       // Asked for more bits than a code can hold
+
+    void fill() {
+        while (count <= 56) {
+            unsigned int byte = 0;
+            if (!atMarker && pos < end) {
+                byte = data[pos];
+                if (byte == 0xFF) {
+                    unsigned int next = pos + 1 < end ? data[pos + 1] : 0xD9;
+                    if (next == 0x00) {
+                        pos += 2;
+                    }
+                    else {
+                        atMarker = true;
+                        byte = 0;
+                    }
+                }
+                else {
+                    pos++;
+                }
+            }
+            bits |= (uint64_t)byte << (56 - count);
+            count += 8;
+        }
+    }
+
+    int getBits(int n) {
+        if (n == 0)
+            return 0;
+        if (n > 16) {
+            corrupt = true;
+            return 0;
+        }
+        if (count < n)
+            fill();
+        int value = (int)(bits >> (64 - n));
+        bits <<= n;
+        count -= n;
+        return value;
+    }
+
+    int getBit() {
+        return getBits(1);
+    }
+
+    // n bits as a signed magnitude category (F.2.2.1)
+    int receiveExtend(int n) {
+        if (n == 0)
+            return 0;
+        if (n > 16) {
+            corrupt = true;
+            return 0;
+        }
+        int value = getBits(n);
+        return value < (1 << (n - 1)) ? value - (1 << n) + 1 : value;
+    }
+
+    void consume(int n) {
+        bits <<= n;
+        count -= n;
+    }
+
+    int decode(const Huffman& table) {
+        if (count < 16)
+            fill();
+        unsigned int entry = table.fast[bits >> (64 - FAST_BITS)];
+        if (entry) {
+            int length = entry >> 8;
+            bits <<= length;
+            count -= length;
+            return entry & 0xFF;
+        }
+        for (int length = FAST_BITS + 1; length <= 16; length++) {
+            int code = (int)(bits >> (64 - length));
+            if (code <= table.maxCode[length]) {
+                bits <<= length;
+                count -= length;
+                return table.values[(code + table.valueOffset[length]) & 0xFF];
+            }
+        }
+        bits <<= 16; // Corrupt data; carry on with garbage rather than loop
+        count -= 16;
+        return 0;
+    }
+
+    // Drops buffered bits and steps over the RSTn marker that should follow
+    void restart() {
+        bits = 0;
+        count = 0;
+        atMarker = false;
+        while (pos + 1 < end && !(data[pos] == 0xFF && data[pos + 1] != 0x00 && data[pos + 1] != 0xFF))
+            pos++;
+        if (pos + 1 < end && data[pos + 1] >= 0xD0 && data[pos + 1] <= 0xD7)
+            pos += 2;
+    }
+};
+
+class Decoder {
+public:
+    Decoder(const unsigned char* data, size_t size)
+        : data(data), size(size), width(0), height(0), progressive(false), adobeTransform(-1),
+          restartInterval(0), hMax(1), vMax(1), mcusPerLine(0), mcusPerColumn(0), scale(8), stride(64),
+          eobRun(0) {
+        memset(quant, 0, sizeof(quant));
+        memset(dcTables, 0, sizeof(dcTables));
+        memset(acTables, 0, sizeof(acTables));
+    }
+
+    bool run(bool headerOnly);
+    void output(bool flipVertically, JpegImage& image);
+
+    const unsigned char* data;
+    size_t size;
+    int width, height;
+    bool progressive;
+    int adobeTransform;
+    int restartInterval;
+    int hMax, vMax;
+    int mcusPerLine, mcusPerColumn;
+    int scale;          // Output pixels per block side: 8, 4, 2 or 1
+    int stride;         // Coefficients kept per block
+    std::vector<Component> components;
+
+private:
+    bool readQuant(const unsigned char* p, size_t length);
+    bool readHuffman(const unsigned char* p, size_t length);
+    bool readFrame(const unsigned char* p, size_t length);
+    bool readScan(const unsigned char* p, size_t length, size_t& pos);
+    size_t skipEntropyData(size_t pos) const;
+    void decodeBlock(BitReader& reader, Component& component, short* block);
+    void idct(Component& component);
+
+    unsigned short quant[4][64];
+    Huffman dcTables[4], acTables[4];
+
+    // Current scan
+    int spectralStart, spectralEnd, approxHigh, approxLow;
+    int eobRun;
+};
+
+}
+
+// False when the counts assign more codes of some length than it has
+static bool buildHuffman(Huffman& table, const unsigned char* counts, const unsigned char* values, int total) {
+    table.defined = false;
+    memset(table.fast, 0, sizeof(table.fast));
+    memcpy(table.values, values, total);
+    int code = 0, index = 0;
+    for (int length = 1; length <= 16; length++) {
+        table.valueOffset[length] = index - code;
+        for (int i = 0; i < counts[length - 1]; i++, index++, code++) {
+            if (code >= (1 << length))
+                return false;
+            if (length <= FAST_BITS) {
+                int shift = FAST_BITS - length;
+                for (int fill = 0; fill < (1 << shift); fill++)
+                    table.fast[(code << shift) | fill] = (unsigned short)(length << 8 | values[index]);
+            }
+        }
+        table.maxCode[length] = counts[length - 1] ? code - 1 : -1;
+        code <<= 1;
+    }
+    table.maxCode[17] = 0x7FFFFFFF;
+    table.defined = true;
+
+    for (int i = 0; i < (1 << FAST_BITS); i++) {
+        table.fastAc[i] = 0;
+        int length = table.fast[i] >> 8, rs = table.fast[i] & 0xFF;
+        int run = rs >> 4, magnitude = rs & 15;
+        if (!length || !magnitude || length + magnitude > FAST_BITS)
+            continue;
+        int value = (i >> (FAST_BITS - length - magnitude)) & ((1 << magnitude) - 1);
+        if (value < (1 << (magnitude - 1)))
+            value += 1 - (1 << magnitude);
+        if (value >= -128 && value <= 127)
+            table.fastAc[i] = (short)(value * 256 + run * 16 + length + magnitude);
+    }
+    return true;
+}
+
+bool Decoder::readQuant(const unsigned char* p, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        int precision = p[i] >> 4, id = p[i] & 15;
+        i++;
+        if (id > 3 || i + (precision ? 128 : 64) > length)
+            return false;
+        for (int k = 0; k < 64; k++)
+            quant[id][k] = precision ? (unsigned short)(p[i + k * 2] << 8 | p[i + k * 2 + 1]) : p[i + k];
+        i += precision ? 128 : 64;
+    }
+    return true;
+}
+
+bool Decoder::readHuffman(const unsigned char* p, size_t length) {
+    size_t i = 0;
+    while (i + 17 <= length) {
+        int tableClass = p[i] >> 4, id = p[i] & 15;
+        const unsigned char* counts = p + i + 1;
+        int total = 0;
+        for (int k = 0; k < 16; k++)
+            total += counts[k];
+        if (id > 3 || tableClass > 1 || total > 256 || i + 17 + total > length)
+            return false;
+        if (!buildHuffman(tableClass ? acTables[id] : dcTables[id], counts, p + i + 17, total))
+            return false;
+        i += 17 + total;
+    }
+    return true;
+}
+
+bool Decoder::readFrame(const unsigned char* p, size_t length) {
+    if (length < 6 || p[0] != 8)
+        return false;
+    height = p[1] << 8 | p[2];
+    width = p[3] << 8 | p[4];
+    int count = p[5];
+    if (width == 0 || height == 0 || (count != 1 && count != 3) || length < 6 + (size_t)count * 3)
+        return false;
+
+    components.resize(count);
+    for (int i = 0; i < count; i++) {
+        Component& component = components[i];
+        component.id = p[6 + i * 3];
+        component.h = p[7 + i * 3] >> 4;
+        component.v = p[7 + i * 3] & 15;
+        component.quantTable = p[8 + i * 3] & 3;
+        if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4)
+            return false;
+        hMax = std::max(hMax, component.h);
+        vMax = std::max(vMax, component.v);
+    }
+
+    mcusPerLine = (width + hMax * 8 - 1) / (hMax * 8);
+    mcusPerColumn = (height + vMax * 8 - 1) / (vMax * 8);
+    return true;
+}
+
+// Where the entropy-coded data starting at pos ends: the next marker other
+// than a restart marker.
+size_t Decoder::skipEntropyData(size_t pos) const {
+    while (pos + 1 < size) {
+        if (data[pos] == 0xFF && data[pos + 1] != 0x00 && data[pos + 1] != 0xFF &&
+            !(data[pos + 1] >= 0xD0 && data[pos + 1] <= 0xD7))
+            return pos;
+        pos++;
+    }
+    return size;
+}
+
+void Decoder::decodeBlock(BitReader& reader, Component& component, short* block) {
+    if (!progressive) {
+        const Huffman& ac = acTables[component.acTable];
+        int category = reader.decode(dcTables[component.dcTable]);
+        component.dcPredictor += reader.receiveExtend(category);
+        block[0] = (short)component.dcPredictor;
+        for (int k = 1; k < 64;) {
+            if (reader.count < 16)
+                reader.fill();
+            int fast = ac.fastAc[reader.bits >> (64 - FAST_BITS)];
+            if (fast) {
+                reader.consume(fast & 15);
+                k += (fast >> 4) & 15;
+                if (k < stride)
+                    block[k] = (short)(fast >> 8);
+                k++;
+                continue;
+            }
+            int rs = reader.decode(ac);
+            int run = rs >> 4, magnitude = rs & 15;
+            if (magnitude == 0) {
+                if (run != 15)
+                    break;
+                k += 16;
+                continue;
+            }
+            k += run;
+            // Coefficients past the stride are not needed at this scale
+            int value = reader.receiveExtend(magnitude);
+            if (k < stride)
+                block[k] = (short)value;
+            k++;
+        }
+        return;
+    }
+
+    if (spectralStart == 0) {
+        if (approxHigh == 0) {
+            int category = reader.decode(dcTables[component.dcTable]);
+            component.dcPredictor += reader.receiveExtend(category);
+            block[0] = (short)(component.dcPredictor * (1 << approxLow));
+        }
+        else if (reader.getBit()) {
+            block[0] |= (short)(1 << approxLow);
+        }
+        return;
+    }
+
+    const Huffman& ac = acTables[component.acTable];
+    if (approxHigh == 0) {
+        if (eobRun > 0) {
+            eobRun--;
+            return;
+        }
+        for (int k = spectralStart; k <= spectralEnd;) {
+            if (reader.count < 16)
+                reader.fill();
+            int fast = ac.fastAc[reader.bits >> (64 - FAST_BITS)];
+            if (fast) {
+                reader.consume(fast & 15);
+                k += (fast >> 4) & 15;
+                if (k > 63)
+                    break;
+                block[k] = (short)((fast >> 8) * (1 << approxLow));
+                k++;
+                continue;
+            }
+            int rs = reader.decode(ac);
+            int run = rs >> 4, magnitude = rs & 15;
+            if (magnitude == 0) {
+                if (run < 15) {
+                    eobRun = (1 << run) - 1 + reader.getBits(run);
+                    break;
+                }
+                k += 16;
+                continue;
+            }
+            k += run;
+            if (k > 63)
+                break;
+            block[k] = (short)(reader.receiveExtend(magnitude) * (1 << approxLow));
+            k++;
+        }
+        return;
+    }
+
+    // Refinement (G.1.2.3): a bit for every coefficient already nonzero, and
+    // new coefficients of magnitude 1 placed among the zero ones
+    short plus = (short)(1 << approxLow), minus = (short)(-1 * (1 << approxLow));
+    int k = spectralStart;
+    if (eobRun == 0) {
+        for (; k <= spectralEnd; k++) {
+            int rs = reader.decode(ac);
+            int run = rs >> 4, magnitude = rs & 15;
+            short value = 0;
+            if (magnitude) {
+                value = reader.getBit() ? plus : minus;
+            }
+            else if (run != 15) {
+                eobRun = (1 << run) + reader.getBits(run);
+                break;
+            }
+            for (; k <= spectralEnd; k++) {
+                short& coefficient = block[k];
+                if (coefficient != 0) {
+                    if (reader.getBit() && (coefficient & plus) == 0)
+                        coefficient += coefficient >= 0 ? plus : minus;
+                }
+                else if (--run < 0) {
+                    break;
+                }
+            }
+            if (value && k <= 63)
+                block[k] = value;
+        }
+    }
+    if (eobRun > 0) {
+        for (; k <= spectralEnd; k++) {
+            short& coefficient = block[k];
+            if (coefficient != 0 && reader.getBit() && (coefficient & plus) == 0)
+                coefficient += coefficient >= 0 ? plus : minus;
+        }
+        eobRun--;
+    }
+}
+
+bool Decoder::readScan(const unsigned char* p, size_t length, size_t& pos) {
+    int count = p[0];
+    if (count < 1 || count > 4 || length < 4 + (size_t)count * 2)
+        return false;
+    std::vector<Component*> scanComponents;
+    for (int i = 0; i < count; i++) {
+        int id = p[1 + i * 2], tables = p[2 + i * 2];
+        Component* found = nullptr;
+        for (Component& component : components) {
+            if (component.id == id)
+                found = &component;
+        }
+        if (!found)
+            return false;
+        found->dcTable = tables >> 4 & 3;
+        found->acTable = tables & 3;
+        scanComponents.push_back(found);
+    }
+    const unsigned char* spectral = p + 1 + count * 2;
+    spectralStart = spectral[0];
+    spectralEnd = std::min((int)spectral[1], 63);
+    approxHigh = spectral[2] >> 4;
+    approxLow = spectral[2] & 15;
+    if (!progressive) {
+        spectralStart = 0;
+        spectralEnd = 63;
+        approxHigh = approxLow = 0;
+    }
+
+    // At 1/8 scale the DC coefficients are all there is to decode
+    if (spectralStart > 0 && stride == 1) {
+        pos = skipEntropyData(pos);
+        return true;
+    }
+    for (Component* component : scanComponents) {
+        if ((spectralStart == 0 && !dcTables[component->dcTable].defined) ||
+            ((spectralStart > 0 || !progressive) && !acTables[component->acTable].defined))
+            return false;
+    }
+
+    BitReader reader = { data, pos, size, 0, 0, false, false };
+    eobRun = 0;
+    for (Component& component : components)
+        component.dcPredictor = 0;
+
+    // A scan of one component walks its blocks in raster order; otherwise
+    // MCUs hold h x v blocks of each component
+    int units;
+    int unitsPerLine;
+    if (count == 1) {
+        Component& component = *scanComponents[0];
+        unitsPerLine = ((width * component.h + hMax - 1) / hMax + 7) / 8;
+        int columns = ((height * component.v + vMax - 1) / vMax + 7) / 8;
+        units = unitsPerLine * columns;
+    }
+    else {
+        unitsPerLine = mcusPerLine;
+        units = mcusPerLine * mcusPerColumn;
+    }
+
+    for (int unit = 0; unit < units; unit++) {
+        if (reader.corrupt)
+            return false;
+        if (restartInterval && unit > 0 && unit % restartInterval == 0) {
+            reader.restart();
+            eobRun = 0;
+            for (Component& component : components)
+                component.dcPredictor = 0;
+        }
+        int unitX = unit % unitsPerLine, unitY = unit / unitsPerLine;
+        if (count == 1) {
+            Component& component = *scanComponents[0];
+            decodeBlock(reader, component,
+                &component.coefficients[((size_t)unitY * component.blocksPerLine + unitX) * stride]);
+            continue;
+        }
+        for (Component* component : scanComponents) {
+            for (int y = 0; y < component->v; y++) {
+                for (int x = 0; x < component->h; x++) {
+                    size_t block = (size_t)(unitY * component->v + y) * component->blocksPerLine +
+                        unitX * component->h + x;
+                    decodeBlock(reader, *component, &component->coefficients[block * stride]);
+                }
+            }
+        }
+    }
+
+    pos = skipEntropyData(reader.pos);
+    return !reader.corrupt;
+}
+
+bool Decoder::run(bool headerOnly) {
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+        return false;
+
+    bool frameRead = false;
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xFF) {
+            pos++;
+            continue;
+        }
+        int marker = data[pos + 1];
+        pos += 2;
+        if (marker == 0xFF) {
+            pos--;
+            continue;
+        }
+        if (marker == 0xD9)
+            break;
+        if (marker == 0xD8 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+            continue;
+
+        size_t length = (size_t)(data[pos] << 8 | data[pos + 1]);
+        if (length < 2 || pos + length > size)
+            return false;
+        const unsigned char* p = data + pos + 2;
+        length -= 2;
+        pos += 2 + length;
+
+        switch (marker) {
+        case 0xC0: case 0xC1: case 0xC2:
+            if (frameRead || !readFrame(p, length))
+                return false;
+            progressive = marker == 0xC2;
+            frameRead = true;
+            if (headerOnly)
+                return true;
+            for (Component& component : components) {
+                component.blocksPerLine = mcusPerLine * component.h;
+                component.blocksPerColumn = mcusPerColumn * component.v;
+                component.coefficients.assign((size_t)component.blocksPerLine * component.blocksPerColumn * stride, 0);
+            }
+            break;
+        case 0xC3: case 0xC5: case 0xC6: case 0xC7: case 0xC9: case 0xCA: case 0xCB:
+        case 0xCD: case 0xCE: case 0xCF:
+            return false; // Lossless, hierarchical or arithmetic coded
+        case 0xC4:
+            if (!readHuffman(p, length))
+                return false;
+            break;
+        case 0xDB:
+            if (!readQuant(p, length))
+                return false;
+            break;
+        case 0xDD:
+            if (length >= 2)
+                restartInterval = p[0] << 8 | p[1];
+            break;
+        case 0xEE:
+            if (length >= 12 && memcmp(p, "Adobe", 5) == 0)
+                adobeTransform = p[11];
+            break;
+        case 0xDA:
+            if (!frameRead || !readScan(p, length, pos))
+                return false;
+            break;
+        default:
+            break;
+        }
+    }
+    return frameRead && !headerOnly;
+}
+
+// Inverse DCT of each block's lowest scale x scale frequencies to scale x
+// scale pixels. The N-point transform of the top-left N x N coefficients,
+// scaled by N/8, keeps each block's average where a full decode puts it.
+void Decoder::idct(Component& component) {
+    const int n = scale;
+    float table[8][8];  // [x][u]
+    for (int x = 0; x < n; x++) {
+        for (int u = 0; u < n; u++) {
+            float a = u == 0 ? std::sqrt(1.0f / n) : std::sqrt(2.0f / n);
+            table[x][u] = std::sqrt(n / 8.0f) * a * std::cos((2 * x + 1) * u * 3.14159265f / (2 * n));
+        }
+    }
+
+    // The zigzag positions inside the top-left n x n
+    int used[64], usedCount = 0;
+    for (int k = 0; k < stride; k++) {
+        if ((ZIGZAG[k] >> 3) < n && (ZIGZAG[k] & 7) < n)
+            used[usedCount++] = k;
+    }
+
+    const unsigned short* q = quant[component.quantTable];
+    int planeWidth = component.blocksPerLine * n;
+    component.plane.resize((size_t)planeWidth * component.blocksPerColumn * n);
+    for (int by = 0; by < component.blocksPerColumn; by++) {
+        for (int bx = 0; bx < component.blocksPerLine; bx++) {
+            const short* block = &component.coefficients[((size_t)by * component.blocksPerLine + bx) * stride];
+            unsigned char* out = &component.plane[(size_t)by * n * planeWidth + (size_t)bx * n];
+            bool acUsed = false;
+            for (int i = 1; i < usedCount && !acUsed; i++)
+                acUsed = block[used[i]] != 0;
+            if (!acUsed) {
+                // Flat block, the common case at small scales
+                float value = (float)block[0] * q[0] / 8.0f + 128.5f;
+                unsigned char pixel = (unsigned char)std::min(255.0f, std::max(0.0f, value));
+                for (int y = 0; y < n; y++)
+                    memset(out + (size_t)y * planeWidth, pixel, n);
+                continue;
+            }
+
+            float coefficients[8][8];
+            bool rowUsed[8] = {};
+            for (int v = 0; v < n; v++) {
+                for (int u = 0; u < n; u++)
+                    coefficients[v][u] = 0.0f;
+            }
+            for (int i = 0; i < usedCount; i++) {
+                int k = used[i], row = ZIGZAG[k] >> 3, column = ZIGZAG[k] & 7;
+                if (block[k]) {
+                    coefficients[row][column] = (float)block[k] * q[k];
+                    rowUsed[row] = true;
+                }
+            }
+
+            float rows[8][8];   // [v][x], after the horizontal pass
+            for (int v = 0; v < n; v++) {
+                for (int x = 0; x < n; x++) {
+                    float sum = 0.0f;
+                    if (rowUsed[v]) {
+                        for (int u = 0; u < n; u++)
+                            sum += table[x][u] * coefficients[v][u];
+                    }
+                    rows[v][x] = sum;
+                }
+            }
+            for (int y = 0; y < n; y++) {
+                for (int x = 0; x < n; x++) {
+                    float sum = 128.5f;
+                    for (int v = 0; v < n; v++)
+                        sum += table[y][v] * rows[v][x];
+                    out[(size_t)y * planeWidth + x] = (unsigned char)std::min(255.0f, std::max(0.0f, sum));
+                }
+            }
+        }
+    }
+    std::vector<short>().swap(component.coefficients);
+}
+
+static unsigned char clampByte(float value) {
+    return (unsigned char)std::min(255.0f, std::max(0.0f, value + 0.5f));
+}
+
+void Decoder::output(bool flipVertically, JpegImage& image) {
+    int shift = scale == 8 ? 0 : scale == 4 ? 1 : scale == 2 ? 2 : 3;
+    image.width = std::max(1, width >> shift);
+    image.height = std::max(1, height >> shift);
+    image.channels = 3;
+    image.pixels.resize((size_t)image.width * image.height * 3);
+
+    for (Component& component : components)
+        idct(component);
+
+    // Subsampled components are stretched by repeating their samples. Three
+    // components are YCbCr unless an Adobe marker says they are RGB.
+    bool ycc = components.size() == 3 && adobeTransform != 0;
+    for (int y = 0; y < image.height; y++) {
+        unsigned char* out = &image.pixels[(size_t)(flipVertically ? image.height - 1 - y : y) * image.width * 3];
+        const unsigned char* rows[3];
+        for (size_t c = 0; c < components.size(); c++) {
+            const Component& component = components[c];
+            rows[c] = &component.plane[(size_t)(y * component.v / vMax) * component.blocksPerLine * scale];
+        }
+        for (int x = 0; x < image.width; x++, out += 3) {
+            if (components.size() == 1) {
+                out[0] = out[1] = out[2] = rows[0][x];
+                continue;
+            }
+            float c0 = rows[0][x * components[0].h / hMax];
+            float c1 = rows[1][x * components[1].h / hMax];
+            float c2 = rows[2][x * components[2].h / hMax];
+            if (ycc) {
+                float cb = c1 - 128.0f, cr = c2 - 128.0f;
+                out[0] = clampByte(c0 + 1.402f * cr);
+                out[1] = clampByte(c0 - 0.344136f * cb - 0.714136f * cr);
+                out[2] = clampByte(c0 + 1.772f * cb);
+            }
+            else {
+                out[0] = (unsigned char)c0;
+                out[1] = (unsigned char)c1;
+                out[2] = (unsigned char)c2;
+            }
+        }
+    }
+}
+
+bool readJpegInfo(const unsigned char* data, size_t size, JpegInfo& info) {
+    Decoder decoder(data, size);
+    if (!decoder.run(true))
+        return false;
+    info.width = decoder.width;
+    info.height = decoder.height;
+    info.components = (int)decoder.components.size();
+    info.progressive = decoder.progressive;
+    return true;
+}
+
+bool decodeJpeg(const unsigned char* data, size_t size, int scaleLog2, bool flipVertically, JpegImage& image) {
+    Decoder decoder(data, size);
+    decoder.scale = 8 >> std::min(std::max(scaleLog2, 0), 3);
+    // Progressive refinement scans need every coefficient to know which are
+    // already nonzero; a baseline decode keeps only those it will use
+    static const int lastNeeded[9] = { 0, 0, 4, 0, 24, 0, 0, 0, 63 };
+    decoder.stride = decoder.scale == 1 ? 1 : 64;
+    JpegInfo info;
+    if (readJpegInfo(data, size, info) && !info.progressive)
+        decoder.stride = lastNeeded[decoder.scale] + 1;
+    if (!decoder.run(false))
+        return false;
+    decoder.output(flipVertically, image);
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef JPEG_DECODER_H
+#define JPEG_DECODER_H
+
+#include <cstddef>
+#include <vector>
+
+// Decodes baseline and progressive JPEGs at 1/1, 1/2, 1/4 or 1/8 scale
+// straight from their DCT coefficients, like libjpeg's scaled IDCT: each 8x8
+// block goes through a 4x4, 2x2 or 1x1 inverse transform of its lowest
+// frequencies, so a reduced image costs a fraction of a full decode. At 1/8
+// only the DC coefficients are needed, and the AC scans of progressive files
+// are skipped without being entropy decoded.
+
+struct JpegInfo {
+    int width, height;
+    int components;         // 1 (grey) or 3 (YCbCr or RGB)
+    bool progressive;
+};
+
+struct JpegImage {
+    int width, height;      // max(1, size >> scaleLog2), like GL's mip levels
+    int channels;           // Always 3
+    std::vector<unsigned char> pixels;
+};
+
+// Reads the frame header only. False if data is not a JPEG this decoder
+// handles (arithmetic coded, lossless, 12-bit and CMYK files are left to
+// stb_image).
+bool readJpegInfo(const unsigned char* data, size_t size, JpegInfo& info);
+
+// scaleLog2 is 0 to 3. Rows are stored bottom-up when flipVertically is set,
+// as textures expect.
+bool decodeJpeg(const unsigned char* data, size_t size, int scaleLog2, bool flipVertically, JpegImage& image);
+
+#endif
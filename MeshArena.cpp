@@ -0,0 +1,222 @@
+#include "MeshArena.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <iterator>
+
+// Multi-draw indirect is core in 4.3, which glad (generated for 3.3) does not
+// cover
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect,
+    GLsizei drawCount, GLsizei stride);
+
+// First fit; a count of 0 takes nothing
+static bool allocate(std::map<uint32_t, uint32_t>& free, uint32_t count, uint32_t& first) {
+    first = 0;
+    if (count == 0)
+        return true;
+    for (std::map<uint32_t, uint32_t>::iterator range = free.begin(); range != free.end(); ++range) {
+        if (range->second < count)
+            continue;
+        first = range->first;
+        uint32_t left = range->second - count;
+        free.erase(range);
+        if (left > 0)
+            free.emplace(first + count, left);
+        return true;
+    }
+    return false;
+}
+
+// Merges the range with the free ones either side of it
+static void release(std::map<uint32_t, uint32_t>& free, uint32_t first, uint32_t count) {
+    if (count == 0)
+        return;
+    std::map<uint32_t, uint32_t>::iterator next = free.lower_bound(first);
+    if (next != free.end() && first + count == next->first) {
+        count += next->second;
+        next = free.erase(next);
+    }
+    if (next != free.begin()) {
+        std::map<uint32_t, uint32_t>::iterator previous = std::prev(next);
+        if (previous->first + previous->second == first) {
+            previous->second += count;
+            return;
+        }
+    }
+    free.emplace(first, count);
+}
+
+MeshArena::MeshArena(void* (*getProcAddress)(const char* name)) {
+    int major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 3))
+        multiDrawElementsIndirect = getProcAddress("glMultiDrawElementsIndirect");
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &instanceBuffer);
+    glGenBuffers(1, &commandBuffer);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    for (GLuint location = 4; location <= 11; location++) {
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+    setInstanceAttributes(0);
+    glBindVertexArray(0);
+}
+
+MeshArena::~MeshArena() {
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteBuffers(1, &instanceBuffer);
+    glDeleteBuffers(1, &commandBuffer);
+}
+
+// With the vertex array bound
+void MeshArena::setInstanceAttributes(size_t firstInstance) {
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    size_t base = firstInstance * sizeof(Instance);
+    for (GLuint column = 0; column < 4; column++) {
+        glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+            (void*)(base + offsetof(Instance, model) + column * sizeof(glm::vec4)));
+    }
+    glVertexAttribPointer(8, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(base + offsetof(Instance, boundsMin)));
+    glVertexAttribPointer(9, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(base + offsetof(Instance, boundsSize)));
+    glVertexAttribPointer(10, 1, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(base + offsetof(Instance, layer)));
+    glVertexAttribPointer(11, 1, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(base + offsetof(Instance, level)));
+}
+
+// Moves the buffer's contents to one with room for needed more records, and
+// frees the new space
+void MeshArena::grow(unsigned int& buffer, unsigned int target, size_t& capacity, std::map<uint32_t, uint32_t>& free,
+    size_t needed, size_t recordSize) {
+    size_t grown = std::max(capacity * 2, capacity + needed);
+    unsigned int bigger;
+    glGenBuffers(1, &bigger);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, bigger);
+    glBufferData(GL_COPY_WRITE_BUFFER, grown * recordSize, nullptr, GL_STATIC_DRAW);
+    if (capacity > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, capacity * recordSize);
+    }
+    glDeleteBuffers(1, &buffer);
+    buffer = bigger;
+
+    glBindVertexArray(VAO);
+    glBindBuffer(target, buffer);
+    if (target == GL_ARRAY_BUFFER)
+        setSceneVertexAttributes();
+    glBindVertexArray(0);
+    release(free, (uint32_t)capacity, (uint32_t)(grown - capacity));
+    capacity = grown;
+}
+
+void MeshArena::add(const SceneGeometry& geometry, Mesh& mesh) {
+    add(geometry.vertices.data(), (uint32_t)geometry.vertices.size(), geometry.indices.data(),
+        (uint32_t)geometry.indices.size(), geometry.boundsMin, geometry.boundsSize, mesh);
+}
+
+void MeshArena::add(const SceneVertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount,
+    const glm::vec3& boundsMin, const glm::vec3& boundsSize, Mesh& mesh) {
+    mesh.vertexCount = vertexCount;
+    mesh.indexCount = indexCount;
+    mesh.boundsMin = boundsMin;
+    mesh.boundsSize = boundsSize;
+    if (!allocate(freeVertices, mesh.vertexCount, mesh.firstVertex)) {
+        grow(VBO, GL_ARRAY_BUFFER, vertexCapacity, freeVertices, mesh.vertexCount, sizeof(SceneVertex));
+        allocate(freeVertices, mesh.vertexCount, mesh.firstVertex);
+    }
+    if (!allocate(freeIndices, mesh.indexCount, mesh.firstIndex)) {
+        grow(EBO, GL_ELEMENT_ARRAY_BUFFER, indexCapacity, freeIndices, mesh.indexCount, sizeof(uint32_t));
+        allocate(freeIndices, mesh.indexCount, mesh.firstIndex);
+    }
+
+    if (mesh.indexCount == 0)
+        return;
+
+    // Indices stay relative to the mesh's first vertex (the command's baseVertex)
+    glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, mesh.firstVertex * sizeof(SceneVertex),
+        mesh.vertexCount * sizeof(SceneVertex), vertices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, mesh.firstIndex * sizeof(uint32_t),
+        mesh.indexCount * sizeof(uint32_t), indices);
+}
+
+void MeshArena::remove(Mesh& mesh) {
+    release(freeVertices, mesh.firstVertex, mesh.vertexCount);
+    release(freeIndices, mesh.firstIndex, mesh.indexCount);
+    mesh.vertexCount = mesh.indexCount = 0;
+}
+
+void MeshArena::clear() {
+    commands.clear();
+    instances.clear();
+}
+
+void MeshArena::draw(const Mesh& mesh, const glm::mat4& model, float layer, int level) {
+    if (mesh.indexCount == 0)
+        return;
+    if (!commands.empty() && commands.back().firstIndex == mesh.firstIndex &&
+        commands.back().count == mesh.indexCount) {
+        commands.back().instanceCount++;
+    }
+    else {
+        commands.push_back({ mesh.indexCount, 1, mesh.firstIndex, (int32_t)mesh.firstVertex, (uint32_t)instances.size() });
+    }
+    instances.push_back({ model, mesh.boundsMin, mesh.boundsSize, layer, (float)level });
+}
+
+void MeshArena::draw(const Mesh& mesh, const Range* ranges, size_t count, const glm::mat4& model, float layer,
+    int level) {
+    if (count == 0 || mesh.indexCount == 0)
+        return;
+    for (size_t i = 0; i < count; i++) {
+        commands.push_back({ ranges[i].indexCount, 1, mesh.firstIndex + ranges[i].firstIndex, (int32_t)mesh.firstVertex,
+            (uint32_t)instances.size() });
+    }
+    instances.push_back({ model, mesh.boundsMin, mesh.boundsSize, layer, (float)level });
+}
+
+int MeshArena::submit() {
+    if (commands.empty())
+        return 0;
+    glBindVertexArray(VAO);
+
+    // Fresh stores each frame (or larger ones), so the driver never waits for
+    // the last frame's draws to finish reading the old ones
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    if (instances.size() > instanceCapacity)
+        instanceCapacity = std::max(instances.size(), instanceCapacity * 2);
+    glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(Instance), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(Instance), instances.data());
+
+    if (multiDrawElementsIndirect) {
+        // Each command's baseInstance picks its records
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        if (commands.size() > commandCapacity)
+            commandCapacity = std::max(commands.size(), commandCapacity * 2);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commandCapacity * sizeof(Command), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(Command), commands.data());
+        ((MultiDrawElementsIndirectProc)multiDrawElementsIndirect)(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0,
+            (GLsizei)commands.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        return 1;
+    }
+
+    // 3.3 has no baseInstance, so the attributes are pointed at each
+    // command's records instead (once for the ranges of one draw)
+    uint32_t pointed = 0xFFFFFFFF;
+    for (const Command& command : commands) {
+        if (command.baseInstance != pointed)
+            setInstanceAttributes(command.baseInstance);
+        pointed = command.baseInstance;
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+            (void*)(command.firstIndex * sizeof(uint32_t)), command.instanceCount, command.baseVertex);
+    }
+    return (int)commands.size();
+}
@@ -0,0 +1,113 @@
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+#include "SceneGeometry.h"
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Meshes packed into one vertex and one index buffer behind one vertex array,
+// so a frame's worth of them is drawn with a single glMultiDrawElementsIndirect
+// on GL 4.3 and up. Each frame, draw() lists what to draw; submit() turns that
+// into DrawElementsIndirectCommands, one per run of copies of the same mesh
+// (or per range of a mesh drawn in parts), and issues them. On the 3.3
+// context the same commands are issued one glDrawElementsInstancedBaseVertex
+// at a time.
+//
+// What differs between draws (model matrix, the mesh's bounds, a texture layer
+// and the level of detail) is kept per instance rather than in uniforms: each
+// command's baseInstance picks its records, which main.cpp's vertex shader
+// reads at locations 4 to 11 when its instanced uniform is set.
+class MeshArena {
+public:
+    // Where a mesh lives in the shared buffers
+    struct Mesh {
+        uint32_t firstVertex, vertexCount;
+        uint32_t firstIndex, indexCount;
+        glm::vec3 boundsMin, boundsSize;
+    };
+
+    // Part of a mesh's triangles, counted in indices from its first
+    struct Range {
+        uint32_t firstIndex, indexCount;
+    };
+
+    // draw() layer that keeps each vertex's own
+    static constexpr float VERTEX_LAYER = -1.0f;
+
+    // getProcAddress loads the 4.3 entry point, which glad (generated for
+    // 3.3) leaves out. GL thread only, like everything here.
+    explicit MeshArena(void* (*getProcAddress)(const char* name));
+    ~MeshArena();
+
+    // Copies every vertex and index of geometry in, growing the buffers when
+    // they are full.
+    void add(const SceneGeometry& geometry, Mesh& mesh);
+
+    // The same from arrays anywhere in memory, such as a mapped CookedMesh.
+    void add(const SceneVertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount,
+        const glm::vec3& boundsMin, const glm::vec3& boundsSize, Mesh& mesh);
+    void remove(Mesh& mesh);
+
+    // Forgets the last frame's draws.
+    void clear();
+
+    // Draws a copy of mesh, placed by model, all its vertices taking layer
+    // unless it is VERTEX_LAYER. level is the level of detail it stands for,
+    // for the shader's debug view. Copies of the same mesh drawn one after
+    // another share a command.
+    void draw(const Mesh& mesh, const glm::mat4& model, float layer = VERTEX_LAYER, int level = 0);
+
+    // Draws only count ranges of mesh, as above, with a command per range all
+    // reading the same instance record.
+    void draw(const Mesh& mesh, const Range* ranges, size_t count, const glm::mat4& model, float layer = VERTEX_LAYER,
+        int level = 0);
+
+    // Issues the draws since clear() with the arena's vertex array bound;
+    // returns the number of draw calls this took.
+    int submit();
+
+    // The vertex array submit() binds
+    unsigned int vertexArray() const { return VAO; }
+
+    // Whether submit() uses glMultiDrawElementsIndirect
+    bool multiDraw() const { return multiDrawElementsIndirect != nullptr; }
+
+    // Of the vertex and index buffers
+    size_t bytes() const { return vertexCapacity * sizeof(SceneVertex) + indexCapacity * sizeof(uint32_t); }
+
+private:
+    // Laid out as GL reads it from the indirect buffer
+    struct Command {
+        uint32_t count;
+        uint32_t instanceCount;
+        uint32_t firstIndex;
+        int32_t baseVertex;
+        uint32_t baseInstance;
+    };
+
+    struct Instance {
+        glm::mat4 model;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsSize;
+        float layer;
+        float level;
+    };
+
+    void setInstanceAttributes(size_t firstInstance);
+    void grow(unsigned int& buffer, unsigned int target, size_t& capacity, std::map<uint32_t, uint32_t>& free,
+        size_t needed, size_t recordSize);
+
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    unsigned int instanceBuffer = 0, commandBuffer = 0;
+    size_t vertexCapacity = 0, indexCapacity = 0;     // In records
+    size_t instanceCapacity = 0, commandCapacity = 0;
+    std::map<uint32_t, uint32_t> freeVertices, freeIndices; // First record -> count
+    std::vector<Command> commands;
+    std::vector<Instance> instances;
+    void* multiDrawElementsIndirect = nullptr;
+};
+
+#endif
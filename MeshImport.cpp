@@ -0,0 +1,707 @@
+#include "MeshImport.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+static bool readFile(const std::string& path, std::string& contents) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    std::ostringstream buffer;
+    buffer << in.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+// One v/vt/vn corner of an OBJ face, as indices from 0 (-1 when left out)
+struct ObjCorner {
+    int32_t position, uv, normal;
+    bool operator==(const ObjCorner& other) const {
+        return position == other.position && uv == other.uv && normal == other.normal;
+    }
+};
+
+struct ObjCornerHash {
+    size_t operator()(const ObjCorner& corner) const {
+        uint64_t key = (uint64_t)(uint32_t)corner.position * 0x9E3779B97F4A7C15ull;
+        key ^= ((uint64_t)(uint32_t)corner.uv << 21) ^ ((uint64_t)(uint32_t)corner.normal << 42);
+        return (size_t)(key ^ (key >> 29));
+    }
+};
+
+bool importObj(const std::string& path, ImportedMesh& mesh) {
+    std::string text;
+    if (!readFile(path, text)) {
+        std::cerr << "Failed to load mesh: " << path << std::endl;
+        return false;
+    }
+    mesh = ImportedMesh();
+
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> uvs;
+    std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> corners;
+    std::vector<uint32_t> face;
+    bool everyNormal = true;
+    int lineNumber = 0;
+
+    // text is NUL-terminated, so strtof and strtol stop at its end
+    const char* p = text.c_str();
+    const char* end = p + text.size();
+    while (p < end) {
+        lineNumber++;
+        const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+        if (!lineEnd)
+            lineEnd = end;
+        while (p < lineEnd && (*p == ' ' || *p == '\t'))
+            p++;
+        auto fail = [&](const char* message) {
+            std::cerr << path << ":" << lineNumber << ": " << message << std::endl;
+            return false;
+        };
+
+        if (p + 1 < lineEnd && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            p++;
+            char* next;
+            glm::vec3 v;
+            for (int c = 0; c < 3; c++, p = next) {
+                v[c] = strtof(p, &next);
+                if (next == p || next > lineEnd)
+                    return fail("expected v <x> <y> <z>");
+            }
+            positions.push_back(v);
+        }
+        else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t')) {
+            p += 2;
+            char* next;
+            glm::vec2 v;
+            for (int c = 0; c < 2; c++, p = next) {
+                v[c] = strtof(p, &next);
+                if (next == p || next > lineEnd)
+                    return fail("expected vt <u> <v>");
+            }
+            uvs.push_back(v);
+        }
+        else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) {
+            p += 2;
+            char* next;
+            glm::vec3 v;
+            for (int c = 0; c < 3; c++, p = next) {
+                v[c] = strtof(p, &next);
+                if (next == p || next > lineEnd)
+                    return fail("expected vn <x> <y> <z>");
+            }
+            normals.push_back(v);
+        }
+        else if (p + 1 < lineEnd && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            p++;
+            face.clear();
+            for (;;) {
+                while (p < lineEnd && (*p == ' ' || *p == '\t' || *p == '\r'))
+                    p++;
+                if (p >= lineEnd)
+                    break;
+
+                // v, v/vt, v//vn or v/vt/vn, counting from 1 or back from -1
+                long index[3] = { 0, 0, 0 };
+                size_t counts[3] = { positions.size(), uvs.size(), normals.size() };
+                char* next;
+                for (int part = 0; part < 3; part++) {
+                    if (part > 0) {
+                        if (*p != '/')
+                            break;
+                        p++;
+                        if (p >= lineEnd || *p == '/' || *p == ' ' || *p == '\t' || *p == '\r')
+                            continue;
+                    }
+                    index[part] = strtol(p, &next, 10);
+                    if (next == p || index[part] == 0)
+                        return fail("bad face corner");
+                    p = next;
+                }
+                ObjCorner corner;
+                int32_t* resolved[3] = { &corner.position, &corner.uv, &corner.normal };
+                for (int part = 0; part < 3; part++) {
+                    long i = index[part] < 0 ? (long)counts[part] + index[part] : index[part] - 1;
+                    if (index[part] != 0 && (i < 0 || i >= (long)counts[part]))
+                        return fail("face corner refers to a missing vertex");
+                    *resolved[part] = index[part] == 0 ? -1 : (int32_t)i;
+                }
+                if (corner.position < 0)
+                    return fail("face corner has no position");
+
+                std::pair<std::unordered_map<ObjCorner, uint32_t, ObjCornerHash>::iterator, bool> added =
+                    corners.emplace(corner, (uint32_t)mesh.positions.size());
+                if (added.second) {
+                    mesh.positions.push_back(positions[corner.position]);
+                    mesh.uvs.push_back(corner.uv >= 0 ? uvs[corner.uv] : glm::vec2(0.0f));
+                    mesh.normals.push_back(corner.normal >= 0 ? normals[corner.normal] : glm::vec3(0.0f));
+                    everyNormal = everyNormal && corner.normal >= 0;
+                }
+                face.push_back(added.first->second);
+            }
+            if (face.size() < 3)
+                return fail("face with fewer than 3 corners");
+            for (size_t i = 1; i + 1 < face.size(); i++) {
+                mesh.indices.push_back(face[0]);
+                mesh.indices.push_back(face[i]);
+                mesh.indices.push_back(face[i + 1]);
+            }
+        }
+        p = lineEnd + 1;
+    }
+
+    // Normals are worked out for the whole mesh when any corner lacks one
+    if (!everyNormal || normals.empty())
+        mesh.normals.clear();
+    if (uvs.empty())
+        mesh.uvs.clear();
+    if (mesh.indices.empty()) {
+        std::cerr << path << ": no faces" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Just enough JSON for glTF: the whole document as a tree
+struct Json {
+    enum Type { Null, Bool, Number, String, Array, Object };
+    Type type = Null;
+    double number = 0.0;
+    std::string text;
+    std::vector<Json> items;
+    std::vector<std::pair<std::string, Json>> members;
+
+    const Json* find(const char* key) const {
+        for (const std::pair<std::string, Json>& member : members) {
+            if (member.first == key)
+                return &member.second;
+        }
+        return nullptr;
+    }
+    double get(const char* key, double fallback) const {
+        const Json* value = find(key);
+        return value && value->type == Number ? value->number : fallback;
+    }
+    // A count, index or offset: false unless the number is a whole one from 0
+    // up to 2^32 - 1
+    bool getSize(const char* key, double fallback, size_t& out) const {
+        double value = get(key, fallback);
+        if (!(value >= 0.0 && value < 4294967296.0) || value != std::floor(value))
+            return false;
+        out = (size_t)value;
+        return true;
+    }
+    const Json* item(double index) const {
+        return type == Array && index >= 0.0 && index < (double)items.size() ? &items[(size_t)index] : nullptr;
+    }
+};
+
+class JsonParser {
+public:
+    JsonParser(const char* text, const char* end) : p(text), end(end) {}
+
+    bool parse(Json& value) {
+        if (!parseValue(value, 0))
+            return false;
+        skipSpace();
+        return p == end;
+    }
+
+private:
+    void skipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            p++;
+    }
+
+    bool literal(const char* word) {
+        size_t length = strlen(word);
+        if ((size_t)(end - p) < length || memcmp(p, word, length) != 0)
+            return false;
+        p += length;
+        return true;
+    }
+
+    bool parseString(std::string& out) {
+        if (p >= end || *p != '"')
+            return false;
+        p++;
+        while (p < end && *p != '"') {
+            char c = *p++;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (p >= end)
+                return false;
+            c = *p++;
+            switch (c) {
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                if (end - p < 4)
+                    return false;
+                unsigned int code = (unsigned int)strtoul(std::string(p, 4).c_str(), nullptr, 16);
+                p += 4;
+                // As UTF-8; surrogate pairs come out as two sequences, which
+                // only matters for names
+                if (code < 0x80) {
+                    out += (char)code;
+                }
+                else if (code < 0x800) {
+                    out += (char)(0xC0 | (code >> 6));
+                    out += (char)(0x80 | (code & 0x3F));
+                }
+                else {
+                    out += (char)(0xE0 | (code >> 12));
+                    out += (char)(0x80 | ((code >> 6) & 0x3F));
+                    out += (char)(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default: out += c; break;
+            }
+        }
+        if (p >= end)
+            return false;
+        p++;
+        return true;
+    }
+
+    bool parseValue(Json& value, int depth) {
+        skipSpace();
+        if (p >= end || depth > 64)
+            return false;
+        if (*p == '{') {
+            value.type = Json::Object;
+            p++;
+            skipSpace();
+            if (p < end && *p == '}') {
+                p++;
+                return true;
+            }
+            for (;;) {
+                skipSpace();
+                std::pair<std::string, Json> member;
+                if (!parseString(member.first))
+                    return false;
+                skipSpace();
+                if (p >= end || *p++ != ':' || !parseValue(member.second, depth + 1))
+                    return false;
+                value.members.push_back(std::move(member));
+                skipSpace();
+                if (p < end && *p == ',') {
+                    p++;
+                    continue;
+                }
+                return p < end && *p++ == '}';
+            }
+        }
+        if (*p == '[') {
+            value.type = Json::Array;
+            p++;
+            skipSpace();
+            if (p < end && *p == ']') {
+                p++;
+                return true;
+            }
+            for (;;) {
+                value.items.emplace_back();
+                if (!parseValue(value.items.back(), depth + 1))
+                    return false;
+                skipSpace();
+                if (p < end && *p == ',') {
+                    p++;
+                    continue;
+                }
+                return p < end && *p++ == ']';
+            }
+        }
+        if (*p == '"') {
+            value.type = Json::String;
+            return parseString(value.text);
+        }
+        if (literal("true")) {
+            value.type = Json::Bool;
+            value.number = 1.0;
+            return true;
+        }
+        if (literal("false")) {
+            value.type = Json::Bool;
+            return true;
+        }
+        if (literal("null"))
+            return true;
+        char* next;
+        value.type = Json::Number;
+        value.number = strtod(p, &next);
+        if (next == p || next > end)
+            return false;
+        p = next;
+        return true;
+    }
+
+    const char* p;
+    const char* end;
+};
+
+static bool decodeBase64(const char* text, size_t length, std::string& out) {
+    unsigned int bits = 0;
+    int count = 0;
+    for (size_t i = 0; i < length; i++) {
+        char c = text[i];
+        int value;
+        if (c >= 'A' && c <= 'Z') value = c - 'A';
+        else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') value = c - '0' + 52;
+        else if (c == '+' || c == '-') value = 62;
+        else if (c == '/' || c == '_') value = 63;
+        else if (c == '=') break;
+        else return false;
+        bits = (bits << 6) | (unsigned int)value;
+        count += 6;
+        if (count >= 8) {
+            count -= 8;
+            out += (char)((bits >> count) & 0xFF);
+        }
+    }
+    return true;
+}
+
+// An accessor's elements, checked to lie inside its buffer
+struct GltfAccessor {
+    const unsigned char* data;
+    size_t count;
+    size_t stride;
+    int componentType;
+    int components;
+    bool normalized;
+
+    float get(size_t element, int component) const {
+        const unsigned char* at = data + element * stride;
+        switch (componentType) {
+        case 5120: { int8_t v; memcpy(&v, at + component, 1); return normalized ? std::max(v / 127.0f, -1.0f) : v; }
+        case 5121: return normalized ? at[component] / 255.0f : at[component];
+        case 5122: { int16_t v; memcpy(&v, at + component * 2, 2); return normalized ? std::max(v / 32767.0f, -1.0f) : v; }
+        case 5123: { uint16_t v; memcpy(&v, at + component * 2, 2); return normalized ? v / 65535.0f : v; }
+        case 5125: { uint32_t v; memcpy(&v, at + component * 4, 4); return (float)v; }
+        default: { float v; memcpy(&v, at + component * 4, 4); return v; }
+        }
+    }
+
+    uint32_t index(size_t element) const {
+        const unsigned char* at = data + element * stride;
+        if (componentType == 5121)
+            return at[0];
+        if (componentType == 5123) {
+            uint16_t v;
+            memcpy(&v, at, 2);
+            return v;
+        }
+        uint32_t v;
+        memcpy(&v, at, 4);
+        return v;
+    }
+};
+
+static int componentSize(int componentType) {
+    switch (componentType) {
+    case 5120: case 5121: return 1;
+    case 5122: case 5123: return 2;
+    case 5125: case 5126: return 4;
+    default: return 0;
+    }
+}
+
+static int typeComponents(const std::string& type) {
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    return 0;
+}
+
+class GltfReader {
+public:
+    GltfReader(const std::string& path) : path(path) {}
+
+    bool read(ImportedMesh& mesh) {
+        std::string file;
+        if (!readFile(path, file)) {
+            std::cerr << "Failed to load mesh: " << path << std::endl;
+            return false;
+        }
+
+        // A .glb is a 12-byte header, then a JSON chunk and an optional
+        // binary one that stands for the first buffer
+        std::string json, binary;
+        bool glb = false;
+        if (file.size() >= 12 && memcmp(file.data(), "glTF", 4) == 0) {
+            glb = true;
+            size_t at = 12;
+            for (int chunk = 0; at + 8 <= file.size(); chunk++) {
+                uint32_t length, type;
+                memcpy(&length, file.data() + at, 4);
+                memcpy(&type, file.data() + at + 4, 4);
+                if (length > file.size() - at - 8)
+                    return fail("truncated chunk");
+                if (chunk == 0 && type == 0x4E4F534A)
+                    json.assign(file.data() + at + 8, length);
+                else if (chunk == 1 && type == 0x004E4942)
+                    binary.assign(file.data() + at + 8, length);
+                at += 8 + length;
+            }
+        }
+        else {
+            json.swap(file);
+        }
+        if (!JsonParser(json.data(), json.data() + json.size()).parse(root) || root.type != Json::Object)
+            return fail("not valid JSON");
+
+        const Json* list = root.find("buffers");
+        for (size_t i = 0; list && i < list->items.size(); i++) {
+            const Json* uri = list->items[i].find("uri");
+            buffers.emplace_back();
+            if (!uri) {
+                if (!glb || i != 0)
+                    return fail("buffer without a uri");
+                buffers.back().swap(binary);
+            }
+            else if (uri->text.compare(0, 5, "data:") == 0) {
+                size_t comma = uri->text.find(";base64,");
+                if (comma == std::string::npos ||
+                    !decodeBase64(uri->text.data() + comma + 8, uri->text.size() - comma - 8, buffers.back()))
+                    return fail("buffer data URI is not base64");
+            }
+            else if (!readFile((fs::path(path).parent_path() / fs::u8path(uri->text)).string(), buffers.back())) {
+                return fail(("missing buffer " + uri->text).c_str());
+            }
+        }
+
+        // The default scene's nodes and their children, or every mesh as it
+        // is when there is no scene
+        const Json* scenes = root.find("scenes");
+        const Json* scene = scenes ? scenes->item(root.get("scene", 0.0)) : nullptr;
+        if (scene) {
+            const Json* nodes = scene->find("nodes");
+            for (size_t i = 0; nodes && i < nodes->items.size(); i++) {
+                if (!addNode(nodes->items[i].number, glm::mat4(1.0f), 0, mesh))
+                    return false;
+            }
+        }
+        else if (const Json* meshes = root.find("meshes")) {
+            for (size_t i = 0; i < meshes->items.size(); i++) {
+                if (!addMesh(meshes->items[i], glm::mat4(1.0f), mesh))
+                    return false;
+            }
+        }
+
+        if (!everyNormal)
+            mesh.normals.clear();
+        if (!anyUv)
+            mesh.uvs.clear();
+        if (mesh.indices.empty())
+            return fail("no triangles");
+        return true;
+    }
+
+private:
+    bool fail(const char* message) const {
+        std::cerr << path << ": " << message << std::endl;
+        return false;
+    }
+
+    bool accessor(double index, GltfAccessor& out) const {
+        const Json* accessors = root.find("accessors");
+        const Json* a = accessors ? accessors->item(index) : nullptr;
+        if (!a)
+            return fail("missing accessor");
+        if (a->find("sparse"))
+            return fail("sparse accessors are not supported");
+        const Json* views = root.find("bufferViews");
+        const Json* view = views ? views->item(a->get("bufferView", -1.0)) : nullptr;
+        const Json* type = a->find("type");
+        size_t componentType;
+        if (!a->getSize("componentType", 0.0, componentType))
+            return fail("bad accessor");
+        out.componentType = (int)componentType;
+        out.components = type ? typeComponents(type->text) : 0;
+        const Json* normalized = a->find("normalized");
+        out.normalized = normalized && normalized->number != 0.0;
+        size_t elementSize = (size_t)componentSize(out.componentType) * out.components;
+        if (!view || elementSize == 0)
+            return fail("accessor without data");
+        // Strides are at most 252 bytes in glTF, which keeps the sums below
+        // from overflowing
+        size_t buffer, viewOffset, accessorOffset, length;
+        if (!view->getSize("buffer", -1.0, buffer) || !view->getSize("byteOffset", 0.0, viewOffset) ||
+            !view->getSize("byteLength", 0.0, length) || !view->getSize("byteStride", 0.0, out.stride) ||
+            !a->getSize("byteOffset", 0.0, accessorOffset) || !a->getSize("count", 0.0, out.count) || out.stride > 252)
+            return fail("bad accessor");
+        if (out.stride == 0)
+            out.stride = elementSize;
+        if (buffer >= buffers.size() || viewOffset > buffers[buffer].size() || length > buffers[buffer].size() - viewOffset ||
+            (out.count > 0 && accessorOffset + out.stride * (out.count - 1) + elementSize > length))
+            return fail("accessor runs past its buffer");
+        out.data = (const unsigned char*)buffers[buffer].data() + viewOffset + accessorOffset;
+        return true;
+    }
+
+    bool addNode(double index, const glm::mat4& parent, int depth, ImportedMesh& mesh) {
+        const Json* nodes = root.find("nodes");
+        const Json* node = nodes ? nodes->item(index) : nullptr;
+        if (!node || depth > 64)
+            return fail("bad node");
+
+        glm::mat4 local(1.0f);
+        if (const Json* matrix = node->find("matrix")) {
+            for (size_t i = 0; i < 16 && i < matrix->items.size(); i++)
+                local[i / 4][i % 4] = (float)matrix->items[i].number;
+        }
+        else {
+            glm::vec3 translation(0.0f), scale(1.0f);
+            glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
+            const Json* t = node->find("translation");
+            const Json* r = node->find("rotation");
+            const Json* s = node->find("scale");
+            if (t && t->items.size() == 3)
+                translation = glm::vec3(t->items[0].number, t->items[1].number, t->items[2].number);
+            if (r && r->items.size() == 4)
+                rotation = glm::quat((float)r->items[3].number, (float)r->items[0].number, (float)r->items[1].number,
+                    (float)r->items[2].number);
+            if (s && s->items.size() == 3)
+                scale = glm::vec3(s->items[0].number, s->items[1].number, s->items[2].number);
+            local = glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation) *
+                glm::scale(glm::mat4(1.0f), scale);
+        }
+        glm::mat4 world = parent * local;
+
+        const Json* meshes = root.find("meshes");
+        const Json* nodeMesh = node->find("mesh");
+        if (nodeMesh) {
+            const Json* m = meshes ? meshes->item(nodeMesh->number) : nullptr;
+            if (!m)
+                return fail("node refers to a missing mesh");
+            if (!addMesh(*m, world, mesh))
+                return false;
+        }
+        const Json* children = node->find("children");
+        for (size_t i = 0; children && i < children->items.size(); i++) {
+            if (!addNode(children->items[i].number, world, depth + 1, mesh))
+                return false;
+        }
+        return true;
+    }
+
+    bool addMesh(const Json& source, const glm::mat4& world, ImportedMesh& mesh) {
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+        bool flip = glm::determinant(glm::mat3(world)) < 0.0f;
+        const Json* primitives = source.find("primitives");
+        for (size_t p = 0; primitives && p < primitives->items.size(); p++) {
+            const Json& primitive = primitives->items[p];
+            if (primitive.get("mode", 4.0) != 4.0) {
+                std::cerr << path << ": skipping a primitive that is not a triangle list" << std::endl;
+                continue;
+            }
+            const Json* attributes = primitive.find("attributes");
+            const Json* position = attributes ? attributes->find("POSITION") : nullptr;
+            GltfAccessor positions;
+            if (!position || !accessor(position->number, positions))
+                return position ? false : fail("primitive without positions");
+            if (positions.componentType != 5126 || positions.components != 3)
+                return fail("positions are not float triples");
+
+            uint32_t base = (uint32_t)mesh.positions.size();
+            for (size_t i = 0; i < positions.count; i++) {
+                glm::vec4 v(positions.get(i, 0), positions.get(i, 1), positions.get(i, 2), 1.0f);
+                mesh.positions.push_back(glm::vec3(world * v));
+            }
+
+            const Json* normal = attributes->find("NORMAL");
+            GltfAccessor normals;
+            if (normal && accessor(normal->number, normals) && normals.components == 3 && normals.count == positions.count) {
+                for (size_t i = 0; i < normals.count; i++) {
+                    glm::vec3 n = normalMatrix * glm::vec3(normals.get(i, 0), normals.get(i, 1), normals.get(i, 2));
+                    mesh.normals.push_back(glm::length(n) > 0.0f ? glm::normalize(n) : n);
+                }
+            }
+            else {
+                everyNormal = false;
+                mesh.normals.resize(mesh.positions.size());
+            }
+
+            const Json* uv = attributes->find("TEXCOORD_0");
+            GltfAccessor uvs;
+            if (uv && accessor(uv->number, uvs) && uvs.components == 2 && uvs.count == positions.count) {
+                anyUv = true;
+                for (size_t i = 0; i < uvs.count; i++)
+                    mesh.uvs.push_back(glm::vec2(uvs.get(i, 0), uvs.get(i, 1)));
+            }
+            else {
+                mesh.uvs.resize(mesh.positions.size());
+            }
+
+            const Json* indexAccessor = primitive.find("indices");
+            GltfAccessor indices;
+            size_t count = positions.count;
+            if (indexAccessor) {
+                if (!accessor(indexAccessor->number, indices))
+                    return false;
+                if (indices.components != 1 || (indices.componentType != 5121 && indices.componentType != 5123 &&
+                    indices.componentType != 5125))
+                    return fail("indices are not unsigned integers");
+                count = indices.count;
+            }
+            for (size_t i = 0; i + 2 < count; i += 3) {
+                uint32_t triangle[3];
+                for (int c = 0; c < 3; c++) {
+                    triangle[c] = indexAccessor ? indices.index(i + c) : (uint32_t)(i + c);
+                    if (triangle[c] >= positions.count)
+                        return fail("index past the end of its vertices");
+                }
+                // A mirroring transform turns the winding around
+                if (flip)
+                    std::swap(triangle[1], triangle[2]);
+                for (int c = 0; c < 3; c++)
+                    mesh.indices.push_back(base + triangle[c]);
+            }
+        }
+        return true;
+    }
+
+    std::string path;
+    Json root;
+    std::vector<std::string> buffers;
+    bool everyNormal = true;
+    bool anyUv = false;
+};
+
+bool importGltf(const std::string& path, ImportedMesh& mesh) {
+    mesh = ImportedMesh();
+    return GltfReader(path).read(mesh);
+}
+
+bool importMesh(const std::string& path, ImportedMesh& mesh) {
+    std::string extension = fs::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)tolower(c); });
+    if (extension == ".obj")
+        return importObj(path, mesh);
+    if (extension == ".gltf" || extension == ".glb")
+        return importGltf(path, mesh);
+    std::cerr << "Unknown mesh format: " << path << std::endl;
+    return false;
+}
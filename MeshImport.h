@@ -0,0 +1,33 @@
+#ifndef MESH_IMPORT_H
+#define MESH_IMPORT_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Triangles as an exporter wrote them: one entry per vertex in each array,
+// three indices per triangle. normals and uvs are empty when the file has
+// none.
+struct ImportedMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<uint32_t> indices;
+};
+
+// Wavefront OBJ: v, vt, vn and f lines (polygons are split into fans, and
+// negative indices count back from the end); everything else, materials
+// included, is ignored. Each distinct v/vt/vn corner becomes one vertex.
+bool importObj(const std::string& path, ImportedMesh& mesh);
+
+// glTF 2.0, as .gltf (with .bin files or data: URIs) or binary .glb: every
+// triangle primitive of the meshes the default scene places, moved into the
+// scene's space, with POSITION, NORMAL and TEXCOORD_0. Sparse accessors and
+// compressed or quantised positions are not supported.
+bool importGltf(const std::string& path, ImportedMesh& mesh);
+
+// Either of the above, by extension. Errors go to std::cerr.
+bool importMesh(const std::string& path, ImportedMesh& mesh);
+
+#endif
@@ -0,0 +1,513 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+
+// Forsyth's tuning, for an LRU cache of this size
+static const int CACHE_SIZE = 32;
+static const int MAX_VALENCE = 32;  // Scores are tabled up to this many triangles left
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+// A FIFO post-transform cache, as GPUs have; true on a miss
+class FifoCache {
+public:
+    FifoCache(size_t vertexCount, int size) : stamps(vertexCount, 0), size((unsigned int)size) {}
+
+    bool miss(uint32_t vertex) {
+        if (time - stamps[vertex] < size && stamps[vertex] != 0)
+            return false;
+        stamps[vertex] = ++time;
+        return true;
+    }
+
+    // Empties the cache
+    void flush() { time += size; }
+
+private:
+    std::vector<unsigned int> stamps;  // When each vertex last went in, 0 for never
+    unsigned int size;
+    unsigned int time = 0;
+};
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    float cacheScores[CACHE_SIZE];
+    for (int i = 0; i < CACHE_SIZE; i++) {
+        // The last triangle's 3 vertices score the same, so it is not simply
+        // reused again
+        cacheScores[i] = i < 3 ? LAST_TRIANGLE_SCORE :
+            std::pow(1.0f - (float)(i - 3) / (CACHE_SIZE - 3), CACHE_DECAY_POWER);
+    }
+    float valenceScores[MAX_VALENCE + 1];
+    valenceScores[0] = 0.0f;
+    for (int i = 1; i <= MAX_VALENCE; i++)
+        valenceScores[i] = VALENCE_BOOST_SCALE * std::pow((float)i, -VALENCE_BOOST_POWER);
+    auto score = [&](int cachePosition, uint32_t valence) {
+        if (valence == 0)
+            return -1.0f;
+        return (cachePosition >= 0 ? cacheScores[cachePosition] : 0.0f) + valenceScores[std::min(valence, (uint32_t)MAX_VALENCE)];
+    };
+
+    // Each vertex's triangles, the first live ones of them first
+    std::vector<uint32_t> first(vertexCount + 1, 0);
+    for (uint32_t index : indices)
+        first[index + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        first[v + 1] += first[v];
+    std::vector<uint32_t> live(vertexCount, 0);
+    std::vector<uint32_t> triangles(indices.size());
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int c = 0; c < 3; c++) {
+            uint32_t v = indices[t * 3 + c];
+            triangles[first[v] + live[v]++] = (uint32_t)t;
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        vertexScore[v] = score(-1, live[v]);
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+    std::vector<unsigned char> emitted(triangleCount, 0);
+
+    std::vector<uint32_t> ordered;
+    ordered.reserve(indices.size());
+    std::vector<uint32_t> cache, nextCache;
+    cache.reserve(CACHE_SIZE + 3);
+    nextCache.reserve(CACHE_SIZE + 3);
+    size_t inputCursor = 0;
+    size_t best = 0;
+    while (ordered.size() < indices.size()) {
+        emitted[best] = 1;
+        const uint32_t* corners = &indices[best * 3];
+        ordered.insert(ordered.end(), corners, corners + 3);
+
+        // The triangle's vertices go to the front, pushing the rest back
+        nextCache.assign(corners, corners + 3);
+        for (uint32_t v : cache) {
+            if (v != corners[0] && v != corners[1] && v != corners[2])
+                nextCache.push_back(v);
+        }
+        for (int c = 0; c < 3; c++) {
+            uint32_t v = corners[c];
+            uint32_t* list = &triangles[first[v]];
+            uint32_t* found = std::find(list, list + live[v], (uint32_t)best);
+            std::swap(*found, list[--live[v]]);
+        }
+
+        // Rescore everything in or just pushed out of the cache, and pick
+        // the best of their triangles next
+        float bestScore = -1.0f;
+        for (size_t i = 0; i < nextCache.size(); i++) {
+            uint32_t v = nextCache[i];
+            cachePosition[v] = i < (size_t)CACHE_SIZE ? (int)i : -1;
+            float updated = score(cachePosition[v], live[v]);
+            float change = updated - vertexScore[v];
+            vertexScore[v] = updated;
+            for (uint32_t j = first[v]; j < first[v] + live[v]; j++) {
+                uint32_t t = triangles[j];
+                triangleScore[t] += change;
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+        if (nextCache.size() > (size_t)CACHE_SIZE)
+            nextCache.resize(CACHE_SIZE);
+        cache.swap(nextCache);
+
+        // Nothing left around the cache: carry on from the next triangle in
+        // the input
+        if (bestScore < 0.0f) {
+            while (inputCursor < triangleCount && emitted[inputCursor])
+                inputCursor++;
+            best = inputCursor;
+        }
+    }
+    indices.swap(ordered);
+}
+
+float averageCacheMissRatio(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize) {
+    if (indices.empty())
+        return 0.0f;
+    FifoCache cache(vertexCount, cacheSize);
+    size_t misses = 0;
+    for (uint32_t index : indices)
+        misses += cache.miss(index) ? 1 : 0;
+    return (float)misses / (float)(indices.size() / 3);
+}
+
+// Reorders runs of triangles (each from runs[r] to runs[r + 1]) so those
+// facing most outwards from the mesh's centre come first; returns the new
+// order, as indices into runs.
+static std::vector<size_t> sortRuns(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+    const std::vector<size_t>& runs) {
+    glm::vec3 meshCentre(0.0f);
+    float meshArea = 0.0f;
+    std::vector<std::pair<float, size_t>> order;
+    std::vector<glm::vec3> centres, normals;
+    for (size_t r = 0; r + 1 < runs.size(); r++) {
+        glm::vec3 centre(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = runs[r]; t < runs[r + 1]; t++) {
+            const glm::vec3& a = positions[indices[t * 3]];
+            const glm::vec3& b = positions[indices[t * 3 + 1]];
+            const glm::vec3& c = positions[indices[t * 3 + 2]];
+            glm::vec3 cross = glm::cross(b - a, c - a);
+            float doubleArea = glm::length(cross);
+            centre += (a + b + c) * (doubleArea / 3.0f);
+            normal += cross;
+            area += doubleArea;
+        }
+        meshCentre += centre;
+        meshArea += area;
+        centres.push_back(area > 0.0f ? centre / area : positions[indices[runs[r] * 3]]);
+        normals.push_back(glm::length(normal) > 0.0f ? glm::normalize(normal) : normal);
+    }
+    if (meshArea > 0.0f)
+        meshCentre /= meshArea;
+    for (size_t r = 0; r < centres.size(); r++)
+        order.push_back({ -glm::dot(centres[r] - meshCentre, normals[r]), r });
+    std::stable_sort(order.begin(), order.end(),
+        [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) { return a.first < b.first; });
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(indices.size());
+    std::vector<size_t> moved;
+    for (const std::pair<float, size_t>& run : order) {
+        sorted.insert(sorted.end(), indices.begin() + runs[run.second] * 3, indices.begin() + runs[run.second + 1] * 3);
+        moved.push_back(run.second);
+    }
+    indices.swap(sorted);
+    return moved;
+}
+
+
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, float threshold) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Runs start where the cache order jumped to an unconnected part of the
+    // mesh (a triangle missing all three vertices) ...
+    FifoCache cache(positions.size(), 16);
+    auto misses = [&](size_t t) {
+        int count = 0;
+        for (int c = 0; c < 3; c++)
+            count += cache.miss(indices[t * 3 + c]) ? 1 : 0;
+        return count;
+    };
+    std::vector<size_t> hard;
+    for (size_t t = 0; t < triangleCount; t++) {
+        if (misses(t) == 3)
+            hard.push_back(t);
+    }
+    hard.push_back(triangleCount);
+
+    // ... and are cut again, each part starting with an empty cache, as soon
+    // as the part so far is within threshold of the whole run's efficiency
+    std::vector<size_t> runs;
+    for (size_t h = 0; h + 1 < hard.size(); h++) {
+        size_t start = hard[h], end = hard[h + 1];
+        cache.flush();
+        int total = 0;
+        for (size_t t = start; t < end; t++)
+            total += misses(t);
+        float limit = (float)total / (float)(end - start) * threshold;
+
+        cache.flush();
+        runs.push_back(start);
+        int sofar = 0;
+        size_t from = start;
+        for (size_t t = start; t + 1 < end; t++) {
+            sofar += misses(t);
+            if ((float)sofar / (float)(t + 1 - from) <= limit) {
+                runs.push_back(t + 1);
+                from = t + 1;
+                sofar = 0;
+                cache.flush();
+            }
+        }
+    }
+    runs.push_back(triangleCount);
+
+    sortRuns(indices, positions, runs);
+}
+
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+    std::vector<MeshCluster>& clusters) {
+    std::vector<size_t> runs;
+    for (const MeshCluster& cluster : clusters)
+        runs.push_back(cluster.firstIndex / 3);
+    runs.push_back(indices.size() / 3);
+    std::vector<MeshCluster> sorted;
+    uint32_t next = 0;
+    for (size_t c : sortRuns(indices, positions, runs)) {
+        sorted.push_back(clusters[c]);
+        sorted.back().firstIndex = next;
+        next += clusters[c].indexCount;
+    }
+    clusters.swap(sorted);
+}
+
+std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t>& indices, size_t vertexCount) {
+    const uint32_t UNUSED = 0xFFFFFFFF;
+    std::vector<uint32_t> remap(vertexCount, UNUSED);
+    uint32_t next = 0;
+    for (uint32_t& index : indices) {
+        if (remap[index] == UNUSED)
+            remap[index] = next++;
+        index = remap[index];
+    }
+    for (uint32_t& target : remap) {
+        if (target == UNUSED)
+            target = next++;
+    }
+    return remap;
+}
+
+// The sphere and cone of indices' triangles first to end
+static MeshCluster boundCluster(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+    size_t first, size_t end, float margin) {
+    glm::vec3 low = positions[indices[first]], high = low;
+    glm::vec3 axis(0.0f);
+    for (size_t i = first; i < end; i += 3) {
+        const glm::vec3& a = positions[indices[i]];
+        const glm::vec3& b = positions[indices[i + 1]];
+        const glm::vec3& c = positions[indices[i + 2]];
+        low = glm::min(low, glm::min(a, glm::min(b, c)));
+        high = glm::max(high, glm::max(a, glm::max(b, c)));
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        if (length > 0.0f)
+            axis += normal / length;
+    }
+    glm::vec3 center = (low + high) * 0.5f;
+    float radius = 0.0f;
+    for (size_t i = first; i < end; i++)
+        radius = std::max(radius, glm::distance(center, positions[indices[i]]));
+
+    // The cone is only worth keeping while all normals are within 90 degrees
+    // of its axis
+    float cutoff = 1.0f;
+    if (glm::length(axis) > 0.0f) {
+        axis = glm::normalize(axis);
+        float nearest = 1.0f;
+        for (size_t i = first; i < end; i += 3) {
+            const glm::vec3& a = positions[indices[i]];
+            glm::vec3 normal = glm::cross(positions[indices[i + 1]] - a, positions[indices[i + 2]] - a);
+            float length = glm::length(normal);
+            if (length > 0.0f)
+                nearest = std::min(nearest, glm::dot(normal / length, axis));
+        }
+        if (nearest > 0.0f)
+            cutoff = std::sqrt(1.0f - nearest * nearest);
+    }
+
+    MeshCluster cluster;
+    for (int c = 0; c < 3; c++) {
+        cluster.center[c] = center[c];
+        cluster.coneAxis[c] = axis[c];
+    }
+    cluster.radius = radius + margin;
+    cluster.coneCutoff = cutoff;
+    cluster.firstIndex = (uint32_t)first;
+    cluster.indexCount = (uint32_t)(end - first);
+    return cluster;
+}
+
+std::vector<MeshCluster> buildClusters(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+    float margin, size_t maxVertices, size_t maxTriangles) {
+    std::vector<MeshCluster> clusters;
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return clusters;
+
+    // Each vertex's triangles
+    size_t vertexCount = positions.size();
+    std::vector<uint32_t> first(vertexCount + 1, 0);
+    for (uint32_t index : indices)
+        first[index + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        first[v + 1] += first[v];
+    std::vector<uint32_t> filled(first.begin(), first.end() - 1);
+    std::vector<uint32_t> triangles(indices.size());
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int c = 0; c < 3; c++)
+            triangles[filled[indices[t * 3 + c]]++] = (uint32_t)t;
+    }
+    std::vector<glm::vec3> normals(triangleCount), centres(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        const glm::vec3& a = positions[indices[t * 3]];
+        const glm::vec3& b = positions[indices[t * 3 + 1]];
+        const glm::vec3& c = positions[indices[t * 3 + 2]];
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        normals[t] = length > 0.0f ? normal / length : normal;
+        centres[t] = (a + b + c) / 3.0f;
+    }
+
+    std::vector<unsigned char> taken(triangleCount, 0);
+    std::vector<uint32_t> seen(vertexCount, 0);     // The cluster (+1) that last took each vertex
+    std::vector<uint32_t> ordered, candidates, members;
+    ordered.reserve(indices.size());
+    size_t cursor = 0;
+    while (ordered.size() < indices.size()) {
+        while (taken[cursor])
+            cursor++;
+        uint32_t stamp = (uint32_t)clusters.size() + 1;
+        size_t start = ordered.size(), vertices = 0;
+        glm::vec3 axis(0.0f), centre(0.0f);
+        candidates.clear();
+        members.clear();
+        uint32_t next = (uint32_t)cursor;
+        for (;;) {
+            taken[next] = 1;
+            members.push_back(next);
+            axis += normals[next];
+            centre += centres[next];
+            for (int c = 0; c < 3; c++) {
+                uint32_t v = indices[next * 3 + c];
+                ordered.push_back(v);
+                if (seen[v] == stamp)
+                    continue;
+                seen[v] = stamp;
+                vertices++;
+                candidates.insert(candidates.end(), &triangles[first[v]], &triangles[first[v + 1]]);
+            }
+            if (members.size() == maxTriangles)
+                break;
+
+            // The neighbour bringing in fewest vertices, most in line with
+            // the cluster and nearest its middle
+            glm::vec3 direction = glm::length(axis) > 0.0f ? glm::normalize(axis) : axis;
+            glm::vec3 middle = centre / (float)members.size();
+            float spread = 0.0f;
+            for (uint32_t m : members)
+                spread = std::max(spread, glm::distance(middle, centres[m]));
+            candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](uint32_t t) { return taken[t] != 0; }),
+                candidates.end());
+            float bestScore = 0.0f;
+            size_t best = candidates.size();
+            for (size_t i = 0; i < candidates.size(); i++) {
+                uint32_t t = candidates[i];
+                int fresh = 0;
+                for (int c = 0; c < 3; c++)
+                    fresh += seen[indices[t * 3 + c]] != stamp ? 1 : 0;
+                if (vertices + fresh > maxVertices)
+                    continue;
+                float score = (float)fresh + (1.0f - glm::dot(normals[t], direction)) +
+                    glm::distance(middle, centres[t]) / std::max(spread, 1e-12f) * 0.5f;
+                if (best == candidates.size() || score < bestScore) {
+                    bestScore = score;
+                    best = i;
+                }
+            }
+            if (best == candidates.size())
+                break;
+            next = candidates[best];
+        }
+        clusters.push_back(boundCluster(ordered, positions, start, ordered.size(), margin));
+    }
+    indices.swap(ordered);
+    return clusters;
+}
+
+// A triangle's corners turned so the smallest comes first, keeping its
+// winding, to spot repeats
+struct TriangleKey {
+    uint32_t corners[3];
+    bool operator==(const TriangleKey& other) const {
+        return corners[0] == other.corners[0] && corners[1] == other.corners[1] && corners[2] == other.corners[2];
+    }
+};
+
+struct TriangleKeyHash {
+    size_t operator()(const TriangleKey& key) const {
+        uint64_t h = key.corners[0] * 0x9E3779B97F4A7C15ull ^ key.corners[1] * 0xC2B2AE3D27D4EB4Full ^
+            key.corners[2] * 0x165667B19E3779F9ull;
+        return (size_t)(h ^ (h >> 31));
+    }
+};
+
+// indices with each vertex replaced by its cell's, at cells of cellSize
+static std::vector<uint32_t> clusterVertices(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+    const glm::vec3& low, float cellSize) {
+    std::unordered_map<uint64_t, uint32_t> cellOf;
+    std::vector<uint32_t> cells(positions.size());
+    std::vector<glm::vec3> sums;
+    std::vector<uint32_t> counts;
+    for (size_t v = 0; v < positions.size(); v++) {
+        glm::vec3 cell = glm::floor((positions[v] - low) / cellSize);
+        uint64_t key = (uint64_t)cell.x | (uint64_t)cell.y << 21 | (uint64_t)cell.z << 42;
+        uint32_t c = cellOf.emplace(key, (uint32_t)sums.size()).first->second;
+        if (c == sums.size()) {
+            sums.push_back(glm::vec3(0.0f));
+            counts.push_back(0);
+        }
+        sums[c] += positions[v];
+        counts[c]++;
+        cells[v] = c;
+    }
+    const uint32_t NONE = 0xFFFFFFFF;
+    std::vector<uint32_t> chosen(sums.size(), NONE);
+    std::vector<float> nearest(sums.size(), 0.0f);
+    for (size_t v = 0; v < positions.size(); v++) {
+        uint32_t c = cells[v];
+        float distance = glm::distance(positions[v], sums[c] / (float)counts[c]);
+        if (chosen[c] == NONE || distance < nearest[c]) {
+            chosen[c] = (uint32_t)v;
+            nearest[c] = distance;
+        }
+    }
+
+    std::unordered_set<TriangleKey, TriangleKeyHash> kept;
+    std::vector<uint32_t> simplified;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        uint32_t a = chosen[cells[indices[t]]], b = chosen[cells[indices[t + 1]]], c = chosen[cells[indices[t + 2]]];
+        if (a == b || b == c || a == c)
+            continue;
+        TriangleKey key = { { a, b, c } };
+        if (b < a && b < c)
+            key = { { b, c, a } };
+        else if (c < a && c < b)
+            key = { { c, a, b } };
+        if (kept.insert(key).second)
+            simplified.insert(simplified.end(), { a, b, c });
+    }
+    return simplified;
+}
+
+std::vector<uint32_t> simplifyMesh(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+    size_t targetTriangles) {
+    if (indices.size() / 3 <= targetTriangles || positions.empty())
+        return indices;
+    glm::vec3 low = positions[0], high = low;
+    for (const glm::vec3& p : positions) {
+        low = glm::min(low, p);
+        high = glm::max(high, p);
+    }
+    float extent = std::max(high.x - low.x, std::max(high.y - low.y, high.z - low.z));
+
+    // A closed surface across n cells keeps about 2 pi n^2 triangles; start
+    // there and coarsen by steps, down to a couple of cells
+    float cells = std::min(std::sqrt((float)targetTriangles / 6.2831853f) * 1.5f, 1000000.0f);
+    std::vector<uint32_t> simplified;
+    for (;;) {
+        cells = std::max(cells, 2.0f);
+        simplified = clusterVertices(indices, positions, low, std::max(extent, 1e-12f) / cells * 1.0001f);
+        if (simplified.size() / 3 <= targetTriangles || cells <= 2.0f)
+            return simplified;
+        cells *= 0.85f;
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// Reorders for how a GPU walks an indexed triangle list. The post-transform
+// cache keeps the last few vertices shaded, so triangles sharing vertices
+// should come close together; triangles facing out of the mesh should come
+// first, so what they hide fails the depth test; and vertices should be
+// stored in the order triangles first use them, so fetching them streams
+// through memory.
+
+// Triangles in the order of Tom Forsyth's "Linear-Speed Vertex Cache
+// Optimisation", which greedily takes the triangle whose vertices score
+// highest for being in a 32-entry LRU cache and for having few triangles
+// left.
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+// After optimizeVertexCache(): splits the triangles into the runs the cache
+// order made, then into smaller runs for as long as each keeps its cache
+// efficiency within threshold of the whole run's (Sander, Nehab and Barczak,
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"), and
+// sorts the runs so those facing most outwards from the mesh's centre come
+// first.
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, float threshold = 1.05f);
+
+// A run of triangles, contiguous in the index list, small enough to be culled
+// on its own: a sphere around it, and a cone around every triangle's normal
+// (Wihlidal, "Optimizing the Graphics Pipeline with Compute"). Laid out as
+// stored in .gmesh files.
+struct MeshCluster {
+    float center[3];
+    float radius;
+    float coneAxis[3];
+    float coneCutoff;       // Sine of the widest angle from the axis to a normal; 1 when too wide to cull by
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+// After optimizeVertexCache(): groups the triangles into clusters of at most
+// maxTriangles triangles using at most maxVertices vertices, and stores each
+// cluster's together. A cluster starts at the first triangle left in cache
+// order and grows by the neighbour bringing in fewest vertices, facing most
+// like it and nearest its middle, so clusters come out flat and compact and
+// their cones narrow. Spheres are grown by margin, to cover the positions
+// once quantized.
+std::vector<MeshCluster> buildClusters(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+    float margin = 0.0f, size_t maxVertices = 64, size_t maxTriangles = 124);
+
+// Sorts whole clusters as optimizeOverdraw() sorts runs, keeping each
+// together.
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+    std::vector<MeshCluster>& clusters);
+
+// The new index of each vertex, in the order of its first use, with vertices
+// no triangle uses at the end; indices are rewritten to match.
+std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t>& indices, size_t vertexCount);
+
+// Vertices shaded per triangle with a FIFO post-transform cache of
+// cacheSize entries: 3 with no reuse, near 0.5 at best for a large grid.
+float averageCacheMissRatio(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize = 16);
+
+// A coarser level of a mesh, for drawing it small, by vertex clustering
+// (Rossignac and Borrel): positions are snapped to a grid, the vertices of a
+// cell all become the one nearest their average, and triangles left without
+// three cells are dropped, as are repeats. The grid coarsens until at most
+// targetTriangles remain. The indices refer to the same vertices.
+std::vector<uint32_t> simplifyMesh(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+    size_t targetTriangles);
+
+// Whether every triangle of cluster faces away from eye, in the cluster's
+// space. Conservative: the whole sphere must lie inside the cone.
+inline bool clusterFacesAway(const MeshCluster& cluster, const glm::vec3& eye) {
+    glm::vec3 offset = glm::vec3(cluster.center[0], cluster.center[1], cluster.center[2]) - eye;
+    glm::vec3 axis(cluster.coneAxis[0], cluster.coneAxis[1], cluster.coneAxis[2]);
+    return glm::dot(offset, axis) >= cluster.coneCutoff * glm::length(offset) + cluster.radius;
+}
+
+// Sets runs to the index runs of clusters first to end that do not face away
+// from eye and reach inside the six planes (see frustumPlanes() in Bvh.h),
+// both in the clusters' space, joining neighbours; returns the triangles in
+// them. A null eye or planes skips that test. Run is any { firstIndex,
+// indexCount } pair, such as MeshArena::Range.
+template <typename Run>
+uint32_t cullClusters(const MeshCluster* clusters, uint32_t first, uint32_t end, const glm::vec3* eye,
+    const glm::vec4* planes, std::vector<Run>& runs) {
+    runs.clear();
+    uint32_t triangles = 0;
+    for (uint32_t i = first; i < end; i++) {
+        const MeshCluster& cluster = clusters[i];
+        if (eye && clusterFacesAway(cluster, *eye))
+            continue;
+        glm::vec3 center(cluster.center[0], cluster.center[1], cluster.center[2]);
+        bool outside = false;
+        for (int p = 0; planes && p < 6 && !outside; p++)
+            outside = glm::dot(glm::vec3(planes[p]), center) + planes[p].w < -cluster.radius;
+        if (outside)
+            continue;
+        if (!runs.empty() && runs.back().firstIndex + runs.back().indexCount == cluster.firstIndex)
+            runs.back().indexCount += cluster.indexCount;
+        else
+            runs.push_back({ cluster.firstIndex, cluster.indexCount });
+        triangles += cluster.indexCount / 3;
+    }
+    return triangles;
+}
+
+#endif
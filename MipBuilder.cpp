@@ -0,0 +1,242 @@
+#include "MipBuilder.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+#if defined(MIP_BUILDER_SCALAR)
+#define MIP_SCALAR 1
+#elif defined(__AVX2__)
+#define MIP_AVX2 1
+#define MIP_SSE2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_SSE2 1
+#include <emmintrin.h>
+#else
+#define MIP_SCALAR 1
+#endif
+
+// Levels are filtered as 4 floats per texel whatever the source channel count,
+// so one filter serves grey, grey-alpha, RGB and RGBA images.
+static const int LINEAR_STEPS = 8191;   // Quantization of the linear -> sRGB table
+
+static float srgbToLinear[256];
+static unsigned char linearToSrgb[LINEAR_STEPS + 1];
+
+static const int KAISER_TAPS = 12;      // Source texels 2x-5 .. 2x+6 feed texel x
+static float kaiserWeights[KAISER_TAPS];
+
+static double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static void buildTables() {
+    for (int i = 0; i < 256; i++) {
+        double c = i / 255.0;
+        srgbToLinear[i] = (float)(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+    }
+    for (int i = 0; i <= LINEAR_STEPS; i++) {
+        double l = (double)i / LINEAR_STEPS;
+        double c = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+        linearToSrgb[i] = (unsigned char)std::min(255.0, c * 255.0 + 0.5);
+    }
+
+    // Sinc at half the source rate, windowed by Kaiser (alpha 4) over three
+    // destination texels either side
+    const double pi = 3.14159265358979323846, radius = 3.0, alpha = 4.0;
+    double total = 0.0;
+    for (int k = 0; k < KAISER_TAPS; k++) {
+        double d = ((k - 5) - 0.5) / 2.0;  // Distance between texel centres, in destination texels
+        double sinc = d == 0.0 ? 1.0 : std::sin(pi * d) / (pi * d);
+        double window = besselI0(alpha * std::sqrt(std::max(0.0, 1.0 - (d / radius) * (d / radius)))) / besselI0(alpha);
+        kaiserWeights[k] = (float)(sinc * window);
+        total += kaiserWeights[k];
+    }
+    for (int k = 0; k < KAISER_TAPS; k++)
+        kaiserWeights[k] = (float)(kaiserWeights[k] / total);
+}
+
+static std::once_flag tablesBuilt;
+
+// Grey and grey-alpha images keep their one colour channel first.
+static int colorChannels(int channels) {
+    return channels >= 3 ? 3 : 1;
+}
+
+static void toLinear(const unsigned char* pixels, int width, int height, int channels, bool srgb,
+    std::vector<float>& out) {
+    size_t count = (size_t)width * height;
+    out.assign(count * 4, 0.0f);
+    int colors = colorChannels(channels);
+    for (size_t i = 0; i < count; i++) {
+        const unsigned char* texel = pixels + i * channels;
+        float* dst = &out[i * 4];
+        for (int c = 0; c < channels; c++)
+            dst[c] = (srgb && c < colors) ? srgbToLinear[texel[c]] : texel[c] * (1.0f / 255.0f);
+    }
+}
+
+static void fromLinear(const std::vector<float>& level, int channels, bool srgb, std::vector<unsigned char>& out) {
+    size_t count = level.size() / 4;
+    out.resize(count * channels);
+    int colors = colorChannels(channels);
+    for (size_t i = 0; i < count; i++) {
+        for (int c = 0; c < channels; c++) {
+            float v = std::min(std::max(level[i * 4 + c], 0.0f), 1.0f);
+            out[i * channels + c] = (srgb && c < colors) ? linearToSrgb[(int)(v * LINEAR_STEPS + 0.5f)]
+                : (unsigned char)(v * 255.0f + 0.5f);
+        }
+    }
+}
+
+static void boxFilter(const float* src, int width, int height, float* dst, int dstWidth, int dstHeight) {
+    for (int y = 0; y < dstHeight; y++) {
+        const float* row0 = src + (size_t)std::min(y * 2, height - 1) * width * 4;
+        const float* row1 = src + (size_t)std::min(y * 2 + 1, height - 1) * width * 4;
+        float* out = dst + (size_t)y * dstWidth * 4;
+        int x = 0;
+#if MIP_AVX2
+        // Two destination texels per iteration while all four source columns exist
+        const __m256 quarter8 = _mm256_set1_ps(0.25f);
+        for (; x + 1 < dstWidth && x * 2 + 3 < width; x += 2) {
+            __m256 a = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 8), _mm256_loadu_ps(row1 + x * 8));
+            __m256 b = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 8 + 8), _mm256_loadu_ps(row1 + x * 8 + 8));
+            __m256 even = _mm256_permute2f128_ps(a, b, 0x20);
+            __m256 odd = _mm256_permute2f128_ps(a, b, 0x31);
+            _mm256_storeu_ps(out + x * 4, _mm256_mul_ps(_mm256_add_ps(even, odd), quarter8));
+        }
+#endif
+        for (; x < dstWidth; x++) {
+            int x0 = std::min(x * 2, width - 1) * 4;
+            int x1 = std::min(x * 2 + 1, width - 1) * 4;
+#if MIP_SSE2
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+                _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+            _mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+            for (int c = 0; c < 4; c++)
+                out[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+#endif
+        }
+    }
+}
+
+// Separable: columns are filtered into scratch (dstWidth x height), then rows.
+static void kaiserFilter(const float* src, int width, int height, float* dst, int dstWidth, int dstHeight,
+    std::vector<float>& scratch) {
+    scratch.resize((size_t)dstWidth * height * 4);
+
+    for (int y = 0; y < height; y++) {
+        const float* row = src + (size_t)y * width * 4;
+        float* out = &scratch[(size_t)y * dstWidth * 4];
+        for (int x = 0; x < dstWidth; x++) {
+#if MIP_SSE2
+            __m128 sum = _mm_setzero_ps();
+            for (int k = 0; k < KAISER_TAPS; k++) {
+                int sx = std::min(std::max(x * 2 + k - 5, 0), width - 1);
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + sx * 4), _mm_set1_ps(kaiserWeights[k])));
+            }
+            _mm_storeu_ps(out + x * 4, sum);
+#else
+            float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for (int k = 0; k < KAISER_TAPS; k++) {
+                int sx = std::min(std::max(x * 2 + k - 5, 0), width - 1);
+                for (int c = 0; c < 4; c++)
+                    sum[c] += row[sx * 4 + c] * kaiserWeights[k];
+            }
+            for (int c = 0; c < 4; c++)
+                out[x * 4 + c] = sum[c];
+#endif
+        }
+    }
+
+    int rowFloats = dstWidth * 4;
+    for (int y = 0; y < dstHeight; y++) {
+        const float* rows[KAISER_TAPS];
+        for (int k = 0; k < KAISER_TAPS; k++)
+            rows[k] = &scratch[(size_t)std::min(std::max(y * 2 + k - 5, 0), height - 1) * rowFloats];
+        float* out = dst + (size_t)y * rowFloats;
+        int i = 0;
+#if MIP_AVX2
+        for (; i + 8 <= rowFloats; i += 8) {
+            __m256 sum = _mm256_setzero_ps();
+            for (int k = 0; k < KAISER_TAPS; k++)
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(rows[k] + i), _mm256_set1_ps(kaiserWeights[k])));
+            _mm256_storeu_ps(out + i, sum);
+        }
+#endif
+#if MIP_SSE2
+        for (; i + 4 <= rowFloats; i += 4) {
+            __m128 sum = _mm_setzero_ps();
+            for (int k = 0; k < KAISER_TAPS; k++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[k] + i), _mm_set1_ps(kaiserWeights[k])));
+            _mm_storeu_ps(out + i, sum);
+        }
+#endif
+        for (; i < rowFloats; i++) {
+            float sum = 0.0f;
+            for (int k = 0; k < KAISER_TAPS; k++)
+                sum += rows[k][i] * kaiserWeights[k];
+            out[i] = sum;
+        }
+    }
+}
+
+void buildMips(const unsigned char* pixels, int width, int height, int channels,
+    const MipOptions& options, std::vector<MipLevel>& levels) {
+    std::call_once(tablesBuilt, buildTables);
+
+    std::vector<float> current, next, scratch;
+    toLinear(pixels, width, height, channels, options.srgb, current);
+    while (width > 1 || height > 1) {
+        int nextWidth = std::max(1, width / 2);
+        int nextHeight = std::max(1, height / 2);
+        next.resize((size_t)nextWidth * nextHeight * 4);
+        if (options.filter == MipFilter::Kaiser)
+            kaiserFilter(current.data(), width, height, next.data(), nextWidth, nextHeight, scratch);
+        else
+            boxFilter(current.data(), width, height, next.data(), nextWidth, nextHeight);
+
+        levels.push_back({ nextWidth, nextHeight, {} });
+        fromLinear(next, channels, options.srgb, levels.back().pixels);
+        current.swap(next);
+        width = nextWidth;
+        height = nextHeight;
+    }
+}
+
+void buildMips(std::vector<MipJob>& jobs, const MipOptions& options, int threadCount) {
+    if (threadCount <= 0)
+        threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+    threadCount = std::min(threadCount, (int)jobs.size());
+
+    std::atomic<int> nextJob(0);
+    auto worker = [&]() {
+        for (int i = nextJob++; i < (int)jobs.size(); i = nextJob++)
+            buildMips(jobs[i].pixels, jobs[i].width, jobs[i].height, jobs[i].channels, options, jobs[i].levels);
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+const char* mipBuilderPath() {
+#if MIP_AVX2
+    return "AVX2";
+#elif MIP_SSE2
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,48 @@
+#ifndef MIP_BUILDER_H
+#define MIP_BUILDER_H
+
+#include <vector>
+
+// How each level is filtered from the one above it. Box averages 2x2 texels;
+// Kaiser is a windowed sinc over 12x12 texels that keeps more detail in
+// distant surfaces at the cost of slight ringing.
+enum class MipFilter {
+    Box,
+    Kaiser
+};
+
+struct MipOptions {
+    MipFilter filter = MipFilter::Box;
+    // Colour channels are decoded from sRGB before filtering and re-encoded
+    // after, so averaging does not darken detailed textures. Alpha is always
+    // filtered as stored.
+    bool srgb = true;
+};
+
+struct MipLevel {
+    int width, height;
+    std::vector<unsigned char> pixels;  // Same channel count as the source
+};
+
+// Builds every level below the source image (1 to 4 channels, 8 bits each)
+// down to 1x1 and appends them to levels. Levels are filtered in floating
+// point from the level above, not from its rounded bytes. Each level is
+// max(1, size / 2), like GL's, so the box filter drops an odd last row or column.
+void buildMips(const unsigned char* pixels, int width, int height, int channels,
+    const MipOptions& options, std::vector<MipLevel>& levels);
+
+struct MipJob {
+    const unsigned char* pixels;
+    int width, height, channels;
+    std::vector<MipLevel> levels;
+};
+
+// Builds the chains of several images at once, an image per thread
+// (0 threads uses every core).
+void buildMips(std::vector<MipJob>& jobs, const MipOptions& options, int threadCount = 0);
+
+// The instruction set the filters were compiled for: "AVX2", "SSE2" or
+// "scalar". Define MIP_BUILDER_SCALAR to force the portable path.
+const char* mipBuilderPath();
+
+#endif
@@ -0,0 +1,158 @@
+#include "RenderQueue.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+
+static const uint32_t NONE = 0xFFFFFFFF;
+
+uint32_t RenderQueue::addPipeline(unsigned int program, std::function<void()> apply) {
+    pipelines.push_back({ program, std::move(apply), glGetUniformLocation(program, "boundsMin"),
+        glGetUniformLocation(program, "boundsSize") });
+    return (uint32_t)pipelines.size() - 1;
+}
+
+void RenderQueue::clear() {
+    geometries.clear();
+    geometryIds.clear();
+    materials.clear();
+    packets.clear();
+}
+
+uint32_t RenderQueue::geometry(unsigned int vertexArray) {
+    std::pair<std::unordered_map<unsigned int, uint32_t>::iterator, bool> added =
+        geometryIds.emplace(vertexArray, (uint32_t)geometries.size());
+    if (added.second)
+        geometries.push_back({ vertexArray, false, glm::vec3(0.0f), glm::vec3(0.0f) });
+    return added.first->second;
+}
+
+uint32_t RenderQueue::geometry(unsigned int vertexArray, const glm::vec3& boundsMin, const glm::vec3& boundsSize) {
+    std::pair<std::unordered_map<unsigned int, uint32_t>::iterator, bool> added =
+        geometryIds.emplace(vertexArray, (uint32_t)geometries.size());
+    if (added.second)
+        geometries.push_back({ vertexArray, true, boundsMin, boundsSize });
+    return added.first->second;
+}
+
+uint32_t RenderQueue::material(const Material& textures) {
+    materials.push_back(textures);
+    return (uint32_t)materials.size() - 1;
+}
+
+void RenderQueue::add(const Packet& packet) {
+    packets.push_back(packet);
+}
+
+uint64_t RenderQueue::keyOf(const Packet& packet) const {
+    float fraction = std::min(std::max(packet.depth / depthRange, 0.0f), 1.0f);
+    uint64_t depth = (uint64_t)std::lround(fraction * 65535.0f);
+    return ((uint64_t)(packet.pass & 0xF) << 60) | ((uint64_t)(packet.pipeline & 0xFF) << 52) |
+        ((uint64_t)(packet.geometry & 0xFFF) << 40) | ((uint64_t)(packet.material & 0xFFFF) << 24) | (depth << 8);
+}
+
+// Stable, a byte at a time from the lowest; a byte every key shares is
+// skipped, which for a frame's packets is most of them
+void RenderQueue::sort() {
+    size_t count = entries.size();
+    uint32_t histograms[8][256] = {};
+    for (const Entry& entry : entries) {
+        for (int b = 0; b < 8; b++)
+            histograms[b][(entry.key >> (b * 8)) & 0xFF]++;
+    }
+    scratch.resize(count);
+    for (int b = 0; b < 8; b++) {
+        uint32_t* histogram = histograms[b];
+        if (histogram[(entries[0].key >> (b * 8)) & 0xFF] == count)
+            continue;
+        uint32_t offset = 0;
+        for (int digit = 0; digit < 256; digit++) {
+            uint32_t size = histogram[digit];
+            histogram[digit] = offset;
+            offset += size;
+        }
+        for (const Entry& entry : entries)
+            scratch[histogram[(entry.key >> (b * 8)) & 0xFF]++] = entry;
+        entries.swap(scratch);
+    }
+}
+
+int RenderQueue::execute() {
+    stats = Counters();
+    stats.packets = (int)packets.size();
+    if (packets.empty())
+        return 0;
+    entries.resize(packets.size());
+    for (size_t i = 0; i < packets.size(); i++)
+        entries[i] = { keyOf(packets[i]), (uint32_t)i };
+    sort();
+
+    // Other code binds textures and vertex arrays between frames, so nothing
+    // is taken to be bound yet
+    unsigned int program = 0;
+    uint32_t pipeline = NONE, geometry = NONE;
+    unsigned int vertexArray = 0;
+    bool vertexArrayKnown = false;
+    unsigned int textures[MAX_UNITS];
+    bool texturesKnown[MAX_UNITS] = {};
+    int activeUnit = -1;
+    for (const Entry& entry : entries) {
+        const Packet& packet = packets[entry.packet];
+        if (packet.pipeline != pipeline) {
+            const Pipeline& next = pipelines[packet.pipeline];
+            if (next.program != program) {
+                glUseProgram(next.program);
+                program = next.program;
+                stats.programChanges++;
+            }
+            if (next.apply)
+                next.apply();
+            pipeline = packet.pipeline;
+            geometry = NONE;    // Its bounds uniforms may not be set yet
+            stats.pipelineChanges++;
+        }
+        if (packet.geometry != geometry) {
+            const Geometry& next = geometries[packet.geometry];
+            if (!vertexArrayKnown || next.vertexArray != vertexArray) {
+                glBindVertexArray(next.vertexArray);
+                vertexArray = next.vertexArray;
+                vertexArrayKnown = true;
+            }
+            if (next.bounded) {
+                const Pipeline& current = pipelines[pipeline];
+                glUniform3fv(current.boundsMinLoc, 1, &next.boundsMin.x);
+                glUniform3fv(current.boundsSizeLoc, 1, &next.boundsSize.x);
+            }
+            geometry = packet.geometry;
+            stats.geometryChanges++;
+        }
+        const Material& material = materials[packet.material];
+        for (int unit = 0; unit < MAX_UNITS; unit++) {
+            unsigned int texture = material.textures[unit];
+            if (texture == 0 || (texturesKnown[unit] && textures[unit] == texture))
+                continue;
+            if (activeUnit != unit) {
+                glActiveTexture(GL_TEXTURE0 + unit);
+                activeUnit = unit;
+            }
+            glBindTexture(material.targets[unit], texture);
+            textures[unit] = texture;
+            texturesKnown[unit] = true;
+            stats.textureChanges++;
+        }
+
+        if (packet.submit) {
+            stats.drawCalls += packet.submit(packet.context);
+            // It may have bound a vertex array of its own
+            vertexArrayKnown = false;
+            geometry = NONE;
+        }
+        else {
+            glDrawElements(GL_TRIANGLES, (GLsizei)packet.indexCount, GL_UNSIGNED_INT,
+                (void*)((size_t)packet.firstIndex * sizeof(uint32_t)));
+            stats.drawCalls++;
+        }
+    }
+    if (activeUnit > 0)
+        glActiveTexture(GL_TEXTURE0);
+    return stats.drawCalls;
+}
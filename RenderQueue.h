@@ -0,0 +1,117 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+// A frame's draws, submitted in any order as small packets and issued sorted
+// by a 64-bit key, so GL state changes only where it must. A packet names its
+// state by ids: a pipeline (a program and the uniforms it is drawn with,
+// registered once), a geometry (a vertex array and the bounds its positions
+// are fractions of) and a material (textures by unit), the last two looked up
+// each frame. The key orders packets by pass, then by the state that costs
+// most to change, then by distance, nearest first:
+//
+//   bits 63-60 pass | 59-52 pipeline | 51-40 geometry | 39-24 material | 23-8 depth
+//
+// Keys are sorted with an LSD radix sort, a byte at a time, skipping bytes
+// every key shares. Ids too large for their field only sort less well: state
+// is compared by id when packets are issued, not by key.
+class RenderQueue {
+public:
+    // Texture units a material can bind
+    static const int MAX_UNITS = 4;
+
+    // Textures by unit; 0 leaves the unit as it is
+    struct Material {
+        unsigned int textures[MAX_UNITS];
+        unsigned int targets[MAX_UNITS];    // GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY...
+    };
+
+    struct Packet {
+        int pass;               // Passes are drawn in increasing order
+        uint32_t pipeline;      // From addPipeline()
+        uint32_t geometry;      // From geometry()
+        uint32_t material;      // From material()
+        float depth;            // Distance from the camera
+        // The draw: indexCount indices from firstIndex (as 32-bit indices),
+        // or, when submit is set, whatever it issues with the state bound,
+        // returning its number of draw calls
+        uint32_t indexCount, firstIndex;
+        int (*submit)(void* context);
+        void* context;
+    };
+
+    struct Counters {
+        int packets;
+        int drawCalls;
+        int programChanges;     // glUseProgram calls
+        int pipelineChanges;    // Uniforms applied for a pipeline
+        int geometryChanges;    // Vertex arrays bound, or bounds set
+        int textureChanges;     // glBindTexture calls
+    };
+
+    // A program and a function setting the uniforms it takes for this
+    // pipeline, called when a packet using it follows one that does not.
+    // Geometry bounds go to its boundsMin and boundsSize uniforms.
+    uint32_t addPipeline(unsigned int program, std::function<void()> apply);
+
+    // Forgets the last frame's packets, geometries and materials.
+    void clear();
+
+    // The id of a vertex array for this frame, with or without the bounds its
+    // positions are fractions of. A vertex array keeps the id (and bounds) it
+    // was first given.
+    uint32_t geometry(unsigned int vertexArray);
+    uint32_t geometry(unsigned int vertexArray, const glm::vec3& boundsMin, const glm::vec3& boundsSize);
+
+    // A new id for a set of textures for this frame; packets sharing textures
+    // should share the id, though textures already bound are not bound again
+    // either way.
+    uint32_t material(const Material& textures);
+
+    void add(const Packet& packet);
+
+    // Sorts the packets since clear() and issues them; returns the number of
+    // draw calls made.
+    int execute();
+
+    const Counters& counters() const { return stats; }
+
+    // Distance mapped to the far end of the depth field
+    float depthRange = 100.0f;
+
+private:
+    struct Pipeline {
+        unsigned int program;
+        std::function<void()> apply;
+        int boundsMinLoc, boundsSizeLoc;
+    };
+
+    struct Geometry {
+        unsigned int vertexArray;
+        bool bounded;
+        glm::vec3 boundsMin, boundsSize;
+    };
+
+    struct Entry {
+        uint64_t key;
+        uint32_t packet;
+    };
+
+    uint64_t keyOf(const Packet& packet) const;
+    void sort();
+
+    std::vector<Pipeline> pipelines;
+    std::vector<Geometry> geometries;
+    std::vector<Material> materials;
+    std::unordered_map<unsigned int, uint32_t> geometryIds;     // By vertex array
+    std::vector<Packet> packets;
+    std::vector<Entry> entries, scratch;
+    Counters stats = {};
+};
+
+#endif
@@ -0,0 +1,381 @@
+#include "Scene.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+static const uint32_t SCENE_FILE_VERSION = 3;
+
+static bool sourceStamp(const std::string& path, uint64_t& size, int64_t& time) {
+    std::error_code error;
+    size = (uint64_t)fs::file_size(path, error);
+    if (error)
+        return false;
+    time = (int64_t)fs::last_write_time(path, error).time_since_epoch().count();
+    return !error;
+}
+
+std::string sceneCachePath(const std::string& sourcePath) {
+    fs::path path = fs::path("cache") / fs::path(sourcePath).relative_path();
+    path += ".gscene";
+    return path.string();
+}
+
+// Splits a line into words. "Quoted words" may hold spaces; # starts a comment.
+static std::vector<std::string> splitLine(const std::string& line) {
+    std::vector<std::string> words;
+    size_t i = 0;
+    while (i < line.size()) {
+        char c = line[i];
+        if (c == '#')
+            break;
+        if (c == ' ' || c == '\t' || c == '\r') {
+            i++;
+            continue;
+        }
+        std::string word;
+        if (c == '"') {
+            size_t end = line.find('"', i + 1);
+            if (end == std::string::npos)
+                end = line.size();
+            word = line.substr(i + 1, end - i - 1);
+            i = end + 1;
+        }
+        else {
+            while (i < line.size() && line[i] != ' ' && line[i] != '\t' && line[i] != '\r' && line[i] != '#')
+                word += line[i++];
+        }
+        words.push_back(word);
+    }
+    return words;
+}
+
+static bool parseNumbers(const std::vector<std::string>& words, size_t first, size_t count, float* out) {
+    if (first + count > words.size())
+        return false;
+    for (size_t i = 0; i < count; i++) {
+        const char* text = words[first + i].c_str();
+        char* end;
+        out[i] = strtof(text, &end);
+        if (end == text || *end != '\0' || !std::isfinite(out[i]))
+            return false;
+    }
+    return true;
+}
+
+template <typename T>
+static void place(std::vector<unsigned char>& compiled, uint64_t offset, const std::vector<T>& records) {
+    if (!records.empty())
+        memcpy(compiled.data() + offset, records.data(), records.size() * sizeof(T));
+}
+
+bool compileScene(const std::string& sourcePath, std::vector<unsigned char>& compiled) {
+    std::ifstream in(sourcePath);
+    if (!in) {
+        std::cerr << "Failed to load scene: " << sourcePath << std::endl;
+        return false;
+    }
+
+    std::vector<SceneRoom> rooms;
+    std::vector<SceneWall> walls;
+    std::vector<SceneArtwork> artworks;
+    std::vector<SceneStand> stands;
+    std::vector<SceneLight> lights;
+    std::vector<SceneDoor> doors;
+    std::vector<SceneSculpture> sculptures;
+    std::vector<int> doorLines;
+    std::unordered_map<std::string, uint32_t> wallsByName;
+    std::string strings;
+    std::unordered_map<std::string, uint32_t> stringOffsets;
+    auto addString = [&](const std::string& text) {
+        std::unordered_map<std::string, uint32_t>::iterator found = stringOffsets.find(text);
+        if (found != stringOffsets.end())
+            return found->second;
+        uint32_t offset = (uint32_t)strings.size();
+        strings += text;
+        strings += '\0';
+        stringOffsets[text] = offset;
+        return offset;
+    };
+
+    bool ok = true;
+    int lineNumber = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        std::vector<std::string> words = splitLine(line);
+        if (words.empty())
+            continue;
+        auto fail = [&](const std::string& message) {
+            std::cerr << sourcePath << ":" << lineNumber << ": " << message << std::endl;
+            ok = false;
+        };
+
+        const std::string& kind = words[0];
+        float n[11];
+        if (kind == "room") {
+            if (words.size() != 10 || !parseNumbers(words, 1, 7, n)) {
+                fail("expected room <min x> <min z> <max x> <max z> <floor y> <ceiling y> <tile size> <floor> <ceiling>");
+                continue;
+            }
+            SceneRoom room = { n[0], n[1], n[2], n[3], n[4], n[5], n[6], addString(words[8]), addString(words[9]) };
+            rooms.push_back(room);
+        }
+        else if (kind == "wall") {
+            if (words.size() != 8 || !parseNumbers(words, 2, 5, n) || n[4] < 1.0f) {
+                fail("expected wall <name> <x0> <z0> <x1> <z1> <segments> <material>");
+                continue;
+            }
+            if (rooms.empty()) {
+                fail("wall before any room");
+                continue;
+            }
+            if (wallsByName.count(words[1]) || std::hypot(n[2] - n[0], n[3] - n[1]) <= 0.0f) {
+                fail("wall " + words[1] + " is already defined or has no length");
+                continue;
+            }
+            const SceneRoom& room = rooms.back();
+            SceneWall wall = { n[0], n[1], n[2], n[3], room.floorY, room.ceilingY, (uint32_t)n[4],
+                addString(words[7]), (uint32_t)rooms.size() - 1 };
+            wallsByName[words[1]] = (uint32_t)walls.size();
+            walls.push_back(wall);
+        }
+        else if (kind == "artwork") {
+            if (words.size() != 7 || !parseNumbers(words, 3, 4, n)) {
+                fail("expected artwork <image> <wall> <distance along wall> <centre height> <width> <height>");
+                continue;
+            }
+            std::unordered_map<std::string, uint32_t>::iterator wallIndex = wallsByName.find(words[2]);
+            if (wallIndex == wallsByName.end()) {
+                fail("no wall named " + words[2]);
+                continue;
+            }
+            const SceneWall& wall = walls[wallIndex->second];
+            float length = std::hypot(wall.x1 - wall.x0, wall.z1 - wall.z0);
+            float dx = (wall.x1 - wall.x0) / length, dz = (wall.z1 - wall.z0) / length;
+            if (n[0] - n[2] * 0.5f < -1e-4f || n[0] + n[2] * 0.5f > length + 1e-4f)
+                std::cerr << sourcePath << ":" << lineNumber << ": " << words[1] << " overhangs its wall" << std::endl;
+            SceneArtwork artwork = {
+                { wall.x0 + dx * n[0], wall.bottom + n[1], wall.z0 + dz * n[0] },
+                { dx, 0.0f, dz },
+                { -dz, 0.0f, dx },
+                n[2], n[3], addString(words[1]), wallIndex->second
+            };
+            artworks.push_back(artwork);
+        }
+        else if (kind == "door") {
+            if (words.size() != 5 || !parseNumbers(words, 2, 3, n) || n[1] <= 0.0f || n[2] <= 0.0f) {
+                fail("expected door <wall> <distance along wall> <width> <height>");
+                continue;
+            }
+            std::unordered_map<std::string, uint32_t>::iterator wallIndex = wallsByName.find(words[1]);
+            if (wallIndex == wallsByName.end()) {
+                fail("no wall named " + words[1]);
+                continue;
+            }
+            const SceneWall& wall = walls[wallIndex->second];
+            float length = std::hypot(wall.x1 - wall.x0, wall.z1 - wall.z0);
+            float dx = (wall.x1 - wall.x0) / length, dz = (wall.z1 - wall.z0) / length;
+            float from = n[0] - n[1] * 0.5f, to = n[0] + n[1] * 0.5f;
+            if (from < -1e-4f || to > length + 1e-4f || wall.bottom + n[2] > wall.top + 1e-4f) {
+                fail("door does not fit in wall " + words[1]);
+                continue;
+            }
+            // The room behind is found once every room is known
+            SceneDoor door = {
+                wall.x0 + dx * from, wall.z0 + dz * from, wall.x0 + dx * to, wall.z0 + dz * to,
+                wall.bottom, wall.bottom + n[2], wallIndex->second, { wall.room, 0 }
+            };
+            doors.push_back(door);
+            doorLines.push_back(lineNumber);
+        }
+        else if (kind == "stand") {
+            bool display = words.size() == 13;
+            if ((words.size() != 8 && !display) || !parseNumbers(words, 1, 6, n) ||
+                (display && !parseNumbers(words, 9, 4, n + 6))) {
+                fail("expected stand <x> <y> <z> <width> <height> <depth> <material> "
+                    "[<image> <width> <height> <bottom> <spin>]");
+                continue;
+            }
+            SceneStand stand = {
+                { n[0], n[1], n[2] }, { n[3], n[4], n[5] }, addString(words[7]),
+                display ? addString(words[8]) : Scene::NO_STRING,
+                display ? n[6] : 0.0f, display ? n[7] : 0.0f, display ? n[8] : 0.0f, display ? n[9] : 0.0f
+            };
+            stands.push_back(stand);
+        }
+        else if (kind == "sculpture") {
+            if (words.size() != 8 || !parseNumbers(words, 1, 5, n)) {
+                fail("expected sculpture <x> <y> <z> <scale> <turn> <mesh> <material>");
+                continue;
+            }
+            if (n[3] <= 0.0f) {
+                fail("sculpture scale must be above 0");
+                continue;
+            }
+            SceneSculpture sculpture = { { n[0], n[1], n[2] }, n[3], n[4], addString(words[6]), addString(words[7]) };
+            sculptures.push_back(sculpture);
+        }
+        else if (kind == "light") {
+            if (words.size() != 7 || !parseNumbers(words, 1, 6, n)) {
+                fail("expected light <x> <y> <z> <red> <green> <blue>");
+                continue;
+            }
+            SceneLight light = { { n[0], n[1], n[2] }, { n[3], n[4], n[5] } };
+            lights.push_back(light);
+        }
+        else {
+            fail("unknown entry " + kind);
+        }
+    }
+
+    // A door leads to the room just behind the middle of it
+    for (size_t i = 0; i < doors.size(); i++) {
+        SceneDoor& door = doors[i];
+        const SceneWall& wall = walls[door.wall];
+        float length = std::hypot(wall.x1 - wall.x0, wall.z1 - wall.z0);
+        float x = (door.x0 + door.x1) * 0.5f + (wall.z1 - wall.z0) / length * 0.05f;
+        float z = (door.z0 + door.z1) * 0.5f - (wall.x1 - wall.x0) / length * 0.05f;
+        door.rooms[1] = door.rooms[0];
+        for (uint32_t r = 0; r < rooms.size() && door.rooms[1] == door.rooms[0]; r++) {
+            const SceneRoom& room = rooms[r];
+            if (r != door.rooms[0] && x >= room.minX && x <= room.maxX && z >= room.minZ && z <= room.maxZ)
+                door.rooms[1] = r;
+        }
+        if (door.rooms[1] == door.rooms[0]) {
+            std::cerr << sourcePath << ":" << doorLines[i] << ": door leads to no other room" << std::endl;
+            ok = false;
+        }
+    }
+    if (!ok)
+        return false;
+
+    SceneFileHeader header = {};
+    memcpy(header.magic, "GSCN", 4);
+    header.version = SCENE_FILE_VERSION;
+    header.roomCount = (uint32_t)rooms.size();
+    header.wallCount = (uint32_t)walls.size();
+    header.artworkCount = (uint32_t)artworks.size();
+    header.standCount = (uint32_t)stands.size();
+    header.lightCount = (uint32_t)lights.size();
+    header.doorCount = (uint32_t)doors.size();
+    header.sculptureCount = (uint32_t)sculptures.size();
+    sourceStamp(sourcePath, header.sourceSize, header.sourceTime);
+
+    // Each array starts on an 8-byte boundary
+    uint64_t offset = sizeof(SceneFileHeader);
+    auto reserve = [&offset](size_t bytes) {
+        offset = (offset + 7) & ~(uint64_t)7;
+        uint64_t start = offset;
+        offset += bytes;
+        return start;
+    };
+    header.roomsOffset = reserve(rooms.size() * sizeof(SceneRoom));
+    header.wallsOffset = reserve(walls.size() * sizeof(SceneWall));
+    header.artworksOffset = reserve(artworks.size() * sizeof(SceneArtwork));
+    header.standsOffset = reserve(stands.size() * sizeof(SceneStand));
+    header.lightsOffset = reserve(lights.size() * sizeof(SceneLight));
+    header.doorsOffset = reserve(doors.size() * sizeof(SceneDoor));
+    header.sculpturesOffset = reserve(sculptures.size() * sizeof(SceneSculpture));
+    header.stringsOffset = reserve(strings.size());
+    header.stringsSize = strings.size();
+
+    compiled.assign(offset, 0);
+    memcpy(compiled.data(), &header, sizeof(header));
+    place(compiled, header.roomsOffset, rooms);
+    place(compiled, header.wallsOffset, walls);
+    place(compiled, header.artworksOffset, artworks);
+    place(compiled, header.standsOffset, stands);
+    place(compiled, header.lightsOffset, lights);
+    place(compiled, header.doorsOffset, doors);
+    place(compiled, header.sculpturesOffset, sculptures);
+    if (!strings.empty())
+        memcpy(compiled.data() + header.stringsOffset, strings.data(), strings.size());
+    return true;
+}
+
+// Checks that every array and every reference lies inside the data before
+// any of it is used.
+bool Scene::use(const unsigned char* data, size_t size) {
+    bytes = nullptr;
+    if (size < sizeof(SceneFileHeader))
+        return false;
+    const SceneFileHeader& h = *(const SceneFileHeader*)data;
+    if (memcmp(h.magic, "GSCN", 4) != 0 || h.version != SCENE_FILE_VERSION)
+        return false;
+
+    auto fits = [size](uint64_t offset, uint64_t count, size_t recordSize) {
+        return offset % 8 == 0 && offset <= size && count <= (size - offset) / recordSize;
+    };
+    if (!fits(h.roomsOffset, h.roomCount, sizeof(SceneRoom)) || !fits(h.wallsOffset, h.wallCount, sizeof(SceneWall)) ||
+        !fits(h.artworksOffset, h.artworkCount, sizeof(SceneArtwork)) ||
+        !fits(h.standsOffset, h.standCount, sizeof(SceneStand)) ||
+        !fits(h.lightsOffset, h.lightCount, sizeof(SceneLight)) || !fits(h.doorsOffset, h.doorCount, sizeof(SceneDoor)) ||
+        !fits(h.sculpturesOffset, h.sculptureCount, sizeof(SceneSculpture)) ||
+        !fits(h.stringsOffset, h.stringsSize, 1) ||
+        (h.stringsSize > 0 && data[h.stringsOffset + h.stringsSize - 1] != '\0'))
+        return false;
+
+    bytes = data;
+    bool valid = true;
+    auto validString = [&h](uint32_t offset) { return offset < h.stringsSize; };
+    for (uint32_t i = 0; i < h.roomCount; i++)
+        valid = valid && validString(rooms()[i].floorMaterial) && validString(rooms()[i].ceilingMaterial);
+    for (uint32_t i = 0; i < h.wallCount; i++)
+        valid = valid && validString(walls()[i].material) && walls()[i].room < h.roomCount && walls()[i].segments > 0;
+    for (uint32_t i = 0; i < h.artworkCount; i++)
+        valid = valid && validString(artworks()[i].image) && artworks()[i].wall < h.wallCount;
+    for (uint32_t i = 0; i < h.standCount; i++)
+        valid = valid && validString(stands()[i].material) &&
+            (stands()[i].display == NO_STRING || validString(stands()[i].display));
+    for (uint32_t i = 0; i < h.sculptureCount; i++)
+        valid = valid && validString(sculptures()[i].mesh) && validString(sculptures()[i].material);
+    for (uint32_t i = 0; i < h.doorCount; i++)
+        valid = valid && doors()[i].wall < h.wallCount && doors()[i].rooms[0] < h.roomCount &&
+            doors()[i].rooms[1] < h.roomCount;
+    if (!valid)
+        bytes = nullptr;
+    return valid;
+}
+
+bool Scene::load(const std::string& path) {
+    if (fs::path(path).extension() == ".gscene") {
+        if (file.open(path) && use(file.data(), file.size()))
+            return true;
+        std::cerr << "Failed to load scene: " << path << std::endl;
+        return false;
+    }
+
+    // The compiled copy, unless the text has changed since
+    std::string cachePath = sceneCachePath(path);
+    uint64_t size;
+    int64_t time;
+    bool haveSource = sourceStamp(path, size, time);
+    if (file.open(cachePath) && use(file.data(), file.size()) &&
+        (!haveSource || (header().sourceSize == size && header().sourceTime == time)))
+        return true;
+    file.close();
+    bytes = nullptr;
+
+    std::vector<unsigned char> fresh;
+    if (!compileScene(path, fresh))
+        return false;
+
+    std::error_code error;
+    fs::create_directories(fs::path(cachePath).parent_path(), error);
+    {
+        std::ofstream out(cachePath, std::ios::binary | std::ios::trunc);
+        out.write((const char*)fresh.data(), fresh.size());
+    }
+    if (file.open(cachePath) && file.size() == fresh.size() && use(file.data(), file.size()))
+        return true;
+    file.close();
+
+    compiled = std::move(fresh);
+    return use(compiled.data(), compiled.size());
+}
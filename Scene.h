@@ -0,0 +1,142 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "MappedFile.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk layout of a compiled scene (.gscene): this header, then each record
+// array at its offset, then a table of NUL-terminated strings (texture paths)
+// that records refer to by offset. Records hold only floats and 32-bit
+// integers, so a mapped file is used as it is, without parsing.
+struct SceneFileHeader {
+    char magic[4];          // "GSCN"
+    uint32_t version;
+    uint32_t roomCount;
+    uint32_t wallCount;
+    uint32_t artworkCount;
+    uint32_t standCount;
+    uint32_t lightCount;
+    uint32_t doorCount;
+    uint32_t sculptureCount;
+    uint32_t reserved;
+    uint64_t roomsOffset;
+    uint64_t wallsOffset;
+    uint64_t artworksOffset;
+    uint64_t standsOffset;
+    uint64_t lightsOffset;
+    uint64_t doorsOffset;
+    uint64_t sculpturesOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t sourceSize;    // Size and timestamp of the text it was compiled
+    int64_t sourceTime;     // from, used to spot stale copies
+};
+
+// Floor and ceiling of a rectangular room; its walls are listed separately.
+struct SceneRoom {
+    float minX, minZ, maxX, maxZ;
+    float floorY, ceilingY;
+    float tileSize;         // World units per repeat of the floor and ceiling textures
+    uint32_t floorMaterial; // String offsets
+    uint32_t ceilingMaterial;
+};
+
+// A straight wall from (x0, z0) to (x1, z1) between its room's floor and
+// ceiling, split into segments that each show the material once. It faces the
+// side on the right when walking from start to end.
+struct SceneWall {
+    float x0, z0, x1, z1;
+    float bottom, top;
+    uint32_t segments;
+    uint32_t material;
+    uint32_t room;
+};
+
+// A painting on a wall, resolved to world space: its centre on the wall's
+// surface, the unit vector along its width (image u) and the way it faces.
+struct SceneArtwork {
+    float center[3];
+    float right[3];
+    float normal[3];
+    float width, height;
+    uint32_t image;
+    uint32_t wall;
+};
+
+// A box standing on the floor, optionally with an image spinning above it.
+struct SceneStand {
+    float position[3];      // Centre of the base
+    float size[3];
+    uint32_t material;
+    uint32_t display;       // Image shown above it, or Scene::NO_STRING
+    float displayWidth, displayHeight;
+    float displayBottom;    // Above the base
+    float spin;             // Degrees per second about the vertical
+};
+
+struct SceneLight {
+    float position[3];
+    float color[3];
+};
+
+// A doorway cut into a wall from its bottom up to top, joining the wall's room
+// to the room behind it.
+struct SceneDoor {
+    float x0, z0, x1, z1;   // Its span on the floor plan, in the wall's direction
+    float bottom, top;
+    uint32_t wall;
+    uint32_t rooms[2];      // The wall's room, then the one behind the wall
+};
+
+// A mesh (see CookedMesh.h) standing in a room: its origin at position,
+// turned about the vertical and scaled the same along every axis, with its
+// uvs into one material.
+struct SceneSculpture {
+    float position[3];
+    float scale;
+    float turn;             // Degrees
+    uint32_t mesh;          // String offsets: the OBJ, glTF or .gmesh file
+    uint32_t material;
+};
+
+// A gallery layout: rooms, walls and the doors through them, hung artworks,
+// stands, sculptures and lights. Written as text (see gallery.scene for the syntax) and
+// compiled to the binary form above, which is cached in cache/ like cooked
+// textures.
+class Scene {
+public:
+    static const uint32_t NO_STRING = 0xFFFFFFFF;
+
+    // Loads a text scene through its compiled copy, recompiling (and
+    // rewriting the copy) when the text is newer. A .gscene path is mapped
+    // directly.
+    bool load(const std::string& path);
+
+    const SceneFileHeader& header() const { return *(const SceneFileHeader*)bytes; }
+    const SceneRoom* rooms() const { return (const SceneRoom*)(bytes + header().roomsOffset); }
+    const SceneWall* walls() const { return (const SceneWall*)(bytes + header().wallsOffset); }
+    const SceneArtwork* artworks() const { return (const SceneArtwork*)(bytes + header().artworksOffset); }
+    const SceneStand* stands() const { return (const SceneStand*)(bytes + header().standsOffset); }
+    const SceneLight* lights() const { return (const SceneLight*)(bytes + header().lightsOffset); }
+    const SceneDoor* doors() const { return (const SceneDoor*)(bytes + header().doorsOffset); }
+    const SceneSculpture* sculptures() const { return (const SceneSculpture*)(bytes + header().sculpturesOffset); }
+    const char* string(uint32_t offset) const { return (const char*)bytes + header().stringsOffset + offset; }
+
+private:
+    bool use(const unsigned char* data, size_t size);
+
+    MappedFile file;
+    std::vector<unsigned char> compiled;    // When the cache could not be written
+    const unsigned char* bytes = nullptr;
+};
+
+// Where the compiled copy of a scene lives, e.g. gallery.scene ->
+// cache/gallery.scene.gscene
+std::string sceneCachePath(const std::string& sourcePath);
+
+// Parses the text form; errors go to std::cerr with their line.
+bool compileScene(const std::string& sourcePath, std::vector<unsigned char>& compiled);
+
+#endif
@@ -0,0 +1,454 @@
+#include "SceneGeometry.h"
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+// Positions closer than this are the same point
+static const float WELD_EPSILON = 1e-4f;
+
+// Octahedral encoding: the unit sphere folded onto the square [-1, 1]^2
+static glm::vec2 octahedralEncode(const glm::vec3& normal) {
+    glm::vec3 n = normal / (std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z));
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f) {
+        glm::vec2 sign(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+        e = (1.0f - glm::abs(glm::vec2(e.y, e.x))) * sign;
+    }
+    return e;
+}
+
+static int16_t packSnorm16(float v) {
+    return (int16_t)std::lround(glm::clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+SceneVertex packSceneVertex(const glm::vec3& position, const glm::vec2& uv, const glm::vec3& normal, int layer,
+    const glm::vec3& boundsMin, const glm::vec3& boundsSize) {
+    SceneVertex packed;
+    glm::vec3 fraction = (position - boundsMin) / boundsSize;
+    for (int c = 0; c < 3; c++)
+        packed.position[c] = glm::packUnorm1x16(fraction[c]);
+    packed.layer = (int16_t)layer;
+    packed.uv[0] = glm::packHalf1x16(uv.x);
+    packed.uv[1] = glm::packHalf1x16(uv.y);
+    glm::vec2 encoded = octahedralEncode(normal);
+    packed.normal[0] = packSnorm16(encoded.x);
+    packed.normal[1] = packSnorm16(encoded.y);
+    return packed;
+}
+
+// Adds vertices and indices, reusing an earlier vertex whenever one with the
+// same position, uv, normal and layer exists (while sharing is on). Vertices
+// stay in floats until finish() packs them against the final bounds.
+class MeshBuilder {
+public:
+    explicit MeshBuilder(SceneGeometry& geometry) : geometry(geometry) {}
+
+    uint32_t vertex(const glm::vec3& position, const glm::vec2& uv, const glm::vec3& normal, float layer) {
+        Vertex v = { position, uv, normal, layer };
+        if (!share) {
+            vertices.push_back(v);
+            return (uint32_t)vertices.size() - 1;
+        }
+        std::string key = weldKey(v);
+        std::unordered_map<std::string, uint32_t>::iterator found = welded.find(key);
+        if (found != welded.end())
+            return found->second;
+        vertices.push_back(v);
+        uint32_t index = (uint32_t)vertices.size() - 1;
+        welded.emplace(key, index);
+        return index;
+    }
+
+    // Two triangles, 0-1-2 and 0-2-3. Returns false, adding nothing, when a
+    // quad with the same corners was added before.
+    bool quad(const glm::vec3 corners[4], const glm::vec2 uvs[4], const glm::vec3& normal, float layer) {
+        std::array<glm::ivec3, 4> key;
+        for (int i = 0; i < 4; i++)
+            key[i] = glm::ivec3(glm::round(corners[i] / WELD_EPSILON));
+        std::sort(key.begin(), key.end(), [](const glm::ivec3& a, const glm::ivec3& b) {
+            return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+        });
+        if (share && !quads.insert(key).second)
+            return false;
+
+        uint32_t v[4];
+        for (int i = 0; i < 4; i++)
+            v[i] = vertex(corners[i], uvs[i], normal, layer);
+        const uint32_t triangles[6] = { v[0], v[1], v[2], v[0], v[2], v[3] };
+        geometry.indices.insert(geometry.indices.end(), triangles, triangles + 6);
+        return true;
+    }
+
+    int vertexCount() const { return (int)vertices.size(); }
+
+    // Size of one position step if packing happened now
+    float positionStep() const {
+        glm::vec3 low, high;
+        bounds(low, high);
+        glm::vec3 size = high - low;
+        return std::max(size.x, std::max(size.y, size.z)) / 65535.0f;
+    }
+
+    void finish() {
+        glm::vec3 low, high;
+        bounds(low, high);
+        geometry.boundsMin = low;
+        geometry.boundsSize = glm::max(high - low, glm::vec3(1e-6f));
+        geometry.vertices.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            const Vertex& v = vertices[i];
+            geometry.vertices[i] = packSceneVertex(v.position, v.uv, v.normal, (int)v.layer, geometry.boundsMin,
+                geometry.boundsSize);
+        }
+    }
+
+    bool share = true;
+
+private:
+    struct Vertex {
+        glm::vec3 position;
+        glm::vec2 uv;
+        glm::vec3 normal;
+        float layer;
+    };
+
+    void bounds(glm::vec3& low, glm::vec3& high) const {
+        low = high = vertices.empty() ? glm::vec3(0.0f) : vertices[0].position;
+        for (const Vertex& v : vertices) {
+            low = glm::min(low, v.position);
+            high = glm::max(high, v.position);
+        }
+    }
+
+    static std::string weldKey(const Vertex& v) {
+        int32_t key[9];
+        for (int i = 0; i < 3; i++) {
+            key[i] = (int32_t)std::lround(v.position[i] / WELD_EPSILON);
+            key[3 + i] = (int32_t)std::lround(v.normal[i] / WELD_EPSILON);
+        }
+        key[6] = (int32_t)std::lround(v.uv.x / WELD_EPSILON);
+        key[7] = (int32_t)std::lround(v.uv.y / WELD_EPSILON);
+        key[8] = (int32_t)v.layer;
+        return std::string((const char*)key, sizeof(key));
+    }
+
+    struct QuadLess {
+        bool operator()(const std::array<glm::ivec3, 4>& a, const std::array<glm::ivec3, 4>& b) const {
+            return memcmp(a.data(), b.data(), sizeof(a)) < 0;
+        }
+    };
+
+    SceneGeometry& geometry;
+    std::vector<Vertex> vertices;
+    std::unordered_map<std::string, uint32_t> welded;
+    std::set<std::array<glm::ivec3, 4>, QuadLess> quads;
+};
+
+void artworkCorners(const SceneArtwork& artwork, glm::vec3 corners[4], float offset) {
+    glm::vec3 center = glm::vec3(artwork.center[0], artwork.center[1], artwork.center[2]) +
+        glm::vec3(artwork.normal[0], artwork.normal[1], artwork.normal[2]) * offset;
+    glm::vec3 right = glm::vec3(artwork.right[0], artwork.right[1], artwork.right[2]) * (artwork.width * 0.5f);
+    glm::vec3 up(0.0f, artwork.height * 0.5f, 0.0f);
+    corners[0] = center - right - up;
+    corners[1] = center + right - up;
+    corners[2] = center + right + up;
+    corners[3] = center - right + up;
+}
+
+// Whether other lies on the same plane as wall, facing either way, and
+// overlaps it; overlap is the part of wall it covers, as for a door.
+static bool wallOverlap(const SceneWall& wall, const SceneWall& other, WallOpening& overlap) {
+    glm::vec2 start(wall.x0, wall.z0), end(wall.x1, wall.z1);
+    glm::vec2 direction = end - start;
+    float length = glm::length(direction);
+    direction /= length;
+    glm::vec2 normal(-direction.y, direction.x);
+    glm::vec2 a(other.x0, other.z0), b(other.x1, other.z1);
+    if (std::fabs(glm::dot(a - start, normal)) > WELD_EPSILON || std::fabs(glm::dot(b - start, normal)) > WELD_EPSILON)
+        return false;
+    float from = glm::dot(a - start, direction), to = glm::dot(b - start, direction);
+    if (from > to)
+        std::swap(from, to);
+    overlap = { std::max(from, 0.0f), std::min(to, length), std::max(other.bottom, wall.bottom), std::min(other.top, wall.top) };
+    return overlap.to > overlap.from + WELD_EPSILON && overlap.top > overlap.bottom + WELD_EPSILON;
+}
+
+// How far the overlapped part of a wall is moved into its own room when the
+// other side of it is another room's wall of another material, so each room
+// sees its own: under the artworks' offset, so they stay in front.
+static const float SHARED_WALL_OFFSET = ARTWORK_OFFSET * 0.5f;
+
+bool doorOpening(const SceneWall& wall, const SceneDoor& door, WallOpening& opening) {
+    glm::vec2 start(wall.x0, wall.z0), end(wall.x1, wall.z1);
+    glm::vec2 direction = end - start;
+    float length = glm::length(direction);
+    direction /= length;
+    glm::vec2 normal(-direction.y, direction.x);
+    glm::vec2 a(door.x0, door.z0), b(door.x1, door.z1);
+    if (std::fabs(glm::dot(a - start, normal)) > WELD_EPSILON || std::fabs(glm::dot(b - start, normal)) > WELD_EPSILON)
+        return false;
+    float from = glm::dot(a - start, direction), to = glm::dot(b - start, direction);
+    if (from > to)
+        std::swap(from, to);
+    opening = { std::max(from, 0.0f), std::min(to, length), std::max(door.bottom, wall.bottom), std::min(door.top, wall.top) };
+    return opening.to > opening.from + WELD_EPSILON && opening.top > opening.bottom + WELD_EPSILON;
+}
+
+SceneSelection selectWholeScene(const Scene& scene) {
+    const SceneFileHeader& header = scene.header();
+    SceneSelection selection;
+    auto all = [](std::vector<uint32_t>& indices, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++)
+            indices.push_back(i);
+    };
+    all(selection.rooms, header.roomCount);
+    all(selection.walls, header.wallCount);
+    all(selection.artworks, header.artworkCount);
+    all(selection.stands, header.standCount);
+    return selection;
+}
+
+void buildSceneGeometry(const Scene& scene, const SceneSelection& selection,
+    const std::function<int(const char*)>& materialLayer, SceneGeometry& geometry) {
+    const glm::vec2 unitUvs[4] = { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f }, { 0.0f, 1.0f } };
+    MeshBuilder mesh(geometry);
+    geometry.droppedQuads = 0;
+
+    // The parts left out are built from nothing
+    const std::vector<uint32_t> none;
+    const std::vector<uint32_t>& rooms = selection.staticMesh ? selection.rooms : none;
+    const std::vector<uint32_t>& walls = selection.staticMesh ? selection.walls : none;
+    const std::vector<uint32_t>& boxes = selection.staticMesh ? selection.stands : none;
+    const std::vector<uint32_t>& artworks = selection.pictures ? selection.artworks : none;
+
+    // Floors and ceilings, the texture repeating every tileSize
+    for (uint32_t i : rooms) {
+        const SceneRoom& room = scene.rooms()[i];
+        glm::vec2 uvs[4] = {
+            { 0.0f, 0.0f }, { (room.maxX - room.minX) / room.tileSize, 0.0f },
+            { (room.maxX - room.minX) / room.tileSize, (room.maxZ - room.minZ) / room.tileSize },
+            { 0.0f, (room.maxZ - room.minZ) / room.tileSize }
+        };
+        float heights[2] = { room.floorY, room.ceilingY };
+        uint32_t materials[2] = { room.floorMaterial, room.ceilingMaterial };
+        const glm::vec3 normals[2] = { { 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f } };
+        for (int j = 0; j < 2; j++) {
+            glm::vec3 corners[4] = {
+                { room.minX, heights[j], room.minZ }, { room.maxX, heights[j], room.minZ },
+                { room.maxX, heights[j], room.maxZ }, { room.minX, heights[j], room.maxZ }
+            };
+            if (!mesh.quad(corners, uvs, normals[j], (float)materialLayer(scene.string(materials[j])))) {
+                std::cerr << "Scene: room " << i << " repeats the " << (j ? "ceiling" : "floor")
+                    << " of an earlier room" << std::endl;
+                geometry.droppedQuads++;
+            }
+        }
+    }
+
+    // Walls, a quad per segment. u runs on across the segments so neighbours
+    // share their edge vertices. Where a door opens the wall, the segment is
+    // split at its sides and only the part above it is kept. The part covered
+    // by an earlier wall on the same plane would fight with it over depth, so
+    // it is cut out the same way. When the two face opposite ways they are the
+    // two sides of a wall between rooms: with one material the shader lights a
+    // quad on the side the camera sees, so one serves both; with two, each is
+    // kept and moved a little into its own room. Only walls built here cut:
+    // a room streamed alone must not lose a wall to one that is not resident,
+    // so an opposite wall outside the selection is treated as another
+    // material, each side then drawn by its own room.
+    std::vector<char> selected(scene.header().wallCount, 0);
+    for (uint32_t i : walls)
+        selected[i] = 1;
+    std::vector<WallOpening> openings, shared, repeated;
+    for (uint32_t i : walls) {
+        const SceneWall& wall = scene.walls()[i];
+        float layer = (float)materialLayer(scene.string(wall.material));
+        glm::vec2 start(wall.x0, wall.z0), end(wall.x1, wall.z1);
+        glm::vec2 direction = glm::normalize(end - start);
+        glm::vec3 normal(-direction.y, 0.0f, direction.x);
+        float segmentLength = glm::length(end - start) / wall.segments;
+        openings.clear();
+        shared.clear();
+        repeated.clear();
+        for (uint32_t d = 0; d < scene.header().doorCount; d++) {
+            WallOpening opening;
+            if (doorOpening(wall, scene.doors()[d], opening))
+                openings.push_back(opening);
+        }
+        for (uint32_t other = 0; other < scene.header().wallCount; other++) {
+            const SceneWall& otherWall = scene.walls()[other];
+            WallOpening overlap;
+            if (other == i || !wallOverlap(wall, otherWall, overlap))
+                continue;
+            bool sameFacing = glm::dot(glm::vec2(otherWall.x1 - otherWall.x0, otherWall.z1 - otherWall.z0), direction) > 0.0f;
+            if (!sameFacing && (otherWall.material != wall.material || !selected[other])) {
+                shared.push_back(overlap);
+            }
+            else if (other < i && selected[other]) {
+                openings.push_back(overlap);
+                if (sameFacing)
+                    repeated.push_back(overlap);
+            }
+        }
+        for (uint32_t s = 0; s < wall.segments; s++) {
+            // Cut where the openings start and end within the segment, and
+            // across at their bottoms and tops so the pieces meet without
+            // T-junctions
+            std::vector<float> cuts = { (float)s, s + 1.0f };
+            std::vector<float> levels = { wall.bottom, wall.top };
+            for (size_t o = 0; o < openings.size() + shared.size(); o++) {
+                const WallOpening& opening = o < openings.size() ? openings[o] : shared[o - openings.size()];
+                float from = opening.from / segmentLength, to = opening.to / segmentLength;
+                if (to < s - WELD_EPSILON || from > s + 1.0f + WELD_EPSILON)
+                    continue;
+                for (float cut : { from, to }) {
+                    if (cut > s + WELD_EPSILON && cut < s + 1.0f - WELD_EPSILON)
+                        cuts.push_back(cut);
+                }
+                for (float level : { opening.bottom, opening.top }) {
+                    if (level > wall.bottom + WELD_EPSILON && level < wall.top - WELD_EPSILON)
+                        levels.push_back(level);
+                }
+            }
+            bool overlapped = std::any_of(repeated.begin(), repeated.end(), [&](const WallOpening& overlap) {
+                return overlap.to > s * segmentLength + WELD_EPSILON && overlap.from < (s + 1) * segmentLength - WELD_EPSILON;
+            });
+            if (overlapped) {
+                std::cerr << "Scene: segment " << s << " of wall " << i << " overlaps an earlier wall" << std::endl;
+                geometry.droppedQuads++;
+            }
+            std::sort(cuts.begin(), cuts.end());
+            std::sort(levels.begin(), levels.end());
+            for (size_t c = 0; c + 1 < cuts.size(); c++) {
+                float u0 = cuts[c], u1 = cuts[c + 1];
+                if (u1 - u0 <= WELD_EPSILON)
+                    continue;
+                glm::vec2 p0 = glm::mix(start, end, u0 / wall.segments), p1 = glm::mix(start, end, u1 / wall.segments);
+                float middle = (u0 + u1) * 0.5f * segmentLength;
+                for (size_t l = 0; l + 1 < levels.size(); l++) {
+                    float bottom = levels[l], top = levels[l + 1];
+                    if (top - bottom <= WELD_EPSILON)
+                        continue;
+                    auto inside = [&](const WallOpening& opening) {
+                        return middle > opening.from && middle < opening.to && top <= opening.top + WELD_EPSILON &&
+                            bottom >= opening.bottom - WELD_EPSILON;
+                    };
+                    if (std::any_of(openings.begin(), openings.end(), inside))
+                        continue;
+                    glm::vec2 offset = std::any_of(shared.begin(), shared.end(), inside) ?
+                        glm::vec2(normal.x, normal.z) * SHARED_WALL_OFFSET : glm::vec2(0.0f);
+                    float v0 = (bottom - wall.bottom) / (wall.top - wall.bottom);
+                    float v1 = (top - wall.bottom) / (wall.top - wall.bottom);
+                    glm::vec2 q0 = p0 + offset, q1 = p1 + offset;
+                    glm::vec3 corners[4] = {
+                        { q0.x, bottom, q0.y }, { q0.x, top, q0.y }, { q1.x, top, q1.y }, { q1.x, bottom, q1.y }
+                    };
+                    glm::vec2 uvs[4] = { { u0, v0 }, { u0, v1 }, { u1, v1 }, { u1, v0 } };
+                    mesh.quad(corners, uvs, normal, layer);
+                }
+            }
+        }
+    }
+
+    // Stands: boxes with the material once on each face
+    for (uint32_t i : boxes) {
+        const SceneStand& stand = scene.stands()[i];
+        float layer = (float)materialLayer(scene.string(stand.material));
+        glm::vec3 low(stand.position[0] - stand.size[0] * 0.5f, stand.position[1], stand.position[2] - stand.size[2] * 0.5f);
+        glm::vec3 high = low + glm::vec3(stand.size[0], stand.size[1], stand.size[2]);
+        const glm::vec3 faces[6][4] = {
+            { { low.x, low.y, low.z }, { high.x, low.y, low.z }, { high.x, low.y, high.z }, { low.x, low.y, high.z } },
+            { { low.x, high.y, low.z }, { high.x, high.y, low.z }, { high.x, high.y, high.z }, { low.x, high.y, high.z } },
+            { { low.x, low.y, high.z }, { high.x, low.y, high.z }, { high.x, high.y, high.z }, { low.x, high.y, high.z } },
+            { { low.x, low.y, low.z }, { high.x, low.y, low.z }, { high.x, high.y, low.z }, { low.x, high.y, low.z } },
+            { { low.x, low.y, low.z }, { low.x, low.y, high.z }, { low.x, high.y, high.z }, { low.x, high.y, low.z } },
+            { { high.x, low.y, low.z }, { high.x, low.y, high.z }, { high.x, high.y, high.z }, { high.x, high.y, low.z } }
+        };
+        const glm::vec3 normals[6] = {
+            { 0.0f, -1.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f },
+            { 0.0f, 0.0f, -1.0f }, { -1.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }
+        };
+        for (int f = 0; f < 6; f++) {
+            if (!mesh.quad(faces[f], unitUvs, normals[f], layer)) {
+                std::cerr << "Scene: stand " << i << " repeats a face of an earlier one" << std::endl;
+                geometry.droppedQuads++;
+            }
+        }
+    }
+    geometry.staticCount = (int)geometry.indices.size();
+
+    // Artworks keep vertices of their own, as main.cpp retags their layer
+    mesh.share = false;
+    float artworkOffset = std::max(ARTWORK_OFFSET, 2.0f * mesh.positionStep());
+    geometry.artworkFirst = (int)geometry.indices.size();
+    geometry.artworkVertexFirst = mesh.vertexCount();
+    for (uint32_t i : artworks) {
+        const SceneArtwork& artwork = scene.artworks()[i];
+        glm::vec3 corners[4];
+        artworkCorners(artwork, corners, artworkOffset);
+        mesh.quad(corners, unitUvs, glm::vec3(artwork.normal[0], artwork.normal[1], artwork.normal[2]), -2.0f);
+    }
+    mesh.finish();
+}
+
+void buildDisplayQuad(SceneGeometry& geometry) {
+    const glm::vec2 unitUvs[4] = { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f }, { 0.0f, 1.0f } };
+    const glm::vec3 corners[4] = {
+        { -0.5f, 0.0f, 0.0f }, { 0.5f, 0.0f, 0.0f }, { 0.5f, 1.0f, 0.0f }, { -0.5f, 1.0f, 0.0f }
+    };
+    MeshBuilder mesh(geometry);
+    geometry.droppedQuads = 0;
+    mesh.quad(corners, unitUvs, glm::vec3(0.0f, 0.0f, 1.0f), 0.0f);
+    geometry.staticCount = (int)geometry.indices.size();
+    geometry.artworkFirst = geometry.staticCount;
+    geometry.artworkVertexFirst = mesh.vertexCount();
+    mesh.finish();
+}
+
+glm::mat4 displayQuadTransform(const SceneStand& stand) {
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, stand.displayBottom, 0.0f));
+    return glm::scale(model, glm::vec3(stand.displayWidth, stand.displayHeight, 1.0f));
+}
+
+size_t uploadSceneGeometry(const SceneGeometry& geometry, unsigned int& VAO, unsigned int& VBO, unsigned int& EBO) {
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, geometry.vertices.size() * sizeof(SceneVertex), geometry.vertices.data(),
+        GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, geometry.indices.size() * sizeof(uint32_t), geometry.indices.data(),
+        GL_STATIC_DRAW);
+    setSceneVertexAttributes();
+    glBindVertexArray(0);
+    return geometry.vertices.size() * sizeof(SceneVertex) + geometry.indices.size() * sizeof(uint32_t);
+}
+
+void setSceneVertexAttributes() {
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(SceneVertex), (void*)offsetof(SceneVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(SceneVertex), (void*)offsetof(SceneVertex, uv));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 1, GL_SHORT, GL_FALSE, sizeof(SceneVertex), (void*)offsetof(SceneVertex, layer));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(SceneVertex), (void*)offsetof(SceneVertex, normal));
+    glEnableVertexAttribArray(3);
+}
+
+void deleteSceneGeometry(unsigned int& VAO, unsigned int& VBO, unsigned int& EBO) {
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    VAO = VBO = EBO = 0;
+}
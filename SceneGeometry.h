@@ -0,0 +1,106 @@
+#ifndef SCENE_GEOMETRY_H
+#define SCENE_GEOMETRY_H
+
+#include "Scene.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// What every mesh built from a scene is drawn with, packed into 16 bytes and
+// unpacked by main.cpp's vertex shader:
+//   position   unorm16 fraction of the way across the geometry's bounds
+//   layer      the material's layer in the texture array (negative values
+//              select a painting's own texture, see main.cpp's shader)
+//   uv         half floats
+//   normal     octahedral encoding, snorm16
+struct SceneVertex {
+    uint16_t position[3];
+    int16_t layer;
+    uint16_t uv[2];
+    int16_t normal[2];
+};
+static_assert(sizeof(SceneVertex) == 16, "SceneVertex is read as 16-byte records");
+
+// Packs a vertex of geometry with the given bounds; normal need not be unit
+// length but must not be zero.
+SceneVertex packSceneVertex(const glm::vec3& position, const glm::vec2& uv, const glm::vec3& normal, int layer,
+    const glm::vec3& boundsMin, const glm::vec3& boundsSize);
+
+// Indexed triangles for a scene or part of one. The rooms and stands come
+// first (staticCount indices, drawn together) and share every vertex they
+// can, then 6 indices per artwork from artworkFirst. The i-th artwork uses the
+// 4 vertices from artworkVertexFirst + 4 * i. Stand displays are not built
+// here but drawn as instances of buildDisplayQuad().
+struct SceneGeometry {
+    std::vector<SceneVertex> vertices;
+    std::vector<uint32_t> indices;
+    glm::vec3 boundsMin;    // A position is boundsMin + boundsSize * the unorm fractions
+    glm::vec3 boundsSize;
+    int staticCount;
+    int artworkFirst;
+    int artworkVertexFirst;
+    int droppedQuads;   // Static quads left out because another already covered them
+};
+
+// Artworks are drawn this far in front of their wall so the two never fight
+// over depth, or two position steps when the bounds are so large that steps
+// are coarser.
+const float ARTWORK_OFFSET = 0.002f;
+
+// Which records of a scene to build, by index: a chunk of a larger gallery.
+// Artworks and displays come out in the order listed.
+struct SceneSelection {
+    std::vector<uint32_t> rooms;
+    std::vector<uint32_t> walls;
+    std::vector<uint32_t> artworks;
+    std::vector<uint32_t> stands;
+    bool staticMesh = true;     // Build the rooms, walls and stand boxes
+    bool pictures = true;       // Build the artworks
+};
+
+// Every record of the scene.
+SceneSelection selectWholeScene(const Scene& scene);
+
+// materialLayer gives the texture array layer of a material path. Artwork
+// vertices get layer -2. Wall segments covered by an earlier wall of the
+// scene on the same line (whether selected or not, so every chunk agrees),
+// and quads repeating an earlier one, are left out (and reported on
+// std::cerr) so no two surfaces ever overlap. Doors are cut out of every wall
+// they open (see doorOpening()). Safe to call from any thread
+// if materialLayer is.
+void buildSceneGeometry(const Scene& scene, const SceneSelection& selection,
+    const std::function<int(const char*)>& materialLayer, SceneGeometry& geometry);
+
+// Part of a wall left open by a door: from and to are distances along the
+// wall from its start.
+struct WallOpening {
+    float from, to;
+    float bottom, top;
+};
+
+// Whether door opens a hole in wall, which it does in its own wall and in any
+// other lying on the same line across it.
+bool doorOpening(const SceneWall& wall, const SceneDoor& door, WallOpening& opening);
+
+// Where an artwork is drawn, at uv (0,0), (1,0), (1,1) and (0,1).
+void artworkCorners(const SceneArtwork& artwork, glm::vec3 corners[4], float offset = ARTWORK_OFFSET);
+
+// The quad every stand display is an instance of: from (-0.5, 0) to (0.5, 1)
+// in the xy plane, facing +z, as staticCount indices.
+void buildDisplayQuad(SceneGeometry& geometry);
+
+// Places the display quad above its stand, in the stand's own space (see
+// SceneStreamer::displayTransform()).
+glm::mat4 displayQuadTransform(const SceneStand& stand);
+
+// Puts geometry in new buffers and a vertex array reading SceneVertex at
+// locations 0 to 3; returns the bytes uploaded. GL thread only.
+size_t uploadSceneGeometry(const SceneGeometry& geometry, unsigned int& VAO, unsigned int& VBO, unsigned int& EBO);
+void deleteSceneGeometry(unsigned int& VAO, unsigned int& VBO, unsigned int& EBO);
+
+// Points locations 0 to 3 of the bound vertex array at SceneVertex records in
+// the bound GL_ARRAY_BUFFER.
+void setSceneVertexAttributes();
+
+#endif
@@ -0,0 +1,1039 @@
+#include "SceneStreamer.h"
+#include "TextureRegistry.h"
+#include "TextureResidency.h"
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+
+// Distance on the floor plan from (x, z) to a room's rectangle, 0 inside it.
+static float distanceToRoom(const SceneRoom& room, float x, float z) {
+    float dx = std::max(std::max(room.minX - x, x - room.maxX), 0.0f);
+    float dz = std::max(std::max(room.minZ - z, z - room.maxZ), 0.0f);
+    return std::sqrt(dx * dx + dz * dz);
+}
+
+static const uint32_t NO_ROOM = 0xFFFFFFFF;
+
+// The room a stand or light at (x, z) belongs to: the first that holds it,
+// or else the nearest.
+static uint32_t roomAt(const Scene& scene, float x, float z) {
+    uint32_t best = 0;
+    float bestDistance = 1e30f;
+    for (uint32_t i = 0; i < scene.header().roomCount; i++) {
+        float distance = distanceToRoom(scene.rooms()[i], x, z);
+        if (distance < bestDistance) {
+            best = i;
+            bestDistance = distance;
+            if (distance == 0.0f)
+                break;
+        }
+    }
+    return best;
+}
+
+SceneStreamer::SceneStreamer(const Scene& scene, TextureResidency& paintings, MeshArena& meshes,
+    std::function<int(const char*)> materialLayer, int virtualArtwork, float loadRadius, float hysteresis)
+    : scene(scene), paintingTextures(paintings), meshes(meshes), materialLayer(materialLayer), virtualArtwork(virtualArtwork),
+    loadRadius(loadRadius), hysteresis(hysteresis), stats() {
+    const SceneFileHeader& header = scene.header();
+    chunks.resize(header.roomCount);
+    for (uint32_t i = 0; i < header.roomCount; i++) {
+        Chunk& chunk = chunks[i];
+        chunk.room = i;
+        chunk.selection.rooms.push_back(i);
+        chunk.selection.staticMesh = false;
+        chunk.resident = chunk.loading = false;
+        chunk.generation = 0;
+        chunk.VAO = chunk.VBO = chunk.EBO = 0;
+        chunk.geometryBytes = 0;
+    }
+    if (header.roomCount > 0) {
+        for (uint32_t i = 0; i < header.wallCount; i++)
+            chunks[scene.walls()[i].room].selection.walls.push_back(i);
+        for (uint32_t i = 0; i < header.artworkCount; i++)
+            chunks[scene.walls()[scene.artworks()[i].wall].room].selection.artworks.push_back(i);
+        for (uint32_t i = 0; i < header.standCount; i++) {
+            const SceneStand& stand = scene.stands()[i];
+            chunks[roomAt(scene, stand.position[0], stand.position[2])].selection.stands.push_back(i);
+        }
+        for (uint32_t i = 0; i < header.sculptureCount; i++) {
+            const SceneSculpture& sculpture = scene.sculptures()[i];
+            chunks[roomAt(scene, sculpture.position[0], sculpture.position[2])].sculptures.push_back(i);
+        }
+        for (uint32_t i = 0; i < header.lightCount; i++) {
+            const SceneLight& light = scene.lights()[i];
+            chunks[roomAt(scene, light.position[0], light.position[2])].lights.push_back(i);
+        }
+    }
+
+    // Rooms within loadRadius of a point overlap its cell or the 8 around it
+    cellSize = std::max(loadRadius, 1.0f);
+    for (uint32_t i = 0; i < header.roomCount; i++) {
+        const SceneRoom& room = scene.rooms()[i];
+        for (int x = (int)std::floor(room.minX / cellSize); x <= (int)std::floor(room.maxX / cellSize); x++)
+            for (int z = (int)std::floor(room.minZ / cellSize); z <= (int)std::floor(room.maxZ / cellSize); z++)
+                grid[cellKey(x, z)].push_back(i);
+    }
+
+    // Batches, by the square each room's centre is in
+    std::unordered_map<long long, uint32_t> batchCells;
+    for (uint32_t i = 0; i < header.roomCount; i++) {
+        const SceneRoom& room = scene.rooms()[i];
+        long long key = cellKey((int)std::floor((room.minX + room.maxX) * 0.5f / batchSize),
+            (int)std::floor((room.minZ + room.maxZ) * 0.5f / batchSize));
+        std::unordered_map<long long, uint32_t>::iterator cell = batchCells.find(key);
+        if (cell == batchCells.end()) {
+            cell = batchCells.emplace(key, (uint32_t)batches.size()).first;
+            batches.push_back(Batch());     // Not dirty, building or built, with no levels yet
+        }
+        batches[cell->second].rooms.push_back(i);
+        chunks[i].batch = cell->second;
+    }
+
+    // Doors, the holes they make in walls, and the rooms whose walls back onto
+    // each room (a wall belongs to the room it faces)
+    roomDoors.resize(header.roomCount);
+    backingRooms.resize(header.roomCount);
+    wallOpenings.resize(header.wallCount);
+    reachedFrame.assign(header.roomCount, 0);
+    backedFrame.assign(header.roomCount, 0);
+    reachedRect.resize(header.roomCount);
+    for (uint32_t i = 0; i < header.doorCount; i++) {
+        const SceneDoor& door = scene.doors()[i];
+        roomDoors[door.rooms[0]].push_back(i);
+        roomDoors[door.rooms[1]].push_back(i);
+    }
+    for (uint32_t i = 0; i < header.wallCount; i++) {
+        const SceneWall& wall = scene.walls()[i];
+        // A door along this wall is in one of the rooms either side of it
+        for (uint32_t door : roomDoors[wall.room]) {
+            WallOpening opening;
+            if (doorOpening(wall, scene.doors()[door], opening))
+                wallOpenings[i].push_back(opening);
+        }
+        glm::vec2 start(wall.x0, wall.z0), end(wall.x1, wall.z1);
+        glm::vec2 direction = glm::normalize(end - start);
+        glm::vec2 behind(direction.y, -direction.x);
+        for (uint32_t s = 0; s < wall.segments; s++) {
+            glm::vec2 point = glm::mix(start, end, (s + 0.5f) / wall.segments) + behind * 0.05f;
+            uint32_t room = roomContaining(point.x, point.y);
+            if (room == NO_ROOM || room == wall.room)
+                continue;
+            std::vector<uint32_t>& backing = backingRooms[room];
+            if (std::find(backing.begin(), backing.end(), wall.room) == backing.end())
+                backing.push_back(wall.room);
+        }
+    }
+
+    worker = std::thread(&SceneStreamer::workerMain, this);
+}
+
+SceneStreamer::~SceneStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    requestReady.notify_all();
+    worker.join();
+
+    for (Chunk* chunk : std::vector<Chunk*>(resident))
+        unload(*chunk);
+    for (Batch* batch : std::vector<Batch*>(builtBatches))
+        freeBatch(*batch);
+}
+
+void SceneStreamer::workerMain() {
+    for (;;) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            requestReady.wait(lock, [this] { return stopping || !requests.empty(); });
+            if (stopping)
+                return;
+            request = requests.front();
+            requests.pop_front();
+            building++;
+        }
+
+        Built result;
+        result.room = request.room;
+        result.batch = request.batch;
+        result.generation = request.generation;
+        if (request.batch != NO_BATCH) {
+            // The static meshes of the rooms together
+            SceneSelection selection;
+            selection.pictures = false;
+            for (uint32_t room : request.rooms) {
+                const SceneSelection& part = chunks[room].selection;
+                selection.rooms.insert(selection.rooms.end(), part.rooms.begin(), part.rooms.end());
+                selection.walls.insert(selection.walls.end(), part.walls.begin(), part.walls.end());
+                selection.stands.insert(selection.stands.end(), part.stands.begin(), part.stands.end());
+            }
+            buildSceneGeometry(scene, selection, materialLayer, result.geometry);
+
+            // And again without the stands, for when they are too far to see
+            result.standSize = 0.0f;
+            for (uint32_t i : selection.stands) {
+                const float* size = scene.stands()[i].size;
+                result.standSize = std::max(result.standSize, std::max(size[0], std::max(size[1], size[2])));
+            }
+            if (!selection.stands.empty()) {
+                selection.stands.clear();
+                buildSceneGeometry(scene, selection, materialLayer, result.standless);
+            }
+        }
+        else {
+            const Chunk& chunk = chunks[request.room];
+            const SceneSelection& selection = chunk.selection;
+            buildSceneGeometry(scene, selection, materialLayer, result.geometry);
+            for (uint32_t i : selection.stands) {
+                const SceneStand& stand = scene.stands()[i];
+                if (stand.display != Scene::NO_STRING)
+                    result.displayLayers.push_back(materialLayer(scene.string(stand.display)));
+            }
+            for (size_t i = 0; i < selection.artworks.size(); i++) {
+                if ((int)selection.artworks[i] == virtualArtwork) {
+                    for (int v = 0; v < 4; v++)
+                        result.geometry.vertices[result.geometry.artworkVertexFirst + i * 4 + v].layer = -1;
+                    result.paintingKeys.push_back(std::string());
+                }
+                else {
+                    result.paintingKeys.push_back(
+                        textureContentKey(scene.string(scene.artworks()[selection.artworks[i]].image)));
+                }
+            }
+
+            // Mapped once per mesh, however many of the room's sculptures
+            // use it
+            for (size_t i = 0; i < chunk.sculptures.size(); i++) {
+                const SceneSculpture& sculpture = scene.sculptures()[chunk.sculptures[i]];
+                size_t same = 0;
+                while (same < i && scene.sculptures()[chunk.sculptures[same]].mesh != sculpture.mesh)
+                    same++;
+                std::shared_ptr<CookedMesh> mesh;
+                if (same < i) {
+                    mesh = result.sculptureMeshes[same];
+                }
+                else {
+                    mesh = std::make_shared<CookedMesh>();
+                    if (!mesh->load(scene.string(sculpture.mesh)))
+                        mesh.reset();
+                }
+                result.sculptureMeshes.push_back(mesh);
+                result.sculptureLayers.push_back(materialLayer(scene.string(sculpture.material)));
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            built.push_back(std::move(result));
+            building--;
+        }
+        builtReady.notify_all();
+    }
+}
+
+float SceneStreamer::distanceTo(const Chunk& chunk, const glm::vec3& position) const {
+    return distanceToRoom(scene.rooms()[chunk.room], position.x, position.z);
+}
+
+void SceneStreamer::upload(Chunk& chunk, Built& result) {
+    chunk.geometryBytes = uploadSceneGeometry(result.geometry, chunk.VAO, chunk.VBO, chunk.EBO);
+    stats.geometryBytes += chunk.geometryBytes;
+    chunk.geometry = std::move(result.geometry);
+    chunk.geometry.vertices = std::vector<SceneVertex>();
+    chunk.geometry.indices = std::vector<uint32_t>();
+    chunk.displayLayers = std::move(result.displayLayers);
+    chunk.sculptureLayers = std::move(result.sculptureLayers);
+
+    // A mesh already in use by another room is only counted again
+    chunk.sculptureMeshes.clear();
+    for (size_t i = 0; i < chunk.sculptures.size(); i++) {
+        std::string path = scene.string(scene.sculptures()[chunk.sculptures[i]].mesh);
+        std::pair<std::unordered_map<std::string, SculptureMesh>::iterator, bool> added =
+            sculptureMeshes.emplace(path, SculptureMesh());
+        SculptureMesh& shared = added.first->second;
+        if (added.second) {
+            shared.users = 0;
+            shared.bytes = 0;
+            shared.mesh = MeshArena::Mesh();
+            shared.fullIndexCount = 0;
+            if (const CookedMesh* cooked = result.sculptureMeshes[i].get()) {
+                const MeshFileHeader& header = cooked->header();
+                meshes.add(cooked->vertices(), header.vertexCount, cooked->indices(), header.indexCount,
+                    glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]),
+                    glm::vec3(header.boundsSize[0], header.boundsSize[1], header.boundsSize[2]), shared.mesh);
+                shared.fullIndexCount = header.indexCount - header.simplifiedIndexCount;
+                shared.clusters.assign(cooked->clusters(), cooked->clusters() + header.clusterCount);
+                shared.bytes = header.vertexCount * sizeof(SceneVertex) + header.indexCount * sizeof(uint32_t);
+                stats.geometryBytes += shared.bytes;
+            }
+        }
+        shared.users++;
+        chunk.sculptureMeshes.push_back(&shared);
+    }
+
+    chunk.paintings.clear();
+    for (size_t i = 0; i < chunk.selection.artworks.size(); i++) {
+        const SceneArtwork& artwork = scene.artworks()[chunk.selection.artworks[i]];
+        if ((int)chunk.selection.artworks[i] == virtualArtwork) {
+            chunk.paintings.push_back(0);
+            continue;
+        }
+        glm::vec3 center(artwork.center[0], artwork.center[1], artwork.center[2]);
+        chunk.paintings.push_back(paintingTextures.add(scene.string(artwork.image), center,
+            std::hypot(artwork.width, artwork.height), result.paintingKeys[i]));
+    }
+
+    chunk.loading = false;
+    chunk.resident = true;
+    chunk.visible = true;
+    chunk.artworkVisible.assign(chunk.selection.artworks.size(), 1);
+    chunk.displayVisible.assign(chunk.selection.stands.size(), 1);
+    chunk.artworkTiny.assign(chunk.selection.artworks.size(), 0);
+    chunk.displayTiny.assign(chunk.selection.stands.size(), 0);
+    chunk.displayTransforms.assign(chunk.selection.stands.size(), glm::mat4(1.0f));
+    chunk.sculptureTiny.assign(chunk.sculptures.size(), 0);
+    chunk.sculptureSimplified.assign(chunk.sculptures.size(), 0);
+    chunk.sculptureRuns.assign(chunk.sculptures.size(), std::vector<MeshArena::Range>());
+    resident.push_back(&chunk);
+    chunksChanged = true;
+    markBatch(chunk.batch);
+    stats.loads++;
+}
+
+void SceneStreamer::unload(Chunk& chunk) {
+    for (size_t i = 0; i < chunk.paintings.size(); i++) {
+        if (!chunk.paintings[i])
+            continue;
+        const SceneArtwork& artwork = scene.artworks()[chunk.selection.artworks[i]];
+        paintingTextures.remove(chunk.paintings[i], glm::vec3(artwork.center[0], artwork.center[1], artwork.center[2]));
+    }
+    chunk.paintings.clear();
+
+    for (uint32_t i : chunk.sculptures) {
+        std::unordered_map<std::string, SculptureMesh>::iterator shared =
+            sculptureMeshes.find(scene.string(scene.sculptures()[i].mesh));
+        if (--shared->second.users > 0)
+            continue;
+        meshes.remove(shared->second.mesh);
+        stats.geometryBytes -= shared->second.bytes;
+        sculptureMeshes.erase(shared);
+    }
+    chunk.sculptureMeshes.clear();
+
+    deleteSceneGeometry(chunk.VAO, chunk.VBO, chunk.EBO);
+    markBatch(chunk.batch);
+
+    stats.geometryBytes -= chunk.geometryBytes;
+    chunk.geometryBytes = 0;
+
+    chunk.resident = false;
+    resident.erase(std::find(resident.begin(), resident.end(), &chunk));
+    chunksChanged = true;
+    stats.unloads++;
+}
+
+void SceneStreamer::update(const glm::vec3& cameraPos) {
+    // Built rooms, a few per frame so uploads never pile into one frame
+    std::vector<Built> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t take = std::min(built.size(), (size_t)std::max(uploadsPerFrame, 1));
+        std::move(built.begin(), built.begin() + take, std::back_inserter(ready));
+        built.erase(built.begin(), built.begin() + take);
+    }
+    uploadBuilt(ready);
+
+    // Out of range, past the hysteresis band
+    for (size_t i = 0; i < active.size();) {
+        Chunk& chunk = *active[i];
+        if (distanceTo(chunk, cameraPos) <= loadRadius + hysteresis) {
+            i++;
+            continue;
+        }
+        if (chunk.resident) {
+            unload(chunk);
+        }
+        else {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests.erase(std::remove_if(requests.begin(), requests.end(),
+                [&chunk](const Request& r) { return r.batch == NO_BATCH && r.room == chunk.room; }), requests.end());
+            chunk.loading = false;
+        }
+        active[i] = active.back();
+        active.pop_back();
+    }
+
+    // Newly in range, nearest first
+    std::vector<std::pair<float, Chunk*>> wanted;
+    int cellX = (int)std::floor(cameraPos.x / cellSize), cellZ = (int)std::floor(cameraPos.z / cellSize);
+    for (int x = cellX - 1; x <= cellX + 1; x++) {
+        for (int z = cellZ - 1; z <= cellZ + 1; z++) {
+            std::unordered_map<long long, std::vector<uint32_t>>::const_iterator cell = grid.find(cellKey(x, z));
+            if (cell == grid.end())
+                continue;
+            for (uint32_t room : cell->second) {
+                Chunk& chunk = chunks[room];
+                float distance = distanceTo(chunk, cameraPos);
+                if (!chunk.resident && !chunk.loading && distance <= loadRadius) {
+                    chunk.loading = true;   // Also keeps rooms in several cells from being added twice
+                    wanted.push_back({ distance, &chunk });
+                }
+            }
+        }
+    }
+    if (!wanted.empty()) {
+        std::sort(wanted.begin(), wanted.end(),
+            [](const std::pair<float, Chunk*>& a, const std::pair<float, Chunk*>& b) { return a.first < b.first; });
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const std::pair<float, Chunk*>& item : wanted) {
+                Chunk& chunk = *item.second;
+                chunk.generation++;
+                requests.push_back({ chunk.room, NO_BATCH, chunk.generation, {} });
+                active.push_back(&chunk);
+            }
+        }
+        requestReady.notify_one();
+    }
+
+    if (chunksChanged)
+        rebuildHierarchy();
+    queueBatches();
+    stats.residentChunks = (int)resident.size();
+    stats.loadingChunks = (int)(active.size() - resident.size());
+}
+
+void SceneStreamer::finish() {
+    // Rooms first, then the batches they change
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            builtReady.wait(lock, [this] { return requests.empty() && building == 0; });
+        }
+        std::vector<Built> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.swap(built);
+        }
+        uploadBuilt(ready);
+        queueBatches();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (requests.empty())
+            break;
+    }
+    if (chunksChanged)
+        rebuildHierarchy();
+    stats.residentChunks = (int)resident.size();
+    stats.loadingChunks = (int)(active.size() - resident.size());
+}
+
+void SceneStreamer::uploadBuilt(std::vector<Built>& ready) {
+    for (Built& result : ready) {
+        if (result.batch != NO_BATCH) {
+            upload(batches[result.batch], result);
+            continue;
+        }
+        Chunk& chunk = chunks[result.room];
+        if (chunk.loading && chunk.generation == result.generation)
+            upload(chunk, result);
+    }
+}
+
+void SceneStreamer::markBatch(uint32_t batch) {
+    if (!batches[batch].dirty) {
+        batches[batch].dirty = true;
+        dirtyBatches.push_back(batch);
+    }
+}
+
+// Queues a build of each batch whose rooms changed, or frees it when none of
+// them is left. A batch already building is queued again once that build is
+// in, since it may be missing the latest change.
+void SceneStreamer::queueBatches() {
+    std::vector<Request> queued;
+    for (size_t i = 0; i < dirtyBatches.size();) {
+        Batch& batch = batches[dirtyBatches[i]];
+        if (batch.building) {
+            i++;
+            continue;
+        }
+        Request request = { 0, dirtyBatches[i], 0, {} };
+        for (uint32_t room : batch.rooms) {
+            if (chunks[room].resident)
+                request.rooms.push_back(room);
+        }
+        batch.dirty = false;
+        if (request.rooms.empty()) {
+            freeBatch(batch);
+        }
+        else {
+            batch.building = true;
+            queued.push_back(std::move(request));
+        }
+        dirtyBatches[i] = dirtyBatches.back();
+        dirtyBatches.pop_back();
+    }
+    if (queued.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (Request& request : queued)
+            requests.push_back(std::move(request));
+    }
+    requestReady.notify_one();
+}
+
+// Replaces what the batch drew; the old mesh stays in use until then
+void SceneStreamer::upload(Batch& batch, Built& result) {
+    batch.building = false;
+    if (batch.built) {
+        for (int i = 0; i < batch.levelCount; i++)
+            meshes.remove(batch.levels[i]);
+        stats.geometryBytes -= batch.geometryBytes;
+    }
+    batch.levelCount = result.standless.indices.empty() ? 1 : 2;
+    batch.geometryBytes = 0;
+    for (int i = 0; i < batch.levelCount; i++) {
+        const SceneGeometry& geometry = i == 0 ? result.geometry : result.standless;
+        meshes.add(geometry, batch.levels[i]);
+        batch.geometryBytes += geometry.vertices.size() * sizeof(SceneVertex) + geometry.indices.size() * sizeof(uint32_t);
+    }
+    batch.standSize = result.standSize;
+    stats.geometryBytes += batch.geometryBytes;
+    batch.visible = true;
+    batch.level = 0;
+    if (!batch.built)
+        builtBatches.push_back(&batch);
+    batch.built = true;
+    stats.batches = (int)builtBatches.size();
+}
+
+void SceneStreamer::freeBatch(Batch& batch) {
+    if (!batch.built)
+        return;
+    for (int i = 0; i < batch.levelCount; i++)
+        meshes.remove(batch.levels[i]);
+    batch.built = false;
+    stats.geometryBytes -= batch.geometryBytes;
+    batch.geometryBytes = 0;
+    builtBatches.erase(std::find(builtBatches.begin(), builtBatches.end(), &batch));
+    stats.batches = (int)builtBatches.size();
+}
+
+int SceneStreamer::nearestLights(const glm::vec3& position, SceneLight* out, int count) const {
+    std::vector<std::pair<float, uint32_t>> lights;
+    for (const Chunk* chunk : resident) {
+        for (uint32_t light : chunk->lights) {
+            const float* p = scene.lights()[light].position;
+            lights.push_back({ glm::length(glm::vec3(p[0], p[1], p[2]) - position), light });
+        }
+    }
+    int found = std::min(count, (int)lights.size());
+    std::partial_sort(lights.begin(), lights.begin() + found, lights.end());
+    for (int i = 0; i < found; i++)
+        out[i] = scene.lights()[lights[i].second];
+    return found;
+}
+
+glm::mat4 SceneStreamer::displayTransform(const SceneStand& stand, float time) {
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(stand.position[0], stand.position[1], stand.position[2]));
+    return glm::rotate(model, time * glm::radians(stand.spin), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate around Y-axis
+}
+
+Aabb SceneStreamer::displayBounds(const SceneStand& stand, const glm::mat4& model) {
+    float halfWidth = stand.displayWidth * 0.5f;
+    Aabb box = Aabb::empty();
+    for (float x : { -halfWidth, halfWidth }) {
+        for (float y : { stand.displayBottom, stand.displayBottom + stand.displayHeight })
+            box.grow(glm::vec3(model * glm::vec4(x, y, 0.0f, 1.0f)));
+    }
+    return box;
+}
+
+glm::mat4 SceneStreamer::sculptureTransform(const SceneSculpture& sculpture) {
+    glm::mat4 model = glm::translate(glm::mat4(1.0f),
+        glm::vec3(sculpture.position[0], sculpture.position[1], sculpture.position[2]));
+    model = glm::rotate(model, glm::radians(sculpture.turn), glm::vec3(0.0f, 1.0f, 0.0f));
+    return glm::scale(model, glm::vec3(sculpture.scale));
+}
+
+// The placed corners of the mesh's bounds; just its origin for a mesh that
+// failed to load
+Aabb SceneStreamer::sculptureBounds(const SceneSculpture& sculpture, const MeshArena::Mesh& mesh) const {
+    glm::mat4 model = sculptureTransform(sculpture);
+    Aabb box = Aabb::empty();
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec3 fraction((float)(corner & 1), (float)((corner >> 1) & 1), (float)(corner >> 2));
+        glm::vec3 point = mesh.indexCount > 0 ? mesh.boundsMin + mesh.boundsSize * fraction : glm::vec3(0.0f);
+        box.grow(glm::vec3(model * glm::vec4(point, 1.0f)));
+    }
+    return box;
+}
+
+// Walls and artworks are flat; this much thickness keeps their boxes from
+// being missed by rays and overlap tests that graze them
+static const float SURFACE_THICKNESS = 0.01f;
+
+void SceneStreamer::rebuildHierarchy() {
+    chunksChanged = false;
+    objectList.clear();
+    displayObjects.clear();
+    culler.clear();
+    cullObjects.clear();
+    displayCullObjects.clear();
+    std::vector<Aabb> boxes;
+    auto add = [&](const Object& object, const Aabb& box) {
+        if (object.kind == Object::Room || object.kind == Object::Artwork || object.kind == Object::Display ||
+            object.kind == Object::Sculpture) {
+            if (object.kind == Object::Display)
+                displayCullObjects.push_back(culler.addBox(box));
+            else
+                culler.addBox(box);
+            cullObjects.push_back((uint32_t)objectList.size());
+        }
+        objectList.push_back(object);
+        boxes.push_back(box);
+    };
+
+    for (Chunk* chunk : resident) {
+        const SceneRoom& room = scene.rooms()[chunk->room];
+        Aabb roomBox = { glm::vec3(room.minX, room.floorY, room.minZ), glm::vec3(room.maxX, room.ceilingY, room.maxZ) };
+
+        for (uint32_t w : chunk->selection.walls) {
+            const SceneWall& wall = scene.walls()[w];
+            glm::vec2 start(wall.x0, wall.z0), end(wall.x1, wall.z1);
+            for (uint32_t s = 0; s < wall.segments; s++) {
+                glm::vec2 a = glm::mix(start, end, (float)s / wall.segments);
+                glm::vec2 b = glm::mix(start, end, (float)(s + 1) / wall.segments);
+                Aabb box = { glm::vec3(std::min(a.x, b.x), wall.bottom, std::min(a.y, b.y)) - glm::vec3(SURFACE_THICKNESS),
+                    glm::vec3(std::max(a.x, b.x), wall.top, std::max(a.y, b.y)) + glm::vec3(SURFACE_THICKNESS) };
+                add({ Object::Wall, chunk, w, s }, box);
+                roomBox.grow(box);
+            }
+        }
+        uint32_t display = 0;
+        for (uint32_t i : chunk->selection.stands) {
+            const SceneStand& stand = scene.stands()[i];
+            glm::vec3 half(stand.size[0] * 0.5f, 0.0f, stand.size[2] * 0.5f);
+            glm::vec3 base(stand.position[0], stand.position[1], stand.position[2]);
+            Aabb box = { base - half, base + half + glm::vec3(0.0f, stand.size[1], 0.0f) };
+            add({ Object::Stand, chunk, i, 0 }, box);
+            roomBox.grow(box);
+            if (stand.display != Scene::NO_STRING) {
+                displayObjects.push_back((uint32_t)objectList.size());
+                add({ Object::Display, chunk, i, display++ }, displayBounds(stand, displayTransform(stand, displayTime)));
+            }
+        }
+        for (uint32_t s = 0; s < chunk->sculptures.size(); s++) {
+            Aabb box = sculptureBounds(scene.sculptures()[chunk->sculptures[s]], chunk->sculptureMeshes[s]->mesh);
+            add({ Object::Sculpture, chunk, chunk->sculptures[s], s }, box);
+            roomBox.grow(box);
+        }
+        for (uint32_t a = 0; a < chunk->selection.artworks.size(); a++) {
+            glm::vec3 corners[4];
+            artworkCorners(scene.artworks()[chunk->selection.artworks[a]], corners);
+            Aabb box = Aabb::empty();
+            for (const glm::vec3& corner : corners)
+                box.grow(corner);
+            box.min -= glm::vec3(SURFACE_THICKNESS);
+            box.max += glm::vec3(SURFACE_THICKNESS);
+            add({ Object::Artwork, chunk, chunk->selection.artworks[a], a }, box);
+        }
+        add({ Object::Room, chunk, chunk->room, 0 }, roomBox);
+    }
+    bvh.build(boxes);
+}
+
+// Calls body over [0, count) on the jobs' threads, or all at once without any
+static void forRanges(JobSystem* jobs, size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+    if (jobs)
+        jobs->parallelFor(count, grain, body);
+    else if (count > 0)
+        body(0, count);
+}
+
+// Displays are placed by the jobs; the BVH, whose refits climb into nodes
+// other displays share, is updated here
+void SceneStreamer::animate(float time) {
+    displayTime = time;
+    displayBoxes.resize(displayObjects.size());
+    forRanges(jobs, displayObjects.size(), displaysPerJob, [&](size_t first, size_t end) {
+        for (size_t i = first; i < end; i++) {
+            const Object& object = objectList[displayObjects[i]];
+            const SceneStand& stand = scene.stands()[object.record];
+            glm::mat4& model = object.chunk->displayTransforms[object.part];
+            model = displayTransform(stand, time);
+            displayBoxes[i] = displayBounds(stand, model);
+            culler.setBox(displayCullObjects[i], displayBoxes[i]);
+        }
+    });
+    for (size_t i = 0; i < displayObjects.size(); i++)
+        bvh.update(displayObjects[i], displayBoxes[i]);
+}
+
+uint32_t SceneStreamer::roomContaining(float x, float z) const {
+    std::unordered_map<long long, std::vector<uint32_t>>::const_iterator cell =
+        grid.find(cellKey((int)std::floor(x / cellSize), (int)std::floor(z / cellSize)));
+    if (cell == grid.end())
+        return NO_ROOM;
+    for (uint32_t i : cell->second) {
+        const SceneRoom& room = scene.rooms()[i];
+        if (x >= room.minX && x <= room.maxX && z >= room.minZ && z <= room.maxZ)
+            return i;
+    }
+    return NO_ROOM;
+}
+
+// Where a door shows on the screen, in NDC (min x, min y, max x, max y), or
+// false when it is wholly behind the camera. Its outline is clipped to the
+// near plane first, so corners behind the camera do not flip across.
+static bool doorOnScreen(const glm::mat4& viewProjection, const SceneDoor& door, glm::vec4& rect) {
+    glm::vec4 corners[4] = {
+        viewProjection * glm::vec4(door.x0, door.bottom, door.z0, 1.0f),
+        viewProjection * glm::vec4(door.x1, door.bottom, door.z1, 1.0f),
+        viewProjection * glm::vec4(door.x1, door.top, door.z1, 1.0f),
+        viewProjection * glm::vec4(door.x0, door.top, door.z0, 1.0f)
+    };
+    rect = glm::vec4(1e30f, 1e30f, -1e30f, -1e30f);
+    bool any = false;
+    auto add = [&](const glm::vec4& corner) {
+        glm::vec2 ndc = glm::vec2(corner) / corner.w;
+        rect = glm::vec4(glm::min(glm::vec2(rect), ndc), glm::max(glm::vec2(rect.z, rect.w), ndc));
+        any = true;
+    };
+    for (int i = 0; i < 4; i++) {
+        const glm::vec4& a = corners[i];
+        const glm::vec4& b = corners[(i + 1) % 4];
+        float inA = a.z + a.w, inB = b.z + b.w;
+        if (inA >= 0.0f)
+            add(a);
+        if ((inA >= 0.0f) != (inB >= 0.0f))
+            add(glm::mix(a, b, inA / (inA - inB)));
+    }
+    return any;
+}
+
+// Closer to a door than this (on the floor plan), the camera may be standing
+// in it, and it fills whatever of the view reached its room
+static const float DOORWAY_REACH = 0.5f;
+
+void SceneStreamer::traverseDoors(const glm::mat4& viewProjection, const glm::vec3& cameraPos, uint32_t cameraRoom) {
+    cullFrame++;
+    std::vector<uint32_t> reached = { cameraRoom };
+    reachedFrame[cameraRoom] = cullFrame;
+    reachedRect[cameraRoom] = glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f);
+
+    // A room is looked at again only when a door shows more of it than
+    // before, so the part of the screen known for it only grows and the walk
+    // ends; the step limit is a guard against it creeping by rounding
+    std::vector<std::pair<uint32_t, glm::vec4>> pending = { { cameraRoom, reachedRect[cameraRoom] } };
+    size_t steps = 0, maxSteps = 16 * ((size_t)scene.header().doorCount + 1);
+    glm::vec2 camera(cameraPos.x, cameraPos.z);
+    while (!pending.empty() && steps++ < maxSteps) {
+        uint32_t room = pending.back().first;
+        glm::vec4 rect = pending.back().second;
+        pending.pop_back();
+        for (uint32_t d : roomDoors[room]) {
+            const SceneDoor& door = scene.doors()[d];
+            uint32_t other = door.rooms[0] == room ? door.rooms[1] : door.rooms[0];
+            glm::vec2 a(door.x0, door.z0), b(door.x1, door.z1);
+            float t = glm::clamp(glm::dot(camera - a, b - a) / glm::dot(b - a, b - a), 0.0f, 1.0f);
+            glm::vec4 seen = rect;
+            if (glm::length(camera - glm::mix(a, b, t)) > DOORWAY_REACH) {
+                glm::vec4 onScreen;
+                if (!doorOnScreen(viewProjection, door, onScreen))
+                    continue;
+                seen = glm::vec4(glm::max(glm::vec2(rect), glm::vec2(onScreen)),
+                    glm::min(glm::vec2(rect.z, rect.w), glm::vec2(onScreen.z, onScreen.w)));
+            }
+            if (seen.x >= seen.z || seen.y >= seen.w)
+                continue;
+            glm::vec4& known = reachedRect[other];
+            if (reachedFrame[other] == cullFrame) {
+                if (seen.x >= known.x && seen.y >= known.y && seen.z <= known.z && seen.w <= known.w)
+                    continue;
+                known = glm::vec4(glm::min(glm::vec2(known), glm::vec2(seen)),
+                    glm::max(glm::vec2(known.z, known.w), glm::vec2(seen.z, seen.w)));
+            }
+            else {
+                reachedFrame[other] = cullFrame;
+                known = seen;
+                reached.push_back(other);
+            }
+            pending.push_back({ other, known });
+        }
+    }
+
+    for (uint32_t room : reached) {
+        for (uint32_t backing : backingRooms[room])
+            backedFrame[backing] = cullFrame;
+    }
+    stats.reachedRooms = (int)reached.size();
+}
+
+// Whether box is within the part of the screen the doors show of room
+bool SceneStreamer::throughDoors(uint32_t room, const glm::mat4& viewProjection, const Aabb& box) const {
+    const glm::vec4& rect = reachedRect[room];
+    if (rect.x <= -1.0f && rect.y <= -1.0f && rect.z >= 1.0f && rect.w >= 1.0f)
+        return true;
+    // Planes where x (or y) over w equals the rect's edges, facing inwards
+    glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+    glm::vec4 x(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+    glm::vec4 y(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+    glm::vec4 planes[4] = { x - w * rect.x, w * rect.z - x, y - w * rect.y, w * rect.w - y };
+    for (const glm::vec4& plane : planes) {
+        glm::vec3 positive(plane.x >= 0.0f ? box.max.x : box.min.x, plane.y >= 0.0f ? box.max.y : box.min.y,
+            plane.z >= 0.0f ? box.max.z : box.min.z);
+        if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+// What something once too small must grow by before it is drawn again
+static const float DETAIL_HYSTERESIS = 4.0f / 3.0f;
+
+// Whether something size high at distance is under limit pixels on screen,
+// allowing for hysteresis when it was last time
+static bool tooSmall(bool wasTooSmall, float size, float distance, float limit, float pixelsPerUnit) {
+    if (pixelsPerUnit <= 0.0f)
+        return false;
+    float pixels = size * pixelsPerUnit / std::max(distance, 1e-3f);
+    return pixels < (wasTooSmall ? limit * DETAIL_HYSTERESIS : limit);
+}
+
+// Sets runs to what cullClusters() leaves of mesh's clusters first to end,
+// placed by model; returns the triangles in them.
+static uint32_t cullSculptureClusters(const SceneStreamer::SculptureMesh& mesh, uint32_t first, uint32_t end,
+    const glm::mat4& model, const glm::mat4& viewProjection, const glm::vec3& cameraPos,
+    std::vector<MeshArena::Range>& runs) {
+    // In the mesh's own space, where the clusters were bounded (the scale is
+    // uniform, so spheres stay spheres)
+    glm::vec3 eye = glm::vec3(glm::inverse(model) * glm::vec4(cameraPos, 1.0f));
+    glm::vec4 planes[6];
+    frustumPlanes(viewProjection * model, planes);
+    return cullClusters(mesh.clusters.data(), first, end, &eye, planes, runs);
+}
+
+const std::vector<uint32_t>& SceneStreamer::cull(const glm::mat4& viewProjection, const glm::vec3& cameraPos,
+    float pixelsPerUnit) {
+    for (Batch* batch : builtBatches)
+        batch->visible = false;
+    for (Chunk* chunk : resident) {
+        chunk->visible = false;
+        std::fill(chunk->artworkVisible.begin(), chunk->artworkVisible.end(), 0);
+        std::fill(chunk->displayVisible.begin(), chunk->displayVisible.end(), 0);
+    }
+    uint32_t cameraRoom = portalCulling && scene.header().doorCount > 0 ?
+        roomContaining(cameraPos.x, cameraPos.z) : NO_ROOM;
+    if (cameraRoom != NO_ROOM)
+        traverseDoors(viewProjection, cameraPos, cameraRoom);
+    else
+        stats.reachedRooms = (int)resident.size();
+
+    visibleList.clear();
+    stats.portalCulledObjects = 0;
+    stats.visibleObjects = 0;
+    stats.trianglesDrawn = stats.trianglesSaved = stats.clusterTrianglesCulled = 0;
+    size_t spans = 0;
+    for (uint32_t visible : culler.cull(viewProjection, jobs)) {
+        uint32_t index = cullObjects[visible];
+        const Object& object = objectList[index];
+        if (cameraRoom != NO_ROOM) {
+            uint32_t room = object.chunk->room;
+            bool reached = reachedFrame[room] == cullFrame;
+            bool shown = object.kind == Object::Room ? reached || backedFrame[room] == cullFrame :
+                reached && throughDoors(room, viewProjection, bvh.bounds(index));
+            if (!shown) {
+                stats.portalCulledObjects++;
+                continue;
+            }
+        }
+        stats.visibleObjects++;
+        if (object.kind == Object::Room) {
+            object.chunk->visible = true;
+            batches[object.chunk->batch].visible = true;
+        }
+        else if (object.kind == Object::Artwork) {
+            object.chunk->artworkVisible[object.part] = 1;
+            const SceneArtwork& artwork = scene.artworks()[object.record];
+            glm::vec3 center(artwork.center[0], artwork.center[1], artwork.center[2]);
+            unsigned char& small = object.chunk->artworkTiny[object.part];
+            small = tooSmall(small, std::max(artwork.width, artwork.height), glm::distance(center, cameraPos),
+                detailPixels, pixelsPerUnit);
+            if (small) {
+                stats.trianglesSaved += 2;
+                continue;
+            }
+        }
+        else if (object.kind == Object::Sculpture) {
+            const SculptureMesh& shared = *object.chunk->sculptureMeshes[object.part];
+            uint32_t fullCount = shared.fullIndexCount, simplifiedCount = shared.mesh.indexCount - fullCount;
+            const Aabb& box = bvh.bounds(index);
+            glm::vec3 size = box.max - box.min;
+            float height = std::max(size.x, std::max(size.y, size.z));
+            float distance = glm::distance((box.min + box.max) * 0.5f, cameraPos);
+            unsigned char& small = object.chunk->sculptureTiny[object.part];
+            small = tooSmall(small, height, distance, detailPixels, pixelsPerUnit);
+            if (small) {
+                stats.trianglesSaved += (int)(fullCount / 3);
+                continue;
+            }
+            unsigned char& simplified = object.chunk->sculptureSimplified[object.part];
+            simplified = simplifiedCount > 0 && tooSmall(simplified, height, distance, simplifyPixels, pixelsPerUnit);
+            if (simplified) {
+                object.chunk->sculptureRuns[object.part].assign(1, { fullCount, simplifiedCount });
+                stats.trianglesDrawn += (int)(simplifiedCount / 3);
+                stats.trianglesSaved += (int)((fullCount - simplifiedCount) / 3);
+            }
+            else if (clusterCulling && !shared.clusters.empty()) {
+                // Culled below, a span of clusters per job
+                for (uint32_t first = 0; first < shared.clusters.size(); first += clustersPerJob) {
+                    if (clusterSpans.size() <= spans)
+                        clusterSpans.resize(spans + 1);
+                    ClusterSpan& span = clusterSpans[spans++];
+                    span.object = index;
+                    span.first = first;
+                    span.end = std::min(first + clustersPerJob, (uint32_t)shared.clusters.size());
+                }
+            }
+            else {
+                object.chunk->sculptureRuns[object.part].assign(1, { 0, fullCount });
+                stats.trianglesDrawn += (int)(fullCount / 3);
+            }
+        }
+        else {
+            object.chunk->displayVisible[object.part] = 1;
+            const SceneStand& stand = scene.stands()[object.record];
+            glm::vec3 center(stand.position[0], stand.position[1] + stand.displayBottom + stand.displayHeight * 0.5f,
+                stand.position[2]);
+            unsigned char& small = object.chunk->displayTiny[object.part];
+            small = tooSmall(small, std::max(stand.displayWidth, stand.displayHeight), glm::distance(center, cameraPos),
+                detailPixels, pixelsPerUnit);
+            if (small) {
+                stats.trianglesSaved += 2;
+                continue;
+            }
+        }
+        if (object.kind == Object::Artwork || object.kind == Object::Display)
+            stats.trianglesDrawn += 2;
+        visibleList.push_back(index);
+    }
+
+    forRanges(jobs, spans, 1, [&](size_t first, size_t end) {
+        for (size_t i = first; i < end; i++) {
+            ClusterSpan& span = clusterSpans[i];
+            const Object& object = objectList[span.object];
+            span.triangles = cullSculptureClusters(*object.chunk->sculptureMeshes[object.part], span.first, span.end,
+                sculptureTransform(scene.sculptures()[object.record]), viewProjection, cameraPos, span.runs);
+        }
+    });
+    // Each sculpture's spans, in order, joined into its runs
+    for (size_t i = 0; i < spans; i++) {
+        const ClusterSpan& span = clusterSpans[i];
+        const Object& object = objectList[span.object];
+        std::vector<MeshArena::Range>& runs = object.chunk->sculptureRuns[object.part];
+        if (span.first == 0) {
+            runs.clear();
+            stats.clusterTrianglesCulled += (int)(object.chunk->sculptureMeshes[object.part]->fullIndexCount / 3);
+        }
+        for (const MeshArena::Range& run : span.runs) {
+            if (!runs.empty() && runs.back().firstIndex + runs.back().indexCount == run.firstIndex)
+                runs.back().indexCount += run.indexCount;
+            else
+                runs.push_back(run);
+        }
+        stats.trianglesDrawn += (int)span.triangles;
+        stats.clusterTrianglesCulled -= (int)span.triangles;
+    }
+
+    // A batch's stands go once the largest is too small, measured from the
+    // nearest point of the batch
+    for (Batch* batch : builtBatches) {
+        if (!batch->visible)
+            continue;
+        if (batch->levelCount > 1) {
+            glm::vec3 low = batch->levels[0].boundsMin, high = low + batch->levels[0].boundsSize;
+            float distance = glm::distance(glm::clamp(cameraPos, low, high), cameraPos);
+            batch->level = tooSmall(batch->level == 1, batch->standSize, distance, detailPixels, pixelsPerUnit) ? 1 : 0;
+        }
+        stats.trianglesDrawn += (int)batch->levels[batch->level].indexCount / 3;
+        stats.trianglesSaved += (int)(batch->levels[0].indexCount - batch->levels[batch->level].indexCount) / 3;
+    }
+    stats.culledObjects = culler.counters().culled;
+    return visibleList;
+}
+
+const SceneStreamer::Object* SceneStreamer::pick(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+    float& distance) const {
+    // Rooms hold the camera, so only what is in them counts, and rays pass
+    // through doors
+    uint32_t nearest = bvh.raycast(origin, direction, maxDistance, [&](uint32_t index, float enter) {
+        const Object& object = objectList[index];
+        if (object.kind == Object::Room)
+            return -1.0f;
+        if (object.kind != Object::Wall || wallOpenings[object.record].empty())
+            return enter;
+        const SceneWall& wall = scene.walls()[object.record];
+        glm::vec2 start(wall.x0, wall.z0), along = glm::normalize(glm::vec2(wall.x1, wall.z1) - start);
+        glm::vec2 normal(-along.y, along.x);
+        float facing = glm::dot(glm::vec2(direction.x, direction.z), normal);
+        if (std::fabs(facing) < 1e-6f)
+            return enter;
+        float t = -glm::dot(glm::vec2(origin.x, origin.z) - start, normal) / facing;
+        glm::vec3 hit = origin + direction * t;
+        float distanceAlong = glm::dot(glm::vec2(hit.x, hit.z) - start, along);
+        for (const WallOpening& opening : wallOpenings[object.record]) {
+            if (distanceAlong > opening.from && distanceAlong < opening.to && hit.y > opening.bottom && hit.y < opening.top)
+                return -1.0f;
+        }
+        return std::max(t, enter);
+    }, distance);
+    return nearest == Bvh::NO_OBJECT ? nullptr : &objectList[nearest];
+}
+
+bool SceneStreamer::collides(const glm::vec3& position, float radius) const {
+    bool blocked = false;
+    Aabb around = { position - glm::vec3(radius), position + glm::vec3(radius) };
+    bvh.overlap(around, [&](uint32_t index) {
+        const Object& object = objectList[index];
+        if (object.kind == Object::Stand || object.kind == Object::Sculpture) {
+            blocked = true;
+        }
+        else if (object.kind == Object::Wall) {
+            // Distance on the floor plan to the segment, less the doors tall
+            // enough to walk through
+            const SceneWall& wall = scene.walls()[object.record];
+            glm::vec2 start(wall.x0, wall.z0), end(wall.x1, wall.z1);
+            float length = glm::length(end - start);
+            std::vector<std::pair<float, float>> solid = { { length * object.part / wall.segments,
+                length * (object.part + 1) / wall.segments } };
+            for (const WallOpening& opening : wallOpenings[object.record]) {
+                if (opening.top < position.y)
+                    continue;
+                std::vector<std::pair<float, float>> rest;
+                for (const std::pair<float, float>& piece : solid) {
+                    if (opening.from >= piece.second || opening.to <= piece.first) {
+                        rest.push_back(piece);
+                        continue;
+                    }
+                    if (opening.from > piece.first)
+                        rest.push_back({ piece.first, opening.from });
+                    if (opening.to < piece.second)
+                        rest.push_back({ opening.to, piece.second });
+                }
+                solid.swap(rest);
+            }
+            glm::vec2 p(position.x, position.z);
+            for (const std::pair<float, float>& piece : solid) {
+                glm::vec2 a = glm::mix(start, end, piece.first / length), b = glm::mix(start, end, piece.second / length);
+                float t = glm::clamp(glm::dot(p - a, b - a) / std::max(glm::dot(b - a, b - a), 1e-12f), 0.0f, 1.0f);
+                blocked = blocked || glm::length(p - glm::mix(a, b, t)) < radius;
+            }
+        }
+    });
+    return blocked;
+}
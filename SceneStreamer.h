@@ -0,0 +1,337 @@
+#ifndef SCENE_STREAMER_H
+#define SCENE_STREAMER_H
+
+#include "Bvh.h"
+#include "CookedMesh.h"
+#include "FrustumCuller.h"
+#include "JobSystem.h"
+#include "MeshArena.h"
+#include "Scene.h"
+#include "SceneGeometry.h"
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class TextureResidency;
+
+// Keeps only the part of a gallery around the camera in memory. Every room is
+// a chunk: its floor, ceiling and walls with their artworks, plus the stands,
+// sculptures and lights standing in it. Chunks whose room comes within loadRadius of the
+// camera are built on a background thread and uploaded a few per frame;
+// chunks further than loadRadius + hysteresis are unloaded, so walking along
+// the edge does not load and unload the same room over and over. Paintings are
+// registered with the texture residency while their room is loaded. What
+// update() and drawing cost depends on how many rooms are near, not on how
+// large the gallery is.
+//
+// The static meshes (floors, ceilings, walls and stand boxes) of resident
+// rooms are built into batches instead, one per batchSize square of the floor
+// plan, each drawn with a single call whichever materials it uses (they share
+// one texture array). When a room comes or goes only its square's batch is
+// rebuilt, on the same background thread; chunks keep only their artworks and
+// displays. Sculpture meshes are mapped from their cooked copies (see
+// CookedMesh.h) on that thread too, and kept in meshes once for all the
+// resident sculptures using them.
+//
+// Far away, a batch is drawn without its stand boxes once the largest of them
+// would be under detailPixels tall on screen, and paintings, displays and
+// sculptures that small are not drawn at all. Sculptures under simplifyPixels
+// tall are drawn from the simplified level cooked with their mesh. Each comes
+// back only once it is a third larger than its threshold, so nothing flickers
+// there.
+//
+// A sculpture in view is drawn cluster by cluster (see MeshCluster): those
+// wholly facing away from the camera, or outside the frustum, are left out,
+// and the rest are drawn as runs of neighbouring clusters. Sculptures are
+// taken to be closed surfaces, whose far side the near side hides.
+//
+// The rooms, walls, stands, sculptures, artworks and displays of resident
+// chunks are kept in a BVH (see Bvh.h), rebuilt when chunks come and go and
+// refitted as the displays turn, which answers picking and collision. The
+// rooms, sculptures, artworks and displays, which are what gets drawn, are also kept in a frustum culler (see
+// FrustumCuller.h) that tests them all in SIMD batches each frame.
+//
+// When the scene has doors, rooms are also culled by what can be seen through
+// them. Starting from the camera's room, each door in view narrows the part
+// of the screen the room behind it can show; rooms no door chain reaches are
+// not drawn, and paintings and displays in reached rooms must fall within
+// what their doors show. A room sharing a wall with a reached one still draws
+// its own walls, floor and ceiling, since its wall may be the one seen.
+//
+// Given a job system (see JobSystem.h), animate() and cull() spread their
+// work over its threads: the displays' transforms and bounds, the frustum
+// tests and the sculptures' clusters, a span of them per job. What they
+// leave in the chunks is the same either way, and the GL thread only reads it.
+class SceneStreamer {
+public:
+    // A sculpture mesh in meshes, shared by the resident sculptures using it
+    struct SculptureMesh {
+        MeshArena::Mesh mesh;
+        uint32_t fullIndexCount;    // Of the full level; the simplified one, if any, follows
+        std::vector<MeshCluster> clusters;
+        int users;
+        size_t bytes;
+    };
+
+    struct Chunk {
+        uint32_t room;
+        SceneSelection selection;   // Its walls, artworks and stands (built without the static mesh)
+        std::vector<uint32_t> lights;
+        bool resident;
+        bool loading;
+        unsigned int generation;    // Bumped on every load, to spot stale builds
+        unsigned int VAO, VBO, EBO;
+        SceneGeometry geometry;     // Counts and bounds; the vertices live on the GPU
+        size_t geometryBytes;
+        std::vector<unsigned int> paintings;    // Per artwork, 0 for the streamed one
+        std::vector<int> displayLayers;         // Texture array layer of each display
+        std::vector<glm::mat4> displayTransforms;   // Of each display, from the last animate()
+        std::vector<uint32_t> sculptures;       // Standing in the room
+        std::vector<const SculptureMesh*> sculptureMeshes;      // Per sculpture, once resident
+        std::vector<int> sculptureLayers;       // Texture array layer of each sculpture's material
+        uint32_t batch;             // Index of the batch holding its static mesh
+
+        // From the last cull(): whether the room (its static mesh), each
+        // artwork and each display (in stand order) is in view
+        bool visible;
+        std::vector<unsigned char> artworkVisible;
+        std::vector<unsigned char> displayVisible;
+        std::vector<std::vector<MeshArena::Range>> sculptureRuns;  // Of each sculpture in view: what of it to draw
+
+        // Whether each artwork and display was last found too small to draw
+        std::vector<unsigned char> artworkTiny;
+        std::vector<unsigned char> displayTiny;
+        std::vector<unsigned char> sculptureTiny;
+        std::vector<unsigned char> sculptureSimplified;     // ... or small enough for its simplified level
+    };
+
+    // The static meshes of the resident rooms in one square
+    struct Batch {
+        std::vector<uint32_t> rooms;    // Every room centred in the square
+        bool dirty;                     // Its resident rooms changed since its last build was queued
+        bool building;
+        bool built;
+        MeshArena::Mesh levels[2];      // Once built: all of it, then without the stand boxes
+        int levelCount;                 // 1 when it has no stands
+        float standSize;                // Longest side of its largest stand
+        size_t geometryBytes;
+        bool visible;                   // From the last cull(): one of its rooms is
+        int level;                      // ... and the level of detail to draw
+    };
+
+    // Something in a resident chunk
+    struct Object {
+        enum Kind { Room, Wall, Stand, Artwork, Display, Sculpture };
+        Kind kind;
+        Chunk* chunk;
+        uint32_t record;    // Index of the wall, stand, artwork or sculpture in the scene
+        uint32_t part;      // Wall segment, or artwork, display or sculpture index within the chunk
+    };
+
+    struct Counters {
+        int residentChunks;
+        int loadingChunks;
+        size_t geometryBytes;       // Vertex and index buffers of resident chunks and batches
+        int batches;                // Built
+        long long loads;
+        long long unloads;
+        int visibleObjects;         // Rooms, artworks, displays and sculptures in view at the last cull()
+        int culledObjects;          // Outside the frustum
+        int portalCulledObjects;    // Inside it but hidden behind walls
+        int reachedRooms;           // Seen through doors, counting the camera's room
+        int trianglesDrawn;         // Of the batches, paintings, displays and sculptures in view
+        int trianglesSaved;         // Left out of those by levels of detail
+        int clusterTrianglesCulled; // Left out of the sculptures in view, in clusters facing away or off screen
+    };
+
+    // materialLayer is called on the background thread. virtualArtwork is the
+    // artwork drawn from the virtual texture (layer -1), or -1 for none.
+    // Batches are kept in meshes.
+    SceneStreamer(const Scene& scene, TextureResidency& paintings, MeshArena& meshes,
+        std::function<int(const char*)> materialLayer, int virtualArtwork, float loadRadius, float hysteresis);
+    ~SceneStreamer();
+
+    // Once per frame on the GL thread: queues rooms that came into range,
+    // uploads built ones and unloads those out of range.
+    void update(const glm::vec3& cameraPos);
+
+    // Blocks until every queued room is built and uploaded.
+    void finish();
+
+    // The chunks ready to draw, in no particular order.
+    const std::vector<Chunk*>& residentChunks() const { return resident; }
+
+    // The batches ready to draw, in no particular order.
+    const std::vector<Batch*>& staticBatches() const { return builtBatches; }
+
+    // The count lights of resident chunks nearest to position; returns how
+    // many there were.
+    int nearestLights(const glm::vec3& position, SceneLight* out, int count) const;
+
+    // Where a stand's display is at time seconds.
+    static glm::mat4 displayTransform(const SceneStand& stand, float time);
+
+    // Where a sculpture's mesh is placed.
+    static glm::mat4 sculptureTransform(const SceneSculpture& sculpture);
+
+    // Turns the displays to time, setting their chunks' displayTransforms
+    // and refitting their bounds.
+    void animate(float time);
+
+    // Sets the visibility flags and levels of detail of resident chunks and
+    // batches for this view and returns the objects to draw, as indices into
+    // objects(). pixelsPerUnit is how many pixels tall something 1 unit high
+    // and 1 unit away is (viewport height * projection[1][1] / 2); with 0
+    // everything is drawn in full.
+    const std::vector<uint32_t>& cull(const glm::mat4& viewProjection, const glm::vec3& cameraPos,
+        float pixelsPerUnit = 0.0f);
+
+    // The nearest wall, stand, artwork, display or sculpture along the ray, or
+    // nullptr.
+    const Object* pick(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance) const;
+
+    // Whether a sphere at position would cut into a wall, a stand or a
+    // sculpture's box.
+    bool collides(const glm::vec3& position, float radius) const;
+
+    const Bvh& hierarchy() const { return bvh; }
+    const std::vector<Object>& objects() const { return objectList; }
+
+    const Counters& counters() const { return stats; }
+
+    // Built rooms uploaded per update()
+    int uploadsPerFrame = 2;
+
+    // Side of the squares rooms are batched by
+    static constexpr float batchSize = 25.0f;
+
+    // Whether cull() looks through doors (when the scene has any)
+    bool portalCulling = true;
+
+    // Screen height below which cull() leaves out stand boxes, paintings,
+    // displays and sculptures
+    float detailPixels = 4.0f;
+
+    // Screen height below which cull() draws sculptures' simplified level
+    float simplifyPixels = 256.0f;
+
+    // Whether cull() leaves out the clusters of sculptures that face away or
+    // are off screen
+    bool clusterCulling = true;
+
+    // Threads animate() and cull() may use, or nullptr to do all on the
+    // calling thread
+    JobSystem* jobs = nullptr;
+
+    // Work handed to each job: displays placed by animate(), and clusters of
+    // one sculpture culled by cull()
+    static constexpr size_t displaysPerJob = 256;
+    static constexpr uint32_t clustersPerJob = 1024;
+
+private:
+    static constexpr uint32_t NO_BATCH = 0xFFFFFFFF;
+
+    struct Built {
+        uint32_t room;
+        uint32_t batch;         // Or NO_BATCH for a room's chunk
+        unsigned int generation;
+        SceneGeometry geometry;
+        std::vector<std::string> paintingKeys;  // textureContentKey() per artwork
+        std::vector<int> displayLayers;
+        SceneGeometry standless;    // A batch without its stand boxes, if it has any
+        float standSize;
+        std::vector<std::shared_ptr<CookedMesh>> sculptureMeshes;   // Per sculpture, null when it failed to load
+        std::vector<int> sculptureLayers;
+    };
+
+    // Clusters of a sculpture in view, culled by one job in cull()
+    struct ClusterSpan {
+        uint32_t object;            // BVH object
+        uint32_t first, end;        // Its clusters
+        std::vector<MeshArena::Range> runs;
+        uint32_t triangles;         // In runs
+    };
+
+    struct Request {
+        uint32_t room;
+        uint32_t batch;         // Or NO_BATCH for a room's chunk
+        unsigned int generation;
+        std::vector<uint32_t> rooms;    // A batch's resident rooms when queued
+    };
+
+    void workerMain();
+    float distanceTo(const Chunk& chunk, const glm::vec3& position) const;
+    void upload(Chunk& chunk, Built& built);
+    void unload(Chunk& chunk);
+    void upload(Batch& batch, Built& built);
+    void freeBatch(Batch& batch);
+    void markBatch(uint32_t batch);
+    void queueBatches();
+    void uploadBuilt(std::vector<Built>& ready);
+    void rebuildHierarchy();
+    uint32_t roomContaining(float x, float z) const;
+    void traverseDoors(const glm::mat4& viewProjection, const glm::vec3& cameraPos, uint32_t cameraRoom);
+    bool throughDoors(uint32_t room, const glm::mat4& viewProjection, const Aabb& box) const;
+    static Aabb displayBounds(const SceneStand& stand, const glm::mat4& model);
+    Aabb sculptureBounds(const SceneSculpture& sculpture, const MeshArena::Mesh& mesh) const;
+    long long cellKey(int x, int z) const { return ((long long)x << 32) ^ (unsigned int)z; }
+
+    const Scene& scene;
+    TextureResidency& paintingTextures;
+    MeshArena& meshes;
+    std::function<int(const char*)> materialLayer;
+    int virtualArtwork;
+    float loadRadius, hysteresis;
+
+    std::vector<Chunk> chunks;
+    std::vector<Chunk*> active;     // Resident or loading
+    std::vector<Chunk*> resident;
+    float cellSize;
+    std::unordered_map<long long, std::vector<uint32_t>> grid;  // Cell -> rooms overlapping it
+
+    std::vector<Batch> batches;
+    std::vector<Batch*> builtBatches;
+    std::vector<uint32_t> dirtyBatches;
+
+    std::unordered_map<std::string, SculptureMesh> sculptureMeshes;   // By mesh path
+
+    std::vector<std::vector<uint32_t>> roomDoors;       // By room: doors to other rooms
+    std::vector<std::vector<uint32_t>> backingRooms;    // By room: rooms whose walls back onto it
+    std::vector<std::vector<WallOpening>> wallOpenings; // By wall
+    unsigned int cullFrame = 0;
+    std::vector<unsigned int> reachedFrame;     // By room: the cull() that last reached it
+    std::vector<unsigned int> backedFrame;      // ... or drew it for a reached neighbour
+    std::vector<glm::vec4> reachedRect;         // By room: what of the screen its doors show, in NDC
+
+    Bvh bvh;
+    std::vector<Object> objectList;     // By BVH object
+    std::vector<uint32_t> displayObjects;
+    FrustumCuller culler;
+    std::vector<uint32_t> cullObjects;      // By culler object: its BVH object
+    std::vector<uint32_t> displayCullObjects;   // Culler object of each of displayObjects
+    std::vector<uint32_t> visibleList;
+    std::vector<Aabb> displayBoxes;             // Of displayObjects, during animate()
+    std::vector<ClusterSpan> clusterSpans;      // Of the sculptures in view, during cull()
+    bool chunksChanged = false;
+    float displayTime = 0.0f;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable requestReady;
+    std::condition_variable builtReady;
+    std::deque<Request> requests;
+    std::vector<Built> built;
+    int building = 0;
+    bool stopping = false;
+
+    Counters stats;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "TextureArrayPacker.h"
+#include "TextureLoader.h"
+#include "TextureRegistry.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <iostream>
+
+TextureArrayPacker::TextureArrayPacker(TextureLoader& loader, int layerWidth, int layerHeight, int maxLayersPerArray,
+    int maxArrays)
+    : loader(loader), layerWidth(layerWidth), layerHeight(layerHeight), maxArrays(maxArrays) {
+    int limit = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &limit);
+    maxLayers = std::max(1, std::min(maxLayersPerArray, limit));
+}
+
+TextureArrayPacker::~TextureArrayPacker() {
+    if (!arrays.empty())
+        glDeleteTextures((int)arrays.size(), arrays.data());
+}
+
+TextureLayer TextureArrayPacker::add(const std::string& path) {
+    std::string key = textureContentKey(path);
+    std::map<std::string, int>::iterator found = slots.find(key);
+    int slot;
+    if (found != slots.end() && sameTextureFile(paths[found->second], path)) {
+        slot = found->second;
+    }
+    else if (maxArrays > 0 && (int)paths.size() >= maxArrays * maxLayers) {
+        std::cerr << "Texture arrays: no layer left for " << path << " (" << maxArrays << " x "
+            << maxLayers << " layers)" << std::endl;
+        return { -1, -1 };
+    }
+    else {
+        slot = (int)paths.size();
+        paths.push_back(path);
+        slots.emplace(key, slot);   // Keeps the first image with a colliding key
+    }
+    return { slot / maxLayers, slot % maxLayers };
+}
+
+void TextureArrayPacker::build() {
+    int arrayTotal = ((int)paths.size() + maxLayers - 1) / maxLayers;
+    arrays.resize(arrayTotal);
+    glGenTextures(arrayTotal, arrays.data());
+
+    // Layers are cleared on the GPU rather than by uploading placeholder texels
+    unsigned int framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    const float placeholder[4] = { 0.5f, 0.5f, 0.5f, 1.0f };
+
+    for (int a = 0; a < arrayTotal; a++) {
+        int layers = std::min(maxLayers, (int)paths.size() - a * maxLayers);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[a]);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, layerWidth, layerHeight, layers, 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        for (int layer = 0; layer < layers; layer++) {
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, arrays[a], 0, layer);
+            glClearBufferfv(GL_COLOR, 0, placeholder);
+        }
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+
+    for (int slot = 0; slot < (int)paths.size(); slot++)
+        loader.loadLayer(paths[slot], arrays[slot / maxLayers], slot % maxLayers, layerWidth, layerHeight);
+}
@@ -0,0 +1,51 @@
+#ifndef TEXTURE_ARRAY_PACKER_H
+#define TEXTURE_ARRAY_PACKER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+class TextureLoader;
+
+// Where a packed image ended up.
+struct TextureLayer {
+    int array;  // Index into TextureArrayPacker::array()
+    int layer;
+};
+
+// Packs images into GL_TEXTURE_2D_ARRAY layers that all share one size, so any
+// number of materials can be drawn with a single texture binding and a layer
+// index per vertex. Images are resampled to the layer size as they load. Once
+// an array is full (or hits GL_MAX_ARRAY_TEXTURE_LAYERS) packing continues in
+// a new one, up to maxArrays (0 for no limit) for users that bind only one.
+class TextureArrayPacker {
+public:
+    TextureArrayPacker(TextureLoader& loader, int layerWidth, int layerHeight, int maxLayersPerArray = 256,
+        int maxArrays = 0);
+    ~TextureArrayPacker();
+
+    // Reserves a layer for path. Paths to identical files (same key from
+    // textureContentKey(), then same bytes) share a layer. Returns { -1, -1 },
+    // with an error on std::cerr, when every array allowed is full.
+    TextureLayer add(const std::string& path);
+
+    // Creates the arrays, clears every layer to a placeholder and queues the
+    // images on the loader. Call once after the last add().
+    void build();
+
+    int arrayCount() const { return (int)arrays.size(); }
+    unsigned int array(int index) const { return arrays[index]; }
+
+private:
+    TextureLoader& loader;
+    int layerWidth;
+    int layerHeight;
+    int maxLayers;
+    int maxArrays;
+
+    std::vector<std::string> paths;     // One per layer, in packing order
+    std::map<std::string, int> slots;   // Content key -> layer
+    std::vector<unsigned int> arrays;
+};
+
+#endif
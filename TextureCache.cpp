@@ -0,0 +1,218 @@
+#include "TextureCache.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+static const uint32_t TEXTURE_FILE_VERSION = 1;
+
+static bool sourceStamp(const std::string& path, uint64_t& size, int64_t& time) {
+    std::error_code error;
+    size = (uint64_t)fs::file_size(path, error);
+    if (error)
+        return false;
+    time = (int64_t)fs::last_write_time(path, error).time_since_epoch().count();
+    return !error;
+}
+
+bool CookedTexture::open(const std::string& cachePath, const std::string& sourcePath) {
+    if (!file.open(cachePath))
+        return false;
+
+    bool valid = file.size() >= sizeof(TextureFileHeader);
+    if (valid) {
+        const TextureFileHeader& h = header();
+        valid = memcmp(h.magic, "GTEX", 4) == 0 && h.version == TEXTURE_FILE_VERSION &&
+            h.levelCount > 0 &&
+            file.size() >= sizeof(TextureFileHeader) + h.levelCount * sizeof(TextureFileLevel);
+    }
+    if (valid) {
+        const TextureFileLevel& last = level(header().levelCount - 1);
+        valid = last.offset + last.size <= file.size();
+    }
+
+    // A cache that ships without its sources is fine; one older than them is not
+    uint64_t size;
+    int64_t time;
+    if (valid && sourceStamp(sourcePath, size, time))
+        valid = header().sourceSize == size && header().sourceTime == time;
+
+    if (!valid)
+        file.close();
+    return valid;
+}
+
+const TextureFileHeader& CookedTexture::header() const {
+    return *(const TextureFileHeader*)file.data();
+}
+
+const TextureFileLevel& CookedTexture::level(int index) const {
+    const TextureFileLevel* levels = (const TextureFileLevel*)(file.data() + sizeof(TextureFileHeader));
+    return levels[index];
+}
+
+const unsigned char* CookedTexture::levelData(int index) const {
+    return file.data() + level(index).offset;
+}
+
+bool isCompressed(TextureFormat format) {
+    return format == TextureFormat::BC1 || format == TextureFormat::BC3 || format == TextureFormat::BC7;
+}
+
+std::string textureCachePath(const std::string& sourcePath) {
+    fs::path path = fs::path("cache") / fs::path(sourcePath).relative_path();
+    path += ".gtex";
+    return path.string();
+}
+
+static BlockFormat blockFormat(TextureFormat format) {
+    if (format == TextureFormat::BC1)
+        return BlockFormat::BC1;
+    if (format == TextureFormat::BC3)
+        return BlockFormat::BC3;
+    return BlockFormat::BC7;
+}
+
+bool cookTexture(const std::string& sourcePath, const std::string& cachePath,
+    const CookOptions& options, CookResult* result) {
+    TextureFileHeader header = {};
+    memcpy(header.magic, "GTEX", 4);
+    header.version = TEXTURE_FILE_VERSION;
+    if (!sourceStamp(sourcePath, header.sourceSize, header.sourceTime)) {
+        std::cerr << "Failed to cook texture: " << sourcePath << std::endl;
+        return false;
+    }
+
+    int width, height, sourceChannels;
+    if (!stbi_info(sourcePath.c_str(), &width, &height, &sourceChannels)) {
+        std::cerr << "Failed to cook texture: " << sourcePath << std::endl;
+        return false;
+    }
+    bool hasAlpha = sourceChannels == 2 || sourceChannels == 4;
+
+    TextureFormat format;
+    switch (options.format) {
+    case CookFormat::Raw: format = hasAlpha ? TextureFormat::RGBA8 : TextureFormat::RGB8; break;
+    case CookFormat::Auto: format = hasAlpha ? TextureFormat::BC3 : TextureFormat::BC1; break;
+    case CookFormat::BC1: format = TextureFormat::BC1; break;
+    case CookFormat::BC3: format = TextureFormat::BC3; break;
+    default: format = TextureFormat::BC7; break;
+    }
+
+    // Grey and grey-alpha images are widened so GL only ever sees RGB/RGBA,
+    // and the block encoders always take RGBA
+    int channels = (format == TextureFormat::RGB8) ? 3 : 4;
+    stbi_set_flip_vertically_on_load_thread(true);
+    unsigned char* pixels = stbi_load(sourcePath.c_str(), &width, &height, &sourceChannels, channels);
+    if (!pixels) {
+        std::cerr << "Failed to cook texture: " << sourcePath << std::endl;
+        return false;
+    }
+
+    header.format = (uint32_t)format;
+    header.width = (uint32_t)width;
+    header.height = (uint32_t)height;
+
+    std::vector<std::vector<unsigned char>> mips;
+    mips.emplace_back(pixels, pixels + (size_t)width * height * channels);
+    std::vector<MipLevel> chain;
+    buildMips(pixels, width, height, channels, options.mips, chain);
+    stbi_image_free(pixels);
+
+    std::vector<TextureFileLevel> levels;
+    levels.push_back({ (uint32_t)width, (uint32_t)height, 0, (uint64_t)width * height * channels });
+    for (MipLevel& mip : chain) {
+        levels.push_back({ (uint32_t)mip.width, (uint32_t)mip.height, 0, (uint64_t)mip.pixels.size() });
+        mips.push_back(std::move(mip.pixels));
+    }
+    uint64_t uncompressedBytes = 0;
+    for (const TextureFileLevel& level : levels)
+        uncompressedBytes += (uint64_t)level.width * level.height * 4;
+    header.levelCount = (uint32_t)levels.size();
+
+    if (isCompressed(format)) {
+        // Mips are filtered from the uncompressed level above, then encoded
+        BlockFormat block = blockFormat(format);
+        for (size_t i = 0; i < levels.size(); i++) {
+            std::vector<unsigned char> encoded(compressedSize(block, levels[i].width, levels[i].height));
+            compressImage(block, options.quality, mips[i].data(), levels[i].width, levels[i].height, encoded.data());
+            levels[i].size = encoded.size();
+            mips[i] = std::move(encoded);
+        }
+    }
+
+    uint64_t offset = sizeof(TextureFileHeader) + levels.size() * sizeof(TextureFileLevel);
+    for (TextureFileLevel& level : levels) {
+        level.offset = offset;
+        offset += level.size;
+    }
+
+    std::error_code error;
+    fs::create_directories(fs::path(cachePath).parent_path(), error);
+    std::ofstream out(cachePath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Failed to write texture cache: " << cachePath << std::endl;
+        return false;
+    }
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)levels.data(), levels.size() * sizeof(TextureFileLevel));
+    for (const std::vector<unsigned char>& mip : mips)
+        out.write((const char*)mip.data(), mip.size());
+    if (!out)
+        return false;
+
+    if (result) {
+        result->format = format;
+        result->uncompressedBytes = uncompressedBytes;
+        result->storedBytes = offset - levels[0].offset;
+    }
+    return true;
+}
+
+static bool isImageFile(const fs::path& path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".jpg" || extension == ".jpeg" || extension == ".png";
+}
+
+static const char* formatName(TextureFormat format) {
+    static const char* names[] = { "RGB8", "RGBA8", "BC1", "BC3", "BC7" };
+    return names[(int)format];
+}
+
+int cookTextures(const std::vector<std::string>& directories, const CookOptions& options) {
+    int failures = 0;
+    uint64_t totalUncompressed = 0, totalStored = 0;
+    for (const std::string& directory : directories) {
+        std::error_code error;
+        for (const fs::directory_entry& entry : fs::directory_iterator(directory, error)) {
+            if (!entry.is_regular_file() || !isImageFile(entry.path()))
+                continue;
+
+            std::string source = entry.path().lexically_normal().generic_string();
+            std::string target = textureCachePath(source);
+            CookResult result;
+            if (!cookTexture(source, target, options, &result)) {
+                failures++;
+                continue;
+            }
+
+            totalUncompressed += result.uncompressedBytes;
+            totalStored += result.storedBytes;
+            std::cout << "Cooked " << source << " -> " << target << " (" << formatName(result.format) << ", "
+                << result.uncompressedBytes / 1024 << " KB -> " << result.storedBytes / 1024 << " KB, saved "
+                << (result.uncompressedBytes - std::min(result.uncompressedBytes, result.storedBytes)) / 1024
+                << " KB)" << std::endl;
+        }
+        if (error)
+            std::cerr << "Failed to read directory: " << directory << std::endl;
+    }
+
+    std::cout << "Texture memory: " << totalUncompressed / 1024 << " KB uncompressed, "
+        << totalStored / 1024 << " KB cooked" << std::endl;
+    return failures;
+}
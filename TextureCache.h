@@ -0,0 +1,90 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "MappedFile.h"
+#include "BlockCompression.h"
+#include "MipBuilder.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Pixel layouts a cooked texture can hold.
+enum class TextureFormat : uint32_t {
+    RGB8 = 0,
+    RGBA8 = 1,
+    BC1 = 2,
+    BC3 = 3,
+    BC7 = 4
+};
+
+bool isCompressed(TextureFormat format);
+
+// On-disk layout of a cooked .gtex file: this header, one TextureFileLevel per
+// mip, then every level's pixels back to back, largest first. Pixels are stored
+// bottom row first, matching what GL expects, so no flip is needed at load.
+struct TextureFileHeader {
+    char magic[4];          // "GTEX"
+    uint32_t version;
+    uint32_t format;        // TextureFormat
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint64_t sourceSize;    // Size and timestamp of the image the file was
+    int64_t sourceTime;     // cooked from, used to spot stale entries
+};
+
+struct TextureFileLevel {
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;        // From the start of the file
+    uint64_t size;
+};
+
+// A cooked texture mapped straight from disk.
+class CookedTexture {
+public:
+    // Fails if the file is missing, malformed, or older than sourcePath.
+    bool open(const std::string& cachePath, const std::string& sourcePath);
+
+    const TextureFileHeader& header() const;
+    const TextureFileLevel& level(int index) const;
+    const unsigned char* levelData(int index) const;
+
+private:
+    MappedFile file;
+};
+
+// Where the cooked copy of an image lives, e.g. pictures/adam.jpg ->
+// cache/pictures/adam.jpg.gtex
+std::string textureCachePath(const std::string& sourcePath);
+
+enum class CookFormat {
+    Raw,    // Uncompressed RGB8/RGBA8
+    Auto,   // BC1 for opaque images, BC3 when there is an alpha channel
+    BC1,
+    BC3,
+    BC7
+};
+
+struct CookOptions {
+    CookFormat format = CookFormat::Auto;
+    CompressionQuality quality = CompressionQuality::Normal;
+    MipOptions mips;
+};
+
+// Bytes the mip chain takes uncompressed (at 4 bytes per texel, which is how
+// drivers store RGB8 too) and as written to the cache.
+struct CookResult {
+    TextureFormat format;
+    uint64_t uncompressedBytes;
+    uint64_t storedBytes;
+};
+
+bool cookTexture(const std::string& sourcePath, const std::string& cachePath,
+    const CookOptions& options, CookResult* result = nullptr);
+
+// Cooks every .jpg/.png directly inside each directory and prints how much
+// memory each one saves; returns how many failed.
+int cookTextures(const std::vector<std::string>& directories, const CookOptions& options = CookOptions());
+
+#endif
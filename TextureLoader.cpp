@@ -0,0 +1,418 @@
+#include "TextureLoader.h"
+#include "TextureCache.h"
+#include "JpegDecoder.h"
+#include "MappedFile.h"
+#include <glad/glad.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Compressed formats are extensions on a 3.3 context, so glad does not define them
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+static bool hasExtension(const char* name) {
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i = 0; i < count; i++) {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+TextureLoader::TextureLoader(int workerCount, const MipOptions& mipOptions)
+    : stopping(false), inFlight(0), nextPbo(0), mipOptions(mipOptions) {
+    int major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    supportsS3TC = hasExtension("GL_EXT_texture_compression_s3tc");
+    supportsBPTC = major > 4 || (major == 4 && minor >= 2) || hasExtension("GL_ARB_texture_compression_bptc");
+
+    if (workerCount <= 0) {
+        int cores = (int)std::thread::hardware_concurrency();
+        workerCount = std::max(1, cores - 1); // Leave a core for the GL thread
+    }
+    for (int i = 0; i < workerCount; i++)
+        workers.emplace_back(&TextureLoader::workerMain, this);
+
+    glGenBuffers(2, pbos);
+}
+
+TextureLoader::~TextureLoader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    requestReady.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+
+    for (Decoded& image : decoded)
+        stbi_image_free(image.pixels);
+
+    glDeleteBuffers(2, pbos);
+}
+
+unsigned int TextureLoader::load(const std::string& path) {
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+
+    // Neutral grey stand-in so the scene can render before decoding finishes
+    const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.push_back({ textureID, path, -1, 0, 0, 0, true });
+        inFlight++;
+    }
+    requestReady.notify_one();
+    return textureID;
+}
+
+void TextureLoader::reload(unsigned int textureID, const std::string& path, int firstLevel, bool preview) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.push_back({ textureID, path, -1, 0, 0, std::max(0, firstLevel), preview });
+        inFlight++;
+    }
+    requestReady.notify_one();
+}
+
+void TextureLoader::loadLayer(const std::string& path, unsigned int arrayID, int layer, int width, int height) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.push_back({ arrayID, path, layer, width, height, 0, false });
+        inFlight++;
+    }
+    requestReady.notify_one();
+}
+
+// Area-average resample of an RGB or RGBA image to RGBA; each destination
+// texel averages the block of source texels it covers (at least one).
+static void resampleRGBA(const unsigned char* src, int width, int height, int channels,
+    unsigned char* dst, int dstWidth, int dstHeight) {
+    for (int y = 0; y < dstHeight; y++) {
+        int y0 = (int)((long long)y * height / dstHeight);
+        int y1 = std::max(y0 + 1, (int)((long long)(y + 1) * height / dstHeight));
+        for (int x = 0; x < dstWidth; x++) {
+            int x0 = (int)((long long)x * width / dstWidth);
+            int x1 = std::max(x0 + 1, (int)((long long)(x + 1) * width / dstWidth));
+            unsigned int count = (unsigned int)((y1 - y0) * (x1 - x0));
+            unsigned int sum[4] = { 0, 0, 0, channels == 4 ? 0 : 255 * count };
+            for (int sy = y0; sy < y1; sy++) {
+                const unsigned char* row = src + ((size_t)sy * width + x0) * channels;
+                for (int sx = x0; sx < x1; sx++, row += channels) {
+                    for (int c = 0; c < channels; c++)
+                        sum[c] += row[c];
+                }
+            }
+            for (int c = 0; c < 4; c++)
+                dst[((size_t)y * dstWidth + x) * 4 + c] = (unsigned char)((sum[c] + count / 2) / count);
+        }
+    }
+}
+
+void TextureLoader::workerMain() {
+    stbi_set_flip_vertically_on_load_thread(true);
+
+    for (;;) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            requestReady.wait(lock, [this] { return stopping || !requests.empty(); });
+            if (stopping)
+                return;
+            request = requests.front();
+            requests.pop_front();
+        }
+
+        Decoded image = { request.textureID, request.path, 0, 0, 0, nullptr, nullptr, request.layer, {}, {},
+            request.firstLevel, {}, false };
+        std::shared_ptr<CookedTexture> cooked = std::make_shared<CookedTexture>();
+        if (request.layer >= 0) {
+            // Layers share one size, so they are always decoded and resampled;
+            // JPEGs at the smallest scale that still covers the layer
+            MappedFile file;
+            JpegInfo info;
+            JpegImage scaled = {};
+            int scale = 0;
+            if (file.open(request.path) && readJpegInfo(file.data(), file.size(), info)) {
+                while (scale < 3 && (info.width >> (scale + 1)) >= request.layerWidth &&
+                    (info.height >> (scale + 1)) >= request.layerHeight)
+                    scale++;
+            }
+            unsigned char* pixels = nullptr;
+            if (scale > 0 && decodeJpeg(file.data(), file.size(), scale, true, scaled)) {
+                image.width = scaled.width;
+                image.height = scaled.height;
+                image.channels = scaled.channels;
+            }
+            else {
+                pixels = stbi_load(request.path.c_str(), &image.width, &image.height, &image.channels, 4);
+                image.channels = 4;
+            }
+            if (pixels || !scaled.pixels.empty()) {
+                image.layerPixels.resize((size_t)request.layerWidth * request.layerHeight * 4);
+                resampleRGBA(pixels ? pixels : scaled.pixels.data(), image.width, image.height, image.channels,
+                    image.layerPixels.data(), request.layerWidth, request.layerHeight);
+                image.width = request.layerWidth;
+                image.height = request.layerHeight;
+                image.channels = 4;
+                stbi_image_free(pixels);
+                buildMips(image.layerPixels.data(), image.width, image.height, 4, mipOptions, image.mips);
+            }
+        }
+        else if (cooked->open(textureCachePath(request.path), request.path) && canUpload(cooked->header())) {
+            image.width = (int)cooked->header().width;
+            image.height = (int)cooked->header().height;
+            image.cooked = cooked;
+        }
+        else {
+            decodeScaled(request, image);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(std::move(image));
+        }
+        decodeReady.notify_one();
+    }
+}
+
+// Decodes a plain texture. JPEGs wanted from level 1 down skip the levels
+// above with a reduced decode, up to 1/8 scale. A progressive JPEG asked for
+// with a preview queues a 1/8 scale image of its own first, which takes a few
+// milliseconds where the full decode takes tens.
+void TextureLoader::decodeScaled(const Request& request, Decoded& image) {
+    MappedFile file;
+    JpegInfo info;
+    bool jpeg = file.open(request.path) && readJpegInfo(file.data(), file.size(), info);
+
+    if (jpeg && request.preview && info.progressive && request.firstLevel < 3) {
+        JpegImage scaled;
+        if (decodeJpeg(file.data(), file.size(), 3, true, scaled)) {
+            Decoded preview = { request.textureID, request.path, scaled.width, scaled.height, scaled.channels,
+                nullptr, nullptr, -1, {}, {}, 0, std::move(scaled.pixels), true };
+            buildMips(preview.scaledPixels.data(), preview.width, preview.height, preview.channels, mipOptions,
+                preview.mips);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                decoded.push_back(std::move(preview));
+            }
+            decodeReady.notify_one();
+        }
+    }
+
+    int scale = jpeg ? std::min(request.firstLevel, 3) : 0;
+    JpegImage scaled;
+    if (scale > 0 && decodeJpeg(file.data(), file.size(), scale, true, scaled)) {
+        image.width = scaled.width;
+        image.height = scaled.height;
+        image.channels = scaled.channels;
+        image.scaledPixels = std::move(scaled.pixels);
+        image.firstLevel -= scale;
+        buildMips(image.scaledPixels.data(), image.width, image.height, image.channels, mipOptions, image.mips);
+        return;
+    }
+
+    image.pixels = stbi_load(request.path.c_str(), &image.width, &image.height, &image.channels, 0);
+    if (image.pixels)
+        buildMips(image.pixels, image.width, image.height, image.channels, mipOptions, image.mips);
+}
+
+static size_t mipBytes(const std::vector<MipLevel>& mips) {
+    size_t bytes = 0;
+    for (const MipLevel& mip : mips)
+        bytes += mip.pixels.size();
+    return bytes;
+}
+
+void TextureLoader::update(size_t uploadBudget) {
+    size_t uploaded = 0;
+    while (uploaded < uploadBudget) {
+        Decoded image;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (decoded.empty())
+                break;
+            image = std::move(decoded.front());
+            decoded.pop_front();
+        }
+
+        bool loaded = true;
+        if (image.layer >= 0 && !image.layerPixels.empty()) {
+            uploadLayer(image);
+            uploaded += image.layerPixels.size() + mipBytes(image.mips);
+        }
+        else if (image.cooked) {
+            uploadCooked(image);
+            const TextureFileLevel& last = image.cooked->level(image.cooked->header().levelCount - 1);
+            uploaded += (size_t)(last.offset + last.size - image.cooked->level(0).offset);
+        }
+        else if (image.pixels || !image.scaledPixels.empty()) {
+            upload(image);
+            uploaded += (size_t)image.width * image.height * image.channels + mipBytes(image.mips);
+            if (image.preview)
+                continue;
+        }
+        else {
+            std::cerr << "Failed to load texture: " << image.path << std::endl;
+            loaded = false;
+        }
+        stbi_image_free(image.pixels);
+        if (uploadCallback)
+            uploadCallback(image.textureID, loaded);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight--;
+    }
+}
+
+bool TextureLoader::canUpload(const TextureFileHeader& header) const {
+    TextureFormat format = (TextureFormat)header.format;
+    if (format == TextureFormat::BC1 || format == TextureFormat::BC3)
+        return supportsS3TC;
+    if (format == TextureFormat::BC7)
+        return supportsBPTC;
+    return true;
+}
+
+// Stage through alternating PBOs so the copy into driver memory can overlap
+// with the previous transfer instead of stalling on a client-side pointer.
+// Returns what to pass as the pixel pointer: an offset into the bound PBO, or
+// the client pointer itself if the buffer could not be mapped.
+const void* TextureLoader::stage(const void* data, size_t size) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[nextPbo]);
+    nextPbo = (nextPbo + 1) % 2;
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!staging) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return data;
+    }
+    memcpy(staging, data, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    return nullptr;
+}
+
+void TextureLoader::upload(const Decoded& image) {
+    GLenum format = (image.channels == 4) ? GL_RGBA : GL_RGB;
+
+    // Level i of the texture is level firstLevel + i of the image
+    int firstLevel = std::min(image.firstLevel, (int)image.mips.size());
+    int levelCount = (int)image.mips.size() + 1 - firstLevel;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // RGB rows are not 4-byte aligned
+    glBindTexture(GL_TEXTURE_2D, image.textureID);
+    const unsigned char* pixels = image.pixels ? image.pixels : image.scaledPixels.data();
+    for (int i = 0; i < levelCount; i++) {
+        int source = firstLevel + i;
+        if (source == 0) {
+            size_t size = (size_t)image.width * image.height * image.channels;
+            glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE,
+                stage(pixels, size));
+        }
+        else {
+            const MipLevel& mip = image.mips[source - 1];
+            glTexImage2D(GL_TEXTURE_2D, i, format, mip.width, mip.height, 0, format, GL_UNSIGNED_BYTE,
+                stage(mip.pixels.data(), mip.pixels.size()));
+        }
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureLoader::uploadCooked(const Decoded& image) {
+    const CookedTexture& cooked = *image.cooked;
+    const TextureFileHeader& header = cooked.header();
+    TextureFormat format = (TextureFormat)header.format;
+
+    GLenum internalFormat;
+    switch (format) {
+    case TextureFormat::BC1: internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT; break;
+    case TextureFormat::BC3: internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+    case TextureFormat::BC7: internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM; break;
+    case TextureFormat::RGBA8: internalFormat = GL_RGBA; break;
+    default: internalFormat = GL_RGB; break;
+    }
+
+    // Levels are contiguous in the file, so the whole chain is staged at once
+    int firstLevel = std::min(image.firstLevel, (int)header.levelCount - 1);
+    int levelCount = (int)header.levelCount - firstLevel;
+    const TextureFileLevel& first = cooked.level(firstLevel);
+    const TextureFileLevel& last = cooked.level(header.levelCount - 1);
+    size_t chainSize = (size_t)(last.offset + last.size - first.offset);
+    const unsigned char* chain = (const unsigned char*)stage(cooked.levelData(firstLevel), chainSize);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, image.textureID);
+    for (int i = 0; i < levelCount; i++) {
+        const TextureFileLevel& level = cooked.level(firstLevel + i);
+        const unsigned char* pixels = chain + (level.offset - first.offset);
+        if (isCompressed(format))
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, internalFormat, level.width, level.height, 0,
+                (GLsizei)level.size, pixels);
+        else
+            glTexImage2D(GL_TEXTURE_2D, i, internalFormat, level.width, level.height, 0, internalFormat,
+                GL_UNSIGNED_BYTE, pixels);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureLoader::uploadLayer(const Decoded& image) {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, image.textureID);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, image.layer, image.width, image.height, 1,
+        GL_RGBA, GL_UNSIGNED_BYTE, stage(image.layerPixels.data(), image.layerPixels.size()));
+    for (size_t i = 0; i < image.mips.size(); i++) {
+        const MipLevel& mip = image.mips[i];
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)i + 1, 0, 0, image.layer, mip.width, mip.height, 1,
+            GL_RGBA, GL_UNSIGNED_BYTE, stage(mip.pixels.data(), mip.pixels.size()));
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureLoader::finish() {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (inFlight == 0)
+                return;
+            decodeReady.wait(lock, [this] { return !decoded.empty(); });
+        }
+        update((size_t)-1);
+    }
+}
+
+void TextureLoader::setUploadCallback(std::function<void(unsigned int, bool)> callback) {
+    uploadCallback = callback;
+}
+
+int TextureLoader::pending() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return inFlight;
+}
@@ -0,0 +1,108 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <functional>
+#include <cstddef>
+#include "MipBuilder.h"
+
+class CookedTexture;
+struct TextureFileHeader;
+
+// Decodes images on a pool of worker threads and uploads them on the GL thread.
+// load() hands back a texture name straight away that shows a placeholder texel
+// until update() has uploaded the real pixels into it. Images that have a
+// cooked copy (see TextureCache.h) are mapped and uploaded without decoding;
+// the others get their mip chains built on the workers too (see MipBuilder.h).
+// JPEGs needed from a lower level than 0 are decoded at reduced scale (see
+// JpegDecoder.h), and progressive ones can show a 1/8 scale preview first.
+class TextureLoader {
+public:
+    explicit TextureLoader(int workerCount = 0, const MipOptions& mipOptions = MipOptions());
+    ~TextureLoader();
+
+    unsigned int load(const std::string& path);
+
+    // Replaces the contents of a texture from load() with path's mip chain from
+    // firstLevel down, so level 0 becomes firstLevel's size. The texture keeps
+    // what it held until the new chain is uploaded. With preview, a progressive
+    // JPEG is first uploaded at 1/8 scale, for textures holding less than that.
+    void reload(unsigned int textureID, const std::string& path, int firstLevel, bool preview = false);
+
+    // Decodes path, resamples it to width x height and uploads it into one layer
+    // of an existing GL_TEXTURE_2D_ARRAY. The layer keeps whatever it held until
+    // then; see TextureArrayPacker for the placeholder it starts with.
+    void loadLayer(const std::string& path, unsigned int arrayID, int layer, int width, int height);
+
+    // Call once per frame on the GL thread; uploads at most uploadBudget bytes.
+    void update(size_t uploadBudget = 16 * 1024 * 1024);
+
+    // Blocks the GL thread until every queued texture is uploaded.
+    void finish();
+
+    int pending() const;
+
+    // Called on the GL thread after each request is handled, with whether the
+    // image could be loaded.
+    void setUploadCallback(std::function<void(unsigned int textureID, bool loaded)> callback);
+
+private:
+    struct Request {
+        unsigned int textureID;
+        std::string path;
+        int layer;              // -1 for a plain 2D texture
+        int layerWidth, layerHeight;
+        int firstLevel;
+        bool preview;
+    };
+
+    struct Decoded {
+        unsigned int textureID;
+        std::string path;
+        int width, height, channels;
+        unsigned char* pixels;
+        std::shared_ptr<CookedTexture> cooked;
+        int layer;
+        std::vector<unsigned char> layerPixels;
+        std::vector<MipLevel> mips;    // Below level 0, for decoded images
+        int firstLevel;
+        std::vector<unsigned char> scaledPixels;   // In place of pixels after a scaled JPEG decode
+        bool preview;                   // Not the end of its request
+    };
+
+    void workerMain();
+    void decodeScaled(const Request& request, Decoded& image);
+    void upload(const Decoded& image);
+    void uploadCooked(const Decoded& image);
+    void uploadLayer(const Decoded& image);
+    bool canUpload(const TextureFileHeader& header) const;
+    const void* stage(const void* data, size_t size);
+
+    std::vector<std::thread> workers;
+    std::deque<Request> requests;
+    std::deque<Decoded> decoded;
+    mutable std::mutex mutex;
+    std::condition_variable requestReady;
+    std::condition_variable decodeReady;
+    bool stopping;
+    int inFlight;
+
+    unsigned int pbos[2];
+    int nextPbo;
+
+    MipOptions mipOptions;
+    std::function<void(unsigned int, bool)> uploadCallback;
+
+    // Block-compressed formats the driver accepts; cooked files in any other
+    // compressed format fall back to decoding their source image
+    bool supportsS3TC;
+    bool supportsBPTC;
+};
+
+#endif
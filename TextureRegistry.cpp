@@ -0,0 +1,94 @@
+#include "TextureRegistry.h"
+#include "MappedFile.h"
+#include <filesystem>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+// xxHash64's primes and round: every word is multiplied, then rotated so its
+// high bits reach the low ones, and the end mixes every bit into every other
+static const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t PRIME3 = 0x165667B19E3779F9ull;
+static const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+static uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t hashRound(uint64_t hash, uint64_t word) {
+    hash += word * PRIME2;
+    return rotateLeft(hash, 31) * PRIME1;
+}
+
+bool hashTextureFile(const std::string& path, uint64_t& hash) {
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    const unsigned char* data = file.data();
+    size_t size = file.size(), i = 0;
+    hash = PRIME5 + (uint64_t)size;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word = 0;
+        for (int b = 0; b < 8; b++)
+            word |= (uint64_t)data[i + b] << (b * 8);
+        hash = rotateLeft(hash ^ hashRound(0, word), 27) * PRIME1 + PRIME4;
+    }
+    for (; i < size; i++)
+        hash = rotateLeft(hash ^ (data[i] * PRIME5), 11) * PRIME1;
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return true;
+}
+
+// Keys already worked out, by normalized path, with the size and time of the
+// file they were hashed from
+struct CachedKey {
+    uint64_t size;
+    int64_t time;
+    std::string key;
+};
+
+static std::mutex keyCacheMutex;
+static std::unordered_map<std::string, CachedKey> keyCache;
+
+std::string textureContentKey(const std::string& path) {
+    std::string normalized = fs::path(path).lexically_normal().generic_string();
+    std::error_code error;
+    uint64_t size = (uint64_t)fs::file_size(path, error);
+    int64_t time = error ? 0 : (int64_t)fs::last_write_time(path, error).time_since_epoch().count();
+    if (error)
+        return normalized;
+    {
+        std::lock_guard<std::mutex> lock(keyCacheMutex);
+        std::unordered_map<std::string, CachedKey>::const_iterator found = keyCache.find(normalized);
+        if (found != keyCache.end() && found->second.size == size && found->second.time == time)
+            return found->second.key;
+    }
+
+    uint64_t hash;
+    if (!hashTextureFile(path, hash))
+        return normalized;
+    char key[17];
+    snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+    std::lock_guard<std::mutex> lock(keyCacheMutex);
+    keyCache[normalized] = { size, time, key };
+    return key;
+}
+
+bool sameTextureFile(const std::string& a, const std::string& b) {
+    if (fs::path(a).lexically_normal() == fs::path(b).lexically_normal())
+        return true;
+    MappedFile first, second;
+    if (!first.open(a) || !second.open(b))
+        return false;
+    return first.size() == second.size() && memcmp(first.data(), second.data(), first.size()) == 0;
+}
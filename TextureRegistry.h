@@ -0,0 +1,27 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <cstdint>
+#include <string>
+
+// Content keys for images, so copies of a file (the root and pictures/ hold
+// the same images) are loaded once. The sharing itself is done by their
+// users: TextureArrayPacker gives each distinct image one layer, and
+// TextureResidency one texture counted per placement.
+
+// Identifies an image by what is in it rather than where it is: a 64-bit hash
+// of the file's bytes and size. Returns false if the file cannot be read.
+bool hashTextureFile(const std::string& path, uint64_t& hash);
+
+// The key to deduplicate images under: the content hash in hex, or the
+// normalized path for files that cannot be read (so they still fail once).
+// Keys are cached by normalized path until the file's size or time changes,
+// so asking again for a path seen before does not read the file. Safe to call
+// from any thread.
+std::string textureContentKey(const std::string& path);
+
+// Whether two files hold the same bytes, to confirm a key match before
+// sharing: true for the same normalized path without reading either.
+bool sameTextureFile(const std::string& a, const std::string& b);
+
+#endif
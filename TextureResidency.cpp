@@ -0,0 +1,325 @@
+#include "TextureResidency.h"
+#include "TextureLoader.h"
+#include "TextureRegistry.h"
+#include <glad/glad.h>
+#include "stb_image.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Textures within this distance of the frustum count as visible, so detail
+// starts loading just before a painting comes into view.
+static const float PREFETCH_MARGIN = 1.0f;
+
+// In-flight requests that add detail; more would only queue behind each other
+static const int MAX_RELOADS = 2;
+
+// Trimmed textures keep the levels up to this size.
+static const int TRIM_SIZE = 64;
+
+TextureResidency::TextureResidency(TextureLoader& loader, size_t budgetBytes)
+    : loader(loader), start(Clock::now()), reloadTotalMs(0.0), stats() {
+    stats.budgetBytes = budgetBytes;
+    loader.setUploadCallback([this](unsigned int texture, bool loaded) { uploaded(texture, loaded); });
+}
+
+TextureResidency::~TextureResidency() {
+    loader.setUploadCallback(nullptr);
+    for (const Entry& entry : entries)
+        glDeleteTextures(1, &entry.texture);
+    for (const Retired& texture : retired)
+        glDeleteTextures(1, &texture.texture);
+}
+
+unsigned int TextureResidency::add(const std::string& path, const glm::vec3& center, float worldSize,
+    const std::string& contentKey) {
+    // Another copy of an image already registered is one more placement of it
+    // (radius is enough for a square painting's half diagonal)
+    Placement placement = { center, worldSize, worldSize * 0.75f };
+    std::string key = contentKey.empty() ? textureContentKey(path) : contentKey;
+    for (Entry& existing : entries) {
+        if (existing.key == key && sameTextureFile(existing.path, path)) {
+            existing.placements.push_back(placement);
+            return existing.texture;
+        }
+    }
+
+    Entry entry = {};
+    entry.path = path;
+    entry.key = key;
+    entry.placements.push_back(placement);
+    entry.loadingLevel = -1;
+    entry.bytesPerTexel = 4.0f;
+    entry.lastSeen = -1e9;
+
+    int channels;
+    if (stbi_info(path.c_str(), &entry.width, &entry.height, &channels)) {
+        int size = std::max(entry.width, entry.height);
+        while (size >> entry.levelCount)
+            entry.levelCount++;
+    }
+    else {
+        std::cerr << "Failed to load texture: " << path << std::endl;
+        entry.width = entry.height = 0;
+    }
+    entry.residentLevel = entry.levelCount;
+
+    // Same neutral grey stand-in the loader uses, held until the texture is needed
+    const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+    glGenTextures(1, &entry.texture);
+    glBindTexture(GL_TEXTURE_2D, entry.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    entry.residentBytes = 4;
+    stats.residentBytes += entry.residentBytes;
+
+    entries.push_back(entry);
+    return entry.texture;
+}
+
+void TextureResidency::remove(unsigned int texture, const glm::vec3& center) {
+    std::vector<Entry>::iterator entry = std::find_if(entries.begin(), entries.end(),
+        [texture](const Entry& e) { return e.texture == texture; });
+    if (entry == entries.end())
+        return;
+    std::vector<Placement>::iterator placement = std::find_if(entry->placements.begin(), entry->placements.end(),
+        [&center](const Placement& p) { return glm::length(p.center - center) < 1e-3f; });
+    if (placement != entry->placements.end())
+        entry->placements.erase(placement);
+    if (!entry->placements.empty())
+        return;
+
+    // The loader may still be about to upload into it, and binding a deleted
+    // name would make that upload land in whatever texture is bound instead;
+    // uploaded() deletes it once its request is done. It holds (and counts)
+    // what that upload brings until then.
+    if (entry->loadingLevel >= 0) {
+        size_t bytes = std::max(entry->residentBytes, estimateBytes(*entry, entry->loadingLevel));
+        stats.residentBytes += bytes - entry->residentBytes;
+        retired.push_back({ texture, bytes });
+    }
+    else {
+        stats.residentBytes -= entry->residentBytes;
+        glDeleteTextures(1, &texture);
+    }
+    entries.erase(entry);
+}
+
+size_t TextureResidency::estimateBytes(const Entry& entry, int firstLevel) const {
+    double texels = 0.0;
+    for (int level = firstLevel; level < entry.levelCount; level++)
+        texels += (double)std::max(1, entry.width >> level) * std::max(1, entry.height >> level);
+    return firstLevel >= entry.levelCount ? 4 : (size_t)(texels * entry.bytesPerTexel);
+}
+
+void TextureResidency::request(Entry& entry, int level) {
+    entry.loadingLevel = level;
+    entry.requested = Clock::now();
+    // A 1/8 scale preview is worth showing over anything coarser
+    loader.reload(entry.texture, entry.path, level, entry.residentLevel > 3);
+    stats.loading++;
+}
+
+void TextureResidency::drop(Entry& entry) {
+    const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+    glBindTexture(GL_TEXTURE_2D, entry.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+    stats.residentBytes -= entry.residentBytes;
+    entry.residentBytes = 4;
+    stats.residentBytes += entry.residentBytes;
+    entry.residentLevel = entry.levelCount;
+    stats.evictions++;
+}
+
+void TextureResidency::uploaded(unsigned int texture, bool loaded) {
+    std::vector<Retired>::iterator removed = std::find_if(retired.begin(), retired.end(),
+        [texture](const Retired& r) { return r.texture == texture; });
+    if (removed != retired.end()) {
+        stats.loading--;
+        stats.residentBytes -= removed->bytes;
+        glDeleteTextures(1, &removed->texture);
+        retired.erase(removed);
+        return;
+    }
+
+    std::vector<Entry>::iterator entry = std::find_if(entries.begin(), entries.end(),
+        [texture](const Entry& e) { return e.texture == texture; });
+    if (entry == entries.end() || entry->loadingLevel < 0)
+        return;
+    stats.loading--;
+
+    int level = entry->loadingLevel;
+    entry->loadingLevel = -1;
+    if (!loaded) {
+        entry->width = entry->height = 0; // Not asked for again
+        return;
+    }
+
+    // What the driver actually holds, which is less than RGBA8 for cooked
+    // block-compressed textures
+    size_t bytes = 0;
+    double texels = 0.0;
+    int maxLevel = 0;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+    for (int i = 0; i <= maxLevel; i++) {
+        int width = 0, height = 0, compressed = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_HEIGHT, &height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed) {
+            int size = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            bytes += (size_t)size;
+        }
+        else {
+            bytes += (size_t)width * height * 4;
+        }
+        texels += (double)width * height;
+    }
+    if (texels > 0.0)
+        entry->bytesPerTexel = (float)(bytes / texels);
+
+    stats.residentBytes -= entry->residentBytes;
+    entry->residentBytes = bytes;
+    stats.residentBytes += bytes;
+
+    if (level < entry->residentLevel) {
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - entry->requested).count();
+        stats.reloads++;
+        reloadTotalMs += ms;
+        stats.lastReloadMs = ms;
+        stats.averageReloadMs = reloadTotalMs / stats.reloads;
+        stats.maxReloadMs = std::max(stats.maxReloadMs, ms);
+    }
+    else {
+        stats.evictions++;
+    }
+    entry->residentLevel = level;
+}
+
+// Drops the least recently seen textures that are out of view until bytes
+// more would fit in the budget, counting in-flight requests at their size
+// and removed textures not yet freed.
+bool TextureResidency::makeRoom(size_t bytes, const Entry& keep, double now) {
+    size_t committed = 0;
+    for (const Retired& texture : retired)
+        committed += texture.bytes;
+    for (const Entry& entry : entries)
+        committed += std::max(entry.residentBytes, entry.loadingLevel >= 0 ? estimateBytes(entry, entry.loadingLevel) : 0);
+
+    while (committed + bytes > stats.budgetBytes) {
+        Entry* oldest = nullptr;
+        for (Entry& entry : entries) {
+            if (&entry == &keep || entry.loadingLevel >= 0 || entry.lastSeen >= now ||
+                entry.residentLevel >= entry.levelCount)
+                continue;
+            if (!oldest || entry.lastSeen < oldest->lastSeen)
+                oldest = &entry;
+        }
+        if (!oldest)
+            return false;
+        committed -= oldest->residentBytes;
+        drop(*oldest);
+        committed += oldest->residentBytes;
+    }
+    return true;
+}
+
+void TextureResidency::update(const glm::vec3& cameraPos, const glm::mat4& projection, const glm::mat4& view,
+    float viewportHeight) {
+    double now = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // Frustum planes of the combined matrix (rows of its transpose)
+    glm::mat4 viewProjection = projection * view;
+    glm::vec4 planes[6];
+    for (int i = 0; i < 3; i++) {
+        glm::vec4 row(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        planes[i * 2] = w + row;
+        planes[i * 2 + 1] = w - row;
+    }
+    for (glm::vec4& plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    std::vector<std::pair<float, Entry*>> wanted; // (priority, entry) for textures that need detail
+    std::vector<int> targets(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        Entry& entry = entries[i];
+        targets[i] = entry.residentLevel;
+        if (entry.width == 0)
+            continue;
+
+        // The placement that needs the most detail decides
+        bool visible = false;
+        float distance = 1e9f, pixels = 0.0f;
+        for (const Placement& placement : entry.placements) {
+            bool inside = true;
+            for (const glm::vec4& plane : planes)
+                inside = inside && glm::dot(glm::vec3(plane), placement.center) + plane.w > -(placement.radius + PREFETCH_MARGIN);
+            float placementDistance = std::max(0.1f, glm::length(placement.center - cameraPos) - placement.radius);
+            distance = std::min(distance, placementDistance);
+            if (inside) {
+                visible = true;
+                pixels = std::max(pixels, placement.worldSize * projection[1][1] * viewportHeight * 0.5f / placementDistance);
+            }
+        }
+
+        int target;
+        if (visible) {
+            entry.lastSeen = now;
+            // Level whose texels are about a pixel at this distance
+            float texels = (float)std::max(entry.width, entry.height);
+            target = (int)std::floor(std::log2(std::max(1.0f, texels / pixels)));
+            target = std::min(target, entry.levelCount - 1);
+        }
+        else if (now - entry.lastSeen < trimAfter) {
+            target = entry.residentLevel;
+        }
+        else if (now - entry.lastSeen < evictAfter) {
+            int trimLevel = 0;
+            while (std::max(entry.width, entry.height) >> trimLevel > TRIM_SIZE)
+                trimLevel++;
+            target = std::max(entry.residentLevel, trimLevel);
+        }
+        else {
+            target = entry.levelCount;
+        }
+        targets[i] = target;
+
+        if (entry.loadingLevel >= 0 || target == entry.residentLevel)
+            continue;
+        if (target > entry.residentLevel) {
+            // Less detail is enough: drop it outright or reload a shorter chain
+            if (target >= entry.levelCount)
+                drop(entry);
+            else
+                request(entry, target);
+        }
+        else {
+            wanted.push_back({ visible ? distance : 1e6f + distance, &entry });
+        }
+    }
+
+    // Nearest first; each takes the finest level that fits after making room
+    std::sort(wanted.begin(), wanted.end(),
+        [](const std::pair<float, Entry*>& a, const std::pair<float, Entry*>& b) { return a.first < b.first; });
+    for (const std::pair<float, Entry*>& item : wanted) {
+        if (stats.loading >= MAX_RELOADS)
+            break;
+        Entry& entry = *item.second;
+        for (int level = targets[&entry - entries.data()]; level < entry.residentLevel; level++) {
+            size_t extra = estimateBytes(entry, level) - std::min(estimateBytes(entry, level), entry.residentBytes);
+            if (makeRoom(extra, entry, now)) {
+                request(entry, level);
+                break;
+            }
+        }
+    }
+}
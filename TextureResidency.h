@@ -0,0 +1,104 @@
+#ifndef TEXTURE_RESIDENCY_H
+#define TEXTURE_RESIDENCY_H
+
+#include <glm/glm.hpp>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class TextureLoader;
+
+// Keeps a set of textures (the paintings) within a VRAM budget. Each frame it
+// works out which mip level every texture needs from where it sits on screen,
+// drops top levels from textures that have not been seen for a while (and
+// whole textures after longer), and streams detail back in through the loader
+// as the camera approaches. When the budget is tight the least recently seen
+// textures give way first.
+class TextureResidency {
+public:
+    struct Counters {
+        size_t residentBytes;   // Measured from GL after each upload
+        size_t budgetBytes;
+        long long evictions;    // Textures that lost levels or were dropped
+        long long reloads;      // Uploads that added detail
+        int loading;
+        double lastReloadMs;    // Request to upload, for uploads that added detail
+        double averageReloadMs;
+        double maxReloadMs;
+    };
+
+    TextureResidency(TextureLoader& loader, size_t budgetBytes);
+    ~TextureResidency();
+
+    // Registers an image drawn on a surface around center, worldSize across.
+    // Returns its texture, which starts as a placeholder until first seen.
+    // Copies of an image already added (by content, see TextureRegistry.h)
+    // share its texture, which then follows whichever copy needs most detail.
+    // contentKey, when known, saves hashing the file here.
+    unsigned int add(const std::string& path, const glm::vec3& center, float worldSize,
+        const std::string& contentKey = std::string());
+
+    // Undoes one add() of the placement at center. The texture is deleted
+    // once no placement of it is left, or, with an upload into it still in
+    // flight, once that upload is done; until then it counts against the
+    // budget.
+    void remove(unsigned int texture, const glm::vec3& center);
+
+    // Once per frame on the GL thread, after the loader's update().
+    void update(const glm::vec3& cameraPos, const glm::mat4& projection, const glm::mat4& view, float viewportHeight);
+
+    void setBudget(size_t bytes) { stats.budgetBytes = bytes; }
+    const Counters& counters() const { return stats; }
+
+    // Seconds unseen before a texture is cut down to its smallest levels, and
+    // before it is dropped altogether.
+    float trimAfter = 5.0f;
+    float evictAfter = 30.0f;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Placement {
+        glm::vec3 center;
+        float worldSize;
+        float radius;
+    };
+
+    struct Entry {
+        std::string path;
+        std::string key;        // textureContentKey()
+        unsigned int texture;
+        std::vector<Placement> placements;
+        int width, height;      // Full size; 0 if the image cannot be read
+        int levelCount;
+        int residentLevel;      // Image level held as texture level 0; levelCount when dropped
+        int loadingLevel;       // -1 when no request is in flight
+        size_t residentBytes;
+        float bytesPerTexel;    // 4 until an upload shows the real rate
+        double lastSeen;        // Seconds since start
+        Clock::time_point requested;
+    };
+
+    // Removed while their own upload was in flight, with the bytes they hold
+    // until it is done
+    struct Retired {
+        unsigned int texture;
+        size_t bytes;
+    };
+
+    void uploaded(unsigned int texture, bool loaded);
+    size_t estimateBytes(const Entry& entry, int firstLevel) const;
+    void request(Entry& entry, int level);
+    void drop(Entry& entry);
+    bool makeRoom(size_t bytes, const Entry& keep, double now);
+
+    TextureLoader& loader;
+    std::vector<Entry> entries;
+    std::vector<Retired> retired;           // Deleted by uploaded()
+    Clock::time_point start;
+    double reloadTotalMs;
+    Counters stats;
+};
+
+#endif
@@ -0,0 +1,401 @@
+#include "VirtualTexture.h"
+#include "MipBuilder.h"
+#include <glad/glad.h>
+#include "stb_image.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+static const uint32_t VIRTUAL_TEXTURE_VERSION = 1;
+static const uint32_t EMPTY_SLOT = 0xFFFFFFFFu;
+
+static bool sourceStamp(const std::string& path, uint64_t& size, int64_t& time) {
+    std::error_code error;
+    size = (uint64_t)fs::file_size(path, error);
+    if (error)
+        return false;
+    time = (int64_t)fs::last_write_time(path, error).time_since_epoch().count();
+    return !error;
+}
+
+std::string virtualTexturePath(const std::string& sourcePath) {
+    fs::path path = fs::path("cache") / fs::path(sourcePath).relative_path();
+    path += ".gvt";
+    return path.string();
+}
+
+// Offline tiling ----------------------------------------------------------------
+
+bool tileVirtualTexture(const std::string& sourcePath, const std::string& targetPath, int pageContent, int pageBorder) {
+    VirtualTextureHeader header = {};
+    memcpy(header.magic, "GVT1", 4);
+    header.version = VIRTUAL_TEXTURE_VERSION;
+
+    std::error_code error;
+    header.sourceSize = (uint64_t)fs::file_size(sourcePath, error);
+    if (!error)
+        header.sourceTime = (int64_t)fs::last_write_time(sourcePath, error).time_since_epoch().count();
+
+    // The whole image is decoded here; only the runtime side streams
+    int width, height, channels;
+    stbi_set_flip_vertically_on_load_thread(true);
+    unsigned char* pixels = error ? nullptr : stbi_load(sourcePath.c_str(), &width, &height, &channels, 4);
+    if (!pixels) {
+        std::cerr << "Failed to tile texture: " << sourcePath << std::endl;
+        return false;
+    }
+
+    int pagesAcross = std::max((width + pageContent - 1) / pageContent, (height + pageContent - 1) / pageContent);
+    uint32_t virtualPages = 1;
+    uint32_t levelCount = 1;
+    while ((int)virtualPages < pagesAcross) {
+        virtualPages *= 2;
+        levelCount++;
+    }
+
+    header.width = (uint32_t)width;
+    header.height = (uint32_t)height;
+    header.pageContent = (uint32_t)pageContent;
+    header.pageBorder = (uint32_t)pageBorder;
+    header.virtualPages = virtualPages;
+    header.levelCount = levelCount;
+
+    size_t tableEntries = 0;
+    for (uint32_t level = 0; level < levelCount; level++)
+        tableEntries += (size_t)(virtualPages >> level) * (virtualPages >> level);
+    std::vector<uint64_t> table(tableEntries, 0);
+
+    int pageSize = pageContent + 2 * pageBorder;
+    size_t pageBytes = (size_t)pageSize * pageSize * 4;
+    uint64_t offset = sizeof(header) + tableEntries * sizeof(uint64_t);
+
+    fs::create_directories(fs::path(targetPath).parent_path(), error);
+    std::ofstream out(targetPath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        stbi_image_free(pixels);
+        std::cerr << "Failed to write virtual texture: " << targetPath << std::endl;
+        return false;
+    }
+    // The table is written last, once every page has its offset
+    out.seekp((std::streamoff)offset);
+
+    std::vector<MipLevel> pyramid;
+    pyramid.push_back({ width, height, std::vector<unsigned char>(pixels, pixels + (size_t)width * height * 4) });
+    buildMips(pixels, width, height, 4, MipOptions(), pyramid);
+    stbi_image_free(pixels);
+    std::vector<unsigned char> page(pageBytes);
+    size_t tableStart = 0;
+
+    for (uint32_t level = 0; level < levelCount; level++) {
+        const MipLevel& image = pyramid[level]; // A page level never outnumbers the mips
+        int levelWidth = image.width, levelHeight = image.height;
+        int levelPages = (int)(virtualPages >> level);
+        for (int py = 0; py < levelPages; py++) {
+            for (int px = 0; px < levelPages; px++) {
+                int originX = px * pageContent, originY = py * pageContent;
+                if (originX >= levelWidth || originY >= levelHeight)
+                    continue; // Padding beyond the image is never sampled
+
+                // Border texels repeat the neighbouring pages so filtering stays seamless
+                for (int y = 0; y < pageSize; y++) {
+                    int sy = std::min(std::max(originY - pageBorder + y, 0), levelHeight - 1);
+                    for (int x = 0; x < pageSize; x++) {
+                        int sx = std::min(std::max(originX - pageBorder + x, 0), levelWidth - 1);
+                        memcpy(&page[((size_t)y * pageSize + x) * 4], &image.pixels[((size_t)sy * levelWidth + sx) * 4], 4);
+                    }
+                }
+                out.write((const char*)page.data(), page.size());
+                table[tableStart + (size_t)py * levelPages + px] = offset;
+                offset += pageBytes;
+            }
+        }
+        tableStart += (size_t)levelPages * levelPages;
+    }
+
+    out.seekp(0);
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)table.data(), table.size() * sizeof(uint64_t));
+    return (bool)out;
+}
+
+// Runtime streaming -------------------------------------------------------------
+
+VirtualTexture::VirtualTexture(int atlasPagesAcross)
+    : atlasPages(atlasPagesAcross), pageSize(0), atlasTexture(0), indirectionTexture(0),
+      indirectionDirty(false), frame(0), stats() {
+}
+
+VirtualTexture::~VirtualTexture() {
+    if (atlasTexture)
+        glDeleteTextures(1, &atlasTexture);
+    if (indirectionTexture)
+        glDeleteTextures(1, &indirectionTexture);
+}
+
+const VirtualTextureHeader& VirtualTexture::header() const {
+    return *(const VirtualTextureHeader*)file.data();
+}
+
+uint64_t VirtualTexture::pageOffset(int level, int x, int y) const {
+    const uint64_t* table = (const uint64_t*)(file.data() + sizeof(VirtualTextureHeader));
+    int levelPages = (int)(header().virtualPages >> level);
+    if (x < 0 || y < 0 || x >= levelPages || y >= levelPages)
+        return 0;
+    return table[levelTableStart[level] + (size_t)y * levelPages + x];
+}
+
+bool VirtualTexture::open(const std::string& path, const std::string& sourcePath) {
+    levelTableStart.clear();
+    if (!file.open(path))
+        return false;
+
+    const VirtualTextureHeader& h = header();
+    bool valid = file.size() >= sizeof(VirtualTextureHeader) && memcmp(h.magic, "GVT1", 4) == 0 &&
+        h.version == VIRTUAL_TEXTURE_VERSION && h.levelCount > 0 && h.levelCount <= 14 &&
+        (h.virtualPages >> (h.levelCount - 1)) == 1 && h.width > 0 && h.height > 0 &&
+        h.pageContent > 0 && h.pageContent + 2 * (uint64_t)h.pageBorder <= 1024;
+    size_t entries = 0;
+    if (valid) {
+        for (uint32_t level = 0; level < h.levelCount; level++) {
+            levelTableStart.push_back(entries);
+            entries += (size_t)(h.virtualPages >> level) * (h.virtualPages >> level);
+        }
+        valid = file.size() >= sizeof(VirtualTextureHeader) + entries * sizeof(uint64_t);
+    }
+    // Every page present must lie past the table and inside the file, as
+    // update() copies it straight from the mapping
+    if (valid) {
+        const uint64_t* table = (const uint64_t*)(file.data() + sizeof(VirtualTextureHeader));
+        uint64_t tableEnd = sizeof(VirtualTextureHeader) + entries * sizeof(uint64_t);
+        uint64_t pageBytes = (uint64_t)(h.pageContent + 2 * h.pageBorder) * (h.pageContent + 2 * h.pageBorder) * 4;
+        for (size_t i = 0; valid && i < entries; i++)
+            valid = table[i] == 0 || (table[i] >= tableEnd && table[i] <= file.size() && file.size() - table[i] >= pageBytes);
+    }
+    if (!valid) {
+        std::cerr << "Invalid virtual texture: " << path << std::endl;
+        file.close();
+        return false;
+    }
+
+    // A copy that ships without its source is fine; one older than it is not
+    uint64_t size;
+    int64_t time;
+    if (sourceStamp(sourcePath, size, time) && (h.sourceSize != size || h.sourceTime != time)) {
+        std::cerr << "Stale virtual texture (tile it again): " << path << std::endl;
+        file.close();
+        return false;
+    }
+
+    pageSize = (int)(h.pageContent + 2 * h.pageBorder);
+    slots.assign((size_t)atlasPages * atlasPages, { EMPTY_SLOT, 0 });
+
+    glGenTextures(1, &atlasTexture);
+    glBindTexture(GL_TEXTURE_2D, atlasTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasPages * pageSize, atlasPages * pageSize, 0,
+        GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glGenTextures(1, &indirectionTexture);
+    glBindTexture(GL_TEXTURE_2D, indirectionTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, h.virtualPages, h.virtualPages, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    indirection.assign((size_t)h.virtualPages * h.virtualPages * 4, 0);
+
+    // The single top-level page is pinned so every texel always has a fallback
+    requested.push_back(pageKey(h.levelCount - 1, 0, 0));
+    update(1);
+    slots[resident.begin()->second].lastUsed = LLONG_MAX;
+    return true;
+}
+
+void VirtualTexture::requestPages(const glm::vec3 corners[4], const glm::mat4& viewProjection, float viewportHeight) {
+    if (!isOpen())
+        return;
+    const VirtualTextureHeader& h = header();
+    glm::vec2 uvScale((float)(h.virtualPages * h.pageContent) / h.width, (float)(h.virtualPages * h.pageContent) / h.height);
+    size_t budget = slots.size() - 1;
+
+    struct Page { int level, x, y; };
+    std::vector<Page> current = { { (int)h.levelCount - 1, 0, 0 } };
+    std::vector<Page> next;
+
+    while (!current.empty()) {
+        next.clear();
+        for (const Page& page : current) {
+            if (!pageOffset(page.level, page.x, page.y))
+                continue;
+
+            // The page's rectangle in uv, then on the painting in world space
+            float levelPages = (float)(h.virtualPages >> page.level);
+            glm::vec2 uv0 = glm::min(glm::vec2(page.x, page.y) / levelPages * uvScale, glm::vec2(1.0f));
+            glm::vec2 uv1 = glm::min(glm::vec2(page.x + 1, page.y + 1) / levelPages * uvScale, glm::vec2(1.0f));
+            const glm::vec2 uvs[4] = { uv0, glm::vec2(uv1.x, uv0.y), uv1, glm::vec2(uv0.x, uv1.y) };
+
+            glm::vec4 clip[4];
+            for (int i = 0; i < 4; i++) {
+                glm::vec3 bottom = glm::mix(corners[0], corners[1], uvs[i].x);
+                glm::vec3 top = glm::mix(corners[3], corners[2], uvs[i].x);
+                clip[i] = viewProjection * glm::vec4(glm::mix(bottom, top, uvs[i].y), 1.0f);
+            }
+
+            // Skip pages entirely outside one frustum plane
+            bool outside = false;
+            for (int axis = 0; axis < 3 && !outside; axis++) {
+                bool allBelow = true, allAbove = true;
+                for (int i = 0; i < 4; i++) {
+                    allBelow = allBelow && clip[i][axis] < -clip[i].w;
+                    allAbove = allAbove && clip[i][axis] > clip[i].w;
+                }
+                outside = allBelow || allAbove;
+            }
+            if (outside)
+                continue;
+
+            requested.push_back(pageKey(page.level, page.x, page.y));
+            if (page.level == 0)
+                continue;
+
+            // Refine while the page covers more pixels than it has texels
+            bool refine = false;
+            float extent = 0.0f;
+            for (int i = 0; i < 4 && !refine; i++) {
+                if (clip[i].w <= 1e-4f) {
+                    refine = true; // Crosses the camera plane: certainly close
+                    break;
+                }
+                glm::vec2 a = glm::vec2(clip[i]) / clip[i].w;
+                glm::vec2 b = glm::vec2(clip[(i + 1) % 4]) / std::max(clip[(i + 1) % 4].w, 1e-4f);
+                extent = std::max(extent, glm::length(a - b) * 0.5f * viewportHeight);
+            }
+            if (refine || extent > (float)h.pageContent) {
+                int level = page.level - 1;
+                next.push_back({ level, page.x * 2, page.y * 2 });
+                next.push_back({ level, page.x * 2 + 1, page.y * 2 });
+                next.push_back({ level, page.x * 2, page.y * 2 + 1 });
+                next.push_back({ level, page.x * 2 + 1, page.y * 2 + 1 });
+            }
+        }
+
+        // Stop refining once the atlas could not hold the finer level anyway
+        if (requested.size() + next.size() > budget)
+            break;
+        current.swap(next);
+    }
+}
+
+int VirtualTexture::acquireSlot() {
+    int best = -1;
+    for (int i = 0; i < (int)slots.size(); i++) {
+        if (slots[i].key == EMPTY_SLOT)
+            return i;
+        // Pages used this frame stay; otherwise the least recently used goes
+        if (slots[i].lastUsed < frame && (best < 0 || slots[i].lastUsed < slots[best].lastUsed))
+            best = i;
+    }
+    return best;
+}
+
+void VirtualTexture::update(int pageBudget) {
+    if (!isOpen())
+        return;
+    frame++;
+    stats.requestedPages = (int)requested.size();
+    stats.uploadsThisFrame = 0;
+
+    std::vector<uint32_t> missing;
+    for (uint32_t key : requested) {
+        std::unordered_map<uint32_t, int>::iterator found = resident.find(key);
+        if (found != resident.end())
+            slots[found->second].lastUsed = std::max(slots[found->second].lastUsed, frame);
+        else if (std::find(missing.begin(), missing.end(), key) == missing.end())
+            missing.push_back(key);
+    }
+    requested.clear();
+
+    // Requests arrive coarsest first, so a budget-limited frame still fills in
+    // the levels that give the most coverage
+    glBindTexture(GL_TEXTURE_2D, atlasTexture);
+    for (uint32_t key : missing) {
+        if (stats.uploadsThisFrame >= pageBudget)
+            break;
+        int slot = acquireSlot();
+        if (slot < 0)
+            break;
+        if (slots[slot].key != EMPTY_SLOT) {
+            resident.erase(slots[slot].key);
+            stats.evictions++;
+        }
+
+        int level = (int)(key >> 26), y = (int)((key >> 13) & 0x1FFF), x = (int)(key & 0x1FFF);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % atlasPages) * pageSize, (slot / atlasPages) * pageSize,
+            pageSize, pageSize, GL_RGBA, GL_UNSIGNED_BYTE, file.data() + pageOffset(level, x, y));
+        slots[slot] = { key, frame };
+        resident[key] = slot;
+        stats.uploadsThisFrame++;
+        indirectionDirty = true;
+    }
+
+    stats.residentPages = (int)resident.size();
+    stats.pendingPages = (int)missing.size() - stats.uploadsThisFrame;
+    if (indirectionDirty)
+        rebuildIndirection();
+}
+
+void VirtualTexture::rebuildIndirection() {
+    const VirtualTextureHeader& h = header();
+    int cells = (int)h.virtualPages;
+
+    // Coarse pages first so finer resident pages overwrite the cells they cover
+    std::vector<std::pair<int, int>> order; // (level, slot)
+    for (const std::pair<const uint32_t, int>& entry : resident)
+        order.push_back({ (int)(entry.first >> 26), entry.second });
+    std::sort(order.begin(), order.end(), [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+        return a.first > b.first;
+    });
+
+    for (const std::pair<int, int>& page : order) {
+        uint32_t key = slots[page.second].key;
+        int level = page.first, y = (int)((key >> 13) & 0x1FFF), x = (int)(key & 0x1FFF);
+        int span = 1 << level;
+        unsigned char entry[4] = { (unsigned char)(page.second % atlasPages),
+            (unsigned char)(page.second / atlasPages), (unsigned char)level, 255 };
+        for (int cy = y * span; cy < std::min((y + 1) * span, cells); cy++) {
+            for (int cx = x * span; cx < std::min((x + 1) * span, cells); cx++)
+                memcpy(&indirection[((size_t)cy * cells + cx) * 4], entry, 4);
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, indirectionTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, cells, cells, GL_RGBA, GL_UNSIGNED_BYTE, indirection.data());
+    indirectionDirty = false;
+}
+
+void VirtualTexture::bind(unsigned int program, int atlasUnit, int indirectionUnit) const {
+    if (!isOpen())
+        return;
+    const VirtualTextureHeader& h = header();
+
+    glActiveTexture(GL_TEXTURE0 + atlasUnit);
+    glBindTexture(GL_TEXTURE_2D, atlasTexture);
+    glActiveTexture(GL_TEXTURE0 + indirectionUnit);
+    glBindTexture(GL_TEXTURE_2D, indirectionTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(glGetUniformLocation(program, "vtAtlas"), atlasUnit);
+    glUniform1i(glGetUniformLocation(program, "vtIndirection"), indirectionUnit);
+    glUniform2f(glGetUniformLocation(program, "vtUvScale"),
+        (float)h.width / (h.virtualPages * h.pageContent), (float)h.height / (h.virtualPages * h.pageContent));
+    glUniform1f(glGetUniformLocation(program, "vtPages"), (float)h.virtualPages);
+    glUniform1f(glGetUniformLocation(program, "vtAtlasPages"), (float)atlasPages);
+    glUniform1f(glGetUniformLocation(program, "vtPageContent"), (float)h.pageContent);
+    glUniform1f(glGetUniformLocation(program, "vtPageBorder"), (float)h.pageBorder);
+}
@@ -0,0 +1,107 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include "MappedFile.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// On-disk page pyramid (.gvt) written by tileVirtualTexture(): this header, a
+// page table per level ((virtualPages >> level)^2 file offsets, 0 for pages
+// that lie wholly outside the image), then the pages. Each page is
+// pageContent texels plus pageBorder on every side, RGBA8, bottom row first.
+// The virtual size is padded to a power of two number of pages so every
+// level exactly halves the one below it.
+struct VirtualTextureHeader {
+    char magic[4];          // "GVT1"
+    uint32_t version;
+    uint32_t width;         // Source image size in texels
+    uint32_t height;
+    uint32_t pageContent;
+    uint32_t pageBorder;
+    uint32_t virtualPages;  // Pages across level 0
+    uint32_t levelCount;    // The last level is a single page
+    uint64_t sourceSize;
+    int64_t sourceTime;
+};
+
+// Where the tiled copy of an image lives, e.g. nightwatch.jpg ->
+// cache/nightwatch.jpg.gvt
+std::string virtualTexturePath(const std::string& sourcePath);
+
+// Offline: decodes sourcePath and writes its page pyramid.
+bool tileVirtualTexture(const std::string& sourcePath, const std::string& targetPath,
+    int pageContent = 124, int pageBorder = 2);
+
+// Streams pages of one huge image into a fixed physical atlas. Each frame the
+// caller describes where the image is drawn with requestPages(), which walks
+// the page quadtree on the CPU and keeps only the pages that are on screen and
+// whose texels are not already smaller than a pixel. update() uploads missing
+// pages (least recently used pages make room) and refreshes the indirection
+// texture that maps virtual pages to atlas slots, falling back to the nearest
+// coarser resident page.
+class VirtualTexture {
+public:
+    struct Counters {
+        int requestedPages;
+        int residentPages;
+        int uploadsThisFrame;
+        long long evictions;
+        int pendingPages;
+    };
+
+    explicit VirtualTexture(int atlasPagesAcross = 16);
+    ~VirtualTexture();
+
+    // Maps a tiled copy made by tileVirtualTexture(), unless it is invalid or
+    // older than sourcePath.
+    bool open(const std::string& path, const std::string& sourcePath);
+    bool isOpen() const { return file.isOpen(); }
+
+    // corners are the world positions at uv (0,0), (1,0), (1,1) and (0,1).
+    void requestPages(const glm::vec3 corners[4], const glm::mat4& viewProjection, float viewportHeight);
+
+    // GL thread: uploads up to pageBudget pages.
+    void update(int pageBudget = 16);
+
+    // Binds the atlas and indirection textures and sets the sampling uniforms
+    // (vtAtlas, vtIndirection, vtUvScale, vtPages, vtAtlasPages, vtPageContent,
+    // vtPageBorder) on the current program.
+    void bind(unsigned int program, int atlasUnit, int indirectionUnit) const;
+
+    const Counters& counters() const { return stats; }
+
+private:
+    struct Slot {
+        uint32_t key;       // Packed level/x/y, or EMPTY_SLOT
+        long long lastUsed;
+    };
+
+    static uint32_t pageKey(int level, int x, int y) { return ((uint32_t)level << 26) | ((uint32_t)y << 13) | (uint32_t)x; }
+
+    const VirtualTextureHeader& header() const;
+    uint64_t pageOffset(int level, int x, int y) const;
+    int acquireSlot();
+    void rebuildIndirection();
+
+    MappedFile file;
+    std::vector<size_t> levelTableStart;    // Index of each level's first entry
+
+    int atlasPages;
+    int pageSize;
+    unsigned int atlasTexture;
+    unsigned int indirectionTexture;
+
+    std::vector<Slot> slots;
+    std::unordered_map<uint32_t, int> resident;
+    std::vector<uint32_t> requested;        // This frame, coarsest first
+    std::vector<unsigned char> indirection;
+    bool indirectionDirty;
+    long long frame;
+
+    Counters stats;
+};
+
+#endif
@@ -0,0 +1,166 @@
+// Measures the scene BVH (Bvh.h): build time, refit time, and how many frustum,
+// ray and overlap queries it answers per second, over 10k to 1M boxes laid
+// out like a large gallery (objects up to a few metres across, spread over a
+// floor that grows with their number, about one per 4 square metres). Every
+// query kind is also checked against a brute-force loop over all boxes.
+//
+// Build from the repository root; on Linux:
+//   g++ -std=c++17 -O2 -I dependencies/include -I . bench/BvhBenchmark.cpp Bvh.cpp -o bvh_benchmark
+// On Windows add the file to a console project with Bvh.cpp.
+//
+// Run: bvh_benchmark [object count...]
+
+#include "Bvh.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+static double bestOf(int runs, const std::function<void()>& work) {
+    double best = 1e30;
+    for (int i = 0; i < runs; i++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        work();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+static std::vector<Aabb> makeBoxes(size_t count, float side, std::mt19937& random) {
+    std::uniform_real_distribution<float> position(0.0f, side), size(0.05f, 2.5f), height(0.0f, 2.0f);
+    std::vector<Aabb> boxes(count);
+    for (Aabb& box : boxes) {
+        glm::vec3 min(position(random), height(random), position(random));
+        box = { min, min + glm::vec3(size(random), size(random) * 0.5f, size(random)) };
+    }
+    return boxes;
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> counts;
+    for (int i = 1; i < argc; i++)
+        counts.push_back((size_t)atol(argv[i]));
+    if (counts.empty())
+        counts = { 10000, 100000, 1000000 };
+
+    printf("%9s %10s %9s %9s %12s %12s %12s %8s\n", "objects", "build ms", "refit ms", "update us",
+        "frustum/s", "ray/s", "overlap/s", "errors");
+    for (size_t count : counts) {
+        std::mt19937 random(1234);
+        float side = std::sqrt((float)count * 4.0f);
+        std::vector<Aabb> boxes = makeBoxes(count, side, random);
+
+        Bvh bvh;
+        double buildMs = bestOf(3, [&] { bvh.build(boxes); });
+
+        // Everything nudged, as if all of it moved a little
+        std::vector<Aabb> moved = boxes;
+        for (Aabb& box : moved) {
+            box.min += glm::vec3(0.01f);
+            box.max += glm::vec3(0.01f);
+        }
+        double refitMs = bestOf(3, [&] { bvh.refit(moved); });
+        bvh.build(boxes);
+
+        // One object at a time, like a spinning display
+        const int updates = 10000;
+        std::uniform_int_distribution<uint32_t> pickObject(0, (uint32_t)count - 1);
+        double updateMs = bestOf(3, [&] {
+            for (int i = 0; i < updates; i++) {
+                uint32_t object = pickObject(random);
+                bvh.update(object, (i & 1) ? moved[object] : boxes[object]);
+            }
+        });
+
+        // Views from eye height looking around, as a visitor would see it
+        const int views = 200;
+        std::uniform_real_distribution<float> place(0.0f, side), turn(0.0f, 6.2831853f);
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1920.0f / 1080.0f, 0.1f, 100.0f);
+        std::vector<glm::mat4> viewProjections(views);
+        std::vector<glm::vec3> origins(views), directions(views);
+        for (int i = 0; i < views; i++) {
+            origins[i] = glm::vec3(place(random), 1.5f, place(random));
+            float angle = turn(random);
+            directions[i] = glm::normalize(glm::vec3(std::cos(angle), -0.1f, std::sin(angle)));
+            viewProjections[i] = projection * glm::lookAt(origins[i], origins[i] + directions[i], glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+
+        size_t visited = 0;
+        double frustumMs = bestOf(3, [&] {
+            for (const glm::mat4& viewProjection : viewProjections) {
+                glm::vec4 planes[6];
+                frustumPlanes(viewProjection, planes);
+                bvh.frustum(planes, [&visited](uint32_t) { visited++; });
+            }
+        });
+
+        const int rays = 20000;
+        double rayMs = bestOf(3, [&] {
+            for (int i = 0; i < rays; i++) {
+                float distance;
+                bvh.raycast(origins[i % views], directions[(i * 7) % views], 100.0f,
+                    [](uint32_t, float enter) { return enter; }, distance);
+            }
+        });
+
+        const int overlaps = 20000;
+        double overlapMs = bestOf(3, [&] {
+            for (int i = 0; i < overlaps; i++) {
+                glm::vec3 center = origins[i % views] + directions[(i * 3) % views] * (float)(i % 10);
+                bvh.overlap({ center - glm::vec3(0.5f), center + glm::vec3(0.5f) }, [&visited](uint32_t) { visited++; });
+            }
+        });
+
+        // Brute force on a few of each, over the boxes the tree now holds
+        // (the updates above moved some)
+        std::vector<Aabb> current(count);
+        for (uint32_t i = 0; i < count; i++)
+            current[i] = bvh.bounds(i);
+        int errors = 0;
+        for (int i = 0; i < 10; i++) {
+            glm::vec4 planes[6];
+            frustumPlanes(viewProjections[i], planes);
+            std::vector<uint32_t> found;
+            bvh.frustum(planes, [&found](uint32_t object) { found.push_back(object); });
+            size_t expected = 0;
+            for (const Aabb& box : current) {
+                bool outside = false;
+                for (const glm::vec4& plane : planes) {
+                    glm::vec3 positive(plane.x >= 0.0f ? box.max.x : box.min.x, plane.y >= 0.0f ? box.max.y : box.min.y,
+                        plane.z >= 0.0f ? box.max.z : box.min.z);
+                    outside = outside || glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f;
+                }
+                expected += outside ? 0 : 1;
+            }
+            errors += found.size() != expected;
+
+            float distance, bruteDistance = 100.0f;
+            bvh.raycast(origins[i], directions[i], 100.0f, [](uint32_t, float enter) { return enter; }, distance);
+            glm::vec3 inverse = 1.0f / directions[i];
+            for (const Aabb& box : current) {
+                float enter = rayEntersBox(origins[i], inverse, box.min, box.max, bruteDistance);
+                if (enter >= 0.0f)
+                    bruteDistance = std::min(bruteDistance, enter);
+            }
+            errors += std::fabs(distance - bruteDistance) > 1e-4f;
+
+            Aabb probe = { origins[i] - glm::vec3(2.0f), origins[i] + glm::vec3(2.0f) };
+            size_t overlapping = 0, bruteOverlapping = 0;
+            bvh.overlap(probe, [&overlapping](uint32_t) { overlapping++; });
+            for (const Aabb& box : current)
+                bruteOverlapping += probe.overlaps(box) ? 1 : 0;
+            errors += overlapping != bruteOverlapping;
+        }
+
+        printf("%9zu %10.1f %9.2f %9.3f %12.0f %12.0f %12.0f %8d\n", count, buildMs, refitMs, updateMs * 1000.0 / updates,
+            views / (frustumMs / 1000.0), rays / (rayMs / 1000.0), overlaps / (overlapMs / 1000.0), errors);
+        if (visited == 0)
+            printf("(nothing visited)\n");
+    }
+    return 0;
+}
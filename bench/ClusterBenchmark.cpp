@@ -0,0 +1,249 @@
+// Measures the per-cluster culling of sculptures (MeshCluster and
+// cullClusters() in MeshOptimizer.h) on synthetic scans: the bumpy blobs of
+// SyntheticSculpture.h, cut into clusters as cookMesh() cuts them. From 8 views
+// around the mesh, and 8 close enough that much of it is off screen, it
+// reports the triangles the whole mesh would submit, those left once clusters
+// facing away, off screen or both are culled, and those that could be seen:
+// facing the eye and at least partly inside the frustum, and of those the
+// ones that cover a pixel, counted from a primitive id buffer. It also times
+// the culling and the drawing of the whole mesh against the clusters left.
+//
+// Build from the repository root; on Linux:
+//   g++ -std=c++17 -O2 -I dependencies/include -I . bench/ClusterBenchmark.cpp MeshOptimizer.cpp Bvh.cpp glad.c -lEGL -ldl -o cluster_benchmark
+// It needs no display or GPU: without one, Mesa's llvmpipe draws the views.
+// On Windows add the file to a console project with MeshOptimizer.cpp,
+// Bvh.cpp, glad.c and glfw3.lib.
+//
+// Run: cluster_benchmark [triangle count...]
+
+#include "HeadlessContext.h"
+#include "SyntheticSculpture.h"
+#include "Bvh.h"
+#include "MeshImport.h"
+#include "MeshOptimizer.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// The clusters' index runs left by the cone test, the frustum test or both,
+// as SceneStreamer::cull() finds them with cullClusters()
+struct Run {
+    uint32_t firstIndex, indexCount;
+};
+
+struct Runs {
+    std::vector<Run> runs;
+    size_t triangles = 0;
+};
+
+static void cull(const std::vector<MeshCluster>& clusters, const glm::mat4& viewProjection, const glm::vec3& eye,
+    bool cones, bool frustum, Runs& runs) {
+    glm::vec4 planes[6];
+    frustumPlanes(viewProjection, planes);
+    runs.triangles = cullClusters(clusters.data(), 0, (uint32_t)clusters.size(), cones ? &eye : nullptr,
+        frustum ? planes : nullptr, runs.runs);
+}
+
+const char* vertexSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+uniform mat4 viewProjection;
+void main() { gl_Position = viewProjection * vec4(aPos, 1.0); }
+)";
+
+// Each pixel keeps the id (+1) of the triangle drawn there
+const char* fragmentSource = R"(
+#version 330 core
+out uint id;
+void main() { id = uint(gl_PrimitiveID) + 1u; }
+)";
+
+class ViewRenderer {
+public:
+    static const int SIZE = 512;
+
+    ViewRenderer(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices) {
+        unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexSource, nullptr);
+        glCompileShader(vertexShader);
+        unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fragmentSource, nullptr);
+        glCompileShader(fragmentShader);
+        program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        glLinkProgram(program);
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+
+        glGenFramebuffers(1, &framebuffer);
+        glGenRenderbuffers(2, renderbuffers);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_R32UI, SIZE, SIZE);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SIZE, SIZE);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        glViewport(0, 0, SIZE, SIZE);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+        glUseProgram(program);
+        glEnable(GL_DEPTH_TEST);
+        indexCount = (GLsizei)indices.size();
+    }
+
+    ~ViewRenderer() {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(2, renderbuffers);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteProgram(program);
+    }
+
+    // Draws the whole mesh, or only runs; returns the milliseconds taken
+    double draw(const glm::mat4& viewProjection, const Runs* runs) {
+        glUniformMatrix4fv(glGetUniformLocation(program, "viewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+        const GLuint zero[4] = { 0, 0, 0, 0 };
+        glClearBufferuiv(GL_COLOR, 0, zero);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        std::vector<GLsizei> counts;
+        std::vector<const void*> offsets;
+        for (size_t i = 0; runs && i < runs->runs.size(); i++) {
+            counts.push_back((GLsizei)runs->runs[i].indexCount);
+            offsets.push_back((const void*)(runs->runs[i].firstIndex * sizeof(uint32_t)));
+        }
+        glFinish();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (runs) {
+            glMultiDrawElements(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), (GLsizei)counts.size());
+        }
+        else {
+            glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)0);
+        }
+        glFinish();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Triangles covering a pixel in what the whole mesh drew last
+    size_t coveringTriangles() {
+        std::vector<GLuint> ids(SIZE * SIZE);
+        glReadPixels(0, 0, SIZE, SIZE, GL_RED_INTEGER, GL_UNSIGNED_INT, ids.data());
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        return ids.size() - (ids.front() == 0 ? 1 : 0);
+    }
+
+private:
+    unsigned int program, framebuffer, renderbuffers[2], VAO, VBO, EBO;
+    GLsizei indexCount;
+};
+
+// Triangles facing eye with a corner not outside the same plane as the others
+static size_t facingInView(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+    const glm::mat4& viewProjection, const glm::vec3& eye) {
+    glm::vec4 planes[6];
+    frustumPlanes(viewProjection, planes);
+    size_t count = 0;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const glm::vec3& a = positions[indices[i]];
+        const glm::vec3& b = positions[indices[i + 1]];
+        const glm::vec3& c = positions[indices[i + 2]];
+        if (glm::dot(glm::cross(b - a, c - a), eye - a) <= 0.0f)
+            continue;
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; p++) {
+            glm::vec3 normal(planes[p]);
+            outside = glm::dot(normal, a) + planes[p].w < 0.0f && glm::dot(normal, b) + planes[p].w < 0.0f &&
+                glm::dot(normal, c) + planes[p].w < 0.0f;
+        }
+        count += outside ? 0 : 1;
+    }
+    return count;
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> counts;
+    for (int i = 1; i < argc; i++)
+        counts.push_back((size_t)atol(argv[i]));
+    if (counts.empty())
+        counts = { 1000000, 4000000 };
+
+    if (!createHeadlessContext())
+        return 1;
+    printf("renderer %s\n\n", (const char*)glGetString(GL_RENDERER));
+
+    for (size_t count : counts) {
+        std::mt19937 random(1234);
+        ImportedMesh mesh;
+        makeSculpture(count, mesh, random);
+        std::vector<uint32_t> indices = mesh.indices;
+        optimizeVertexCache(indices, mesh.positions.size());
+        std::vector<MeshCluster> clusters = buildClusters(indices, mesh.positions);
+        optimizeOverdraw(indices, mesh.positions, clusters);
+        size_t triangles = indices.size() / 3;
+        printf("%zu triangles in %zu clusters (%.1f each)\n", triangles, clusters.size(),
+            (double)triangles / clusters.size());
+
+        ViewRenderer renderer(mesh.positions, indices);
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.05f, 10.0f);
+        printf("  %-6s %10s %10s %10s %10s %10s %10s %8s %8s %9s %7s\n", "views", "mesh", "- cones", "- frustum",
+            "- both", "facing", "covering", "cull ms", "draw all", "draw left", "runs");
+        const char* names[2] = { "around", "close" };
+        for (int group = 0; group < 2; group++) {
+            double sums[6] = { 0, 0, 0, 0, 0, 0 };
+            double cullMs = 0.0, drawAllMs = 0.0, drawCulledMs = 0.0, runCount = 0.0;
+            for (int view = 0; view < 8; view++) {
+                float angle = view * 3.14159265f / 4.0f;
+                glm::vec3 eye = group == 0 ? glm::vec3(2.2f * std::cos(angle), 0.9f, 2.2f * std::sin(angle)) :
+                    glm::vec3(0.9f * std::cos(angle), 0.7f, 0.9f * std::sin(angle));
+                glm::vec3 target = group == 0 ? glm::vec3(0.0f, 0.5f, 0.0f) :
+                    glm::vec3(0.3f * std::cos(angle + 0.8f), 0.5f, 0.3f * std::sin(angle + 0.8f));
+                glm::mat4 viewProjection = projection * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+
+                Runs cones, frustum, both;
+                cull(clusters, viewProjection, eye, true, false, cones);
+                cull(clusters, viewProjection, eye, false, true, frustum);
+                const int repeats = 20;
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                for (int r = 0; r < repeats; r++)
+                    cull(clusters, viewProjection, eye, true, true, both);
+                cullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() /
+                    repeats;
+
+                drawAllMs += renderer.draw(viewProjection, nullptr);
+                size_t covering = renderer.coveringTriangles();
+                drawCulledMs += renderer.draw(viewProjection, &both);
+                runCount += both.runs.size();
+
+                sums[0] += triangles;
+                sums[1] += cones.triangles;
+                sums[2] += frustum.triangles;
+                sums[3] += both.triangles;
+                sums[4] += facingInView(mesh.positions, indices, viewProjection, eye);
+                sums[5] += covering;
+            }
+            printf("  %-6s %10.0f %10.0f %10.0f %10.0f %10.0f %10.0f %8.3f %8.2f %9.2f %7.0f\n", names[group],
+                sums[0] / 8, sums[1] / 8, sums[2] / 8, sums[3] / 8, sums[4] / 8, sums[5] / 8, cullMs / 8,
+                drawAllMs / 8, drawCulledMs / 8, runCount / 8);
+        }
+        printf("\n");
+    }
+    return 0;
+}
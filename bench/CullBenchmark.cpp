@@ -0,0 +1,126 @@
+// Measures the frustum culler (FrustumCuller.h) against the BVH's frustum
+// query (Bvh.h) from the few hundred objects of the rooms around the camera
+// up to a million, laid out as in BvhBenchmark.cpp. Boxes and spheres are
+// both checked against a plain loop over every object.
+//
+// Build from the repository root; on Linux:
+//   g++ -std=c++17 -O2 -mavx2 -I dependencies/include -I . bench/CullBenchmark.cpp FrustumCuller.cpp JobSystem.cpp Bvh.cpp -lpthread -o cull_benchmark
+// Leave out -mavx2 for the SSE2 path, or add -DFRUSTUM_CULLER_SCALAR for the
+// portable one. On Windows add the file to a console project with
+// FrustumCuller.cpp, JobSystem.cpp and Bvh.cpp.
+//
+// Run: cull_benchmark [object count...]
+
+#include "FrustumCuller.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+static double bestOf(int runs, const std::function<void()>& work) {
+    double best = 1e30;
+    for (int i = 0; i < runs; i++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        work();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+// The culler's test, one object at a time
+static bool inFrustum(const glm::vec4 planes[6], const glm::vec3& center, const glm::vec3& extent, float radius) {
+    for (int p = 0; p < 6; p++) {
+        const glm::vec4& plane = planes[p];
+        float distance = (plane.x * center.x + plane.y * center.y) + (plane.z * center.z + plane.w);
+        float reach = (std::fabs(plane.x) * extent.x + std::fabs(plane.y) * extent.y) + (std::fabs(plane.z) * extent.z + radius);
+        if (distance + reach < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> counts;
+    for (int i = 1; i < argc; i++)
+        counts.push_back((size_t)atol(argv[i]));
+    if (counts.empty())
+        counts = { 300, 10000, 100000, 1000000 };
+
+    printf("culler path: %s\n", frustumCullerPath());
+    printf("%9s %9s %12s %12s %12s %8s\n", "objects", "visible", "culler us", "bvh us", "spheres us", "errors");
+    for (size_t count : counts) {
+        std::mt19937 random(1234);
+        float side = std::sqrt((float)count * 4.0f);
+        std::uniform_real_distribution<float> position(0.0f, side), size(0.05f, 2.5f), height(0.0f, 2.0f);
+        std::vector<Aabb> boxes(count);
+        for (Aabb& box : boxes) {
+            glm::vec3 min(position(random), height(random), position(random));
+            box = { min, min + glm::vec3(size(random), size(random) * 0.5f, size(random)) };
+        }
+
+        FrustumCuller culler, sphereCuller;
+        for (const Aabb& box : boxes) {
+            culler.addBox(box);
+            sphereCuller.addSphere(box.center(), glm::length(box.max - box.min) * 0.5f);
+        }
+        Bvh bvh;
+        bvh.build(boxes);
+
+        const int views = 200;
+        std::uniform_real_distribution<float> turn(0.0f, 6.2831853f);
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1920.0f / 1080.0f, 0.1f, 100.0f);
+        std::vector<glm::mat4> viewProjections(views);
+        for (glm::mat4& viewProjection : viewProjections) {
+            glm::vec3 origin(position(random), 1.5f, position(random));
+            float angle = turn(random);
+            glm::vec3 direction(std::cos(angle), -0.1f, std::sin(angle));
+            viewProjection = projection * glm::lookAt(origin, origin + direction, glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+
+        size_t visible = 0;
+        double cullerMs = bestOf(3, [&] {
+            visible = 0;
+            for (const glm::mat4& viewProjection : viewProjections)
+                visible += culler.cull(viewProjection).size();
+        });
+        size_t found = 0;
+        double bvhMs = bestOf(3, [&] {
+            for (const glm::mat4& viewProjection : viewProjections) {
+                glm::vec4 planes[6];
+                frustumPlanes(viewProjection, planes);
+                bvh.frustum(planes, [&found](uint32_t) { found++; });
+            }
+        });
+        double sphereMs = bestOf(3, [&] {
+            for (const glm::mat4& viewProjection : viewProjections)
+                sphereCuller.cull(viewProjection);
+        });
+
+        int errors = 0;
+        for (int i = 0; i < 10; i++) {
+            glm::vec4 planes[6];
+            frustumPlanes(viewProjections[i], planes);
+            std::vector<uint32_t> expectedBoxes, expectedSpheres;
+            for (uint32_t j = 0; j < count; j++) {
+                const Aabb& box = boxes[j];
+                if (inFrustum(planes, box.center(), (box.max - box.min) * 0.5f, 0.0f))
+                    expectedBoxes.push_back(j);
+                if (inFrustum(planes, box.center(), glm::vec3(0.0f), glm::length(box.max - box.min) * 0.5f))
+                    expectedSpheres.push_back(j);
+            }
+            errors += culler.cull(viewProjections[i]) != expectedBoxes;
+            errors += sphereCuller.cull(viewProjections[i]) != expectedSpheres;
+        }
+
+        printf("%9zu %9zu %12.2f %12.2f %12.2f %8d\n", count, visible / views, cullerMs * 1000.0 / views,
+            bvhMs * 1000.0 / views, sphereMs * 1000.0 / views, errors);
+        if (found == 0)
+            printf("(nothing found)\n");
+    }
+    return 0;
+}
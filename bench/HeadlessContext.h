@@ -0,0 +1,64 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+// A GL 3.3 core context with no window, for the benchmarks. Linux uses EGL's
+// surfaceless platform (Mesa; link with -lEGL), Windows a hidden GLFW window.
+
+#include <glad/glad.h>
+#include <iostream>
+
+#ifdef _WIN32
+#include <GLFW/glfw3.h>
+
+inline bool createHeadlessContext() {
+    if (!glfwInit())
+        return false;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "bench", nullptr, nullptr);
+    if (!window) {
+        std::cerr << "Failed to create GL context" << std::endl;
+        return false;
+    }
+    glfwMakeContextCurrent(window);
+    return gladLoadGLLoader((GLADloadproc)glfwGetProcAddress) != 0;
+}
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+inline bool createHeadlessContext() {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (!eglInitialize(display, nullptr, nullptr)) {
+        std::cerr << "Failed to initialize EGL" << std::endl;
+        return false;
+    }
+
+    const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig config = nullptr;
+    EGLint configCount = 0;
+    eglChooseConfig(display, configAttributes, &config, 1, &configCount);
+    eglBindAPI(EGL_OPENGL_API);
+
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, configCount ? config : nullptr, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cerr << "Failed to create GL context" << std::endl;
+        return false;
+    }
+    return gladLoadGLLoader((GLADloadproc)eglGetProcAddress) != 0;
+}
+#endif
+
+#endif
@@ -0,0 +1,242 @@
+// Measures how the per-frame CPU work of SceneStreamer (animate() and cull())
+// scales with the threads of a job system (JobSystem.h), on a synthetic
+// gallery far larger than the rooms around the camera: displays turning on
+// their stands, a frustum culler over every object, and sculptures cut into
+// clusters (the scans of SyntheticSculpture.h), culled a span of clusters per
+// job with cullClusters() as cull() does, at the grains SceneStreamer.h gives
+// its jobs. For each worker count it reports the milliseconds of each stage
+// and of the whole frame, the speedup over running every job on the calling
+// thread (0 workers), and whether the objects and clusters found match that
+// run.
+//
+// Build from the repository root; on Linux:
+//   g++ -std=c++17 -O2 -mavx2 -I dependencies/include -I . bench/JobBenchmark.cpp JobSystem.cpp FrustumCuller.cpp MeshOptimizer.cpp Bvh.cpp -lpthread -o job_benchmark
+// On Windows add the file to a console project with JobSystem.cpp,
+// FrustumCuller.cpp, MeshOptimizer.cpp and Bvh.cpp.
+//
+// Run: job_benchmark [max workers] [objects] [sculpture triangles]
+
+#include "SyntheticSculpture.h"
+#include "JobSystem.h"
+#include "FrustumCuller.h"
+#include "MeshOptimizer.h"
+#include "SceneStreamer.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+static const int FRAMES = 60;
+
+static double now() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Display {
+    glm::vec3 position;
+    float speed;
+    uint32_t object;    // In the culler
+};
+
+struct Sculpture {
+    glm::mat4 model;
+    glm::vec3 center;
+    float radius;
+};
+
+struct Run {
+    uint32_t firstIndex, indexCount;
+};
+
+struct Span {
+    uint32_t sculpture;
+    uint32_t first, end;
+    std::vector<Run> runs;
+    uint32_t triangles;
+};
+
+// What a frame found, to check the threaded runs against
+struct Result {
+    size_t visible = 0;
+    size_t runs = 0;
+    size_t triangles = 0;
+    bool operator==(const Result& other) const {
+        return visible == other.visible && runs == other.runs && triangles == other.triangles;
+    }
+};
+
+struct Timing {
+    double animate = 0.0, cull = 0.0, clusters = 0.0;
+    double frame() const { return animate + cull + clusters; }
+};
+
+class Gallery {
+public:
+    Gallery(size_t objectCount, size_t sculptureTriangles) {
+        std::mt19937 random(1234);
+        side = std::sqrt((float)objectCount * 4.0f);
+        std::uniform_real_distribution<float> position(0.0f, side), size(0.05f, 2.5f), height(0.0f, 2.0f),
+            speed(0.2f, 1.0f);
+        // A tenth of the objects are displays
+        for (size_t i = 0; i < objectCount; i++) {
+            glm::vec3 min(position(random), height(random), position(random));
+            if (i % 10 == 0) {
+                displays.push_back({ min, speed(random), 0 });
+                displays.back().object = culler.addBox({ min, min + glm::vec3(0.5f) });
+            }
+            else {
+                culler.addBox({ min, min + glm::vec3(size(random), size(random) * 0.5f, size(random)) });
+            }
+        }
+
+        ImportedMesh mesh;
+        makeSculpture(sculptureTriangles, mesh, random);
+        optimizeVertexCache(mesh.indices, mesh.positions.size());
+        clusters = buildClusters(mesh.indices, mesh.positions);
+        triangleCount = mesh.indices.size() / 3;
+        Aabb bounds = Aabb::empty();
+        for (const glm::vec3& p : mesh.positions)
+            bounds.grow(p);
+        // A ring of sculptures around the middle, where the camera stands
+        glm::vec3 middle(side * 0.5f, 0.0f, side * 0.5f);
+        for (int i = 0; i < 16; i++) {
+            float angle = 6.2831853f * i / 16;
+            glm::vec3 at = middle + glm::vec3(std::cos(angle), 0.0f, std::sin(angle)) * 4.0f;
+            glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), at), glm::vec3(1.5f));
+            sculptures.push_back({ model, glm::vec3(model * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f)),
+                glm::length(bounds.max - bounds.min) * 0.75f });
+        }
+    }
+
+    size_t triangles() const { return triangleCount; }
+    size_t clusterCount() const { return clusters.size(); }
+    size_t objectCount() const { return culler.objectCount(); }
+
+    Result frame(int index, JobSystem& jobs, Timing& timing) {
+        float time = index * 0.016f;
+        glm::vec3 eye(side * 0.5f, 1.6f, side * 0.5f);
+        float angle = index * 0.1f;
+        glm::vec3 direction(std::cos(angle), -0.05f, std::sin(angle));
+        glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 1920.0f / 1080.0f, 0.1f, 100.0f) *
+            glm::lookAt(eye, eye + direction, glm::vec3(0.0f, 1.0f, 0.0f));
+
+        // Turn the displays, as animate() does
+        double start = now();
+        jobs.parallelFor(displays.size(), SceneStreamer::displaysPerJob, [&](size_t first, size_t end) {
+            for (size_t i = first; i < end; i++) {
+                const Display& display = displays[i];
+                glm::mat4 model = glm::rotate(glm::translate(glm::mat4(1.0f), display.position),
+                    time * display.speed, glm::vec3(0.0f, 1.0f, 0.0f));
+                Aabb box = Aabb::empty();
+                for (float x : { -0.25f, 0.25f }) {
+                    for (float y : { 0.0f, 0.5f })
+                        box.grow(glm::vec3(model * glm::vec4(x, y, 0.0f, 1.0f)));
+                }
+                culler.setBox(display.object, box);
+            }
+        });
+        double animated = now();
+
+        Result result;
+        result.visible = culler.cull(viewProjection, &jobs).size();
+        double culled = now();
+
+        // The sculptures in view, a span of clusters per job, then joined
+        glm::vec4 planes[6];
+        frustumPlanes(viewProjection, planes);
+        size_t count = 0;
+        for (uint32_t s = 0; s < sculptures.size(); s++) {
+            bool outside = false;
+            for (int p = 0; p < 6 && !outside; p++)
+                outside = glm::dot(glm::vec3(planes[p]), sculptures[s].center) + planes[p].w < -sculptures[s].radius;
+            for (uint32_t first = 0; !outside && first < clusters.size(); first += SceneStreamer::clustersPerJob) {
+                if (spans.size() <= count)
+                    spans.resize(count + 1);
+                Span& span = spans[count++];
+                span.sculpture = s;
+                span.first = first;
+                span.end = std::min(first + SceneStreamer::clustersPerJob, (uint32_t)clusters.size());
+            }
+        }
+        jobs.parallelFor(count, 1, [&](size_t first, size_t end) {
+            for (size_t i = first; i < end; i++)
+                cullSpan(spans[i], viewProjection, eye);
+        });
+        std::vector<Run>& joined = sculptureRuns;
+        joined.clear();
+        for (size_t i = 0; i < count; i++) {
+            for (const Run& run : spans[i].runs) {
+                if (!joined.empty() && spans[i].first > 0 && joined.back().firstIndex + joined.back().indexCount == run.firstIndex)
+                    joined.back().indexCount += run.indexCount;
+                else
+                    joined.push_back(run);
+            }
+            result.triangles += spans[i].triangles;
+        }
+        result.runs = joined.size();
+        double end = now();
+
+        timing.animate += animated - start;
+        timing.cull += culled - animated;
+        timing.clusters += end - culled;
+        return result;
+    }
+
+private:
+    // As cull() in SceneStreamer.cpp, in the sculpture's own space
+    void cullSpan(Span& span, const glm::mat4& viewProjection, const glm::vec3& cameraPos) const {
+        const glm::mat4& model = sculptures[span.sculpture].model;
+        glm::vec3 eye = glm::vec3(glm::inverse(model) * glm::vec4(cameraPos, 1.0f));
+        glm::vec4 planes[6];
+        frustumPlanes(viewProjection * model, planes);
+        span.triangles = cullClusters(clusters.data(), span.first, span.end, &eye, planes, span.runs);
+    }
+
+    float side;
+    FrustumCuller culler;
+    std::vector<Display> displays;
+    size_t triangleCount;
+    std::vector<MeshCluster> clusters;
+    std::vector<Sculpture> sculptures;
+    std::vector<Span> spans;
+    std::vector<Run> sculptureRuns;
+};
+
+int main(int argc, char** argv) {
+    int cores = (int)std::thread::hardware_concurrency();
+    int maxWorkers = argc > 1 ? atoi(argv[1]) : std::max(3, cores - 1);
+    size_t objects = argc > 2 ? (size_t)atol(argv[2]) : 200000;
+    size_t triangles = argc > 3 ? (size_t)atol(argv[3]) : 1000000;
+
+    Gallery gallery(objects, triangles);
+    printf("%d cores; %zu objects, 16 sculptures of %zu triangles in %zu clusters; %d frames\n", cores,
+        gallery.objectCount(), gallery.triangles(), gallery.clusterCount(), FRAMES);
+    printf("%8s %10s %10s %11s %10s %8s %6s\n", "workers", "animate", "cull", "clusters", "frame ms", "speedup", "same");
+
+    std::vector<Result> expected;
+    double serialFrame = 0.0;
+    for (int workers = 0; workers <= maxWorkers; workers++) {
+        JobSystem jobs(workers);
+        std::vector<Result> results(FRAMES);
+        Timing best;
+        for (int run = 0; run < 3; run++) {
+            Timing timing;
+            for (int i = 0; i < FRAMES; i++)
+                results[i] = gallery.frame(i, jobs, timing);
+            if (run == 0 || timing.frame() < best.frame())
+                best = timing;
+        }
+        if (expected.empty()) {
+            expected = results;
+            serialFrame = best.frame();
+        }
+        printf("%8d %10.3f %10.3f %11.3f %10.3f %7.2fx %6s\n", workers, best.animate / FRAMES, best.cull / FRAMES,
+            best.clusters / FRAMES, best.frame() / FRAMES, serialFrame / best.frame(), results == expected ? "yes" : "NO");
+    }
+    return 0;
+}
@@ -0,0 +1,244 @@
+// Measures the sculpture mesh pipeline (MeshImport.h, MeshOptimizer.h,
+// CookedMesh.h) on synthetic scans: a dozen overlapping bumpy blobs of 100k
+// to a few million triangles in all, written as OBJ with their triangles
+// shuffled, the way a reconstruction often leaves them. For each size it
+// reports the time to parse the OBJ against mapping the cooked copy, the time
+// of each cooking pass, the vertices shaded per triangle with FIFO caches of
+// 16 and 32 entries after each (the last row in the order cookMesh() stores,
+// clusters sorted whole), and overdraw: fragments passing the depth test per
+// covered pixel, counted with occlusion queries from 8 views around the mesh
+// (both sides drawn, as the gallery does).
+//
+// Build from the repository root; on Linux:
+//   g++ -std=c++17 -O2 -I dependencies/include -I . bench/MeshBenchmark.cpp MeshImport.cpp MeshOptimizer.cpp CookedMesh.cpp SceneGeometry.cpp MappedFile.cpp glad.c -lEGL -ldl -o mesh_benchmark
+// It needs no display or GPU: without one, Mesa's llvmpipe draws the views.
+// On Windows add the file to a console project with MeshImport.cpp,
+// MeshOptimizer.cpp, CookedMesh.cpp, SceneGeometry.cpp, MappedFile.cpp,
+// glad.c and glfw3.lib.
+//
+// Run: mesh_benchmark [triangle count...]
+// The OBJ and its cooked copy are written to the system's temporary folder.
+
+#include "HeadlessContext.h"
+#include "SyntheticSculpture.h"
+#include "CookedMesh.h"
+#include "MeshImport.h"
+#include "MeshOptimizer.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static double timeMs(const std::function<void()>& work) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    work();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void writeObj(const std::string& path, const ImportedMesh& mesh) {
+    FILE* file = fopen(path.c_str(), "w");
+    for (const glm::vec3& p : mesh.positions)
+        fprintf(file, "v %.6f %.6f %.6f\n", p.x, p.y, p.z);
+    for (const glm::vec2& uv : mesh.uvs)
+        fprintf(file, "vt %.6f %.6f\n", uv.x, uv.y);
+    for (const glm::vec3& n : mesh.normals)
+        fprintf(file, "vn %.6f %.6f %.6f\n", n.x, n.y, n.z);
+    for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+        uint32_t a = mesh.indices[i] + 1, b = mesh.indices[i + 1] + 1, c = mesh.indices[i + 2] + 1;
+        fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c);
+    }
+    fclose(file);
+}
+
+const char* vertexSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+uniform mat4 viewProjection;
+void main() { gl_Position = viewProjection * vec4(aPos, 1.0); }
+)";
+
+const char* fragmentSource = R"(
+#version 330 core
+out vec4 FragColor;
+void main() { FragColor = vec4(1.0); }
+)";
+
+// Fragments that passed the depth test per covered pixel, over the views
+class OverdrawMeter {
+public:
+    OverdrawMeter() {
+        unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexSource, nullptr);
+        glCompileShader(vertexShader);
+        unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fragmentSource, nullptr);
+        glCompileShader(fragmentShader);
+        program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        glLinkProgram(program);
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+
+        glGenFramebuffers(1, &framebuffer);
+        glGenRenderbuffers(2, renderbuffers);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SIZE, SIZE);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SIZE, SIZE);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        glViewport(0, 0, SIZE, SIZE);
+        glGenQueries(1, &query);
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+    }
+
+    ~OverdrawMeter() {
+        glDeleteQueries(1, &query);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(2, renderbuffers);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteProgram(program);
+    }
+
+    double measure(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices) {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+        glUseProgram(program);
+        glEnable(GL_DEPTH_TEST);
+
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 10.0f);
+        GLuint shaded = 0, covered = 0;
+        for (int view = 0; view < 8; view++) {
+            float angle = view * 3.14159265f / 4.0f;
+            glm::vec3 eye(2.2f * std::cos(angle), 0.9f, 2.2f * std::sin(angle));
+            glm::mat4 viewProjection = projection * glm::lookAt(eye, glm::vec3(0.0f, 0.5f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            glUniformMatrix4fv(glGetUniformLocation(program, "viewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            // Every fragment that got past the depth test when drawn, then
+            // again only the ones left in the end, one per covered pixel
+            GLuint passed = 0;
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+            glBeginQuery(GL_SAMPLES_PASSED, query);
+            glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, (void*)0);
+            glEndQuery(GL_SAMPLES_PASSED);
+            glGetQueryObjectuiv(query, GL_QUERY_RESULT, &passed);
+            shaded += passed;
+
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+            glBeginQuery(GL_SAMPLES_PASSED, query);
+            glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, (void*)0);
+            glEndQuery(GL_SAMPLES_PASSED);
+            glGetQueryObjectuiv(query, GL_QUERY_RESULT, &passed);
+            covered += passed;
+        }
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        return covered > 0 ? (double)shaded / covered : 0.0;
+    }
+
+private:
+    static const int SIZE = 512;
+    unsigned int program, framebuffer, renderbuffers[2], query, VAO, VBO, EBO;
+};
+
+int main(int argc, char** argv) {
+    std::vector<size_t> counts;
+    for (int i = 1; i < argc; i++)
+        counts.push_back((size_t)atol(argv[i]));
+    if (counts.empty())
+        counts = { 100000, 1000000 };
+
+    if (!createHeadlessContext())
+        return 1;
+    printf("renderer %s\n\n", (const char*)glGetString(GL_RENDERER));
+    OverdrawMeter overdraw;
+    std::string objPath = (fs::temp_directory_path() / "mesh_benchmark.obj").string();
+    std::string cookedPath = (fs::temp_directory_path() / "mesh_benchmark.gmesh").string();
+
+    for (size_t count : counts) {
+        std::mt19937 random(1234);
+        ImportedMesh source;
+        makeSculpture(count, source, random);
+        writeObj(objPath, source);
+
+        ImportedMesh mesh;
+        double parseMs = timeMs([&] { importObj(objPath, mesh); });
+        std::vector<unsigned char> cooked;
+        double cookMs = timeMs([&] { cookMesh(objPath, cooked); });
+        saveCookedMesh(cookedPath, cooked);
+        CookedMesh mapped;
+        double mapMs = timeMs([&] { mapped.load(cookedPath); });
+
+        std::vector<uint32_t> indices = mesh.indices;
+        size_t vertices = mesh.positions.size();
+        float missBefore16 = averageCacheMissRatio(indices, vertices, 16);
+        float missBefore32 = averageCacheMissRatio(indices, vertices, 32);
+        double overdrawBefore = overdraw.measure(mesh.positions, indices);
+
+        double cacheMs = timeMs([&] { optimizeVertexCache(indices, vertices); });
+        float missCache16 = averageCacheMissRatio(indices, vertices, 16);
+        float missCache32 = averageCacheMissRatio(indices, vertices, 32);
+        double overdrawCache = overdraw.measure(mesh.positions, indices);
+
+        double overdrawMs = timeMs([&] { optimizeOverdraw(indices, mesh.positions); });
+        float missOverdraw16 = averageCacheMissRatio(indices, vertices, 16);
+        float missOverdraw32 = averageCacheMissRatio(indices, vertices, 32);
+        double overdrawSorted = overdraw.measure(mesh.positions, indices);
+
+        // What cookMesh() does instead: clusters from the cache order, sorted
+        // whole for overdraw
+        std::vector<uint32_t> clustered = mesh.indices;
+        optimizeVertexCache(clustered, vertices);
+        std::vector<MeshCluster> clusters;
+        double clusterMs = timeMs([&] {
+            clusters = buildClusters(clustered, mesh.positions);
+            optimizeOverdraw(clustered, mesh.positions, clusters);
+        });
+        float missClusters16 = averageCacheMissRatio(clustered, vertices, 16);
+        float missClusters32 = averageCacheMissRatio(clustered, vertices, 32);
+        double overdrawClusters = overdraw.measure(mesh.positions, clustered);
+
+        std::vector<uint32_t> fetched = indices;
+        double fetchMs = timeMs([&] { optimizeVertexFetch(fetched, vertices); });
+
+        printf("%zu triangles, %zu vertices, OBJ %.1f MB, cooked %.1f MB\n", indices.size() / 3, vertices,
+            fs::file_size(objPath) / 1e6, cooked.size() / 1e6);
+        printf("  parse OBJ %9.1f ms   cook (with parse) %9.1f ms   map cooked %7.2f ms\n", parseMs, cookMs, mapMs);
+        printf("  vertex cache pass %7.1f ms   overdraw pass %7.1f ms   cluster passes %7.1f ms   fetch pass %7.1f ms\n",
+            cacheMs, overdrawMs, clusterMs, fetchMs);
+        printf("  %-16s %14s %14s %10s\n", "order", "misses/tri 16", "misses/tri 32", "overdraw");
+        printf("  %-16s %14.3f %14.3f %10.3f\n", "as exported", missBefore16, missBefore32, overdrawBefore);
+        printf("  %-16s %14.3f %14.3f %10.3f\n", "vertex cache", missCache16, missCache32, overdrawCache);
+        printf("  %-16s %14.3f %14.3f %10.3f\n", "+ overdraw", missOverdraw16, missOverdraw32, overdrawSorted);
+        printf("  %-16s %14.3f %14.3f %10.3f   (%zu clusters, as cooked)\n\n", "+ clusters", missClusters16,
+            missClusters32, overdrawClusters, clusters.size());
+    }
+
+    std::error_code error;
+    fs::remove(objPath, error);
+    fs::remove(cookedPath, error);
+    return 0;
+}
@@ -0,0 +1,178 @@
+// Compares the CPU mip builder (MipBuilder.h) with the driver's glGenerateMipmap:
+// time to build the chains, time to get them into GL, and how far each 1x1
+// level lands from the true (linear light) average colour of its image.
+//
+// Build from the repository root; on Linux:
+//   g++ -std=c++17 -O2 -mavx2 -I dependencies/include -I . bench/MipBenchmark.cpp MipBuilder.cpp glad.c -lEGL -lpthread -ldl -o mip_benchmark
+// Drop -mavx2 to measure the SSE2 path, or add -DMIP_BUILDER_SCALAR for the scalar one.
+// On Windows add the file to a console project with MipBuilder.cpp, glad.c and glfw3.lib.
+//
+// Run from the folder with the images: mip_benchmark [image...]
+
+#include "HeadlessContext.h"
+#include "MipBuilder.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Image {
+    std::string path;
+    int width, height;
+    std::vector<unsigned char> pixels;  // RGBA
+};
+
+static double bestOf(int runs, const std::function<void()>& run) {
+    double best = 1e30;
+    for (int i = 0; i < runs; i++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        run();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+static double toLinear(double c) {
+    return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+}
+
+static double toSrgb(double l) {
+    return l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+}
+
+// Mean absolute difference, in 8-bit steps, between a 1x1 level and the sRGB
+// encoding of the image's average in linear light.
+static double averageError(const Image& image, const unsigned char* texel) {
+    double error = 0.0;
+    for (int c = 0; c < 3; c++) {
+        double sum = 0.0;
+        for (size_t i = c; i < image.pixels.size(); i += 4)
+            sum += toLinear(image.pixels[i] / 255.0);
+        double expected = toSrgb(sum / (image.pixels.size() / 4)) * 255.0;
+        error += std::fabs(expected - texel[c]);
+    }
+    return error / 3.0;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+        paths.push_back(argv[i]);
+    if (paths.empty())
+        paths = { "adam.jpg", "girlwithpearl.jpg", "starry.jpg", "venus.jpg", "mona.jpg", "nightwatch.jpg",
+            "La Grande Jatte.jpg", "lastsupper.jpg", "ceiling.jpg", "wood-floor-textures.jpg" };
+
+    if (!createHeadlessContext())
+        return 1;
+
+    std::vector<Image> images;
+    size_t texels = 0;
+    for (const std::string& path : paths) {
+        Image image = { path, 0, 0, {} };
+        int channels;
+        stbi_set_flip_vertically_on_load(true);
+        unsigned char* pixels = stbi_load(path.c_str(), &image.width, &image.height, &channels, 4);
+        if (!pixels) {
+            std::cerr << "Failed to load texture: " << path << std::endl;
+            continue;
+        }
+        image.pixels.assign(pixels, pixels + (size_t)image.width * image.height * 4);
+        stbi_image_free(pixels);
+        texels += (size_t)image.width * image.height;
+        images.push_back(std::move(image));
+    }
+    if (images.empty())
+        return 1;
+
+    const int runs = 3;
+    int threads = std::max(1, (int)std::thread::hardware_concurrency());
+    printf("%zu images, %.1f Mtexels, CPU path %s, %d threads, %s\n", images.size(), texels / 1e6,
+        mipBuilderPath(), threads, (const char*)glGetString(GL_RENDERER));
+
+    // CPU chains
+    std::vector<std::vector<MipLevel>> chains(images.size());
+    MipOptions box, kaiser;
+    kaiser.filter = MipFilter::Kaiser;
+    double boxSerial = bestOf(runs, [&] {
+        for (size_t i = 0; i < images.size(); i++) {
+            chains[i].clear();
+            buildMips(images[i].pixels.data(), images[i].width, images[i].height, 4, box, chains[i]);
+        }
+    });
+    double kaiserSerial = bestOf(runs, [&] {
+        std::vector<MipLevel> levels;
+        for (const Image& image : images) {
+            levels.clear();
+            buildMips(image.pixels.data(), image.width, image.height, 4, kaiser, levels);
+        }
+    });
+    double boxParallel = bestOf(runs, [&] {
+        std::vector<MipJob> jobs;
+        for (const Image& image : images)
+            jobs.push_back({ image.pixels.data(), image.width, image.height, 4, {} });
+        buildMips(jobs, box, threads);
+    });
+
+    // GL side: the CPU chain uploaded level by level, against level 0 plus
+    // glGenerateMipmap. glFinish makes the driver's work part of the timing.
+    std::vector<unsigned int> textures(images.size());
+    glGenTextures((int)textures.size(), textures.data());
+    double uploadChains = bestOf(runs, [&] {
+        for (size_t i = 0; i < images.size(); i++) {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, images[i].width, images[i].height, 0, GL_RGBA,
+                GL_UNSIGNED_BYTE, images[i].pixels.data());
+            for (size_t level = 0; level < chains[i].size(); level++)
+                glTexImage2D(GL_TEXTURE_2D, (int)level + 1, GL_RGBA8, chains[i][level].width, chains[i][level].height,
+                    0, GL_RGBA, GL_UNSIGNED_BYTE, chains[i][level].pixels.data());
+        }
+        glFinish();
+    });
+    double uploadBase = bestOf(runs, [&] {
+        for (size_t i = 0; i < images.size(); i++) {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, images[i].width, images[i].height, 0, GL_RGBA,
+                GL_UNSIGNED_BYTE, images[i].pixels.data());
+        }
+        glFinish();
+    });
+    double driver = bestOf(runs, [&] {
+        for (size_t i = 0; i < images.size(); i++) {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, images[i].width, images[i].height, 0, GL_RGBA,
+                GL_UNSIGNED_BYTE, images[i].pixels.data());
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+        glFinish();
+    });
+
+    double cpuError = 0.0, driverError = 0.0;
+    for (size_t i = 0; i < images.size(); i++) {
+        unsigned char texel[4];
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glGetTexImage(GL_TEXTURE_2D, (int)chains[i].size(), GL_RGBA, GL_UNSIGNED_BYTE, texel);
+        driverError += averageError(images[i], texel);
+        cpuError += averageError(images[i], chains[i].back().pixels.data());
+    }
+    glDeleteTextures((int)textures.size(), textures.data());
+
+    printf("\n%-38s %10s\n", "", "ms");
+    printf("%-38s %10.2f\n", "CPU box, 1 thread", boxSerial);
+    printf("%-38s %10.2f\n", "CPU Kaiser, 1 thread", kaiserSerial);
+    printf("%-38s %10.2f\n", "CPU box, an image per thread", boxParallel);
+    printf("%-38s %10.2f\n", "GL upload, level 0 only", uploadBase);
+    printf("%-38s %10.2f\n", "GL upload, CPU-built chain", uploadChains);
+    printf("%-38s %10.2f\n", "GL upload + glGenerateMipmap", driver);
+    printf("\nGL thread time per chain: %.2f ms CPU-built, %.2f ms driver-built\n",
+        (uploadChains - uploadBase) / images.size(), (driver - uploadBase) / images.size());
+    printf("1x1 level vs linear-light average (8-bit steps): CPU %.2f, driver %.2f\n",
+        cpuError / images.size(), driverError / images.size());
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef SYNTHETIC_SCULPTURE_H
+#define SYNTHETIC_SCULPTURE_H
+
+#include "MeshImport.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// A synthetic scan for the benchmarks: a dozen overlapping blobs, as uv
+// spheres with bumps, about triangleCount triangles in all, their triangles
+// shuffled the way a reconstruction often leaves them.
+inline void makeSculpture(size_t triangleCount, ImportedMesh& mesh, std::mt19937& random) {
+    const int blobs = 12;
+    int rings = std::max(4, (int)std::sqrt((double)triangleCount / (4.0 * blobs)));
+    std::uniform_real_distribution<float> offset(-0.45f, 0.45f), radius(0.15f, 0.35f), phase(0.0f, 6.28f);
+    for (int b = 0; b < blobs; b++) {
+        glm::vec3 centre(offset(random), offset(random) + 0.5f, offset(random));
+        float size = radius(random), shift = phase(random);
+        uint32_t base = (uint32_t)mesh.positions.size();
+        for (int r = 0; r <= rings; r++) {
+            for (int s = 0; s <= rings * 2; s++) {
+                float theta = 3.14159265f * r / rings, phi = 3.14159265f * s / rings;
+                glm::vec3 direction(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+                float bump = 1.0f + 0.15f * std::sin(7.0f * theta + shift) * std::cos(5.0f * phi) +
+                    0.05f * std::sin(23.0f * theta + 3.0f * phi);
+                mesh.positions.push_back(centre + direction * size * bump);
+                mesh.normals.push_back(direction);
+                mesh.uvs.push_back(glm::vec2((float)s / rings, (float)r / rings));
+            }
+        }
+        for (int r = 0; r < rings; r++) {
+            for (int s = 0; s < rings * 2; s++) {
+                uint32_t a = base + r * (rings * 2 + 1) + s, c = a + rings * 2 + 1;
+                const uint32_t quad[6] = { a, a + 1, c, a + 1, c + 1, c };
+                mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+            }
+        }
+    }
+
+    std::vector<uint32_t> order(mesh.indices.size() / 3);
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = (uint32_t)i;
+    std::shuffle(order.begin(), order.end(), random);
+    std::vector<uint32_t> shuffled;
+    shuffled.reserve(mesh.indices.size());
+    for (uint32_t t : order)
+        shuffled.insert(shuffled.end(), mesh.indices.begin() + t * 3, mesh.indices.begin() + t * 3 + 3);
+    mesh.indices.swap(shuffled);
+}
+
+#endif
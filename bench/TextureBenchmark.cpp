@@ -0,0 +1,316 @@
+// Times every stage of getting an image onto the GPU, the way the loader does
+// it: decoding (stb_image at full size and JpegDecoder at reduced scale), the
+// vertical flip, building the mip chain on the CPU, uploading, and the
+// driver's glGenerateMipmap for comparison. Runs over every image in
+// pictures/ plus synthetic large images, then the CPU stages over the whole
+// set on one thread and on several. Prints a table and writes the results as
+// JSON so runs can be compared between releases.
+//
+// Build from the repository root; on Linux:
+//   g++ -std=c++17 -O2 -mavx2 -I dependencies/include -I . bench/TextureBenchmark.cpp JpegDecoder.cpp MipBuilder.cpp MappedFile.cpp glad.c -lEGL -lpthread -ldl -o texture_benchmark
+// It needs no display or GPU: without one, Mesa's llvmpipe runs the GL stages.
+// On Windows add the file to a console project with JpegDecoder.cpp, MipBuilder.cpp, MappedFile.cpp, glad.c and glfw3.lib.
+//
+// Run from the project folder:
+//   texture_benchmark [--runs N] [--threads N] [--json path] [--synthetic WxH]... [image...]
+// With no images it uses pictures/; --synthetic replaces the default 4096x4096
+// and 8192x4096 images (--synthetic 0x0 for none).
+
+#include "HeadlessContext.h"
+#include "JpegDecoder.h"
+#include "MappedFile.h"
+#include "MipBuilder.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+struct Stage {
+    const char* name;
+    double ms;
+};
+
+struct Image {
+    std::string name;
+    std::vector<unsigned char> file;    // Empty for synthetic images
+    int width, height, channels;
+    std::vector<unsigned char> pixels;
+    std::vector<Stage> stages;
+};
+
+static double bestOf(int runs, const std::function<void()>& run) {
+    double best = 1e30;
+    for (int i = 0; i < runs; i++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        run();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+static double peakRssMB() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0.0;
+    return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0; // Kilobytes on Linux
+#endif
+}
+
+// A gradient under hashed noise, so neither the mip filters nor the driver
+// can take shortcuts over flat areas
+static void fillSynthetic(Image& image) {
+    image.channels = 3;
+    image.pixels.resize((size_t)image.width * image.height * 3);
+    unsigned char* out = image.pixels.data();
+    for (int y = 0; y < image.height; y++) {
+        for (int x = 0; x < image.width; x++, out += 3) {
+            unsigned int hash = (unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u;
+            hash = (hash ^ (hash >> 13)) * 0x5bd1e995u;
+            out[0] = (unsigned char)(x * 255 / image.width);
+            out[1] = (unsigned char)(y * 255 / image.height);
+            out[2] = (unsigned char)(hash >> 24);
+        }
+    }
+}
+
+static std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// Decode, flip and mip chain of every file image, with the images shared out
+// over threadCount threads. Returns the wall time.
+static double cpuPipeline(const std::vector<Image>& images, int threadCount) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++) {
+        threads.emplace_back([&] {
+            for (size_t i = next++; i < images.size(); i = next++) {
+                const Image& image = images[i];
+                if (image.file.empty())
+                    continue;
+                int width, height, channels;
+                unsigned char* pixels = stbi_load_from_memory(image.file.data(), (int)image.file.size(),
+                    &width, &height, &channels, 0);
+                if (!pixels)
+                    continue;
+                stbi__vertical_flip(pixels, width, height, channels);
+                std::vector<MipLevel> levels;
+                buildMips(pixels, width, height, channels, MipOptions(), levels);
+                stbi_image_free(pixels);
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    int runs = 3;
+    int threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+    std::string jsonPath = "texture_benchmark.json";
+    std::vector<std::string> paths;
+    std::vector<std::pair<int, int>> synthetic = { { 4096, 4096 }, { 8192, 4096 } };
+    bool syntheticGiven = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc) {
+            runs = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--threads" && i + 1 < argc) {
+            threadCount = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--json" && i + 1 < argc) {
+            jsonPath = argv[++i];
+        }
+        else if (arg == "--synthetic" && i + 1 < argc) {
+            if (!syntheticGiven)
+                synthetic.clear();
+            syntheticGiven = true;
+            int width = 0, height = 0;
+            if (sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0)
+                synthetic.push_back({ width, height });
+        }
+        else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        std::error_code error;
+        for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator("pictures", error)) {
+            if (entry.is_regular_file())
+                paths.push_back(entry.path().generic_string());
+        }
+        std::sort(paths.begin(), paths.end());
+    }
+
+    if (!createHeadlessContext())
+        return 1;
+
+    std::vector<Image> images;
+    for (const std::string& path : paths) {
+        MappedFile file;
+        if (!file.open(path)) {
+            std::cerr << "Failed to load texture: " << path << std::endl;
+            continue;
+        }
+        Image image = { path, std::vector<unsigned char>(file.data(), file.data() + file.size()), 0, 0, 0, {}, {} };
+        images.push_back(std::move(image));
+    }
+    for (const std::pair<int, int>& size : synthetic) {
+        Image image = { "synthetic " + std::to_string(size.first) + "x" + std::to_string(size.second), {},
+            size.first, size.second, 3, {}, {} };
+        fillSynthetic(image);
+        images.push_back(std::move(image));
+    }
+    if (images.empty())
+        return 1;
+
+    const char* renderer = (const char*)glGetString(GL_RENDERER);
+    printf("%zu images, %d runs each, CPU mips %s, %s\n\n", images.size(), runs, mipBuilderPath(), renderer);
+
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (Image& image : images) {
+        if (!image.file.empty()) {
+            // stb_image at full size, as the loader does for images without a
+            // cooked copy, and the reduced JPEG decodes reloads use
+            unsigned char* pixels = nullptr;
+            image.stages.push_back({ "decode", bestOf(runs, [&] {
+                stbi_image_free(pixels);
+                pixels = stbi_load_from_memory(image.file.data(), (int)image.file.size(),
+                    &image.width, &image.height, &image.channels, 0);
+            }) });
+            if (!pixels) {
+                std::cerr << "Failed to load texture: " << image.name << std::endl;
+                continue;
+            }
+            image.pixels.assign(pixels, pixels + (size_t)image.width * image.height * image.channels);
+            stbi_image_free(pixels);
+
+            JpegInfo info;
+            if (readJpegInfo(image.file.data(), image.file.size(), info)) {
+                static const char* names[3] = { "decode 1/2", "decode 1/4", "decode 1/8" };
+                for (int scale = 1; scale <= 3; scale++) {
+                    JpegImage scaled;
+                    image.stages.push_back({ names[scale - 1], bestOf(runs, [&] {
+                        decodeJpeg(image.file.data(), image.file.size(), scale, true, scaled);
+                    }) });
+                }
+            }
+        }
+
+        // stb_image's own flip, which stbi_set_flip_vertically_on_load runs
+        image.stages.push_back({ "flip", bestOf(runs, [&] {
+            stbi__vertical_flip(image.pixels.data(), image.width, image.height, image.channels);
+        }) });
+
+        std::vector<MipLevel> levels;
+        image.stages.push_back({ "mips (CPU)", bestOf(runs, [&] {
+            levels.clear();
+            buildMips(image.pixels.data(), image.width, image.height, image.channels, MipOptions(), levels);
+        }) });
+
+        // GL stages; glFinish makes the driver's work part of the timing
+        GLenum format = image.channels == 4 ? GL_RGBA : image.channels == 3 ? GL_RGB : GL_RED;
+        image.stages.push_back({ "upload", bestOf(runs, [&] {
+            glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE,
+                image.pixels.data());
+            glFinish();
+        }) });
+        image.stages.push_back({ "upload mips", bestOf(runs, [&] {
+            for (size_t i = 0; i < levels.size(); i++)
+                glTexImage2D(GL_TEXTURE_2D, (int)i + 1, format, levels[i].width, levels[i].height, 0, format,
+                    GL_UNSIGNED_BYTE, levels[i].pixels.data());
+            glFinish();
+        }) });
+        image.stages.push_back({ "glGenerateMipmap", bestOf(runs, [&] {
+            glGenerateMipmap(GL_TEXTURE_2D);
+            glFinish();
+        }) });
+
+        double megapixels = (double)image.width * image.height / 1e6;
+        printf("%s (%dx%d, %d channels)\n", image.name.c_str(), image.width, image.height, image.channels);
+        for (const Stage& stage : image.stages)
+            printf("    %-20s %9.2f ms %9.1f MP/s\n", stage.name, stage.ms, megapixels / (stage.ms / 1000.0));
+        image.pixels.clear();
+        image.pixels.shrink_to_fit();
+    }
+    glDeleteTextures(1, &texture);
+
+    // The loader's worker side over the whole set: one thread, then all of them
+    double fileMegapixels = 0.0;
+    for (const Image& image : images) {
+        if (!image.file.empty())
+            fileMegapixels += (double)image.width * image.height / 1e6;
+    }
+    double serial = bestOf(runs, [&] { cpuPipeline(images, 1); });
+    double parallel = bestOf(runs, [&] { cpuPipeline(images, threadCount); });
+    double peak = peakRssMB();
+    printf("\nDecode + flip + mips, all files: %.1f ms on 1 thread (%.1f MP/s), %.1f ms on %d (%.1f MP/s), %.2fx\n",
+        serial, fileMegapixels / (serial / 1000.0), parallel, threadCount, fileMegapixels / (parallel / 1000.0),
+        serial / parallel);
+    printf("Peak RSS %.1f MB\n", peak);
+
+    FILE* json = fopen(jsonPath.c_str(), "w");
+    if (!json) {
+        std::cerr << "Failed to write " << jsonPath << std::endl;
+        return 1;
+    }
+    fprintf(json, "{\n  \"renderer\": %s,\n  \"mipPath\": \"%s\",\n  \"runs\": %d,\n  \"threads\": %d,\n",
+        jsonString(renderer ? renderer : "").c_str(), mipBuilderPath(), runs, threadCount);
+    fprintf(json, "  \"peakRssMB\": %.1f,\n  \"images\": [\n", peak);
+    for (size_t i = 0; i < images.size(); i++) {
+        const Image& image = images[i];
+        double megapixels = (double)image.width * image.height / 1e6;
+        fprintf(json, "    { \"name\": %s, \"width\": %d, \"height\": %d, \"channels\": %d, \"stages\": {",
+            jsonString(image.name).c_str(), image.width, image.height, image.channels);
+        for (size_t s = 0; s < image.stages.size(); s++) {
+            const Stage& stage = image.stages[s];
+            fprintf(json, "%s\n        %s: { \"ms\": %.3f, \"mpps\": %.2f }", s ? "," : "",
+                jsonString(stage.name).c_str(), stage.ms, megapixels / (stage.ms / 1000.0));
+        }
+        fprintf(json, "\n      } }%s\n", i + 1 < images.size() ? "," : "");
+    }
+    fprintf(json, "  ],\n  \"cpuPipeline\": {\n");
+    fprintf(json, "    \"megapixels\": %.3f,\n", fileMegapixels);
+    fprintf(json, "    \"singleThreadMs\": %.3f,\n    \"multiThreadMs\": %.3f,\n", serial, parallel);
+    fprintf(json, "    \"singleThreadMpps\": %.2f,\n    \"multiThreadMpps\": %.2f\n  }\n}\n",
+        fileMegapixels / (serial / 1000.0), fileMegapixels / (parallel / 1000.0));
+    fclose(json);
+    printf("Results written to %s\n", jsonPath.c_str());
+    return 0;
+}
@@ -7,26 +7,69 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
 #include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <cstddef>
+#include <unordered_map>
 #include "Camera.h"
+#include "TextureLoader.h"
+#include "TextureCache.h"
+#include "TextureArrayPacker.h"
+#include "VirtualTexture.h"
+#include "TextureResidency.h"
+#include "Scene.h"
+#include "SceneGeometry.h"
+#include "SceneStreamer.h"
+#include "MeshArena.h"
+#include "CookedMesh.h"
+#include "RenderQueue.h"
+#include "JobSystem.h"
 
 // Vertex Shader source.
 const char* vertexShaderSource = R"(
 #version 330 core
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec3 aPos;         // Fractions of the bounds
 layout (location = 1) in vec2 aTexCoord;
-
+layout (location = 2) in float aLayer;
+layout (location = 3) in vec2 aNormal;      // Octahedral
+layout (location = 4) in mat4 aModel;       // Per instance (see MeshArena.h)
+layout (location = 8) in vec3 aBoundsMin;
+layout (location = 9) in vec3 aBoundsSize;
+layout (location = 10) in float aInstanceLayer; // Negative to keep aLayer
+layout (location = 11) in float aLevel;     // Of detail
+
+uniform bool instanced;     // Take the model matrix, bounds and layer from the instance
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform vec3 boundsMin;
+uniform vec3 boundsSize;
 
 out vec2 TexCoord;
+out vec3 FragPos;
+out vec3 Normal;
+flat out float Layer;
+flat out float Level;
+
+vec3 decodeNormal(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    mat4 toWorld = instanced ? aModel : model;
+    vec3 position = instanced ? aBoundsMin + aPos * aBoundsSize : boundsMin + aPos * boundsSize;
+    vec4 worldPos = toWorld * vec4(position, 1.0);
+    gl_Position = projection * view * worldPos;
+    FragPos = worldPos.xyz;
+    Normal = mat3(toWorld) * decodeNormal(aNormal);
     TexCoord = aTexCoord;
+    Layer = instanced && aInstanceLayer >= 0.0 ? aInstanceLayer : aLayer;
+    Level = instanced ? aLevel : 0.0;
 }
 )";
 
@@ -36,13 +79,39 @@ const char* fragmentShaderSource = R"(
 out vec4 FragColor;
 
 in vec2 TexCoord;
-
-uniform sampler2D texture1;
+in vec3 FragPos;
+in vec3 Normal;
+flat in float Layer;
+flat in float Level;
+
+uniform sampler2DArray texture1;
+uniform bool showLevels;        // Tint by level of detail: green full, red reduced
+uniform sampler2D painting;     // Where Layer is -2: the painting being drawn
+
+// Virtual texture, used where Layer is negative (see VirtualTexture.h)
+uniform sampler2D vtAtlas;
+uniform sampler2D vtIndirection;
+uniform vec2 vtUvScale;
+uniform float vtPages;
+uniform float vtAtlasPages;
+uniform float vtPageContent;
+uniform float vtPageBorder;
+
+vec4 sampleVirtual(vec2 uv) {
+    vec2 v = clamp(uv, 0.0, 1.0) * vtUvScale;
+    ivec2 cell = ivec2(min(floor(v * vtPages), vec2(vtPages - 1.0)));
+    vec3 entry = floor(texelFetch(vtIndirection, cell, 0).rgb * 255.0 + 0.5);
+    float levelPages = vtPages / exp2(entry.b);
+    vec2 inPage = fract(v * levelPages);
+    float pageSize = vtPageContent + 2.0 * vtPageBorder;
+    vec2 texel = entry.xy * pageSize + vtPageBorder + inPage * vtPageContent;
+    return texture(vtAtlas, texel / (vtAtlasPages * pageSize));
+}
 
 // Lighting uniforms
 uniform vec3 lightPositions[4]; // Up to 4 lights
 uniform vec3 lightColors[4];    // Corresponding colors
-uniform vec3 viewPos;
+uniform vec3 viewPos;            // The camera, so surfaces are lit on whichever side it sees
 
 void main() {
     vec3 result = vec3(0.0); // Accumulated light result
@@ -56,12 +125,15 @@ void main() {
         ambient += ambientStrength * lightColors[i];
 
         // Diffuse lighting
-        vec3 norm = vec3(0.0, 1.0, 0.0); // Assuming flat surfaces facing up
-        vec3 lightDir = normalize(lightPositions[i] - vec3(0.0, 0.5, 0.0)); // Replace with fragment position if needed
+        // A wall between two rooms is one quad, facing one of them
+        vec3 norm = normalize(Normal);
+        if (dot(norm, viewPos - FragPos) < 0.0)
+            norm = -norm;
+        vec3 lightDir = normalize(lightPositions[i] - FragPos);
         float diff = max(dot(norm, lightDir), 0.0);
 
         // Optional: Add attenuation for more realistic lighting
-        float distance = length(lightPositions[i] - vec3(0.0, 0.5, 0.0));
+        float distance = length(lightPositions[i] - FragPos);
         float attenuation = 1.0 / (1.0 + 0.09 * distance + 0.032 * (distance * distance));
 
         vec3 diffuse = diff * lightColors[i] * attenuation * 0.5; // Dim diffuse lighting by 50%
@@ -71,331 +143,19 @@ void main() {
     }
 
     // Combine lighting result with texture
-    FragColor = vec4(result, 1.0) * texture(texture1, TexCoord);
+    vec4 albedo;
+    if (Layer < -1.5)
+        albedo = texture(painting, TexCoord);
+    else if (Layer < 0.0)
+        albedo = sampleVirtual(TexCoord);
+    else
+        albedo = texture(texture1, vec3(TexCoord, Layer));
+    if (showLevels)
+        albedo.rgb *= Level > 0.5 ? vec3(1.0, 0.45, 0.45) : vec3(0.55, 1.0, 0.55);
+    FragColor = vec4(result, 1.0) * albedo;
 }
 )";
 
-// Vertices with texture coordinates
-float vertices[] = {
-    // Floor (5x larger)
-    -6.25f,  0.0f, -6.25f,  0.0f, 0.0f,
-     6.25f,  0.0f, -6.25f,  5.0f, 0.0f,
-     6.25f,  0.0f,  6.25f,  5.0f, 5.0f,
-    -6.25f,  0.0f, -6.25f,  0.0f, 0.0f,
-     6.25f,  0.0f,  6.25f,  5.0f, 5.0f,
-    -6.25f,  0.0f,  6.25f,  0.0f, 5.0f,
-
-    // ceiling (5x larger)
-    -6.25f,  1.0f, -6.25f,  0.0f, 0.0f,
-     6.25f,  1.0f, -6.25f,  5.0f, 0.0f,
-     6.25f,  1.0f,  6.25f,  5.0f, 5.0f,
-    -6.25f,  1.0f, -6.25f,  0.0f, 0.0f,
-     6.25f,  1.0f,  6.25f,  5.0f, 5.0f,
-    -6.25f,  1.0f,  6.25f,  0.0f, 5.0f,
-
-
-    // Walls (5 segments per side)
-    // Back wall (-Z direction)
-    -6.25f, 0.0f, -6.25f,  0.0f, 0.0f,
-    -6.25f, 1.0f, -6.25f,  0.0f, 1.0f,
-    -3.75f, 1.0f, -6.25f,  1.0f, 1.0f,
-    -6.25f, 0.0f, -6.25f,  0.0f, 0.0f,
-    -3.75f, 1.0f, -6.25f,  1.0f, 1.0f,
-    -3.75f, 0.0f, -6.25f,  1.0f, 0.0f,
-
-    -3.75f, 0.0f, -6.25f,  0.0f, 0.0f,
-    -3.75f, 1.0f, -6.25f,  0.0f, 1.0f,
-    -1.25f, 1.0f, -6.25f,  1.0f, 1.0f,
-    -3.75f, 0.0f, -6.25f,  0.0f, 0.0f,
-    -1.25f, 1.0f, -6.25f,  1.0f, 1.0f,
-    -1.25f, 0.0f, -6.25f,  1.0f, 0.0f,
-
-    -1.25f, 0.0f, -6.25f,  0.0f, 0.0f,
-    -1.25f, 1.0f, -6.25f,  0.0f, 1.0f,
-     1.25f, 1.0f, -6.25f,  1.0f, 1.0f,
-    -1.25f, 0.0f, -6.25f,  0.0f, 0.0f,
-     1.25f, 1.0f, -6.25f,  1.0f, 1.0f,
-     1.25f, 0.0f, -6.25f,  1.0f, 0.0f,
-
-     1.25f, 0.0f, -6.25f,  0.0f, 0.0f,
-     1.25f, 1.0f, -6.25f,  0.0f, 1.0f,
-     3.75f, 1.0f, -6.25f,  1.0f, 1.0f,
-     1.25f, 0.0f, -6.25f,  0.0f, 0.0f,
-     3.75f, 1.0f, -6.25f,  1.0f, 1.0f,
-     3.75f, 0.0f, -6.25f,  1.0f, 0.0f,
-
-     3.75f, 0.0f, -6.25f,  0.0f, 0.0f,
-     3.75f, 1.0f, -6.25f,  0.0f, 1.0f,
-     6.25f, 1.0f, -6.25f,  1.0f, 1.0f,
-     3.75f, 0.0f, -6.25f,  0.0f, 0.0f,
-     6.25f, 1.0f, -6.25f,  1.0f, 1.0f,
-     6.25f, 0.0f, -6.25f,  1.0f, 0.0f,
-
-     // Front wall (+Z direction)
--6.25f, 0.0f,  6.25f,  0.0f, 0.0f,
--6.25f, 1.0f,  6.25f,  0.0f, 1.0f,
--3.75f, 1.0f,  6.25f,  1.0f, 1.0f,
--6.25f, 0.0f,  6.25f,  0.0f, 0.0f,
--3.75f, 1.0f,  6.25f,  1.0f, 1.0f,
--3.75f, 0.0f,  6.25f,  1.0f, 0.0f,
-
--3.75f, 0.0f,  6.25f,  0.0f, 0.0f,
--3.75f, 1.0f,  6.25f,  0.0f, 1.0f,
--1.25f, 1.0f,  6.25f,  1.0f, 1.0f,
--3.75f, 0.0f,  6.25f,  0.0f, 0.0f,
--1.25f, 1.0f,  6.25f,  1.0f, 1.0f,
--1.25f, 0.0f,  6.25f,  1.0f, 0.0f,
-
--1.25f, 0.0f,  6.25f,  0.0f, 0.0f,
--1.25f, 1.0f,  6.25f,  0.0f, 1.0f,
- 1.25f, 1.0f,  6.25f,  1.0f, 1.0f,
--1.25f, 0.0f,  6.25f,  0.0f, 0.0f,
- 1.25f, 1.0f,  6.25f,  1.0f, 1.0f,
- 1.25f, 0.0f,  6.25f,  1.0f, 0.0f,
-
- 1.25f, 0.0f,  6.25f,  0.0f, 0.0f,
- 1.25f, 1.0f,  6.25f,  0.0f, 1.0f,
- 3.75f, 1.0f,  6.25f,  1.0f, 1.0f,
- 1.25f, 0.0f,  6.25f,  0.0f, 0.0f,
- 3.75f, 1.0f,  6.25f,  1.0f, 1.0f,
- 3.75f, 0.0f,  6.25f,  1.0f, 0.0f,
-
- 3.75f, 0.0f,  6.25f,  0.0f, 0.0f,
- 3.75f, 1.0f,  6.25f,  0.0f, 1.0f,
- 6.25f, 1.0f,  6.25f,  1.0f, 1.0f,
- 3.75f, 0.0f,  6.25f,  0.0f, 0.0f,
- 6.25f, 1.0f,  6.25f,  1.0f, 1.0f,
- 6.25f, 0.0f,  6.25f,  1.0f, 0.0f,
- // Front wall (+Z direction)
--6.25f, 0.0f,  6.25f,  0.0f, 0.0f,
--6.25f, 1.0f,  6.25f,  0.0f, 1.0f,
--3.75f, 1.0f,  6.25f,  1.0f, 1.0f,
--6.25f, 0.0f,  6.25f,  0.0f, 0.0f,
--3.75f, 1.0f,  6.25f,  1.0f, 1.0f,
--3.75f, 0.0f,  6.25f,  1.0f, 0.0f,
-
--3.75f, 0.0f,  6.25f,  0.0f, 0.0f,
--3.75f, 1.0f,  6.25f,  0.0f, 1.0f,
--1.25f, 1.0f,  6.25f,  1.0f, 1.0f,
--3.75f, 0.0f,  6.25f,  0.0f, 0.0f,
--1.25f, 1.0f,  6.25f,  1.0f, 1.0f,
--1.25f, 0.0f,  6.25f,  1.0f, 0.0f,
-
--1.25f, 0.0f,  6.25f,  0.0f, 0.0f,
--1.25f, 1.0f,  6.25f,  0.0f, 1.0f,
-1.25f, 1.0f,  6.25f,  1.0f, 1.0f,
--1.25f, 0.0f,  6.25f,  0.0f, 0.0f,
-1.25f, 1.0f,  6.25f,  1.0f, 1.0f,
-1.25f, 0.0f,  6.25f,  1.0f, 0.0f,
-
-1.25f, 0.0f,  6.25f,  0.0f, 0.0f,
-1.25f, 1.0f,  6.25f,  0.0f, 1.0f,
-3.75f, 1.0f,  6.25f,  1.0f, 1.0f,
-1.25f, 0.0f,  6.25f,  0.0f, 0.0f,
-3.75f, 1.0f,  6.25f,  1.0f, 1.0f,
-3.75f, 0.0f,  6.25f,  1.0f, 0.0f,
-
-3.75f, 0.0f,  6.25f,  0.0f, 0.0f,
-3.75f, 1.0f,  6.25f,  0.0f, 1.0f,
-6.25f, 1.0f,  6.25f,  1.0f, 1.0f,
-3.75f, 0.0f,  6.25f,  0.0f, 0.0f,
-6.25f, 1.0f,  6.25f,  1.0f, 1.0f,
-6.25f, 0.0f,  6.25f,  1.0f, 0.0f,
-
-// Left wall (-X direction)
--6.25f, 0.0f, -6.25f,  0.0f, 0.0f,
--6.25f, 1.0f, -6.25f,  0.0f, 1.0f,
--6.25f, 1.0f, -3.75f,  1.0f, 1.0f,
--6.25f, 0.0f, -6.25f,  0.0f, 0.0f,
--6.25f, 1.0f, -3.75f,  1.0f, 1.0f,
--6.25f, 0.0f, -3.75f,  1.0f, 0.0f,
-
--6.25f, 0.0f, -3.75f,  0.0f, 0.0f,
--6.25f, 1.0f, -3.75f,  0.0f, 1.0f,
--6.25f, 1.0f, -1.25f,  1.0f, 1.0f,
--6.25f, 0.0f, -3.75f,  0.0f, 0.0f,
--6.25f, 1.0f, -1.25f,  1.0f, 1.0f,
--6.25f, 0.0f, -1.25f,  1.0f, 0.0f,
-
--6.25f, 0.0f, -1.25f,  0.0f, 0.0f,
--6.25f, 1.0f, -1.25f,  0.0f, 1.0f,
--6.25f, 1.0f,  1.25f,  1.0f, 1.0f,
--6.25f, 0.0f, -1.25f,  0.0f, 0.0f,
--6.25f, 1.0f,  1.25f,  1.0f, 1.0f,
--6.25f, 0.0f,  1.25f,  1.0f, 0.0f,
-
--6.25f, 0.0f,  1.25f,  0.0f, 0.0f,
--6.25f, 1.0f,  1.25f,  0.0f, 1.0f,
--6.25f, 1.0f,  3.75f,  1.0f, 1.0f,
--6.25f, 0.0f,  1.25f,  0.0f, 0.0f,
--6.25f, 1.0f,  3.75f,  1.0f, 1.0f,
--6.25f, 0.0f,  3.75f,  1.0f, 0.0f,
-
--6.25f, 0.0f,  3.75f,  0.0f, 0.0f,
--6.25f, 1.0f,  3.75f,  0.0f, 1.0f,
--6.25f, 1.0f,  6.25f,  1.0f, 1.0f,
--6.25f, 0.0f,  3.75f,  0.0f, 0.0f,
--6.25f, 1.0f,  6.25f,  1.0f, 1.0f,
--6.25f, 0.0f,  6.25f,  1.0f, 0.0f,
-// Left wall (-X direction)
- -6.25f, 0.0f, -6.25f, 0.0f, 0.0f,
- -6.25f, 1.0f, -6.25f, 0.0f, 1.0f,
- -6.25f, 1.0f, -3.75f, 1.0f, 1.0f,
- -6.25f, 0.0f, -6.25f, 0.0f, 0.0f,
- -6.25f, 1.0f, -3.75f, 1.0f, 1.0f,
- -6.25f, 0.0f, -3.75f, 1.0f, 0.0f,
-
- -6.25f, 0.0f, -3.75f, 0.0f, 0.0f,
- -6.25f, 1.0f, -3.75f, 0.0f, 1.0f,
- -6.25f, 1.0f, -1.25f, 1.0f, 1.0f,
- -6.25f, 0.0f, -3.75f, 0.0f, 0.0f,
- -6.25f, 1.0f, -1.25f, 1.0f, 1.0f,
- -6.25f, 0.0f, -1.25f, 1.0f, 0.0f,
-
- -6.25f, 0.0f, -1.25f, 0.0f, 0.0f,
- -6.25f, 1.0f, -1.25f, 0.0f, 1.0f,
- -6.25f, 1.0f, 1.25f, 1.0f, 1.0f,
- -6.25f, 0.0f, -1.25f, 0.0f, 0.0f,
- -6.25f, 1.0f, 1.25f, 1.0f, 1.0f,
- -6.25f, 0.0f, 1.25f, 1.0f, 0.0f,
-
- -6.25f, 0.0f, 1.25f, 0.0f, 0.0f,
- -6.25f, 1.0f, 1.25f, 0.0f, 1.0f,
- -6.25f, 1.0f, 3.75f, 1.0f, 1.0f,
- -6.25f, 0.0f, 1.25f, 0.0f, 0.0f,
- -6.25f, 1.0f, 3.75f, 1.0f, 1.0f,
- -6.25f, 0.0f, 3.75f, 1.0f, 0.0f,
-
- -6.25f, 0.0f, 3.75f, 0.0f, 0.0f,
- -6.25f, 1.0f, 3.75f, 0.0f, 1.0f,
- -6.25f, 1.0f, 6.25f, 1.0f, 1.0f,
- -6.25f, 0.0f, 3.75f, 0.0f, 0.0f,
- -6.25f, 1.0f, 6.25f, 1.0f, 1.0f,
- -6.25f, 0.0f, 6.25f, 1.0f, 0.0f,
-
- // Right wall (+X direction)
-6.25f, 0.0f, -6.25f,  0.0f, 0.0f,
-6.25f, 1.0f, -6.25f,  0.0f, 1.0f,
-6.25f, 1.0f, -3.75f,  1.0f, 1.0f,
-6.25f, 0.0f, -6.25f,  0.0f, 0.0f,
-6.25f, 1.0f, -3.75f,  1.0f, 1.0f,
-6.25f, 0.0f, -3.75f,  1.0f, 0.0f,
-
-6.25f, 0.0f, -3.75f,  0.0f, 0.0f,
-6.25f, 1.0f, -3.75f,  0.0f, 1.0f,
-6.25f, 1.0f, -1.25f,  1.0f, 1.0f,
-6.25f, 0.0f, -3.75f,  0.0f, 0.0f,
-6.25f, 1.0f, -1.25f,  1.0f, 1.0f,
-6.25f, 0.0f, -1.25f,  1.0f, 0.0f,
-
-6.25f, 0.0f, -1.25f,  0.0f, 0.0f,
-6.25f, 1.0f, -1.25f,  0.0f, 1.0f,
-6.25f, 1.0f,  1.25f,  1.0f, 1.0f,
-6.25f, 0.0f, -1.25f,  0.0f, 0.0f,
-6.25f, 1.0f,  1.25f,  1.0f, 1.0f,
-6.25f, 0.0f,  1.25f,  1.0f, 0.0f,
-
-6.25f, 0.0f,  1.25f,  0.0f, 0.0f,
-6.25f, 1.0f,  1.25f,  0.0f, 1.0f,
-6.25f, 1.0f,  3.75f,  1.0f, 1.0f,
-6.25f, 0.0f,  1.25f,  0.0f, 0.0f,
-6.25f, 1.0f,  3.75f,  1.0f, 1.0f,
-6.25f, 0.0f,  3.75f,  1.0f, 0.0f,
-
-6.25f, 0.0f,  3.75f,  0.0f, 0.0f,
-6.25f, 1.0f,  3.75f,  0.0f, 1.0f,
-6.25f, 1.0f,  6.25f,  1.0f, 1.0f,
-6.25f, 0.0f,  3.75f,  0.0f, 0.0f,
-6.25f, 1.0f,  6.25f,  1.0f, 1.0f,
-6.25f, 0.0f,  6.25f,  1.0f, 0.0f,
-
-};
-
-float standVertices[] = {
-    // Positions              // Texture Coords
-    // Bottom face
-    -0.5f, 0.0f, -0.5f,       0.0f, 0.0f,
-     0.5f, 0.0f, -0.5f,       1.0f, 0.0f,
-     0.5f, 0.0f,  0.5f,       1.0f, 1.0f,
-    -0.5f, 0.0f, -0.5f,       0.0f, 0.0f,
-     0.5f, 0.0f,  0.5f,       1.0f, 1.0f,
-    -0.5f, 0.0f,  0.5f,       0.0f, 1.0f,
-
-    // Top face
-    -0.5f, 0.3f, -0.5f,       0.0f, 0.0f,
-     0.5f, 0.3f, -0.5f,       1.0f, 0.0f,
-     0.5f, 0.3f,  0.5f,       1.0f, 1.0f,
-    -0.5f, 0.3f, -0.5f,       0.0f, 0.0f,
-     0.5f, 0.3f,  0.5f,       1.0f, 1.0f,
-    -0.5f, 0.3f,  0.5f,       0.0f, 1.0f,
-
-    // Front face
-    -0.5f, 0.0f,  0.5f,       0.0f, 0.0f,
-     0.5f, 0.0f,  0.5f,       1.0f, 0.0f,
-     0.5f, 0.3f,  0.5f,       1.0f, 1.0f,
-    -0.5f, 0.0f,  0.5f,       0.0f, 0.0f,
-     0.5f, 0.3f,  0.5f,       1.0f, 1.0f,
-    -0.5f, 0.3f,  0.5f,       0.0f, 1.0f,
-
-    // Back face
-    -0.5f, 0.0f, -0.5f,       0.0f, 0.0f,
-     0.5f, 0.0f, -0.5f,       1.0f, 0.0f,
-     0.5f, 0.3f, -0.5f,       1.0f, 1.0f,
-    -0.5f, 0.0f, -0.5f,       0.0f, 0.0f,
-     0.5f, 0.3f, -0.5f,       1.0f, 1.0f,
-    -0.5f, 0.3f, -0.5f,       0.0f, 1.0f,
-
-    // Left face
-    -0.5f, 0.0f, -0.5f,       0.0f, 0.0f,
-    -0.5f, 0.0f,  0.5f,       1.0f, 0.0f,
-    -0.5f, 0.3f,  0.5f,       1.0f, 1.0f,
-    -0.5f, 0.0f, -0.5f,       0.0f, 0.0f,
-    -0.5f, 0.3f,  0.5f,       1.0f, 1.0f,
-    -0.5f, 0.3f, -0.5f,       0.0f, 1.0f,
-
-    // Right face
-     0.5f, 0.0f, -0.5f,       0.0f, 0.0f,
-     0.5f, 0.0f,  0.5f,       1.0f, 0.0f,
-     0.5f, 0.3f,  0.5f,       1.0f, 1.0f,
-     0.5f, 0.0f, -0.5f,       0.0f, 0.0f,
-     0.5f, 0.3f,  0.5f,       1.0f, 1.0f,
-     0.5f, 0.3f, -0.5f,       0.0f, 1.0f
-};
-
-float rectangleVertices[] = {
-    // Positions            // Texture Coords
-    -0.5f, -0.25f, 0.0f,     0.0f, 0.0f,  // Bottom-left
-     0.5f, -0.25f, 0.0f,     1.0f, 0.0f,  // Bottom-right
-     0.5f, 0.625f, 0.0f,     1.0f, 1.0f,  // Top-right
-    -0.5f, 0.625f, 0.0f,     0.0f, 1.0f   // Top-left
-};
-
-// Utility to load textures
-unsigned int loadTexture(const char* path) {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-    if (data) {
-        GLenum format = (nrChannels == 4) ? GL_RGBA : GL_RGB;
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    }
-    else {
-        std::cerr << "Failed to load texture: " << path << std::endl;
-    }
-    stbi_image_free(data);
-    return textureID;
-}
-
 // Utility to process input
 void processInput(GLFWwindow* window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
@@ -410,8 +170,13 @@ bool keys[1024];
 float lastX = 400, lastY = 300;
 bool firstMouse = true;
 bool rightMouseButtonPressed = false;
+bool leftMouseClicked = false;
+bool showLevels = false;
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode) {
+    // L tints what is drawn by its level of detail
+    if (key == GLFW_KEY_L && action == GLFW_PRESS)
+        showLevels = !showLevels;
     if (action == GLFW_PRESS)
         keys[key] = true;
     else if (action == GLFW_RELEASE)
@@ -448,10 +213,87 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
             rightMouseButtonPressed = false;
         }
     }
+    else if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+        leftMouseClicked = true;
+    }
 }
 
 
-int main() {
+int main(int argc, char** argv) {
+    // Offline step: bake every texture into cache/ so later launches can map them
+    //   --cook [raw|auto|bc1|bc3|bc7] [--quality fast|normal|best] [--mips box|kaiser]
+    if (argc > 1 && std::string(argv[1]) == "--cook") {
+        CookOptions options;
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "raw") options.format = CookFormat::Raw;
+            else if (arg == "auto") options.format = CookFormat::Auto;
+            else if (arg == "bc1") options.format = CookFormat::BC1;
+            else if (arg == "bc3") options.format = CookFormat::BC3;
+            else if (arg == "bc7") options.format = CookFormat::BC7;
+            else if (arg == "--quality" && i + 1 < argc) {
+                std::string quality = argv[++i];
+                if (quality == "fast") options.quality = CompressionQuality::Fast;
+                else if (quality == "best") options.quality = CompressionQuality::Best;
+                else options.quality = CompressionQuality::Normal;
+            }
+            else if (arg == "--mips" && i + 1 < argc) {
+                std::string filter = argv[++i];
+                options.mips.filter = (filter == "kaiser") ? MipFilter::Kaiser : MipFilter::Box;
+            }
+        }
+        return cookTextures({ "pictures", "." }, options) == 0 ? 0 : 1;
+    }
+
+    // Offline step: split a large painting into pages for streaming
+    //   --tile <image>
+    if (argc > 2 && std::string(argv[1]) == "--tile")
+        return tileVirtualTexture(argv[2], virtualTexturePath(argv[2])) ? 0 : 1;
+
+    // Offline step: import and cook sculpture meshes into cache/ (done on first
+    // use otherwise)
+    //   --cook-mesh <obj or gltf file>...
+    if (argc > 2 && std::string(argv[1]) == "--cook-mesh") {
+        int failed = 0;
+        for (int i = 2; i < argc; i++) {
+            std::vector<unsigned char> cooked;
+            MeshCookStats stats;
+            if (!cookMesh(argv[i], cooked, &stats) || !saveCookedMesh(meshCachePath(argv[i]), cooked)) {
+                failed++;
+                continue;
+            }
+            std::cout << argv[i] << ": " << stats.triangles << " triangles, " << stats.importedVertices << " -> " <<
+                stats.vertices << " vertices, " << stats.degenerate << " degenerate triangles dropped, " <<
+                stats.missRatioBefore << " -> " << stats.missRatioAfter << " vertices shaded per triangle, " << stats.clusters <<
+                " clusters, " << stats.simplifiedTriangles << " triangles simplified" << std::endl;
+        }
+        return failed == 0 ? 0 : 1;
+    }
+
+    // Texture memory the paintings may use: --texture-budget <MB>
+    // The gallery to show: --scene <file> (text, or a compiled .gscene)
+    // Rooms are loaded within --load-radius <m> of the camera and unloaded
+    // --load-hysteresis <m> further out
+    // Stands, paintings and displays under --detail-pixels <px> tall on screen
+    // are left out
+    size_t textureBudget = 256;
+    std::string scenePath = "gallery.scene";
+    float loadRadius = 30.0f;
+    float loadHysteresis = 5.0f;
+    float detailPixels = 4.0f;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--texture-budget")
+            textureBudget = (size_t)std::max(1, atoi(argv[i + 1]));
+        else if (std::string(argv[i]) == "--scene")
+            scenePath = argv[i + 1];
+        else if (std::string(argv[i]) == "--load-radius")
+            loadRadius = std::max(1.0f, (float)atof(argv[i + 1]));
+        else if (std::string(argv[i]) == "--load-hysteresis")
+            loadHysteresis = std::max(0.0f, (float)atof(argv[i + 1]));
+        else if (std::string(argv[i]) == "--detail-pixels")
+            detailPixels = std::max(0.0f, (float)atof(argv[i + 1]));
+    }
+
     // Initialize GLFW
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW" << std::endl;
@@ -501,80 +343,87 @@ int main() {
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
 
-    // Create VAO, VBO
-    unsigned int VAO, VBO;
-    // Additional VAOs and VBOs for the stand and rectangle
-    unsigned int standVAO, standVBO, rectVAO, rectVBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-
-    glBindVertexArray(VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    // Setup for Stand
-    glGenVertexArrays(1, &standVAO);
-    glGenBuffers(1, &standVBO);
-    glBindVertexArray(standVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, standVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(standVertices), standVertices, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    // Setup for Rectangle
-    glGenVertexArrays(1, &rectVAO);
-    glGenBuffers(1, &rectVBO);
-    glBindVertexArray(rectVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, rectVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(rectangleVertices), rectangleVertices, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    glm::vec3 lightPositions[] = {
-        glm::vec3(2.0f, 0.9f, 2.0f),
-        glm::vec3(-2.0f, 0.9f, 2.0f),
-        glm::vec3(2.0f, 0.9f, -2.0f),
-        glm::vec3(-2.0f, 0.9f, -2.0f)
-    };
-
-    glm::vec3 lightColors[] = {
-        glm::vec3(1.0f, 0.0f, 0.0f), // Red
-        glm::vec3(0.0f, 1.0f, 0.0f), // Green
-        glm::vec3(0.0f, 0.0f, 0.5f), // Blue
-        glm::vec3(1.5f, 1.5f, 1.5f)  // White
+    // Everything drawn comes from the scene file
+    Scene* scene = new Scene();
+    if (!scene->load(scenePath)) {
+        glfwTerminate();
+        return -1;
+    }
+    const SceneFileHeader& layout = scene->header();
+
+    // Load textures; every material is a layer of one texture array, decoded
+    // on the loader's worker threads. The few materials are shared by every
+    // room, so they are all loaded up front. The shader samples that one
+    // array only, so a scene with more materials than it holds is refused.
+    TextureLoader* textureLoader = new TextureLoader();
+    TextureArrayPacker* materials = new TextureArrayPacker(*textureLoader, 1024, 1024, 256, 1);
+    std::unordered_map<std::string, int> materialLayers;
+    bool materialsFit = true;
+    auto addMaterial = [&](uint32_t path) {
+        if (path == Scene::NO_STRING || materialLayers.count(scene->string(path)))
+            return;
+        TextureLayer layer = materials->add(scene->string(path));
+        materialsFit = materialsFit && layer.array == 0;
+        materialLayers[scene->string(path)] = layer.layer;
     };
+    for (uint32_t i = 0; i < layout.roomCount; i++) {
+        addMaterial(scene->rooms()[i].floorMaterial);
+        addMaterial(scene->rooms()[i].ceilingMaterial);
+    }
+    for (uint32_t i = 0; i < layout.wallCount; i++)
+        addMaterial(scene->walls()[i].material);
+    for (uint32_t i = 0; i < layout.standCount; i++) {
+        addMaterial(scene->stands()[i].material);
+        addMaterial(scene->stands()[i].display);
+    }
+    for (uint32_t i = 0; i < layout.sculptureCount; i++)
+        addMaterial(scene->sculptures()[i].material);
+    if (!materialsFit) {
+        delete materials;
+        delete textureLoader;
+        delete scene;
+        glfwTerminate();
+        return -1;
+    }
+    materials->build();
+
+    // Paintings are textures of their own, kept at the detail the camera
+    // needs within the texture budget, and drawn after the room. The first
+    // one with a tiled copy (see --tile) streams from it instead.
+    TextureResidency* paintingTextures = new TextureResidency(*textureLoader, textureBudget * 1024 * 1024);
+    VirtualTexture* virtualPainting = new VirtualTexture();
+    int virtualArtwork = -1;
+    glm::vec3 virtualQuad[4];
+    for (uint32_t i = 0; i < layout.artworkCount && virtualArtwork < 0; i++) {
+        std::string image = scene->string(scene->artworks()[i].image);
+        if (virtualPainting->open(virtualTexturePath(image), image)) {
+            artworkCorners(scene->artworks()[i], virtualQuad);
+            virtualArtwork = (int)i;
+        }
+    }
 
-    // Load textures
-    unsigned int floorTexture = loadTexture("wood-floor-textures.jpg");
-    unsigned int wallTexture = loadTexture("white-wall-textures.jpg");
-    unsigned int ceilingTexture = loadTexture("ceiling.jpg");
-
-    //Load pics
-    unsigned int image1Texture = loadTexture("adam.jpg");
-    unsigned int image2Texture = loadTexture("girlwithpearl.jpg");
-    unsigned int image3Texture = loadTexture("starry.jpg");
-    unsigned int image4Texture = loadTexture("venus.jpg");
-    unsigned int image5Texture = loadTexture("mona.jpg");
-    unsigned int image6Texture = loadTexture("nightwatch.jpg");
-    unsigned int image7Texture = loadTexture("La Grande Jatte.jpg");
-    unsigned int image8Texture = loadTexture("lastsupper.jpg");
-
-    unsigned int masterpiece = loadTexture("masterpiece.jpg");
-    unsigned int white_gold_marble = loadTexture("white-gold-marble.png");
-
+    // The room batches and the display quad share buffers, to be drawn
+    // together
+    MeshArena* meshes = new MeshArena((GLADloadproc)glfwGetProcAddress);
+    SceneGeometry displayQuadGeometry;
+    buildDisplayQuad(displayQuadGeometry);
+    MeshArena::Mesh displayQuad;
+    meshes->add(displayQuadGeometry, displayQuad);
+
+    // The rooms near the camera, each an indexed mesh in the packed layout of
+    // SceneVertex, built in the background as the camera moves
+    SceneStreamer* streamer = new SceneStreamer(*scene, *paintingTextures, *meshes, [&materialLayers](const char* path) {
+        std::unordered_map<std::string, int>::const_iterator found = materialLayers.find(path);
+        return found != materialLayers.end() ? found->second : 0;
+    }, virtualArtwork, loadRadius, loadHysteresis);
+    streamer->detailPixels = detailPixels;
+
+    // Culling and animation run on a few threads each frame; the GL thread
+    // only draws what they leave in the chunks
+    JobSystem* jobs = new JobSystem();
+    streamer->jobs = jobs;
+    streamer->update(camera.Position);
+    streamer->finish();
 
     // Variables for the rotating camera
     float cameraAngle = 0.0f;  // Angle for rotation in radians
@@ -601,30 +450,77 @@ int main() {
     int viewPosLoc = glGetUniformLocation(shaderProgram, "viewPos");
 
     glUseProgram(shaderProgram);
+    glUniform1i(glGetUniformLocation(shaderProgram, "vtAtlas"), 1);
+    glUniform1i(glGetUniformLocation(shaderProgram, "vtIndirection"), 2);
+    glUniform1i(glGetUniformLocation(shaderProgram, "painting"), 3);
     glUniform3fv(lightPosLoc, 1, glm::value_ptr(lightPos));
     glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
     glUniform3fv(viewPosLoc, 1, glm::value_ptr(viewPos));
+    int instancedLoc = glGetUniformLocation(shaderProgram, "instanced");
+    int showLevelsLoc = glGetUniformLocation(shaderProgram, "showLevels");
 
+    // The shader takes four lights, the ones nearest the camera; missing ones
+    // are black
+    int lightPositionLocs[4], lightColorLocs[4];
     for (int i = 0; i < 4; i++) {
         std::string lightPosUniform = "lightPositions[" + std::to_string(i) + "]";
         std::string lightColorUniform = "lightColors[" + std::to_string(i) + "]";
-
-        glUniform3fv(glGetUniformLocation(shaderProgram, lightPosUniform.c_str()), 1, glm::value_ptr(lightPositions[i]));
-        glUniform3fv(glGetUniformLocation(shaderProgram, lightColorUniform.c_str()), 1, glm::value_ptr(lightColors[i]));
+        lightPositionLocs[i] = glGetUniformLocation(shaderProgram, lightPosUniform.c_str());
+        lightColorLocs[i] = glGetUniformLocation(shaderProgram, lightColorUniform.c_str());
     }
 
+    // Frames are drawn through a queue (see RenderQueue.h) that sorts them by
+    // state: the arena's draws, which take their model matrix, bounds and
+    // layer per instance, and the paintings, drawn one by one
+    RenderQueue* renderQueue = new RenderQueue();
+    uint32_t instancedPipeline = renderQueue->addPipeline(shaderProgram, [&] {
+        glUniform1i(instancedLoc, 1);
+        glUniform1i(showLevelsLoc, showLevels);
+    });
+    uint32_t placedPipeline = renderQueue->addPipeline(shaderProgram, [&] {
+        glm::mat4 identity = glm::mat4(1.0f);
+        glUniform1i(instancedLoc, 0);
+        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(identity));
+    });
+
     // Enable depth testing
     glEnable(GL_DEPTH_TEST);
 
     // Rendering loop
+    float lastTitleTime = -1.0f;
     while (!glfwWindowShouldClose(window)) {
         float currentFrame = glfwGetTime();
         float deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        // Process input
+        // Upload any textures the workers have finished decoding
+        textureLoader->update();
+
+        // Process input, sliding along walls and stands rather than through them
         processInput(window);
+        glm::vec3 previousPosition = camera.Position;
         camera.ProcessKeyboard(keys, deltaTime);
+        if (streamer->collides(camera.Position, 0.2f)) {
+            glm::vec3 moved = camera.Position;
+            camera.Position = glm::vec3(moved.x, moved.y, previousPosition.z);
+            if (streamer->collides(camera.Position, 0.2f))
+                camera.Position = glm::vec3(previousPosition.x, moved.y, moved.z);
+            if (streamer->collides(camera.Position, 0.2f))
+                camera.Position = previousPosition;
+        }
+
+        // Left click names what is in the middle of the view
+        if (leftMouseClicked) {
+            leftMouseClicked = false;
+            float distance;
+            const SceneStreamer::Object* picked = streamer->pick(camera.Position, camera.Front, 100.0f, distance);
+            if (picked && picked->kind == SceneStreamer::Object::Artwork)
+                std::cout << scene->string(scene->artworks()[picked->record].image) << " (" << distance << " m)" << std::endl;
+            else if (picked && picked->kind == SceneStreamer::Object::Display)
+                std::cout << scene->string(scene->stands()[picked->record].display) << " (" << distance << " m)" << std::endl;
+            else if (picked && picked->kind == SceneStreamer::Object::Sculpture)
+                std::cout << scene->string(scene->sculptures()[picked->record].mesh) << " (" << distance << " m)" << std::endl;
+        }
 
         // Clear the color and depth buffers
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
@@ -637,123 +533,105 @@ int main() {
         glm::mat4 view = camera.GetViewMatrix();
         glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        glUniform3fv(viewPosLoc, 1, glm::value_ptr(camera.Position));
 
-        // Render Room
-        glBindVertexArray(VAO);
-        glm::mat4 model = glm::mat4(1.0f);
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-        // Render floor
-        glBindTexture(GL_TEXTURE_2D, floorTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        // Render ceiling
-        glBindTexture(GL_TEXTURE_2D, ceilingTexture);
-        glDrawArrays(GL_TRIANGLES, 6, 6);
-
-        // Draw walls
-        glBindTexture(GL_TEXTURE_2D, wallTexture);
-        glDrawArrays(GL_TRIANGLES, 12, 6);
-
-        glBindTexture(GL_TEXTURE_2D, image1Texture);
-        glDrawArrays(GL_TRIANGLES, 18, 6);
-
-        glBindTexture(GL_TEXTURE_2D, wallTexture);
-        glDrawArrays(GL_TRIANGLES, 24, 6);
-
-        glBindTexture(GL_TEXTURE_2D, image2Texture);
-        glDrawArrays(GL_TRIANGLES, 30, 6);
-
-        glBindTexture(GL_TEXTURE_2D, wallTexture);
-        glDrawArrays(GL_TRIANGLES, 36, 6);
-
-        glBindTexture(GL_TEXTURE_2D, image3Texture);
-        glDrawArrays(GL_TRIANGLES, 42, 6);
-
-        glBindTexture(GL_TEXTURE_2D, wallTexture);
-        glDrawArrays(GL_TRIANGLES, 48, 6);
-
-        glBindTexture(GL_TEXTURE_2D, image4Texture);
-        glDrawArrays(GL_TRIANGLES, 54, 6);
-
-        glBindTexture(GL_TEXTURE_2D, wallTexture);
-        glDrawArrays(GL_TRIANGLES, 60, 6);
-
-        glBindTexture(GL_TEXTURE_2D, image5Texture);
-        glDrawArrays(GL_TRIANGLES, 72, 6);
-
-        glBindTexture(GL_TEXTURE_2D, wallTexture);
-        glDrawArrays(GL_TRIANGLES, 78, 6);
+        // Load the rooms coming into range, drop those left behind
+        streamer->update(camera.Position);
 
-        glBindTexture(GL_TEXTURE_2D, image6Texture);
-        glDrawArrays(GL_TRIANGLES, 84, 6);
-
-        glBindTexture(GL_TEXTURE_2D, wallTexture);
-        glDrawArrays(GL_TRIANGLES, 90, 6);
-
-        glBindTexture(GL_TEXTURE_2D, image7Texture);
-        glDrawArrays(GL_TRIANGLES, 96, 6);
-
-        glBindTexture(GL_TEXTURE_2D, wallTexture);
-        glDrawArrays(GL_TRIANGLES, 102, 6);
-
-        glBindTexture(GL_TEXTURE_2D, image8Texture);
-        glDrawArrays(GL_TRIANGLES, 108, 6);
-
-        glBindTexture(GL_TEXTURE_2D, wallTexture);
-        glDrawArrays(GL_TRIANGLES, 114, 6);
-
-        glBindTexture(GL_TEXTURE_2D, wallTexture);
-        glDrawArrays(GL_TRIANGLES, 120, 6);
-
-        glBindTexture(GL_TEXTURE_2D, wallTexture);
-        glDrawArrays(GL_TRIANGLES, 126, 6);
-
-        glBindTexture(GL_TEXTURE_2D, wallTexture);
-        glDrawArrays(GL_TRIANGLES, 132, 30);
-
-        glBindTexture(GL_TEXTURE_2D, wallTexture);
-        glDrawArrays(GL_TRIANGLES, 162, 30);
-
-        // Render Stand
-        glBindVertexArray(standVAO);
-        glBindTexture(GL_TEXTURE_2D, white_gold_marble); // Adjust texture if needed
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); // Adjust position as needed
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Render Rectangle
-        glBindVertexArray(rectVAO);
-        glBindTexture(GL_TEXTURE_2D, masterpiece); // Use a suitable texture
+        SceneLight lights[4] = {};
+        streamer->nearestLights(camera.Position, lights, 4);
+        for (int i = 0; i < 4; i++) {
+            glUniform3fv(lightPositionLocs[i], 1, lights[i].position);
+            glUniform3fv(lightColorLocs[i], 1, lights[i].color);
+        }
 
-        // Transform for spinning animation
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.5f, 0.0f)); // Position above ground
-        float angle = glfwGetTime() * glm::radians(20.0f); // Slow spin (adjust speed if needed)
-        model = glm::rotate(model, angle, glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate around Y-axis
+        // Turn the displays and work out what is in view
+        float time = glfwGetTime();
+        streamer->animate(time);
+        const std::vector<uint32_t>& visible = streamer->cull(projection * view, camera.Position,
+            1080.0f * projection[1][1] * 0.5f);
 
-        // Pass the model matrix to the shader
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+        // Bring painting detail in or out for this view
+        paintingTextures->update(camera.Position, projection, view, 1080.0f);
 
-        // Draw the rectangle
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        // Stream in the pages of the tiled painting this view needs
+        if (virtualPainting->isOpen()) {
+            virtualPainting->requestPages(virtualQuad, projection * view, 1080.0f);
+            virtualPainting->update();
+        }
+        virtualPainting->bind(shaderProgram, 1, 2);
+
+        // Every material lives in the one array
+        renderQueue->clear();
+        RenderQueue::Material arrayOnly = { { materials->array(0), 0, 0, 0 }, { GL_TEXTURE_2D_ARRAY, 0, 0, 0 } };
+        uint32_t arrayMaterial = renderQueue->material(arrayOnly);
+
+        // The rooms, walls and stands in view, a batch of nearby rooms per
+        // command, the images turning above the stands, all copies of one
+        // quad, and the sculptures, submitted together; then the paintings,
+        // each with its own texture
+        meshes->clear();
+        glm::mat4 identity = glm::mat4(1.0f);
+        for (const SceneStreamer::Batch* batch : streamer->staticBatches()) {
+            if (batch->visible)
+                meshes->draw(batch->levels[batch->level], identity, MeshArena::VERTEX_LAYER, batch->level);
+        }
+        for (uint32_t index : visible) {
+            const SceneStreamer::Object& object = streamer->objects()[index];
+            if (object.kind == SceneStreamer::Object::Display) {
+                const SceneStand& stand = scene->stands()[object.record];
+                meshes->draw(displayQuad, object.chunk->displayTransforms[object.part] * displayQuadTransform(stand),
+                    (float)object.chunk->displayLayers[object.part]);
+            }
+            else if (object.kind == SceneStreamer::Object::Sculpture) {
+                const std::vector<MeshArena::Range>& runs = object.chunk->sculptureRuns[object.part];
+                meshes->draw(object.chunk->sculptureMeshes[object.part]->mesh, runs.data(), runs.size(),
+                    SceneStreamer::sculptureTransform(scene->sculptures()[object.record]),
+                    (float)object.chunk->sculptureLayers[object.part], object.chunk->sculptureSimplified[object.part]);
+            }
+            else if (object.kind == SceneStreamer::Object::Artwork) {
+                // The streamed painting (0) samples the virtual texture instead
+                const SceneStreamer::Chunk* chunk = object.chunk;
+                const SceneGeometry& geometry = chunk->geometry;
+                const SceneArtwork& artwork = scene->artworks()[object.record];
+                RenderQueue::Material textures = arrayOnly;
+                textures.textures[3] = chunk->paintings[object.part];
+                textures.targets[3] = GL_TEXTURE_2D;
+                glm::vec3 center(artwork.center[0], artwork.center[1], artwork.center[2]);
+                uint32_t placed = renderQueue->geometry(chunk->VAO, geometry.boundsMin, geometry.boundsSize);
+                renderQueue->add({ 0, placedPipeline, placed, renderQueue->material(textures),
+                    glm::distance(center, camera.Position), 6, geometry.artworkFirst + object.part * 6, nullptr, nullptr });
+            }
+        }
+        renderQueue->add({ 0, instancedPipeline, renderQueue->geometry(meshes->vertexArray()), arrayMaterial, 0.0f, 0, 0,
+            [](void* arena) { return ((MeshArena*)arena)->submit(); }, meshes });
+        int drawCalls = renderQueue->execute();
+
+        if (time - lastTitleTime >= 0.5f) {
+            const SceneStreamer::Counters& counters = streamer->counters();
+            std::string title = "OpenGL mini art gallery - " + std::to_string(counters.visibleObjects) + " in view, " +
+                std::to_string(counters.culledObjects) + " culled, " + std::to_string(counters.portalCulledObjects) +
+                " behind walls, " + std::to_string(drawCalls) + " draws, " +
+                std::to_string(counters.trianglesDrawn) + " triangles (" + std::to_string(counters.trianglesSaved) +
+                " saved by detail levels, " + std::to_string(counters.clusterTrianglesCulled) + " by clusters)";
+            glfwSetWindowTitle(window, title.c_str());
+            lastTitleTime = time;
+        }
 
         // Swap buffers and poll events
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteTextures(1, &floorTexture);
-    glDeleteTextures(1, &wallTexture);
-
-    // Cleanup for stand and rectangle
-    glDeleteVertexArrays(1, &standVAO);
-    glDeleteBuffers(1, &standVBO);
-    glDeleteVertexArrays(1, &rectVAO);
-    glDeleteBuffers(1, &rectVBO);
+    delete renderQueue;
+    delete streamer;
+    delete jobs;
+    delete meshes;
+    delete virtualPainting;
+    delete paintingTextures;
+    delete materials;
+    delete textureLoader;
+    delete scene;
 
     glfwTerminate();
     return 0;